@@ -0,0 +1,341 @@
+// fpw_bench: Google Benchmark suite for the PixelArtProcessor stages and the full Process.
+//
+// Every hot path is timed on its own (block mean with / without the fused pre-blur, palette
+// extraction, the three palette mappings, expansion, edge enhancement, outline) plus the
+// whole Process, over:
+//   - inputs: a synthetic image (gradients, shapes and noise; deterministic) and, with
+//     --fpw_photo=FILE, a real photo resized to each size
+//   - sizes: 1 / 12 / 48 MP (4:3)
+//   - block sizes: 4 / 8 / 32
+//   - dithering: off / Floyd-Steinberg / ordered (Bayer 8x8)
+//   - every built-in palette preset (custom = K-means)
+// Benchmark names read stage/input/size/block/dither/preset; filter them with
+// --benchmark_filter (e.g. --benchmark_filter='^quantize/synthetic/12MP/'). Each reports
+// MP/s of *input* pixels (and bytes/s of input BGR), so stages compare directly.
+// --fpw_isa=NAME times another CpuKernels variant (see CpuDispatch); the one used is in the
+// run context as fpw_kernels.
+//
+// JSON for tracking: --benchmark_out=results.json --benchmark_out_format=json
+// (or --benchmark_format=json for stdout).
+
+#include "BlockKernels.h"
+#include "CpuDispatch.h"
+#include "PixelArtProcessor.h"
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+using Params = PixelArtProcessor::Params;
+using Preset = PixelArtProcessor::PalettePreset;
+using Dither = PixelArtProcessor::DitherMethod;
+
+struct SizeCase { const char* name; cv::Size size; };
+const SizeCase kSizes[] = {
+  {"1MP", cv::Size(1152, 864)},
+  {"12MP", cv::Size(4000, 3000)},
+  {"48MP", cv::Size(8000, 6000)},
+};
+const int kBlockSizes[] = {4, 8, 32};
+
+enum class DitherCase { Off, FloydSteinberg, Ordered };
+struct DitherEntry { const char* name; DitherCase mode; };
+const DitherEntry kDithers[] = {
+  {"nodither", DitherCase::Off},
+  {"fs", DitherCase::FloydSteinberg},
+  {"bayer8", DitherCase::Ordered},
+};
+
+struct PresetEntry { const char* name; Preset preset; };
+const PresetEntry kPresets[] = {
+  {"custom", Preset::Custom}, {"nes", Preset::NES}, {"gameboy", Preset::GameBoy},
+  {"gbpocket", Preset::GameBoyPocket}, {"pico8", Preset::Pico8}, {"cga", Preset::CGA},
+  {"ega", Preset::EGA}, {"c64", Preset::Commodore64},
+};
+
+// ---- Inputs ----
+// Benchmarks are registered so that all cases of one input / size run back to back; each
+// cache below keeps only its most recent entry, which bounds memory at 48 MP while building
+// every input once per group.
+
+cv::Mat g_photo; // --fpw_photo, as loaded
+
+cv::Mat MakeSynthetic(const cv::Size& size) {
+  // Smooth diagonal gradients (banding for the dither paths), flat shapes with hard edges
+  // (outlines, edge enhancement) and mild noise (a realistic color count for K-means).
+  cv::Mat img(size, CV_8UC3);
+  for (int y = 0; y < size.height; ++y) {
+    cv::Vec3b* row = img.ptr<cv::Vec3b>(y);
+    for (int x = 0; x < size.width; ++x) {
+      row[x] = cv::Vec3b(static_cast<uchar>(255 * x / size.width), static_cast<uchar>(255 * y / size.height),
+                         static_cast<uchar>(255 * (x + y) / (size.width + size.height)));
+    }
+  }
+  cv::RNG rng(12345);
+  const int minSide = std::min(size.width, size.height);
+  for (int i = 0; i < 48; ++i) {
+    const cv::Point c(rng.uniform(0, size.width), rng.uniform(0, size.height));
+    const cv::Scalar color(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+    const int r = rng.uniform(minSide / 40 + 1, minSide / 8 + 2);
+    if (i % 2) {
+      cv::circle(img, c, r, color, cv::FILLED, cv::LINE_AA);
+    } else {
+      cv::rectangle(img, cv::Rect(c.x - r, c.y - r / 2, 2 * r, r), color, cv::FILLED);
+    }
+  }
+  cv::Mat noise(size, CV_16SC3);
+  rng.fill(noise, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(6));
+  cv::Mat noisy;
+  cv::add(img, noise, noisy, cv::noArray(), CV_8UC3); // saturating
+  return noisy;
+}
+
+cv::Mat MakePhoto(const cv::Size& size) {
+  if (g_photo.size() == size) return g_photo;
+  cv::Mat out;
+  // Shrinking averages; enlarging (e.g. a 12 MP photo to 48 MP) interpolates smoothly.
+  const bool shrink = size.area() < g_photo.size().area();
+  cv::resize(g_photo, out, size, 0.0, 0.0, shrink ? cv::INTER_AREA : cv::INTER_CUBIC);
+  return out;
+}
+
+const cv::Mat& Input(bool photo, const SizeCase& sc) {
+  static std::string key;
+  static cv::Mat img;
+  const std::string want = std::string(photo ? "photo/" : "synthetic/") + sc.name;
+  if (key != want) {
+    img.release(); // free the previous size first
+    img = photo ? MakePhoto(sc.size) : MakeSynthetic(sc.size);
+    key = want;
+  }
+  return img;
+}
+
+// Block image (pre-blurred, as Process builds it) of Input(photo, sc).
+const cv::Mat& Blocks(bool photo, const SizeCase& sc, int blockSize) {
+  static std::string key;
+  static cv::Mat small;
+  const std::string want = std::string(photo ? "photo/" : "synthetic/") + sc.name + "/" + std::to_string(blockSize);
+  if (key != want) {
+    Params p;
+    p.blockSize = blockSize;
+    small = PixelArtProcessor::BuildBlockColorImage(Input(photo, sc), p);
+    key = want;
+  }
+  return small;
+}
+
+// Full-resolution quantized image (input of the edge / outline stages), Pico-8, no dither.
+const cv::Mat& Quantized(bool photo, const SizeCase& sc, int blockSize) {
+  static std::string key;
+  static cv::Mat full;
+  const std::string want = std::string(photo ? "photo/" : "synthetic/") + sc.name + "/" + std::to_string(blockSize);
+  if (key != want) {
+    full.release();
+    Params p;
+    p.blockSize = blockSize;
+    p.palettePreset = Preset::Pico8;
+    const cv::Mat& small = Blocks(photo, sc, blockSize);
+    const cv::Mat q = PixelArtProcessor::QuantizeBlocks(small, p);
+    full = PixelArtProcessor::ExpandBlocksBGR(q, sc.size, blockSize);
+    key = want;
+  }
+  return full;
+}
+
+Params MakeParams(int blockSize, DitherCase dither, Preset preset) {
+  Params p;
+  p.blockSize = blockSize;
+  p.palettePreset = preset;
+  p.dither = dither != DitherCase::Off;
+  p.ditherMethod = dither == DitherCase::Ordered ? Dither::Bayer8 : Dither::FloydSteinberg;
+  return p;
+}
+
+void SetThroughput(benchmark::State& state, const cv::Size& size) {
+  const double pixels = static_cast<double>(size.area());
+  state.counters["MP/s"] = benchmark::Counter(pixels * 1e-6 * static_cast<double>(state.iterations()),
+                                              benchmark::Counter::kIsRate);
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(size.area()) * 3);
+}
+
+// ---- Registration ----
+
+std::string Name(const char* stage, bool photo, const SizeCase& sc, int blockSize) {
+  return std::string(stage) + "/" + (photo ? "photo" : "synthetic") + "/" + sc.name + "/bs" + std::to_string(blockSize);
+}
+
+void RegisterInput(bool photo, const SizeCase& sc) {
+  for (int bs : kBlockSizes) {
+    // Steps 1 + 2, both variants.
+    benchmark::RegisterBenchmark(Name("blocks_blur", photo, sc, bs).c_str(), [photo, sc, bs](benchmark::State& state) {
+      const cv::Mat& input = Input(photo, sc);
+      Params p;
+      p.blockSize = bs;
+      for (auto _ : state) benchmark::DoNotOptimize(PixelArtProcessor::BuildBlockColorImage(input, p));
+      SetThroughput(state, sc.size);
+    });
+    benchmark::RegisterBenchmark(Name("blocks_mean", photo, sc, bs).c_str(), [photo, sc, bs](benchmark::State& state) {
+      const cv::Mat& input = Input(photo, sc);
+      for (auto _ : state) benchmark::DoNotOptimize(PixelArtProcessor::BuildBlockColorImageBGR(input, bs));
+      SetThroughput(state, sc.size);
+    });
+
+    // Step 3a: palette extraction (only K-means does work; the presets are lookups, kept so
+    // the matrix is complete).
+    for (const PresetEntry& pe : kPresets) {
+      const Preset preset = pe.preset;
+      benchmark::RegisterBenchmark((Name("palette", photo, sc, bs) + "/" + pe.name).c_str(),
+                                   [photo, sc, bs, preset](benchmark::State& state) {
+        const cv::Mat& small = Blocks(photo, sc, bs);
+        const Params p = MakeParams(bs, DitherCase::Off, preset);
+        for (auto _ : state) benchmark::DoNotOptimize(PixelArtProcessor::ExtractPalette(small, p));
+        SetThroughput(state, sc.size);
+      });
+    }
+
+    // Step 3b: QuantizeWithPalette / ...Dither / ...Ordered via ApplyPaletteIndices.
+    for (const DitherEntry& de : kDithers) {
+      for (const PresetEntry& pe : kPresets) {
+        const DitherCase dither = de.mode;
+        const Preset preset = pe.preset;
+        benchmark::RegisterBenchmark((Name("quantize", photo, sc, bs) + "/" + de.name + "/" + pe.name).c_str(),
+                                     [photo, sc, bs, dither, preset](benchmark::State& state) {
+          const cv::Mat& small = Blocks(photo, sc, bs);
+          const Params p = MakeParams(bs, dither, preset);
+          const std::shared_ptr<const Palette> palette = PixelArtProcessor::ExtractPalette(small, p);
+          if (!palette) {
+            state.SkipWithError("no palette");
+            return;
+          }
+          for (auto _ : state) benchmark::DoNotOptimize(PixelArtProcessor::ApplyPaletteIndices(small, *palette, p));
+          SetThroughput(state, sc.size);
+        });
+      }
+    }
+
+    // Step 4: expansion of BGR and of palette indices.
+    benchmark::RegisterBenchmark(Name("expand_bgr", photo, sc, bs).c_str(), [photo, sc, bs](benchmark::State& state) {
+      const cv::Mat& small = Blocks(photo, sc, bs);
+      for (auto _ : state) benchmark::DoNotOptimize(PixelArtProcessor::ExpandBlocksBGR(small, sc.size, bs));
+      SetThroughput(state, sc.size);
+    });
+    benchmark::RegisterBenchmark(Name("expand_indexed", photo, sc, bs).c_str(), [photo, sc, bs](benchmark::State& state) {
+      Params p;
+      p.blockSize = bs;
+      p.palettePreset = Preset::Pico8;
+      const cv::Mat& small = Blocks(photo, sc, bs);
+      const cv::Mat indices = PixelArtProcessor::ApplyPaletteIndices(small, *PixelArtProcessor::ResolvePalette(p), p);
+      for (auto _ : state) benchmark::DoNotOptimize(BlockKernels::ExpandBlocksIndexed(indices, sc.size, bs));
+      SetThroughput(state, sc.size);
+    });
+
+    // Steps 5 + 6 at full resolution (the in-place kernels get a fresh copy per iteration;
+    // the copy is excluded from the timing).
+    benchmark::RegisterBenchmark(Name("edge", photo, sc, bs).c_str(), [photo, sc, bs](benchmark::State& state) {
+      const cv::Mat& src = Quantized(photo, sc, bs);
+      cv::Mat work;
+      for (auto _ : state) {
+        state.PauseTiming();
+        src.copyTo(work);
+        state.ResumeTiming();
+        PixelArtProcessor::ApplyEdgeEnhancementInPlace(work);
+        benchmark::ClobberMemory();
+      }
+      SetThroughput(state, sc.size);
+    });
+    benchmark::RegisterBenchmark(Name("outline", photo, sc, bs).c_str(), [photo, sc, bs](benchmark::State& state) {
+      const cv::Mat& src = Quantized(photo, sc, bs);
+      cv::Mat work;
+      for (auto _ : state) {
+        state.PauseTiming();
+        src.copyTo(work);
+        state.ResumeTiming();
+        PixelArtProcessor::ApplyPixelArtOutline(work, 1);
+        benchmark::ClobberMemory();
+      }
+      SetThroughput(state, sc.size);
+    });
+
+    // The whole Process (steps 1-4; edge / outline off, as in the default GUI settings).
+    for (const DitherEntry& de : kDithers) {
+      for (const PresetEntry& pe : kPresets) {
+        const DitherCase dither = de.mode;
+        const Preset preset = pe.preset;
+        benchmark::RegisterBenchmark((Name("process", photo, sc, bs) + "/" + de.name + "/" + pe.name).c_str(),
+                                     [photo, sc, bs, dither, preset](benchmark::State& state) {
+          const cv::Mat& input = Input(photo, sc);
+          const Params p = MakeParams(bs, dither, preset);
+          for (auto _ : state) benchmark::DoNotOptimize(PixelArtProcessor::Process(input, p));
+          SetThroughput(state, sc.size);
+        });
+        // The same with a ProcessContext, as fpw_batch runs it: buffers reused across iterations.
+        benchmark::RegisterBenchmark((Name("process_ctx", photo, sc, bs) + "/" + de.name + "/" + pe.name).c_str(),
+                                     [photo, sc, bs, dither, preset](benchmark::State& state) {
+          const cv::Mat& input = Input(photo, sc);
+          const Params p = MakeParams(bs, dither, preset);
+          ProcessContext context;
+          for (auto _ : state) {
+            benchmark::DoNotOptimize(PixelArtProcessor::Process(input, p, nullptr, nullptr, &context));
+          }
+          SetThroughput(state, sc.size);
+        });
+      }
+    }
+  }
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  // Our own flags are removed before Google Benchmark parses the rest.
+  std::vector<char*> args;
+  for (int i = 0; i < argc; ++i) {
+    const char* isaPrefix = "--fpw_isa=";
+    if (i > 0 && std::strncmp(argv[i], isaPrefix, std::strlen(isaPrefix)) == 0) {
+      const char* name = argv[i] + std::strlen(isaPrefix);
+      CpuDispatch::Isa isa = CpuDispatch::Isa::Scalar;
+      if (!CpuDispatch::ParseIsa(name, isa) || !CpuDispatch::Select(isa)) {
+        std::fprintf(stderr, "Instruction set not available: %s\n", name);
+        return 1;
+      }
+      continue;
+    }
+    const char* prefix = "--fpw_photo=";
+    if (i > 0 && std::strncmp(argv[i], prefix, std::strlen(prefix)) == 0) {
+      const char* path = argv[i] + std::strlen(prefix);
+      g_photo = cv::imread(path, cv::IMREAD_COLOR);
+      if (g_photo.empty()) {
+        std::fprintf(stderr, "Cannot read photo: %s\n", path);
+        return 1;
+      }
+      continue;
+    }
+    args.push_back(argv[i]);
+  }
+  int benchArgc = static_cast<int>(args.size());
+
+  for (const SizeCase& sc : kSizes) {
+    RegisterInput(false, sc);
+    if (!g_photo.empty()) RegisterInput(true, sc);
+  }
+
+  benchmark::Initialize(&benchArgc, args.data());
+  if (benchmark::ReportUnrecognizedArguments(benchArgc, args.data())) {
+    std::fprintf(stderr, "fpw_bench also accepts --fpw_photo=FILE (benchmark a real photo too) and\n"
+                         "--fpw_isa=NAME (scalar|sse2|neon|sse4.1|avx2|avx512: CPU kernels to time)\n");
+    return 1;
+  }
+  benchmark::AddCustomContext("fpw_kernels", CpuDispatch::IsaName(CpuDispatch::Active()));
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -118,7 +118,7 @@ if errorlevel 1 (
 echo.
 echo === Building ===
 REM Build the app target explicitly (so we don't stop after only building imgui_impl).
-cmake --build "%BUILD_DIR%" --config %BUILD_TYPE% --parallel --target FordPixelWizard
+cmake --build "%BUILD_DIR%" --config %BUILD_TYPE% --parallel --target FordPixelWizard fpw_batch
 if errorlevel 1 (
   echo [ERROR] Build failed.
   exit /b 1
@@ -128,6 +128,7 @@ echo.
 echo [OK] Build finished.
 echo      Binary should be under:
 echo      - Visual Studio generator: %BUILD_DIR%\%BUILD_TYPE%\FordPixelWizard.exe
+echo      - Batch CLI: %BUILD_DIR%\%BUILD_TYPE%\fpw_batch.exe
 
 endlocal
 exit /b 0
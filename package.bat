@@ -31,6 +31,7 @@ mkdir "%OUTPUT_DIR%"
 
 echo [2/6] Copying executable and icon...
 copy /y "%EXE_PATH%" "%OUTPUT_DIR%\" >nul
+if exist "%BUILD_DIR%\%BUILD_TYPE%\fpw_batch.exe" copy /y "%BUILD_DIR%\%BUILD_TYPE%\fpw_batch.exe" "%OUTPUT_DIR%\" >nul
 if exist "%ROOT%\icon.png" copy /y "%ROOT%\icon.png" "%OUTPUT_DIR%\" >nul
 if exist "%ROOT%\icon.ico" copy /y "%ROOT%\icon.ico" "%OUTPUT_DIR%\" >nul
 
@@ -1,5 +1,9 @@
 #include "App.h"
 
+#include "CpuDispatch.h"
+#include "GpuProcessor.h"
+#include "ParamsFile.h"
+
 #include <imgui.h>
 #include <backends/imgui_impl_glfw.h>
 #include <backends/imgui_impl_opengl2.h>
@@ -8,8 +12,12 @@
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 
-#include <random>
-
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <random>
 
 #include <GLFW/glfw3.h>
@@ -73,6 +81,27 @@ bool App::Initialize() {
   ImGui_ImplGlfw_InitForOpenGL(window_, true);
   ImGui_ImplOpenGL2_Init();
 
+  // Lets the profiler report peak memory; must precede the worker thread.
+  ProcessStats::EnableAllocationTracking();
+  // GPU results go straight into the preview textures when OpenCL can share this GL context;
+  // must run on this thread, before any other OpenCL use (the worker's included).
+  GpuProcessor::EnableGLSharing();
+  // Re-running a config on an image seen before decodes the cached result instead.
+  // FPW_CACHE_DIR picks the directory ("off" disables the cache).
+  const char* cacheEnv = std::getenv("FPW_CACHE_DIR");
+  std::string cacheDir = cacheEnv && *cacheEnv ? cacheEnv : std::string();
+  if (cacheDir.empty()) {
+    std::error_code ec;
+    const std::filesystem::path tmp = std::filesystem::temp_directory_path(ec);
+    if (!ec) cacheDir = (tmp / "FordPixelWizard" / "cache").string();
+  }
+  if (!cacheDir.empty() && cacheDir != "off") {
+    std::string err;
+    if (!worker_.EnableCache(cacheDir, kCacheMaxBytes, err)) status_ = "Result cache disabled: " + err;
+  }
+  worker_.Start();
+  explorer_.Start();
+
   return true;
 }
 
@@ -92,9 +121,15 @@ void App::Run() {
 }
 
 void App::Shutdown() {
+  // Stop background processing before tearing down anything it could hand results to
+  worker_.Stop();
+  explorer_.Stop();
+
   // Cleanup textures
+  variantTiles_.clear();
   outputTex_.Destroy();
   inputTex_.Destroy();
+  GLTexture::DestroyStreamBuffers();
 
   // Cleanup ImGui
   if (window_) {
@@ -112,6 +147,9 @@ void App::Shutdown() {
 }
 
 void App::RenderUI() {
+  PollProcessingResult();
+  PollVariants();
+
   // Get viewport to calculate window sizes
   ImGuiViewport* viewport = ImGui::GetMainViewport();
   ImVec2 viewportSize = viewport->Size;
@@ -141,11 +179,13 @@ void App::RenderUI() {
 
   // Left: original
   ImGui::BeginChild("orig", ImVec2(halfW, h), true);
-  ImGui::TextUnformatted("Original");
+  if (viewZoom_ > 1.0f) {
+    ImGui::Text("Original (%.0f%%)", viewZoom_ * 100.0f);
+  } else {
+    ImGui::TextUnformatted("Original");
+  }
   if (inputTex_.IsValid()) {
-    ImVec2 maxSize = ImGui::GetContentRegionAvail();
-    ImVec2 sz = FitSizeKeepAspect(inputTex_.Width(), inputTex_.Height(), maxSize);
-    ImGui::Image(inputTex_.ImGuiID(), sz);
+    DrawPreview("##orig_view", inputTex_, inputBgr_.size());
   } else {
     ImGui::TextUnformatted("No image loaded.");
   }
@@ -157,9 +197,8 @@ void App::RenderUI() {
   ImGui::BeginChild("result", ImVec2(0, h), true);
   ImGui::TextUnformatted("Pixel Art Result");
   if (outputTex_.IsValid()) {
-    ImVec2 maxSize = ImGui::GetContentRegionAvail();
-    ImVec2 sz = FitSizeKeepAspect(outputTex_.Width(), outputTex_.Height(), maxSize);
-    ImGui::Image(outputTex_.ImGuiID(), sz);
+    // Native results are one texel per block; GL_NEAREST magnification draws the blocks.
+    DrawPreview("##result_view", outputTex_, outputDisplaySize_);
   } else {
     ImGui::TextUnformatted("No result yet. Click Pixelize.");
   }
@@ -186,10 +225,7 @@ void App::RenderUI() {
       std::string err;
       cv::Mat img;
       if (ImageLoader::LoadBGR(loadPath_.data(), img, err)) {
-        inputBgr_ = img;
-        outputBgr_.release();
-        inputTex_.UpdateFromMat(inputBgr_);
-        outputTex_.Destroy();
+        SetInput(img);
         status_ = "Loaded: " + std::string(loadPath_.data());
       } else {
         status_ = "Load failed: " + err;
@@ -201,59 +237,95 @@ void App::RenderUI() {
     std::string err;
     cv::Mat img;
     if (ImageLoader::LoadBGR(loadPath_.data(), img, err)) {
-      inputBgr_ = img;
-      outputBgr_.release();
-      inputTex_.UpdateFromMat(inputBgr_);
-      outputTex_.Destroy();
+      SetInput(img);
       status_ = "Loaded: " + std::string(loadPath_.data());
     } else {
       status_ = "Load failed: " + err;
     }
   }
+  ImGui::SameLine();
+  if (ImGui::Button("Reload")) {
+    std::string err;
+    cv::Mat img;
+    if (ImageLoader::LoadBGR(loadPath_.data(), img, err)) {
+      ReloadInput(img);
+    } else {
+      status_ = "Reload failed: " + err;
+    }
+  }
+  if (ImGui::IsItemHovered()) {
+    ImGui::BeginTooltip();
+    ImGui::TextUnformatted("Re-read the file after touching it up in another editor;\n"
+                           "only the edited area is pixelized again.");
+    ImGui::EndTooltip();
+  }
 
   ImGui::Separator();
   ImGui::TextUnformatted("Pixel Art Params:");
   ImGui::SliderInt("Block Size", &params_.blockSize, 4, 32);
   
-  // Palette selection
+  // Palette selection: "Custom (K-means)" followed by every registered palette
+  // (built-in presets first, then palettes loaded from disk).
   ImGui::TextUnformatted("Palette:");
-  const char* paletteNames[] = {
-    "Custom (K-means)",
-    "NES (54 colors)",
-    "Game Boy (4 colors)",
-    "Game Boy Pocket (4 colors)",
-    "Pico-8 (16 colors)",
-    "CGA (4 colors)",
-    "EGA (16 colors)",
-    "Commodore 64 (16 colors)"
-  };
-  int currentPalette = static_cast<int>(params_.palettePreset);
-  if (ImGui::Combo("##palette", &currentPalette, paletteNames, IM_ARRAYSIZE(paletteNames))) {
-    params_.palettePreset = static_cast<PixelArtProcessor::PalettePreset>(currentPalette);
+  const Palette* selectedPalette = PixelArtProcessor::ResolvePalette(params_);
+  const std::string previewLabel = selectedPalette ? PaletteLabel(*selectedPalette) : "Custom (K-means)";
+  if (ImGui::BeginCombo("##palette", previewLabel.c_str())) {
+    if (ImGui::Selectable("Custom (K-means)", !selectedPalette)) {
+      params_.palettePreset = PixelArtProcessor::PalettePreset::Custom;
+    }
+    const int builtins = PaletteRegistry::BuiltinCount();
+    for (int id = 0, n = PaletteRegistry::Count(); id < n; ++id) {
+      const Palette* palette = PaletteRegistry::Get(id);
+      ImGui::PushID(id);
+      const bool selected = palette == selectedPalette;
+      if (ImGui::Selectable(PaletteLabel(*palette).c_str(), selected)) {
+        if (id < builtins) {
+          params_.palettePreset = static_cast<PixelArtProcessor::PalettePreset>(id + 1);
+        } else {
+          params_.palettePreset = PixelArtProcessor::PalettePreset::User;
+          params_.userPaletteId = id;
+        }
+      }
+      if (selected) ImGui::SetItemDefaultFocus();
+      ImGui::PopID();
+    }
+    ImGui::EndCombo();
+  }
+  ImGui::SameLine();
+  if (ImGui::Button("Load...##palette")) {
+    char selectedPath[1024] = {};
+    if (ShowOpenFileDialog(selectedPath, sizeof(selectedPath),
+                           "Palettes (*.hex;*.gpl)\0*.hex;*.gpl\0All Files\0*.*\0")) {
+      LoadPalette(selectedPath);
+    }
+  }
+  if (ImGui::IsItemHovered()) {
+    ImGui::BeginTooltip();
+    ImGui::TextUnformatted("Load a .hex (Lospec) or .gpl (GIMP) palette file.");
+    ImGui::EndTooltip();
   }
   
   // Show palette size slider only for Custom palette
-  if (params_.palettePreset == PixelArtProcessor::PalettePreset::Custom) {
+  if (!selectedPalette) {
     ImGui::SliderInt("Palette Size", &params_.paletteSize, 2, 64);
   } else {
     // Display palette info for fixed palettes
-    int paletteColorCount = 0;
-    switch (params_.palettePreset) {
-      case PixelArtProcessor::PalettePreset::NES: paletteColorCount = 54; break;
-      case PixelArtProcessor::PalettePreset::GameBoy:
-      case PixelArtProcessor::PalettePreset::GameBoyPocket:
-      case PixelArtProcessor::PalettePreset::CGA: paletteColorCount = 4; break;
-      case PixelArtProcessor::PalettePreset::Pico8:
-      case PixelArtProcessor::PalettePreset::EGA:
-      case PixelArtProcessor::PalettePreset::Commodore64: paletteColorCount = 16; break;
-      default: break;
-    }
-    ImGui::TextDisabled("Using fixed %d-color palette", paletteColorCount);
+    ImGui::TextDisabled("Using fixed %d-color palette", selectedPalette->size());
   }
   
   ImGui::Checkbox("Pre-Blur (reduce noise)", &params_.preBlur);
   ImGui::Checkbox("Edge Enhance (crisper outlines)", &params_.edgeEnhance);
-  ImGui::Checkbox("Floyd-Steinberg Dither (reduce color banding)", &params_.dither);
+  ImGui::Checkbox("Dither (reduce color banding)", &params_.dither);
+  if (params_.dither) {
+    static const char* kDitherMethods[] = {"Floyd-Steinberg", "Bayer 2x2", "Bayer 4x4", "Bayer 8x8", "Blue Noise"};
+    int method = static_cast<int>(params_.ditherMethod);
+    if (ImGui::Combo("Dither Method", &method, kDitherMethods, IM_ARRAYSIZE(kDitherMethods))) {
+      params_.ditherMethod = static_cast<PixelArtProcessor::DitherMethod>(method);
+    }
+    if (params_.ditherMethod == PixelArtProcessor::DitherMethod::FloydSteinberg) {
+      ImGui::Checkbox("Serpentine Scan (fewer diagonal artifacts)", &params_.ditherSerpentine);
+    }
+  }
   
   ImGui::Checkbox("Outline (contour extraction + pixel-art borders)", &params_.outline);
   if (params_.outline) {
@@ -266,32 +338,74 @@ void App::RenderUI() {
     status_ = "Parameters randomized! Click 'Pixelize' to apply.";
   }
   ImGui::SameLine();
+  if (ImGui::Button("Save params...")) SaveParams();
+  ImGui::SameLine();
+  if (ImGui::Button("Load params...")) LoadParams();
+  ImGui::SameLine();
   ImGui::TextDisabled("(?)");
   if (ImGui::IsItemHovered()) {
     ImGui::BeginTooltip();
     ImGui::TextUnformatted("Randomize all parameters to discover new pixel art styles!");
     ImGui::EndTooltip();
   }
+  ImGui::SameLine();
+  ImGui::Checkbox("Variants", &showVariants_);
+  if (ImGui::IsItemHovered()) {
+    ImGui::BeginTooltip();
+    ImGui::TextUnformatted("Grid of thumbnails for many random configs or a block size x palette sweep.");
+    ImGui::EndTooltip();
+  }
 
   if (ImGui::Button("Pixelize (Pixel Art)")) {
     if (inputBgr_.empty()) {
       status_ = "No input image loaded.";
     } else {
-      outputBgr_ = PixelArtProcessor::Process(inputBgr_, params_);
-      if (outputBgr_.empty()) {
-        status_ = "Processing failed (unexpected empty output).";
-      } else {
-        outputTex_.UpdateFromMat(outputBgr_);
-        status_ = "Processed successfully. Preview updated.";
-      }
+      // Runs on the worker thread; the result is picked up in PollProcessingResult().
+      SubmitFullResolution();
+      status_ = "Processing...";
+    }
+  }
+  ImGui::SameLine();
+  ImGui::Checkbox("Live", &livePreview_);
+  if (ImGui::IsItemHovered()) {
+    ImGui::BeginTooltip();
+    ImGui::TextUnformatted("Re-process on every parameter change using a ~1 MP proxy,\n"
+                           "then refine at full resolution once the controls are idle.");
+    ImGui::EndTooltip();
+  }
+  if (GpuProcessor::Available()) {
+    ImGui::SameLine();
+    if (ImGui::Checkbox("GPU", &useGpu_)) {
+      worker_.SetUseGpu(useGpu_);
+      liveSubmittedParams_.reset(); // re-run the live preview on the other device
+    }
+    if (ImGui::IsItemHovered()) {
+      ImGui::BeginTooltip();
+      ImGui::Text("Process on %s (OpenCL), at full resolution even in Live mode.",
+                  GpuProcessor::DeviceName().c_str());
+      ImGui::TextUnformatted(GpuProcessor::GLSharingEnabled()
+                                 ? "Results are copied into the preview on the GPU."
+                                 : "No OpenCL / OpenGL sharing: results are read back for the preview.");
+      ImGui::EndTooltip();
     }
   }
+  ImGui::SameLine();
+  ImGui::Checkbox("Profiler", &showProfiler_);
+  if (worker_.IsBusy()) {
+    ImGui::SameLine();
+    ImGui::TextDisabled("working...");
+  }
+  UpdateLivePreview();
 
   ImGui::Separator();
   ImGui::TextUnformatted("Save Result:");
+  ImGui::Checkbox("Native resolution (1 pixel per block)", &saveNative_);
   if (ImGui::Button("Save")) {
+    // GPU results stay on the device until they are saved.
+    if (outputBgr_.empty() && !outputDevice_.empty()) outputDevice_.copyTo(outputBgr_);
     if (outputBgr_.empty()) {
-      status_ = "Nothing to save (process an image first).";
+      status_ = outputIsProxy_ ? "Full-resolution result not ready yet; try again in a moment."
+                               : "Nothing to save (process an image first).";
     } else {
       // If no save path is set, open save dialog first
       if (savePath_[0] == '\0') {
@@ -305,10 +419,21 @@ void App::RenderUI() {
         }
       }
       
-      // Save the image
+      // Results are kept at native size when possible; upscale only for the saved file.
+      const bool native = PixelArtProcessor::OutputIsNative(outputParams_);
+      const cv::Mat toSave = (native && !saveNative_)
+          ? PixelArtProcessor::ExpandBlocksBGR(outputBgr_, inputBgr_.size(), outputParams_.blockSize)
+          : outputBgr_;
+      
+      // Save the image; PNG / GIF as palette-indexed files whenever it fits in 256 colors.
       std::string err;
-      if (ImageLoader::Save(savePath_.data(), outputBgr_, err)) {
+      IndexedImage indexed;
+      const bool saved = ImageLoader::WritesIndexed(savePath_.data()) && IndexedImage::FromBGR(toSave, indexed)
+          ? ImageLoader::SaveIndexed(savePath_.data(), indexed, err)
+          : ImageLoader::Save(savePath_.data(), toSave, err);
+      if (saved) {
         status_ = "Saved: " + std::string(savePath_.data());
+        if (saveNative_ && !native) status_ += " (full resolution: edge enhance / outline need it)";
       } else {
         status_ = "Save failed: " + err;
       }
@@ -320,41 +445,518 @@ void App::RenderUI() {
     ImGui::TextWrapped("%s", status_.c_str());
   }
   ImGui::End();
+
+  RenderProfiler();
+  RenderVariants();
 }
 
-void App::RandomizeParams() {
+void App::RenderProfiler() {
+  if (!showProfiler_) return;
+  ImGui::SetNextWindowBgAlpha(0.9f);
+  ImGui::SetNextWindowPos(ImVec2(12.0f, ImGui::GetMainViewport()->Size.y - 12.0f), ImGuiCond_FirstUseEver,
+                          ImVec2(0.0f, 1.0f));
+  if (!ImGui::Begin("Profiler", &showProfiler_, ImGuiWindowFlags_AlwaysAutoResize)) {
+    ImGui::End();
+    return;
+  }
+  if (statsHistory_.empty()) {
+    ImGui::TextUnformatted("No runs yet. Click Pixelize.");
+    ImGui::End();
+    return;
+  }
+
+  // Averages only over recent runs of the same input size: proxy and full-resolution runs
+  // differ by orders of magnitude.
+  const ProcessStats& latest = statsHistory_.back();
+  double avgStage[ProcessStats::kStageCount] = {};
+  double avgTotal = 0.0;
+  int runs = 0;
+  for (const ProcessStats& s : statsHistory_) {
+    if (s.inputSize != latest.inputSize) continue;
+    for (int i = 0; i < ProcessStats::kStageCount; ++i) avgStage[i] += s.stageSeconds[i];
+    avgTotal += s.totalSeconds;
+    ++runs;
+  }
+  ImGui::Text("%d x %d px, average of %d run(s)", latest.inputSize.width, latest.inputSize.height, runs);
+
+  if (ImGui::BeginTable("stages", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+    ImGui::TableSetupColumn("Stage");
+    ImGui::TableSetupColumn("Latest (ms)");
+    ImGui::TableSetupColumn("Average (ms)");
+    ImGui::TableHeadersRow();
+    auto row = [](const char* label, double latestSeconds, double averageSeconds) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(label);
+      ImGui::TableNextColumn();
+      ImGui::Text("%9.1f", latestSeconds * 1000.0);
+      ImGui::TableNextColumn();
+      ImGui::Text("%9.1f", averageSeconds * 1000.0);
+    };
+    for (int i = 0; i < ProcessStats::kStageCount; ++i) {
+      row(ProcessStats::StageLabel(static_cast<ProcessStats::Stage>(i)), latest.stageSeconds[i], avgStage[i] / runs);
+    }
+    row("Total", latest.totalSeconds, avgTotal / runs);
+    ImGui::EndTable();
+  }
+  if (latest.peakBytes >= 0) {
+    ImGui::Text("Peak memory: %.1f MB", static_cast<double>(latest.peakBytes) / (1024.0 * 1024.0));
+  }
+  // Which CpuKernels variant ran; FPW_ISA can pin a lower one.
+  const char* best = CpuDispatch::IsaName(CpuDispatch::Best());
+  if (std::strcmp(latest.kernels, best) == 0) {
+    ImGui::Text("CPU kernels: %s", latest.kernels);
+  } else {
+    ImGui::Text("CPU kernels: %s (CPU supports %s)", latest.kernels, best);
+  }
+  ImGui::TextDisabled("0.0 = cached or disabled stage");
+  bool cacheEnabled = false;
+  const ResultCache::Stats cache = worker_.CacheStats(cacheEnabled);
+  if (cacheEnabled) {
+    ImGui::Text("Result cache: %lld hit(s), %lld miss(es), %lld stored", static_cast<long long>(cache.hits),
+                static_cast<long long>(cache.misses), static_cast<long long>(cache.stores));
+  }
+
+  if (ImGui::Button("Export JSON...")) ExportProfile(false);
+  ImGui::SameLine();
+  if (ImGui::Button("Export trace...")) ExportProfile(true);
+  if (ImGui::IsItemHovered()) {
+    ImGui::BeginTooltip();
+    ImGui::TextUnformatted("Chrome trace of the recent runs (open in chrome://tracing or Perfetto)");
+    ImGui::EndTooltip();
+  }
+  ImGui::End();
+}
+
+void App::ExportProfile(bool chromeTrace) {
+  if (statsHistory_.empty()) return;
+  char path[1024] = {};
+  if (!ShowSaveFileDialog(path, sizeof(path), "JSON Files\0*.json\0All Files\0*.*\0", "json")) {
+    status_ = "Export cancelled.";
+    return;
+  }
+  const std::string text = chromeTrace
+      ? ProcessStats::ToChromeTrace(std::vector<ProcessStats>(statsHistory_.begin(), statsHistory_.end()))
+      : statsHistory_.back().ToJson();
+  std::string err;
+  if (ProcessStats::WriteFile(path, text, err)) {
+    status_ = std::string(chromeTrace ? "Trace" : "Profile") + " written: " + path;
+  } else {
+    status_ = "Export failed: " + err;
+  }
+}
+
+void App::RenderVariants() {
+  if (!showVariants_) return;
+  ImGui::SetNextWindowSize(ImVec2(840.0f, 620.0f), ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin("Variants", &showVariants_)) {
+    ImGui::End();
+    return;
+  }
+  ImGui::RadioButton("Random configs", &variantMode_, 0);
+  ImGui::SameLine();
+  ImGui::RadioButton("Block size x palette sweep", &variantMode_, 1);
+  if (variantMode_ == 0) {
+    ImGui::SliderInt("Count", &variantCount_, 2, 32);
+  } else {
+    // Every other parameter comes from the main controls.
+    ImGui::TextUnformatted("Block sizes:");
+    for (int i = 0; i < kVariantBlockSizeCount; ++i) {
+      char label[16];
+      std::snprintf(label, sizeof(label), "%d##sweep_bs", kVariantBlockSizes[i]);
+      ImGui::SameLine();
+      ImGui::Checkbox(label, &sweepBlockSizes_[i]);
+    }
+    ImGui::TextUnformatted("Palettes:");
+    // Starts with K-means and every built-in preset; palettes loaded later start unchecked.
+    if (sweepPalettes_.empty()) sweepPalettes_.assign(static_cast<size_t>(PaletteRegistry::BuiltinCount()) + 1, 1);
+    sweepPalettes_.resize(static_cast<size_t>(PaletteRegistry::Count()) + 1, 0);
+    for (int id = -1, n = PaletteRegistry::Count(); id < n; ++id) {
+      const Palette* palette = id < 0 ? nullptr : PaletteRegistry::Get(id);
+      bool checked = sweepPalettes_[id + 1] != 0;
+      ImGui::PushID(id);
+      if ((id + 1) % 4 != 0) ImGui::SameLine();
+      if (ImGui::Checkbox(palette ? palette->Name().c_str() : "Custom (K-means)", &checked)) {
+        sweepPalettes_[id + 1] = checked ? 1 : 0;
+      }
+      ImGui::PopID();
+    }
+  }
+  if (ImGui::Button("Generate")) GenerateVariants();
+  const int remaining = explorer_.Remaining();
+  if (remaining > 0) {
+    ImGui::SameLine();
+    ImGui::Text("rendering... %d of %d done", static_cast<int>(variantTiles_.size()) - remaining,
+                static_cast<int>(variantTiles_.size()));
+  }
+  ImGui::SameLine();
+  ImGui::TextDisabled("Click a variant to process it at full resolution.");
+  ImGui::Separator();
+
+  ImGui::BeginChild("##variant_grid");
+  const float cell = static_cast<float>(kVariantThumbSide);
+  const float spacing = ImGui::GetStyle().ItemSpacing.x;
+  const int columns = std::max(1, static_cast<int>((ImGui::GetContentRegionAvail().x + spacing) / (cell + spacing)));
+  ImDrawList* drawList = ImGui::GetWindowDrawList();
+  for (size_t i = 0; i < variantTiles_.size(); ++i) {
+    VariantTile& tile = *variantTiles_[i];
+    if (i % columns != 0) ImGui::SameLine();
+    ImGui::PushID(static_cast<int>(i));
+    ImGui::BeginGroup();
+    const ImVec2 p0 = ImGui::GetCursorScreenPos();
+    const ImVec2 p1(p0.x + cell, p0.y + cell);
+    if (ImGui::InvisibleButton("##variant", ImVec2(cell, cell)) && tile.ready && !tile.failed) {
+      PromoteVariant(i);
+    }
+    const bool hovered = ImGui::IsItemHovered();
+    if (tile.texture.IsValid()) {
+      const ImVec2 fit = FitSizeKeepAspect(tile.texture.Width(), tile.texture.Height(), ImVec2(cell, cell));
+      const ImVec2 a(p0.x + 0.5f * (cell - fit.x), p0.y + 0.5f * (cell - fit.y));
+      drawList->AddImage(tile.texture.ImGuiID(), a, ImVec2(a.x + fit.x, a.y + fit.y));
+    } else {
+      // Placeholder until the thumbnail arrives.
+      drawList->AddRectFilled(p0, p1, ImGui::GetColorU32(ImGuiCol_FrameBg));
+      drawList->AddText(ImVec2(p0.x + 8.0f, p0.y + 8.0f), ImGui::GetColorU32(ImGuiCol_TextDisabled),
+                        tile.failed ? "failed" : "rendering...");
+    }
+    if (hovered) {
+      drawList->AddRect(p0, p1, ImGui::GetColorU32(ImGuiCol_ButtonHovered), 0.0f, 0, 2.0f);
+      ImGui::BeginTooltip();
+      ImGui::TextUnformatted(ParamsFile::ToText(tile.params).c_str());
+      if (tile.ready) ImGui::TextDisabled("thumbnail in %.0f ms", tile.seconds * 1000.0);
+      ImGui::EndTooltip();
+    }
+    const Palette* palette = PixelArtProcessor::ResolvePalette(tile.params);
+    if (palette) {
+      ImGui::TextDisabled("%d px, %s", tile.params.blockSize, palette->Name().c_str());
+    } else {
+      ImGui::TextDisabled("%d px, K-means %d", tile.params.blockSize, tile.params.paletteSize);
+    }
+    ImGui::EndGroup();
+    ImGui::PopID();
+  }
+  ImGui::EndChild();
+  ImGui::End();
+}
+
+void App::GenerateVariants() {
+  if (inputBgr_.empty()) {
+    status_ = "No input image loaded.";
+    return;
+  }
+  std::vector<PixelArtProcessor::Params> variants;
+  if (variantMode_ == 0) {
+    for (int i = 0; i < variantCount_; ++i) variants.push_back(RandomParams(params_));
+  } else {
+    const int builtins = PaletteRegistry::BuiltinCount();
+    for (int b = 0; b < kVariantBlockSizeCount; ++b) {
+      if (!sweepBlockSizes_[b]) continue;
+      for (size_t slot = 0; slot < sweepPalettes_.size(); ++slot) {
+        if (!sweepPalettes_[slot]) continue;
+        // Same id -> preset mapping as the palette combo.
+        const int id = static_cast<int>(slot) - 1;
+        PixelArtProcessor::Params v = params_;
+        v.blockSize = kVariantBlockSizes[b];
+        if (id < 0) {
+          v.palettePreset = PixelArtProcessor::PalettePreset::Custom;
+        } else if (id < builtins) {
+          v.palettePreset = static_cast<PixelArtProcessor::PalettePreset>(id + 1);
+        } else {
+          v.palettePreset = PixelArtProcessor::PalettePreset::User;
+          v.userPaletteId = id;
+        }
+        variants.push_back(v);
+      }
+    }
+  }
+  if (variants.empty()) {
+    status_ = "Pick at least one block size and one palette to sweep.";
+    return;
+  }
+  variantTiles_.clear();
+  for (const PixelArtProcessor::Params& v : variants) {
+    variantTiles_.push_back(std::make_unique<VariantTile>());
+    variantTiles_.back()->params = v;
+  }
+  explorer_.Explore(inputBgr_, variants, kVariantThumbSide);
+  status_ = "Rendering " + std::to_string(variants.size()) + " variants...";
+}
+
+void App::PollVariants() {
+  std::vector<VariantExplorer::Tile> finished;
+  if (!explorer_.TakeFinished(finished)) return;
+  for (VariantExplorer::Tile& t : finished) {
+    if (t.index < 0 || static_cast<size_t>(t.index) >= variantTiles_.size()) continue;
+    VariantTile& tile = *variantTiles_[t.index];
+    tile.ready = true;
+    tile.seconds = t.seconds;
+    tile.failed = t.image.empty() || !tile.texture.UpdateFromMat(t.image);
+  }
+}
+
+void App::PromoteVariant(size_t index) {
+  if (inputBgr_.empty()) return;
+  params_ = variantTiles_[index]->params;
+  // In Live mode this is the submission for the new params; no proxy pass needed.
+  liveSubmittedParams_ = params_;
+  SubmitFullResolution();
+  status_ = "Variant " + std::to_string(index + 1) + ": processing at full resolution...";
+}
+
+void App::SetInput(const cv::Mat& img) {
+  // Results of jobs for the previous image must never show up for the new one.
+  worker_.Cancel();
+  inputBgr_ = img;
+  inputId_ += 2; // new content for the stage cache; +1 is reserved for the live proxy
+  outputBgr_.release();
+  outputDevice_.release();
+  outputIsProxy_ = false;
+  inputTex_.Update(inputBgr_);
+  outputTex_.Destroy();
+  outputTexInputId_ = 0;
+  viewZoom_ = 1.0f;
+  viewCenter_ = ImVec2(0.5f, 0.5f);
+
+  // Live preview proxy: cap at ~1 MP so slider feedback stays interactive on huge photos.
+  proxyBgr_.release();
+  proxyScale_ = 1.0;
+  // Thumbnails of the previous image are meaningless now.
+  explorer_.Cancel();
+  variantTiles_.clear();
+  const double pixels = static_cast<double>(inputBgr_.total());
+  if (pixels > kLiveProxyPixels) {
+    proxyScale_ = std::sqrt(kLiveProxyPixels / pixels);
+    const cv::Size proxySize(std::max(1, static_cast<int>(inputBgr_.cols * proxyScale_)),
+                             std::max(1, static_cast<int>(inputBgr_.rows * proxyScale_)));
+    cv::resize(inputBgr_, proxyBgr_, proxySize, 0.0, 0.0, cv::INTER_AREA);
+  }
+  // Force the live preview to run once for the new image.
+  liveSubmittedParams_.reset();
+}
+
+void App::ReloadInput(const cv::Mat& img) {
+  // GPU jobs keep no stage cache to patch: those run again whole.
+  if (useGpu_ || inputBgr_.empty() || img.size() != inputBgr_.size() || img.type() != inputBgr_.type() ||
+      outputTexInputId_ == 0) {
+    SetInput(img);
+    status_ = "Loaded: " + std::string(loadPath_.data());
+    return;
+  }
+  const cv::Rect dirty = PixelArtProcessor::DiffRect(inputBgr_, img);
+  if (dirty.empty()) {
+    status_ = "No changes in " + std::string(loadPath_.data());
+    return;
+  }
+
+  const uint64_t previousId = inputId_;
+  inputBgr_ = img;
+  inputId_ += 2;
+  inputTex_.Update(inputBgr_, inputTex_.Content(), dirty);
+  // Save must wait for the edited result; the preview keeps the old one until then.
+  outputBgr_.release();
+  outputDevice_.release();
+  outputIsProxy_ = true;
+  if (!proxyBgr_.empty()) {
+    // Into a new Mat: a running proxy job may still read the old one (inputs are never
+    // modified in place, see ProcessingWorker).
+    cv::Mat proxy;
+    cv::resize(inputBgr_, proxy, proxyBgr_.size(), 0.0, 0.0, cv::INTER_AREA);
+    proxyBgr_ = proxy;
+  }
+
+  PixelArtProcessor::Params jobParams = params_;
+  jobParams.nativeOutput = true;
+  fullResJobId_ = worker_.SubmitEdited(inputBgr_, inputId_, previousId, dirty, jobParams);
+  fullResPending_ = false;
+  char buf[128];
+  std::snprintf(buf, sizeof(buf), "Reloaded: %d x %d px changed; processing...", dirty.width, dirty.height);
+  status_ = buf;
+}
+
+void App::SubmitFullResolution() {
+  // Display and Save both handle native results, so never build the full-resolution buffer
+  // unless a step needs it.
+  PixelArtProcessor::Params jobParams = params_;
+  jobParams.nativeOutput = true;
+  fullResJobId_ = worker_.Submit(inputBgr_, inputId_, jobParams);
+  fullResPending_ = false;
+}
+
+void App::UpdateLivePreview() {
+  if (!livePreview_ || inputBgr_.empty()) {
+    // Live was turned off before the refine pass: still replace the proxy result, or Save
+    // would wait for a full-resolution pass that never comes.
+    if (fullResPending_ && !inputBgr_.empty()) SubmitFullResolution();
+    fullResPending_ = false;
+    return;
+  }
+
+  const double now = ImGui::GetTime();
+  if (!liveSubmittedParams_ || *liveSubmittedParams_ != params_) {
+    liveSubmittedParams_ = params_;
+    lastParamChangeTime_ = now;
+    if (proxyBgr_.empty() || useGpu_) {
+      // Input already small enough (or the GPU is fast enough at full size): the "proxy"
+      // pass is the full-resolution pass.
+      SubmitFullResolution();
+    } else {
+      // Scale blockSize with the proxy so the preview keeps the same block grid density.
+      PixelArtProcessor::Params proxyParams = params_;
+      proxyParams.blockSize =
+          std::max(1, static_cast<int>(std::lround(params_.blockSize * proxyScale_)));
+      proxyParams.nativeOutput = true;
+      // Proxy palettes warm-start from the previous drag step; the full-resolution refine
+      // stays cold-started so saved output is reproducible.
+      worker_.Submit(proxyBgr_, inputId_ + 1, proxyParams, /*warmStartPalette=*/true);
+      fullResPending_ = true;
+    }
+    return;
+  }
+
+  // Refine once the user stopped interacting (slider released and no change for a moment).
+  if (fullResPending_ && !ImGui::IsAnyItemActive() && now - lastParamChangeTime_ >= kLiveIdleSeconds) {
+    SubmitFullResolution();
+  }
+}
+
+void App::PollProcessingResult() {
+  ProcessingWorker::Result result;
+  if (!worker_.TryTakeResult(result)) return;
+
+  const bool device = !result.deviceOutput.empty();
+  const cv::Size outSize = device ? result.deviceOutput.size() : result.output.size();
+  if (outSize.empty()) {
+    status_ = "Processing failed (unexpected empty output).";
+    return;
+  }
+  // Edit results only differ in changedRect from the result they were edited from; if the
+  // texture still shows that one, upload just the changed part.
+  const bool patch = result.editedFrom != 0 && result.editedFrom == outputTexInputId_ &&
+                     result.params == outputTexParams_;
+  // Native results cover partial blocks at the right / bottom edge: show only the source extent.
+  cv::Size2f content(static_cast<float>(outSize.width), static_cast<float>(outSize.height));
+  if (PixelArtProcessor::OutputIsNative(result.params)) {
+    const float bs = static_cast<float>(std::max(1, result.params.blockSize));
+    content = cv::Size2f(static_cast<float>(result.inputSize.width) / bs,
+                         static_cast<float>(result.inputSize.height) / bs);
+  }
+  if (device) {
+    outputTex_.Update(result.deviceOutput, content);
+  } else if (patch) {
+    outputTex_.Update(result.output, content, result.changedRect);
+  } else {
+    outputTex_.Update(result.output, content);
+  }
+  outputTexInputId_ = result.inputId;
+  outputTexParams_ = result.params;
+  outputDisplaySize_ = result.inputSize;
+  // A cache hit ran no stages: keep it out of the profiler averages.
+  if (!result.fromCache) {
+    statsHistory_.push_back(std::move(result.stats));
+    if (statsHistory_.size() > kStatsHistory) statsHistory_.pop_front();
+  }
+  char buf[96];
+  if (result.jobId == fullResJobId_) {
+    outputBgr_ = result.output;
+    outputDevice_ = result.deviceOutput;
+    outputParams_ = result.params;
+    outputIsProxy_ = false;
+    std::snprintf(buf, sizeof(buf), result.fromCache ? "Loaded from the result cache in %.0f ms. Preview updated."
+                                                     : "Processed successfully in %.0f ms. Preview updated.",
+                  result.seconds * 1000.0);
+  } else {
+    // Proxy results are display-only; Save always writes a full-resolution pass.
+    outputBgr_.release();
+    outputDevice_.release();
+    outputIsProxy_ = true;
+    std::snprintf(buf, sizeof(buf), "Live preview (proxy) in %.0f ms; refining...",
+                  result.seconds * 1000.0);
+  }
+  status_ = buf;
+  if (!result.gpuError.empty()) status_ += " (GPU failed, ran on the CPU: " + result.gpuError + ")";
+}
+
+std::string App::PaletteLabel(const Palette& palette) {
+  return palette.Name() + " (" + std::to_string(palette.size()) + " colors)";
+}
+
+void App::LoadPalette(const std::string& path) {
+  int id = -1;
+  std::string err;
+  if (PaletteRegistry::LoadFile(path, id, err)) {
+    params_.palettePreset = PixelArtProcessor::PalettePreset::User;
+    params_.userPaletteId = id;
+    status_ = "Loaded palette: " + PaletteRegistry::Get(id)->Name();
+  } else {
+    status_ = "Palette load failed: " + err;
+  }
+}
+
+void App::SaveParams() {
+  char path[1024] = {};
+  if (!ShowSaveFileDialog(path, sizeof(path), "Params (*.fpwparams)\0*.fpwparams\0All Files\0*.*\0",
+                          "fpwparams")) {
+    status_ = "Save cancelled.";
+    return;
+  }
+  std::string err;
+  if (ParamsFile::Save(path, params_, err)) {
+    status_ = "Params saved: " + std::string(path);
+  } else {
+    status_ = "Params save failed: " + err;
+  }
+}
+
+void App::LoadParams() {
+  char path[1024] = {};
+  if (!ShowOpenFileDialog(path, sizeof(path), "Params (*.fpwparams)\0*.fpwparams\0All Files\0*.*\0")) return;
+  std::string err;
+  if (ParamsFile::Load(path, params_, err)) {
+    status_ = "Params loaded: " + std::string(path) + ". Click 'Pixelize' to apply.";
+  } else {
+    status_ = "Params load failed: " + err;
+  }
+}
+
+PixelArtProcessor::Params App::RandomParams(const PixelArtProcessor::Params& base) {
+  PixelArtProcessor::Params params = base;
   // Use C++11 random number generator
   static std::random_device rd;
   static std::mt19937 gen(rd());
   
   // Randomize block size (4-32, prefer values that divide nicely)
   std::uniform_int_distribution<int> blockDist(4, 32);
-  params_.blockSize = blockDist(gen);
+  params.blockSize = blockDist(gen);
   
   // Randomize palette preset (all available presets)
   std::uniform_int_distribution<int> palettePresetDist(
       0, static_cast<int>(PixelArtProcessor::PalettePreset::Commodore64));
-  params_.palettePreset = static_cast<PixelArtProcessor::PalettePreset>(
+  params.palettePreset = static_cast<PixelArtProcessor::PalettePreset>(
       palettePresetDist(gen));
   
   // Randomize palette size (2-64, only used when Custom)
   std::uniform_int_distribution<int> paletteSizeDist(2, 64);
-  params_.paletteSize = paletteSizeDist(gen);
+  params.paletteSize = paletteSizeDist(gen);
   
   // Randomize boolean options (each has 50% chance)
   std::uniform_int_distribution<int> boolDist(0, 1);
-  params_.preBlur = (boolDist(gen) == 1);
-  params_.edgeEnhance = (boolDist(gen) == 1);
-  params_.dither = (boolDist(gen) == 1);
-  params_.outline = (boolDist(gen) == 1);
+  params.preBlur = (boolDist(gen) == 1);
+  params.edgeEnhance = (boolDist(gen) == 1);
+  params.dither = (boolDist(gen) == 1);
+  params.outline = (boolDist(gen) == 1);
   
   // Randomize outline thickness (1-3, only if outline is enabled)
-  if (params_.outline) {
+  if (params.outline) {
     std::uniform_int_distribution<int> thicknessDist(1, 3);
-    params_.outlineThickness = thicknessDist(gen);
+    params.outlineThickness = thicknessDist(gen);
   } else {
-    params_.outlineThickness = 1; // Reset to default if outline disabled
+    params.outlineThickness = 1; // Reset to default if outline disabled
   }
+  return params;
+}
+
+void App::RandomizeParams() {
+  params_ = RandomParams(params_);
 }
 
 void App::Render() {
@@ -387,6 +989,53 @@ ImVec2 App::FitSizeKeepAspect(int imgW, int imgH, const ImVec2& maxSize) {
   return ImVec2(outW, outH);
 }
 
+void App::DrawPreview(const char* id, PreviewTexture& texture, const cv::Size& displaySize) {
+  const ImVec2 avail = ImGui::GetContentRegionAvail();
+  const ImVec2 fit = FitSizeKeepAspect(displaySize.width, displaySize.height, avail);
+  if (fit.x < 1.0f || fit.y < 1.0f) return;
+  const ImVec2 fbScale = ImGui::GetIO().DisplayFramebufferScale;
+  texture.SetPanelSize(ImVec2(fit.x * fbScale.x, fit.y * fbScale.y));
+
+  // Zoom until one source pixel covers 32 screen pixels: enough to inspect single blocks.
+  const float maxZoom = std::max(1.0f, 32.0f * static_cast<float>(displaySize.width) / fit.x);
+  ImGuiIO& io = ImGui::GetIO();
+
+  // At zoom z the whole image spans fit * z; the panel shows the part around viewCenter_.
+  auto viewExtent = [&](ImVec2& full, ImVec2& size, ImVec2& half) {
+    full = ImVec2(fit.x * viewZoom_, fit.y * viewZoom_);
+    size = ImVec2(std::min(avail.x, full.x), std::min(avail.y, full.y));
+    half = ImVec2(0.5f * size.x / full.x, 0.5f * size.y / full.y);
+  };
+  ImVec2 full, size, half;
+  viewExtent(full, size, half);
+
+  const ImVec2 p0 = ImGui::GetCursorScreenPos();
+  ImGui::InvisibleButton(id, size);
+  if (ImGui::IsItemHovered() && io.MouseWheel != 0.0f) {
+    // Keep the image point under the cursor in place.
+    const ImVec2 m(io.MousePos.x - p0.x, io.MousePos.y - p0.y);
+    const ImVec2 u(viewCenter_.x - half.x + m.x / full.x, viewCenter_.y - half.y + m.y / full.y);
+    viewZoom_ = std::clamp(viewZoom_ * std::pow(1.25f, io.MouseWheel), 1.0f, maxZoom);
+    viewExtent(full, size, half);
+    viewCenter_ = ImVec2(u.x + half.x - m.x / full.x, u.y + half.y - m.y / full.y);
+  }
+  if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left, 0.0f)) {
+    viewCenter_.x -= io.MouseDelta.x / full.x;
+    viewCenter_.y -= io.MouseDelta.y / full.y;
+  }
+  if (ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left)) {
+    viewZoom_ = 1.0f;
+    viewCenter_ = ImVec2(0.5f, 0.5f);
+    viewExtent(full, size, half);
+  }
+  viewCenter_.x = std::clamp(viewCenter_.x, half.x, 1.0f - half.x);
+  viewCenter_.y = std::clamp(viewCenter_.y, half.y, 1.0f - half.y);
+
+  texture.Draw(ImGui::GetWindowDrawList(), p0, ImVec2(p0.x + size.x, p0.y + size.y),
+               ImVec2(viewCenter_.x - half.x, viewCenter_.y - half.y),
+               ImVec2(viewCenter_.x + half.x, viewCenter_.y + half.y));
+}
+
 void App::SetWindowIcon(GLFWwindow* window, const char* iconPath) {
   if (!window || !iconPath) return;
 
@@ -567,14 +1216,14 @@ bool App::ShowOpenFileDialog(char* outPath, size_t pathSize, const char* filter)
   return false;
 }
 
-bool App::ShowSaveFileDialog(char* outPath, size_t pathSize, const char* filter) {
+bool App::ShowSaveFileDialog(char* outPath, size_t pathSize, const char* filter, const char* defaultExt) {
   if (!outPath || pathSize == 0) return false;
 
   OPENFILENAMEA ofn = {};
   char szFile[1024] = {};
   
-  // Pre-fill with default filename if savePath_ has something
-  if (savePath_[0] != '\0') {
+  // Pre-fill with default filename if savePath_ has something (image saves only)
+  if (!defaultExt && savePath_[0] != '\0') {
     strncpy_s(szFile, sizeof(szFile), savePath_.data(), _TRUNCATE);
   }
   
@@ -582,9 +1231,9 @@ bool App::ShowSaveFileDialog(char* outPath, size_t pathSize, const char* filter)
   ofn.hwndOwner = glfwGetWin32Window(window_);
   ofn.lpstrFile = szFile;
   ofn.nMaxFile = sizeof(szFile);
-  ofn.lpstrFilter = filter ? filter : "PNG Files\0*.png\0JPEG Files\0*.jpg\0All Files\0*.*\0";
+  ofn.lpstrFilter = filter ? filter : "PNG Files\0*.png\0GIF Files\0*.gif\0JPEG Files\0*.jpg\0All Files\0*.*\0";
   ofn.nFilterIndex = 1;
-  ofn.lpstrDefExt = "png";
+  ofn.lpstrDefExt = defaultExt ? defaultExt : "png";
   ofn.Flags = OFN_OVERWRITEPROMPT | OFN_PATHMUSTEXIST;
 
   if (GetSaveFileNameA(&ofn)) {
@@ -601,10 +1250,11 @@ bool App::ShowOpenFileDialog(char* outPath, size_t pathSize, const char* filter)
   return false; // Not implemented on non-Windows platforms
 }
 
-bool App::ShowSaveFileDialog(char* outPath, size_t pathSize, const char* filter) {
+bool App::ShowSaveFileDialog(char* outPath, size_t pathSize, const char* filter, const char* defaultExt) {
   (void)outPath;
   (void)pathSize;
   (void)filter;
+  (void)defaultExt;
   return false; // Not implemented on non-Windows platforms
 }
 #endif
@@ -1,12 +1,18 @@
 #ifndef APP_H
 #define APP_H
 
-#include "GLTexture.h"
 #include "ImageLoader.h"
 #include "PixelArtProcessor.h"
+#include "PreviewTexture.h"
+#include "ProcessingWorker.h"
+#include "VariantExplorer.h"
 
 #include <array>
+#include <deque>
+#include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include <imgui.h>
 
@@ -37,6 +43,10 @@ private:
   // Helper: keep image display aspect ratio inside a target region
   static ImVec2 FitSizeKeepAspect(int imgW, int imgH, const ImVec2& maxSize);
 
+  // Draw one preview image (displaySize: source pixels it represents) at the shared zoom /
+  // pan; the wheel zooms about the cursor, dragging pans, double-click fits again.
+  void DrawPreview(const char* id, PreviewTexture& texture, const cv::Size& displaySize);
+
   // Helper: load and set window icon from file
   static void SetWindowIcon(GLFWwindow* window, const char* iconPath);
 
@@ -45,11 +55,54 @@ private:
 
   // Randomize processing parameters for experimentation
   void RandomizeParams();
+  // A random config: the fields RandomizeParams changes are drawn, the rest taken from `base`
+  static PixelArtProcessor::Params RandomParams(const PixelArtProcessor::Params& base);
+
+  // Variant grid window: generate, show thumbnails as they arrive, promote a clicked one
+  void RenderVariants();
+  void GenerateVariants();
+  void PollVariants();
+  void PromoteVariant(size_t index);
+
+  // Write / read params_ as a ParamsFile (.fpwparams)
+  void SaveParams();
+  void LoadParams();
+
+  // Register a .hex/.gpl palette file and select it
+  void LoadPalette(const std::string& path);
+
+  // Combo label for a palette, e.g. "NES (54 colors)"
+  static std::string PaletteLabel(const Palette& palette);
+
+  // Replace the current input image (drops any in-flight processing of the old one)
+  void SetInput(const cv::Mat& img);
+
+  // Replace the input with an edited version of it (same file re-read after a touch-up):
+  // only the changed area is re-processed and re-uploaded. Falls back to SetInput when the
+  // size changed or nothing was processed yet.
+  void ReloadInput(const cv::Mat& img);
+
+  // Pick up a finished background job and upload it for display (UI thread)
+  void PollProcessingResult();
+
+  // Per-stage timing overlay of the latest runs (ProcessStats)
+  void RenderProfiler();
+  // Save the latest run as JSON, or all recent runs as a Chrome trace
+  void ExportProfile(bool chromeTrace);
+
+  // Queue a full-resolution run of the current params
+  void SubmitFullResolution();
+
+  // Live mode: proxy run on every param change, full-resolution run once idle
+  void UpdateLivePreview();
 
   // Windows file dialogs (Windows-only)
   // Returns true if user selected a file, false if cancelled
   bool ShowOpenFileDialog(char* outPath, size_t pathSize, const char* filter = nullptr);
-  bool ShowSaveFileDialog(char* outPath, size_t pathSize, const char* filter = nullptr);
+  // `defaultExt` (e.g. "json"): appended to names typed without one; the dialog then starts
+  // empty instead of at the image save path. Default: "png".
+  bool ShowSaveFileDialog(char* outPath, size_t pathSize, const char* filter = nullptr,
+                          const char* defaultExt = nullptr);
 
 private:
   GLFWwindow* window_ = nullptr;
@@ -64,11 +117,63 @@ private:
 
   // Image data (BGR format for OpenCV)
   cv::Mat inputBgr_;
-  cv::Mat outputBgr_;
-
-  // OpenGL textures for display
-  GLTexture inputTex_;
-  GLTexture outputTex_;
+  cv::Mat outputBgr_;                   // newest full-resolution job result (may be native size)
+  cv::UMat outputDevice_;               // the same, for a GPU job (outputBgr_ empty until Save)
+  PixelArtProcessor::Params outputParams_; // params outputBgr_ was produced with
+  bool saveNative_ = false;             // save one pixel per block instead of upscaling
+
+  // OpenGL textures for display (overview + zoomed-in tiles)
+  PreviewTexture inputTex_;
+  PreviewTexture outputTex_;
+  cv::Size outputDisplaySize_; // size the result represents (the source size of its job)
+  // Preview zoom / pan, shared by both panels so original and result stay aligned
+  float viewZoom_ = 1.0f;             // 1 = whole image fits the panel
+  ImVec2 viewCenter_{0.5f, 0.5f};     // normalized image coordinates of the panel center
+  uint64_t outputTexInputId_ = 0;            // input id / params of the result outputTex_ shows,
+  PixelArtProcessor::Params outputTexParams_; // so edit results can patch it in place
+
+  // Background processing (keeps the UI responsive on large images)
+  ProcessingWorker worker_;
+  uint64_t inputId_ = 0;      // identifies inputBgr_ content for the worker's stage cache
+  uint64_t fullResJobId_ = 0; // id of the newest full-resolution job
+  bool outputIsProxy_ = false; // preview currently shows a proxy result (outputBgr_ is empty)
+
+  // Live preview state
+  static constexpr double kLiveProxyPixels = 1.0e6; // proxy size cap (pixels)
+  static constexpr double kLiveIdleSeconds = 0.35;  // idle time before the full-resolution pass
+  bool livePreview_ = false;
+  bool useGpu_ = false;     // process on the OpenCL device (GpuProcessor); no proxy needed
+  cv::Mat proxyBgr_;        // downscaled input; empty if the input is already small
+  double proxyScale_ = 1.0; // proxy size / input size
+  std::optional<PixelArtProcessor::Params> liveSubmittedParams_;
+  double lastParamChangeTime_ = 0.0;
+  bool fullResPending_ = false;
+
+  // Profiler overlay
+  static constexpr size_t kStatsHistory = 32; // runs kept for averages and trace export
+  bool showProfiler_ = false;
+  std::deque<ProcessStats> statsHistory_;
+
+  // Variant grid (VariantExplorer thumbnails of random or swept params)
+  struct VariantTile {
+    PixelArtProcessor::Params params;
+    GLTexture texture;
+    bool ready = false; // texture holds the thumbnail (or failed is set)
+    bool failed = false;
+    double seconds = 0.0;
+  };
+  static constexpr int kVariantThumbSide = 192;
+  static constexpr int kVariantBlockSizes[] = {4, 6, 8, 12, 16, 24}; // sweep choices
+  static constexpr int kVariantBlockSizeCount = 6;
+  bool showVariants_ = false;
+  int variantMode_ = 0;    // 0: random configs, 1: block size x palette sweep
+  int variantCount_ = 12;  // random mode
+  bool sweepBlockSizes_[kVariantBlockSizeCount] = {false, false, true, true, true, false};
+  std::vector<char> sweepPalettes_; // [0] = Custom (K-means), [id + 1] = PaletteRegistry id
+  VariantExplorer explorer_;
+  std::vector<std::unique_ptr<VariantTile>> variantTiles_; // one per variant, in grid order
+
+  static constexpr uint64_t kCacheMaxBytes = 512ull << 20; // result cache size, trimmed at startup
 };
 
 #endif // APP_H
@@ -0,0 +1,95 @@
+#include "AsyncImageWriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+
+AsyncImageWriter::AsyncImageWriter(int threads, size_t maxQueued, const ImageLoader::SaveOptions& options,
+                                   WrittenFn onWritten)
+    : options_(options), onWritten_(std::move(onWritten)), maxQueued_(std::max<size_t>(1, maxQueued)) {
+  const int n = std::max(1, threads);
+  threads_.reserve(static_cast<size_t>(n));
+  for (int i = 0; i < n; ++i) threads_.emplace_back(&AsyncImageWriter::WorkerLoop, this);
+}
+
+AsyncImageWriter::~AsyncImageWriter() { Finish(); }
+
+void AsyncImageWriter::Submit(const std::string& path, cv::Mat image) {
+  Job job;
+  job.path = path;
+  job.bgr = std::move(image);
+  Enqueue(std::move(job));
+}
+
+void AsyncImageWriter::Submit(const std::string& path, IndexedImage image) {
+  Job job;
+  job.path = path;
+  job.indexed = std::move(image);
+  Enqueue(std::move(job));
+}
+
+bool AsyncImageWriter::TrySubmit(const std::string& path, cv::Mat image) {
+  Job job;
+  job.path = path;
+  job.bgr = std::move(image);
+  return Enqueue(std::move(job), /*wait=*/false);
+}
+
+bool AsyncImageWriter::Enqueue(Job job, bool wait) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!wait && queue_.size() >= maxQueued_) return false;
+  hasRoom_.wait(lock, [&] { return queue_.size() < maxQueued_ || stopping_; });
+  queue_.push_back(std::move(job));
+  hasJob_.notify_one();
+  return true;
+}
+
+std::vector<AsyncImageWriter::Result> AsyncImageWriter::Finish() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  hasJob_.notify_all();
+  hasRoom_.notify_all();
+  for (std::thread& t : threads_) t.join();
+  threads_.clear();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::move(results_);
+}
+
+void AsyncImageWriter::WorkerLoop() {
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      // Drain the queue before honouring stopping_: Finish waits for every submitted image.
+      hasJob_.wait(lock, [&] { return !queue_.empty() || stopping_; });
+      if (queue_.empty()) return;
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    hasRoom_.notify_one();
+
+    Result r;
+    r.path = job.path;
+    const auto t0 = std::chrono::steady_clock::now();
+    r.ok = job.indexed.empty() ? ImageLoader::Save(job.path, job.bgr, options_, r.error)
+                               : ImageLoader::SaveIndexed(job.path, job.indexed, options_, r.error);
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (r.ok) {
+      std::error_code ec;
+      const auto size = std::filesystem::file_size(job.path, ec);
+      r.bytes = ec ? 0.0 : static_cast<double>(size);
+    }
+
+    if (onWritten_) {
+      onWritten_(r);
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    results_.push_back(std::move(r));
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "ImageLoader.h"
+
+#include <opencv2/core.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// AsyncImageWriter: a small pool of encoder threads behind ImageLoader::Save / SaveIndexed.
+// Why this exists:
+// - In batch runs PNG / JPEG compression is a large share of every image's time. Handing the
+//   finished image to an encoder thread lets the worker decode and process its next image
+//   while the previous one compresses.
+// - The queue is bounded: Submit blocks while `maxQueued` images are waiting, so memory stays
+//   at a few output images however far processing runs ahead of encoding.
+// - Long-lived users (the GUI's result cache) pass `onWritten` instead of collecting results:
+//   it runs on the encoder thread right after each image is written.
+class AsyncImageWriter {
+public:
+  struct Result {
+    std::string path;
+    bool ok = false;
+    std::string error;
+    double seconds = 0.0; // encode + write time
+    double bytes = 0.0;   // size of the written file
+  };
+
+  using WrittenFn = std::function<void(const Result&)>;
+
+  // With `onWritten`, every Result goes to it (on the encoder thread) and Finish returns none.
+  AsyncImageWriter(int threads, size_t maxQueued, const ImageLoader::SaveOptions& options,
+                   WrittenFn onWritten = {});
+  ~AsyncImageWriter();
+  AsyncImageWriter(const AsyncImageWriter&) = delete;
+  AsyncImageWriter& operator=(const AsyncImageWriter&) = delete;
+
+  // Queues `image` for ImageLoader::Save / SaveIndexed to `path`. Safe to call from any thread.
+  void Submit(const std::string& path, cv::Mat image);
+  void Submit(const std::string& path, IndexedImage image);
+  // Same, but returns false instead of waiting when the queue is full (the image is dropped).
+  bool TrySubmit(const std::string& path, cv::Mat image);
+
+  // Waits until every queued image is written, stops the threads and returns one Result per
+  // submitted image (in completion order). Submit must not be called afterwards.
+  std::vector<Result> Finish();
+
+private:
+  struct Job {
+    std::string path;
+    cv::Mat bgr;
+    IndexedImage indexed;
+  };
+
+  // Waits for room if `wait`; otherwise returns false when the queue is full.
+  bool Enqueue(Job job, bool wait = true);
+  void WorkerLoop();
+
+  ImageLoader::SaveOptions options_;
+  WrittenFn onWritten_;
+  size_t maxQueued_;
+  std::mutex mutex_;
+  std::condition_variable hasJob_;
+  std::condition_variable hasRoom_;
+  std::deque<Job> queue_;
+  bool stopping_ = false;
+  std::vector<Result> results_;
+  std::vector<std::thread> threads_;
+};
@@ -0,0 +1,491 @@
+#include "BatchRunner.h"
+
+#include "AsyncImageWriter.h"
+#include "CpuDispatch.h"
+#include "ImageLoader.h"
+#include "RegressionCheck.h"
+#include "SequenceProcessor.h"
+#include "StreamingProcessor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include <opencv2/core.hpp>
+
+namespace fs = std::filesystem;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool HasImageExtension(const fs::path& p, bool sequences) {
+  std::string ext = p.extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  if (sequences && (ext == ".gif" || ext == ".avi" || ext == ".mp4" || ext == ".mkv" || ext == ".mov")) {
+    return true;
+  }
+  return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" ||
+         ext == ".tif" || ext == ".tiff" || ext == ".webp" || ext == ".ppm" || ext == ".pgm" ||
+         ext == ".pnm";
+}
+
+double FileSizeOrZero(const fs::path& p) {
+  std::error_code ec;
+  const auto size = fs::file_size(p, ec);
+  return ec ? 0.0 : static_cast<double>(size);
+}
+
+// Per-worker accumulation; merged into the report once the worker exits so the hot loop
+// never contends on a shared lock.
+struct WorkerTotals {
+  BatchRunner::StageTotals decode;
+  BatchRunner::StageTotals process;
+  BatchRunner::StageTotals encode;
+  int succeeded = 0;
+  int failed = 0;
+  std::vector<std::string> errors;
+  std::vector<ProcessStats> runs; // traced runs (Options::tracePath)
+  std::vector<std::pair<std::string, std::string>> cacheStores; // (output path, key) once written
+};
+
+std::string Lower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return s;
+}
+
+// Output file of every input: <stem><suffix><ext> in outputDir. Inputs whose stems collide
+// (same name in several directories, e.g. with -r) would overwrite each other, concurrently:
+// those get their parent directory's name in front ("walk_idle.png"), and a counter if that
+// still collides. Compared case-insensitively (Windows file systems are).
+std::vector<fs::path> OutputPaths(const BatchRunner::Options& options) {
+  const size_t n = options.inputs.size();
+  auto name = [&](const std::string& stem) { return Lower(stem + options.suffix + options.outputExt); };
+  std::vector<std::string> stems(n);
+  std::unordered_map<std::string, int> uses;
+  for (size_t i = 0; i < n; ++i) {
+    stems[i] = fs::path(options.inputs[i]).stem().string();
+    ++uses[name(stems[i])];
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (uses[name(stems[i])] < 2) continue;
+    std::error_code ec;
+    const std::string parent = fs::absolute(options.inputs[i], ec).parent_path().filename().string();
+    if (!parent.empty()) stems[i] = parent + "_" + stems[i];
+  }
+  std::unordered_set<std::string> taken;
+  std::vector<fs::path> out(n);
+  for (size_t i = 0; i < n; ++i) {
+    std::string stem = stems[i];
+    for (int k = 2; !taken.insert(name(stem)).second; ++k) stem = stems[i] + "_" + std::to_string(k);
+    out[i] = fs::path(options.outputDir) / (stem + options.suffix + options.outputExt);
+  }
+  return out;
+}
+
+// Everything besides input and params that changes the bytes of the written file.
+std::string CacheFormat(const BatchRunner::Options& options, bool indexedOut) {
+  std::string ext = options.outputExt;
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  const ImageLoader::SaveOptions& s = options.save;
+  return ext + (indexedOut ? " indexed" : " rgb") + " png " + std::to_string(s.pngCompression) + "/" +
+         std::to_string(static_cast<int>(s.pngStrategy)) + " jpeg " + std::to_string(s.jpegQuality) + " webp " +
+         std::to_string(s.webpQuality);
+}
+
+void Accumulate(BatchRunner::StageTotals& into, const BatchRunner::StageTotals& from) {
+  into.seconds += from.seconds;
+  into.bytes += from.bytes;
+  into.images += from.images;
+}
+
+void PrintStage(std::FILE* out, const char* name, const BatchRunner::StageTotals& s, int jobs) {
+  // Stage rates are normalised to the pool size: "how fast would this stage go if every
+  // worker were doing only this stage". That makes the bottleneck stage obvious.
+  const double effective = s.seconds / std::max(1, jobs);
+  const double ips = effective > 0.0 ? s.images / effective : 0.0;
+  const double mbps = effective > 0.0 ? (s.bytes / (1024.0 * 1024.0)) / effective : 0.0;
+  std::fprintf(out, "  %-8s %10.3f %10.1f %10.1f\n", name, s.seconds, ips, mbps);
+}
+} // namespace
+
+bool BatchRunner::CollectInputs(const std::string& path, bool recursive,
+                                std::vector<std::string>& outFiles, std::string& outError,
+                                bool sequences) {
+  outError.clear();
+  std::error_code ec;
+  const fs::path root(path);
+
+  if (fs::is_regular_file(root, ec)) {
+    outFiles.push_back(root.string());
+    return true;
+  }
+  if (!fs::is_directory(root, ec)) {
+    outError = "Input not found: " + path;
+    return false;
+  }
+
+  std::vector<std::string> found;
+  if (recursive) {
+    for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+      if (it->is_regular_file(ec) && HasImageExtension(it->path(), sequences)) found.push_back(it->path().string());
+    }
+  } else {
+    for (fs::directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+      if (it->is_regular_file(ec) && HasImageExtension(it->path(), sequences)) found.push_back(it->path().string());
+    }
+  }
+  if (ec) {
+    outError = "Failed to scan directory " + path + ": " + ec.message();
+    return false;
+  }
+
+  std::sort(found.begin(), found.end());
+  outFiles.insert(outFiles.end(), found.begin(), found.end());
+  return true;
+}
+
+bool BatchRunner::ReadFileList(const std::string& listPath,
+                               std::vector<std::string>& outFiles, std::string& outError) {
+  outError.clear();
+  std::ifstream in(listPath);
+  if (!in) {
+    outError = "Cannot open file list: " + listPath;
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    // Tolerate CRLF lists and surrounding whitespace.
+    while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back()))) line.pop_back();
+    size_t start = 0;
+    while (start < line.size() && std::isspace(static_cast<unsigned char>(line[start]))) ++start;
+    if (start >= line.size() || line[start] == '#') continue;
+    outFiles.push_back(line.substr(start));
+  }
+  return true;
+}
+
+BatchRunner::Report BatchRunner::Run(const Options& options) {
+  Report report;
+  const int hw = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  // Sequences run one at a time on a single worker; SequenceProcessor parallelises across the
+  // frames of each one instead.
+  const int sequenceJobs = options.jobs > 0 ? options.jobs : hw;
+  const int jobs = options.sequence ? 1
+      : std::max(1, std::min(options.jobs > 0 ? options.jobs : hw,
+                             static_cast<int>(std::max<size_t>(1, options.inputs.size()))));
+  report.jobs = jobs;
+  if (options.inputs.empty()) return report;
+  // Streaming and sequence runs encode inside StreamingProcessor / SequenceProcessor.
+  const int encodeJobs = options.streaming || options.sequence || options.encodeJobs < 0
+      ? 0 : (options.encodeJobs > 0 ? options.encodeJobs : std::max(1, jobs / 2));
+  report.encodeJobs = encodeJobs;
+
+  std::error_code ec;
+  fs::create_directories(options.outputDir, ec);
+  if (ec) {
+    report.failed = static_cast<int>(options.inputs.size());
+    report.errors.push_back("Cannot create output directory " + options.outputDir + ": " + ec.message());
+    return report;
+  }
+
+  // Parallelism lives at the image level here; letting OpenCV spawn its own threads inside
+  // every worker as well would only oversubscribe the cores.
+  const int prevCvThreads = cv::getNumThreads();
+  if (jobs > 1) cv::setNumThreads(1);
+
+  ResultCache cache;
+  const bool useCache = !options.cacheDir.empty() && !options.streaming && !options.sequence;
+  if (useCache) {
+    std::string err;
+    if (cache.Open(options.cacheDir, err)) {
+      report.cached = true;
+    } else {
+      report.errors.push_back(err + " (running without the cache)");
+    }
+  }
+
+  const std::vector<fs::path> outPaths = OutputPaths(options);
+  std::atomic<size_t> next{0};
+  std::vector<WorkerTotals> totals(static_cast<size_t>(jobs));
+  const auto wallStart = Clock::now();
+  // Two queued outputs per encoder keep every encoder busy without letting memory grow.
+  std::unique_ptr<AsyncImageWriter> writer;
+  if (encodeJobs > 0) {
+    writer = std::make_unique<AsyncImageWriter>(encodeJobs, static_cast<size_t>(encodeJobs) * 2, options.save);
+  }
+
+  auto worker = [&](WorkerTotals& t) {
+    // Same-sized inputs reuse the previous image's intermediates and (once encoded) its output.
+    ProcessContext context;
+    for (;;) {
+      const size_t i = next.fetch_add(1);
+      if (i >= options.inputs.size()) break;
+      const fs::path inPath(options.inputs[i]);
+      const fs::path& outPath = outPaths[i];
+      std::string err;
+
+      auto t0 = Clock::now();
+      if (options.streaming) {
+        // Decode, process and encode interleave strip by strip; account it all as "process".
+        StreamingProcessor::Stats stats;
+        if (!StreamingProcessor::Run(inPath.string(), outPath.string(), options.params,
+                                     StreamingProcessor::Options{}, &stats, err)) {
+          ++t.failed;
+          t.errors.push_back(inPath.string() + ": " + err);
+          continue;
+        }
+        t.process.seconds += SecondsSince(t0);
+        t.process.bytes += static_cast<double>(stats.inputSize.width) * stats.inputSize.height * 3.0;
+        ++t.process.images;
+        ++t.succeeded;
+        continue;
+      }
+      if (options.sequence) {
+        // The whole decode -> process -> encode pipeline of the sequence counts as "process".
+        SequenceProcessor::Options sequenceOptions = options.sequenceOptions;
+        sequenceOptions.jobs = sequenceJobs;
+        sequenceOptions.cancel = nullptr;
+        SequenceProcessor::Stats stats;
+        if (!SequenceProcessor::Run(inPath.string(), outPath.string(), options.params, sequenceOptions,
+                                    &stats, err)) {
+          ++t.failed;
+          t.errors.push_back(inPath.string() + ": " + err);
+          continue;
+        }
+        t.process.seconds += SecondsSince(t0);
+        t.process.bytes += static_cast<double>(stats.frameSize.width) * stats.frameSize.height * 3.0 *
+                           stats.frames;
+        ++t.process.images;
+        ++t.succeeded;
+        continue;
+      }
+
+      // Indexed PNG / GIF are written straight from the palette indices; the result only
+      // comes back as BGR when it needs true color (see ProcessIndexed).
+      const bool indexedOut = !options.trueColor && ImageLoader::WritesIndexed(outPath.string());
+
+      // A cached result is the file this input would produce: copy it, skip everything else.
+      std::string cacheKey;
+      if (cache.IsOpen()) {
+        ResultCache::Digest digest;
+        if (ResultCache::HashFile(inPath.string(), digest, err)) {
+          cacheKey = ResultCache::Key(digest, options.params, CacheFormat(options, indexedOut));
+          if (cache.Fetch(cacheKey, outPath.string())) {
+            ++t.succeeded;
+            continue;
+          }
+        }
+      }
+
+      cv::Mat input;
+      if (!ImageLoader::LoadBGR(inPath.string(), input, err)) {
+        ++t.failed;
+        t.errors.push_back(inPath.string() + ": " + err);
+        continue;
+      }
+      t.decode.seconds += SecondsSince(t0);
+      t.decode.bytes += FileSizeOrZero(inPath);
+      ++t.decode.images;
+
+      t0 = Clock::now();
+      IndexedImage indexed;
+      cv::Mat output;
+      ProcessStats stats;
+      ProcessStats* statsOut = options.tracePath.empty() ? nullptr : &stats;
+      if (indexedOut) {
+        PixelArtProcessor::ProcessIndexed(input, options.params, indexed, output, nullptr, statsOut, &context);
+      } else {
+        output = PixelArtProcessor::Process(input, options.params, nullptr, statsOut, &context);
+      }
+      if (statsOut) t.runs.push_back(std::move(stats));
+      t.process.seconds += SecondsSince(t0);
+      t.process.bytes += static_cast<double>(input.total() * input.elemSize());
+      ++t.process.images;
+      input.release(); // free the decoded source before encoding to keep peak memory low
+      if (output.empty() && indexed.empty()) {
+        ++t.failed;
+        t.errors.push_back(inPath.string() + ": processing failed (empty output)");
+        continue;
+      }
+
+      if (writer) {
+        // Encoded on the pool; success and encode totals are counted from its results.
+        if (!cacheKey.empty()) t.cacheStores.emplace_back(outPath.string(), std::move(cacheKey));
+        if (indexed.empty()) {
+          writer->Submit(outPath.string(), std::move(output));
+        } else {
+          writer->Submit(outPath.string(), std::move(indexed));
+        }
+        continue;
+      }
+
+      t0 = Clock::now();
+      const bool saved = indexed.empty() ? ImageLoader::Save(outPath.string(), output, options.save, err)
+                                         : ImageLoader::SaveIndexed(outPath.string(), indexed, options.save, err);
+      if (!saved) {
+        ++t.failed;
+        t.errors.push_back(outPath.string() + ": " + err);
+        continue;
+      }
+      if (!cacheKey.empty()) t.cacheStores.emplace_back(outPath.string(), std::move(cacheKey));
+      t.encode.seconds += SecondsSince(t0);
+      t.encode.bytes += FileSizeOrZero(outPath);
+      ++t.encode.images;
+      ++t.succeeded;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(static_cast<size_t>(jobs));
+  for (int j = 0; j < jobs; ++j) threads.emplace_back(worker, std::ref(totals[static_cast<size_t>(j)]));
+  for (auto& th : threads) th.join();
+  std::unordered_set<std::string> unwritten; // outputs that failed to encode / write
+  if (writer) {
+    for (const AsyncImageWriter::Result& r : writer->Finish()) {
+      if (!r.ok) {
+        ++report.failed;
+        report.errors.push_back(r.path + ": " + r.error);
+        unwritten.insert(r.path);
+        continue;
+      }
+      report.encode.seconds += r.seconds;
+      report.encode.bytes += r.bytes;
+      ++report.encode.images;
+      ++report.succeeded;
+    }
+  }
+
+  // New results go into the cache once their files are complete.
+  if (cache.IsOpen()) {
+    for (WorkerTotals& t : totals) {
+      for (const auto& entry : t.cacheStores) {
+        std::string err;
+        if (unwritten.count(entry.first) == 0 && !cache.Store(entry.second, entry.first, err)) {
+          report.errors.push_back(err);
+        }
+      }
+    }
+    if (options.cacheMaxBytes > 0) report.cacheEvicted = cache.Trim(options.cacheMaxBytes);
+    report.cache = cache.GetStats();
+  }
+
+  report.wallSeconds = SecondsSince(wallStart);
+  if (jobs > 1) cv::setNumThreads(prevCvThreads);
+
+  std::vector<ProcessStats> runs;
+  for (WorkerTotals& t : totals) {
+    Accumulate(report.decode, t.decode);
+    Accumulate(report.process, t.process);
+    Accumulate(report.encode, t.encode);
+    report.succeeded += t.succeeded;
+    report.failed += t.failed;
+    report.errors.insert(report.errors.end(), t.errors.begin(), t.errors.end());
+    for (ProcessStats& run : t.runs) {
+      for (int s = 0; s < ProcessStats::kStageCount; ++s) report.processStageSeconds[s] += run.stageSeconds[s];
+      runs.push_back(std::move(run));
+    }
+  }
+  if (!options.tracePath.empty() && !options.streaming && !options.sequence) {
+    report.profiled = true;
+    std::string err;
+    if (!ProcessStats::WriteFile(options.tracePath, ProcessStats::ToChromeTrace(runs), err)) {
+      report.errors.push_back(err);
+    }
+  }
+  return report;
+}
+
+void BatchRunner::PrintReport(const Report& report, std::FILE* out) {
+  if (!out) return;
+  for (const std::string& e : report.errors) std::fprintf(out, "error: %s\n", e.c_str());
+
+  const int total = report.succeeded + report.failed;
+  std::fprintf(out, "\nProcessed %d/%d image(s) with %d worker(s) in %.3f s (%.1f images/s)\n",
+               report.succeeded, total, report.jobs, report.wallSeconds,
+               report.wallSeconds > 0.0 ? report.succeeded / report.wallSeconds : 0.0);
+  std::fprintf(out, "  CPU kernels: %s\n", CpuDispatch::IsaName(CpuDispatch::Active()));
+  std::fprintf(out, "  %-8s %10s %10s %10s\n", "stage", "busy (s)", "images/s", "MB/s");
+  PrintStage(out, "decode", report.decode, report.jobs);
+  PrintStage(out, "process", report.process, report.jobs);
+  PrintStage(out, "encode", report.encode, report.encodeJobs > 0 ? report.encodeJobs : report.jobs);
+  if (report.profiled) {
+    // Process time by pipeline stage (the rest is normalization, conversions, cancel checks).
+    for (int s = 0; s < ProcessStats::kStageCount; ++s) {
+      const double seconds = report.processStageSeconds[s];
+      std::fprintf(out, "    %-10s %10.3f %9.1f%%\n", ProcessStats::StageName(static_cast<ProcessStats::Stage>(s)),
+                   seconds, report.process.seconds > 0.0 ? 100.0 * seconds / report.process.seconds : 0.0);
+    }
+  }
+  if (report.cached) {
+    const ResultCache::Stats& c = report.cache;
+    const int64_t lookups = c.hits + c.misses;
+    std::fprintf(out, "  result cache: %lld hit(s), %lld miss(es) (%.1f%% hits), %lld stored (%.1f MB)",
+                 static_cast<long long>(c.hits), static_cast<long long>(c.misses),
+                 lookups > 0 ? 100.0 * c.hits / lookups : 0.0, static_cast<long long>(c.stores),
+                 c.bytesStored / (1024.0 * 1024.0));
+    if (report.cacheEvicted > 0) std::fprintf(out, ", %d evicted", report.cacheEvicted);
+    std::fprintf(out, "\n");
+  }
+  if (report.encodeJobs > 0) {
+    std::fprintf(out, "  (decode / process rates assume all %d workers run that stage, encode all %d "
+                      "encoder threads; MB = encoded input, decoded input, encoded output)\n",
+                 report.jobs, report.encodeJobs);
+  } else {
+    std::fprintf(out, "  (stage rates assume all %d workers run that stage; MB = encoded input, "
+                      "decoded input, encoded output)\n", report.jobs);
+  }
+}
+
+int BatchRunner::Verify(const Options& options, std::FILE* out) {
+  // One image at a time: the kernels under test are multi-threaded themselves, and the
+  // reference side needs several full-resolution copies.
+  int checks = 0;
+  int failures = 0;
+  for (const std::string& path : options.inputs) {
+    cv::Mat input;
+    std::string err;
+    if (!ImageLoader::LoadBGR(path, input, err)) {
+      if (out) std::fprintf(out, "FAIL  %s: %s\n", path.c_str(), err.c_str());
+      ++failures;
+      continue;
+    }
+    if (out) std::fprintf(out, "%s (%dx%d)\n", path.c_str(), input.cols, input.rows);
+    for (const RegressionCheck::Result& r : RegressionCheck::Run(input, options.params)) {
+      ++checks;
+      if (!r.Passed()) ++failures;
+      if (!out) continue;
+      const char* status = !r.Passed() ? "FAIL" : (r.tolerance == RegressionCheck::kReportOnly ? "info" : "ok");
+      if (!r.sameSize) {
+        std::fprintf(out, "  %-4s  %-26s size / type mismatch\n", status, r.check.c_str());
+      } else if (r.maxDelta == 0) {
+        std::fprintf(out, "  %-4s  %-26s identical\n", status, r.check.c_str());
+      } else {
+        char allowed[32] = "differs by design";
+        if (r.tolerance != RegressionCheck::kReportOnly) std::snprintf(allowed, sizeof(allowed), "allowed %d", r.tolerance);
+        std::fprintf(out, "  %-4s  %-26s max delta %d (%s), %lld px differ, PSNR %.2f dB\n", status,
+                     r.check.c_str(), r.maxDelta, allowed, static_cast<long long>(r.differing), r.psnr);
+      }
+    }
+  }
+  if (out) {
+    std::fprintf(out, "\nVerified %zu image(s) against the reference: %d check(s), %d failed\n",
+                 options.inputs.size(), checks, failures);
+  }
+  return failures;
+}
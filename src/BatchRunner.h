@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ImageLoader.h"
+#include "PixelArtProcessor.h"
+#include "ResultCache.h"
+#include "SequenceProcessor.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// BatchRunner: headless, multi-threaded driver for PixelArtProcessor.
+// Why this exists:
+// - The GUI runs one image at a time on the UI thread; nightly sprite conversion needs all cores.
+// - Each worker runs decode -> process for one file and hands the result to a small encoder
+//   pool (AsyncImageWriter), so compression overlaps with the next image. The pool sizes and
+//   the encoder's bounded queue bound peak memory (at most `jobs` decoded images plus a few
+//   queued outputs are alive at once).
+// - In streaming mode each worker runs StreamingProcessor instead, so a single huge scan never
+//   needs to be decoded whole.
+// - In verify mode nothing is written: every input is run through RegressionCheck instead.
+// - In sequence mode every input is an animation (video, animated GIF, sprite sheet) run
+//   through SequenceProcessor one at a time; its own pipeline keeps all `jobs` cores busy.
+// - With a cache directory, an input whose output is already cached (ResultCache: same input
+//   bytes, params and output format) is copied from the cache without decoding; new results
+//   are stored once written. Not in streaming / sequence mode.
+// - No GLFW/ImGui/OpenGL dependency: links only PixelArtProcessor + ImageLoader.
+class BatchRunner {
+public:
+  struct Options {
+    std::vector<std::string> inputs; // image file paths (see CollectInputs)
+    std::string outputDir;           // created if missing
+    std::string outputExt = ".png";  // extension (with dot) for written files
+    std::string suffix;              // appended to the input stem, e.g. "_px"
+    int jobs = 0;                    // worker count; 0 => hardware concurrency
+    int encodeJobs = 0;              // encoder threads (AsyncImageWriter); 0 => jobs / 2 (at least 1),
+                                     // < 0 => every worker encodes its own output inline
+    ImageLoader::SaveOptions save;   // PNG level / strategy, JPEG / WebP quality
+    bool streaming = false;          // process in strips with bounded memory (StreamingProcessor)
+    bool trueColor = false;          // write 24-bit PNG instead of indexed PNG
+    bool sequence = false;           // inputs are frame sequences (SequenceProcessor); outputExt
+                                     // picks GIF / video / sheet / numbered frames
+    SequenceProcessor::Options sequenceOptions; // jobs / cancel are set by Run
+    std::string tracePath;           // non-empty: write a Chrome trace of every image's process
+                                     // stages (ProcessStats) here; not in streaming / sequence mode
+    std::string cacheDir;            // non-empty: ResultCache directory (created if missing)
+    uint64_t cacheMaxBytes = 0;      // trim the cache to this size after the run; 0 = no limit
+    PixelArtProcessor::Params params;
+  };
+
+  // Accumulated busy time and byte volume for one pipeline stage, summed over all workers.
+  struct StageTotals {
+    double seconds = 0.0;
+    double bytes = 0.0;
+    int images = 0;
+  };
+
+  struct Report {
+    int jobs = 0;
+    int encodeJobs = 0; // 0: inline encoding on the workers
+    int succeeded = 0;
+    int failed = 0;
+    double wallSeconds = 0.0;
+    StageTotals decode;  // bytes = encoded input file size
+    StageTotals process; // bytes = decoded BGR input size (streaming: decode + process + encode)
+    StageTotals encode;  // bytes = encoded output file size
+    bool profiled = false; // processStageSeconds filled (Options::tracePath set)
+    double processStageSeconds[ProcessStats::kStageCount] = {}; // "process" split by pipeline stage
+    bool cached = false;       // Options::cacheDir was used
+    ResultCache::Stats cache;  // hits = inputs copied from the cache (counted in succeeded)
+    int cacheEvicted = 0;      // entries removed by the cacheMaxBytes trim
+    std::vector<std::string> errors;
+  };
+
+  // Appends image files found at `path` (a file, or a directory scanned for known image
+  // extensions) to `outFiles`. Directory results are sorted for reproducible output order.
+  // With `sequences`, directories also yield animated GIF and video files.
+  static bool CollectInputs(const std::string& path, bool recursive,
+                            std::vector<std::string>& outFiles, std::string& outError,
+                            bool sequences = false);
+
+  // Appends one path per non-empty line of `listPath` (lines starting with '#' are skipped).
+  static bool ReadFileList(const std::string& listPath,
+                           std::vector<std::string>& outFiles, std::string& outError);
+
+  // Processes every input with a bounded worker pool and blocks until all are done.
+  // Outputs are <stem><suffix><ext> in outputDir; inputs with the same stem (from different
+  // directories) get their parent directory's name in front, then a counter, so no two
+  // inputs ever write the same file.
+  static Report Run(const Options& options);
+
+  // Prints totals plus per-stage throughput (images/s, MB/s), and with a trace the split of
+  // the process time over the pipeline stages; with a cache, its hit / miss counts.
+  static void PrintReport(const Report& report, std::FILE* out);
+
+  // Regression mode: runs RegressionCheck (optimised kernels vs ReferenceProcessor) on every
+  // input in turn, prints one line per check and a summary, and returns the number of failed
+  // checks (an input that cannot be decoded counts as one). Nothing is written.
+  static int Verify(const Options& options, std::FILE* out);
+};
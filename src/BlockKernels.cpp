@@ -0,0 +1,437 @@
+#include "BlockKernels.h"
+
+#include "CpuDispatch.h"
+#include "ProcessContext.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+struct Tap {
+  int index;    // source row / column (already reflected into the image)
+  float weight; // summed blur weight of that source line for the whole block
+};
+
+// Taps of consecutive blocks along one axis, flattened: block i reads taps[start[i]] ..
+// taps[start[i + 1] - 1]. Two buffers per axis instead of one vector per block.
+struct BlockTaps {
+  struct Span {
+    const Tap* first;
+    const Tap* last;
+    const Tap* begin() const { return first; }
+    const Tap* end() const { return last; }
+  };
+
+  std::vector<Tap> taps;
+  std::vector<int> start;
+
+  int blocks() const { return static_cast<int>(start.size()) - 1; }
+  Span operator[](size_t i) const { return {taps.data() + start[i], taps.data() + start[i + 1]}; }
+};
+
+// Working buffers of the calling thread, kept between calls. Bound to references before use:
+// inside a parallel_for_ body the thread_local name would resolve to the pool thread's copy.
+BlockTaps& RowTaps() {
+  thread_local BlockTaps taps;
+  return taps;
+}
+BlockTaps& ColTaps() {
+  thread_local BlockTaps taps;
+  return taps;
+}
+
+// For every block along one axis: the source lines it reads and their total weight.
+// A block covering [b0, b1) reads lines b0 - r .. b1 - 1 + r, reflected at the borders;
+// lines that reflect onto the same index are merged. Weights are normalised so they sum to 1,
+// which folds the block-mean division in as well. Only blocks [first, last) are built
+// (block 0 of `out` is block `first`). `out` keeps its capacity from call to call.
+void BuildBlockTaps(int length, int blockSize, const std::vector<double>& kernel, int first, int last,
+                    BlockTaps& out) {
+  const int r = static_cast<int>(kernel.size()) / 2;
+  out.taps.clear();
+  out.start.assign(1, 0);
+  thread_local std::vector<double> acc;
+
+  for (int b = first; b < last; ++b) {
+    const int b0 = b * blockSize;
+    const int b1 = std::min(b0 + blockSize, length);
+    // Reflection never leaves [b0 - r, b1 + r) by more than the kernel radius, so the
+    // window [lo, hi] below bounds every index we can touch.
+    const int lo = std::max(0, b0 - 2 * r);
+    const int hi = std::min(length - 1, b1 - 1 + 2 * r);
+    acc.assign(static_cast<size_t>(hi - lo + 1), 0.0);
+    for (int p = b0; p < b1; ++p) {
+      for (int k = -r; k <= r; ++k) {
+        const int src = cv::borderInterpolate(p + k, length, cv::BORDER_REFLECT_101);
+        acc[static_cast<size_t>(std::min(std::max(src, lo), hi) - lo)] += kernel[static_cast<size_t>(k + r)];
+      }
+    }
+    const double norm = 1.0 / static_cast<double>(b1 - b0);
+    for (int i = lo; i <= hi; ++i) {
+      const double wgt = acc[static_cast<size_t>(i - lo)];
+      if (wgt != 0.0) out.taps.push_back({i, static_cast<float>(wgt * norm)});
+    }
+    out.start.push_back(static_cast<int>(out.taps.size()));
+  }
+}
+
+// The 1-D kernel GaussianBlur derives for sigma 0, cached per thread (it only depends on ksize).
+const std::vector<double>& GaussianTaps(int ksize) {
+  thread_local std::vector<double> kernel;
+  if (static_cast<int>(kernel.size()) != ksize) {
+    const cv::Mat kernelMat = cv::getGaussianKernel(ksize, 0.0, CV_64F);
+    const double* kernelPtr = kernelMat.ptr<double>();
+    kernel.assign(kernelPtr, kernelPtr + ksize);
+  }
+  return kernel;
+}
+
+// One axis of a block grid: for every grid column (row), the block it samples (-1 = outside
+// the block image, black) and how many output columns (rows) it covers.
+void BuildGridAxis(int outLength, int blocks, int blockSize, int radius, std::vector<int>& outBlock,
+                   std::vector<int>& outRuns) {
+  outBlock.clear();
+  outRuns.clear();
+  auto addBlock = [&](int block, int length) {
+    if (length <= 0) return;
+    if (length < 2 * radius + 1) {
+      outBlock.insert(outBlock.end(), static_cast<size_t>(length), block);
+      outRuns.insert(outRuns.end(), static_cast<size_t>(length), 1);
+      return;
+    }
+    // R edge columns, one representative for the interior, R edge columns.
+    outBlock.insert(outBlock.end(), static_cast<size_t>(2 * radius + 1), block);
+    outRuns.insert(outRuns.end(), static_cast<size_t>(radius), 1);
+    outRuns.push_back(length - 2 * radius);
+    outRuns.insert(outRuns.end(), static_cast<size_t>(radius), 1);
+  };
+  for (int b = 0; b < blocks; ++b) {
+    addBlock(b, std::min(blockSize, outLength - b * blockSize));
+  }
+  // Output beyond the block grid is black in ExpandBlocksBGR; it acts like one more block.
+  addBlock(-1, outLength - blocks * blockSize);
+}
+
+// acc[i] += weight * src[i]; written so compilers auto-vectorise it.
+inline void AccumulateWeightedRow(const uchar* src, float weight, float* acc, int n) {
+  for (int i = 0; i < n; ++i) acc[i] += weight * static_cast<float>(src[i]);
+}
+
+// Shared by the BGR and the palette-index versions: T is cv::Vec3b or uchar. Output that is
+// not covered by the block image is 0 (black / palette entry 0).
+// First scanline of a block row (CpuKernels::expandRow*).
+inline void ExpandScanline(const CpuKernels& k, const cv::Vec3b* src, cv::Vec3b* line, int width, int blockSize) {
+  k.expandRowBGR(src->val, line->val, width, blockSize);
+}
+inline void ExpandScanline(const CpuKernels& k, const uchar* src, uchar* line, int width, int blockSize) {
+  k.expandRowIndexed(src, line, width, blockSize);
+}
+
+template <typename T>
+cv::Mat ExpandBlocks(const cv::Mat& small, const cv::Size& outSize, int blockSize, ProcessContext* context) {
+  blockSize = std::max(1, blockSize);
+  cv::Mat out = ProcessContext::Output(context, outSize.height, outSize.width, small.type());
+  if (out.empty()) return out;
+
+  const int w = outSize.width;
+  const int h = outSize.height;
+  // Output pixels covered by the block grid; anything beyond it stays black.
+  const int coveredW = std::min(w, small.cols * blockSize);
+  const int coveredRows = std::min(h, small.rows * blockSize);
+  const size_t rowBytes = static_cast<size_t>(w) * sizeof(T);
+  const int blockRows = (coveredRows + blockSize - 1) / blockSize;
+  const CpuKernels& kernels = CpuDispatch::Kernels();
+
+  cv::parallel_for_(cv::Range(0, blockRows), [&](const cv::Range& range) {
+    for (int by = range.start; by < range.end; ++by) {
+      const int y0 = by * blockSize;
+      const int y1 = std::min(y0 + blockSize, coveredRows);
+
+      // Build the first scanline of the block row, then copy it to the other rows.
+      ExpandScanline(kernels, small.ptr<T>(by), out.ptr<T>(y0), coveredW, blockSize);
+      std::memset(out.ptr<uchar>(y0) + static_cast<size_t>(coveredW) * sizeof(T), 0,
+                  static_cast<size_t>(w - coveredW) * sizeof(T));
+
+      for (int y = y0 + 1; y < y1; ++y) std::memcpy(out.ptr<uchar>(y), out.ptr<uchar>(y0), rowBytes);
+    }
+  });
+  for (int y = coveredRows; y < h; ++y) std::memset(out.ptr<uchar>(y), 0, rowBytes);
+  return out;
+}
+
+template <typename T>
+BlockKernels::BlockGrid BuildGrid(const cv::Mat& small, const cv::Size& outSize, int blockSize, int radius,
+                                  ProcessContext* context) {
+  BlockKernels::BlockGrid grid;
+  blockSize = std::max(1, blockSize);
+  radius = std::max(0, radius);
+
+  thread_local std::vector<int> colBlock, rowBlock;
+  BuildGridAxis(outSize.width, small.cols, blockSize, radius, colBlock, grid.colRuns);
+  BuildGridAxis(outSize.height, small.rows, blockSize, radius, rowBlock, grid.rowRuns);
+
+  grid.image = ProcessContext::Scratch(context, ProcessContext::Slot::Grid, static_cast<int>(rowBlock.size()),
+                                       static_cast<int>(colBlock.size()), small.type());
+  for (int gy = 0; gy < grid.image.rows; ++gy) {
+    const int by = rowBlock[static_cast<size_t>(gy)];
+    const T* src = by >= 0 ? small.ptr<T>(by) : nullptr;
+    T* dst = grid.image.ptr<T>(gy);
+    for (int gx = 0; gx < grid.image.cols; ++gx) {
+      const int bx = colBlock[static_cast<size_t>(gx)];
+      dst[gx] = (src && bx >= 0) ? src[bx] : T();
+    }
+  }
+  return grid;
+}
+
+template <typename T>
+cv::Mat ExpandGrid(const BlockKernels::BlockGrid& grid, ProcessContext* context) {
+  int w = 0, h = 0;
+  for (int r : grid.colRuns) w += r;
+  for (int r : grid.rowRuns) h += r;
+  cv::Mat out = ProcessContext::Output(context, h, w, grid.image.type());
+
+  // First output row of every grid row (bound here: the stripes below run on other threads).
+  thread_local std::vector<int> rowStartBuffer;
+  std::vector<int>& rowStart = rowStartBuffer;
+  rowStart.assign(grid.rowRuns.size() + 1, 0);
+  for (size_t i = 0; i < grid.rowRuns.size(); ++i) rowStart[i + 1] = rowStart[i] + grid.rowRuns[i];
+  const size_t rowBytes = static_cast<size_t>(w) * sizeof(T);
+
+  cv::parallel_for_(cv::Range(0, grid.image.rows), [&](const cv::Range& range) {
+    for (int gy = range.start; gy < range.end; ++gy) {
+      const T* src = grid.image.ptr<T>(gy);
+      const int y0 = rowStart[static_cast<size_t>(gy)];
+      const int y1 = rowStart[static_cast<size_t>(gy) + 1];
+      T* line = out.ptr<T>(y0);
+      int x = 0;
+      for (size_t gx = 0; gx < grid.colRuns.size(); ++gx) {
+        const T c = src[gx];
+        for (const int x1 = x + grid.colRuns[gx]; x < x1; ++x) line[x] = c;
+      }
+      for (int y = y0 + 1; y < y1; ++y) std::memcpy(out.ptr<uchar>(y), out.ptr<uchar>(y0), rowBytes);
+    }
+  });
+  return out;
+}
+} // namespace
+
+cv::Mat BlockKernels::BlockMeanBGR(const cv::Mat& srcBgr, int blockSize, ProcessContext* context) {
+  if (srcBgr.empty() || srcBgr.type() != CV_8UC3) return {};
+  const int w = srcBgr.cols;
+  const int h = srcBgr.rows;
+  blockSize = std::max(1, std::min(blockSize, 256));
+
+  const int bw = (w + blockSize - 1) / blockSize;
+  const int bh = (h + blockSize - 1) / blockSize;
+  cv::Mat small = ProcessContext::Scratch(context, ProcessContext::Slot::Blocks, bh, bw, CV_8UC3);
+
+  const CpuKernels& kernels = CpuDispatch::Kernels();
+  cv::parallel_for_(cv::Range(0, bh), [&](const cv::Range& range) {
+    // Column sums for one block row: at most 256 * 255 per entry, so 16 bits suffice.
+    // Kept per (pool) thread, like every row buffer here.
+    thread_local std::vector<uint16_t> acc;
+    acc.resize(static_cast<size_t>(w) * 3);
+
+    for (int by = range.start; by < range.end; ++by) {
+      const int y0 = by * blockSize;
+      const int y1 = std::min(y0 + blockSize, h);
+      std::fill(acc.begin(), acc.end(), uint16_t{0});
+      for (int y = y0; y < y1; ++y) kernels.accumulateRow(srcBgr.ptr<uchar>(y), acc.data(), w * 3);
+
+      cv::Vec3b* out = small.ptr<cv::Vec3b>(by);
+      for (int bx = 0; bx < bw; ++bx) {
+        const int x0 = bx * blockSize;
+        const int x1 = std::min(x0 + blockSize, w);
+        uint32_t s0 = 0, s1 = 0, s2 = 0;
+        for (const uint16_t* a = acc.data() + x0 * 3, *end = acc.data() + x1 * 3; a < end; a += 3) {
+          s0 += a[0];
+          s1 += a[1];
+          s2 += a[2];
+        }
+        // Same arithmetic as cv::mean (sum * (1/count) in double, then truncation) so
+        // results are identical to the per-ROI version this replaces.
+        const double inv = 1.0 / static_cast<double>((x1 - x0) * (y1 - y0));
+        out[bx] = cv::Vec3b(static_cast<uchar>(s0 * inv),
+                            static_cast<uchar>(s1 * inv),
+                            static_cast<uchar>(s2 * inv));
+      }
+    }
+  });
+  return small;
+}
+
+cv::Mat BlockKernels::BlurredBlockMeanBGR(const cv::Mat& srcBgr, int blockSize, int ksize,
+                                          ProcessContext* context) {
+  if (srcBgr.empty() || srcBgr.type() != CV_8UC3) return {};
+  if (ksize <= 1) return BlockMeanBGR(srcBgr, blockSize, context);
+  blockSize = std::max(1, std::min(blockSize, 256));
+  return BlurredBlockMeanRowsBGR(srcBgr, 0, srcBgr.rows, blockSize, ksize, 0,
+                                 (srcBgr.rows + blockSize - 1) / blockSize, context);
+}
+
+cv::Mat BlockKernels::BlurredBlockMeanRowsBGR(const cv::Mat& srcRows, int firstRow, int imageHeight, int blockSize,
+                                              int ksize, int blockRow0, int blockRow1, ProcessContext* context) {
+  if (srcRows.empty() || srcRows.type() != CV_8UC3) return {};
+  ksize = std::max(1, ksize) | 1;
+  const int w = srcRows.cols;
+  const int h = imageHeight;
+  blockSize = std::max(1, std::min(blockSize, 256));
+  blockRow0 = std::max(0, blockRow0);
+  blockRow1 = std::min(blockRow1, (h + blockSize - 1) / blockSize);
+  if (blockRow0 >= blockRow1) return {};
+
+  const std::vector<double>& kernel = GaussianTaps(ksize);
+  BlockTaps& rowTaps = RowTaps();
+  BlockTaps& colTaps = ColTaps();
+  BuildBlockTaps(h, blockSize, kernel, blockRow0, blockRow1, rowTaps);
+  BuildBlockTaps(w, blockSize, kernel, 0, (w + blockSize - 1) / blockSize, colTaps);
+
+  // Every source row the requested block rows read must be inside srcRows.
+  for (const Tap& t : rowTaps.taps) {
+    if (t.index < firstRow || t.index >= firstRow + srcRows.rows) return {};
+  }
+
+  const int bw = colTaps.blocks();
+  const int bh = rowTaps.blocks();
+  cv::Mat small = ProcessContext::Scratch(context, ProcessContext::Slot::Blocks, bh, bw, CV_8UC3);
+
+  cv::parallel_for_(cv::Range(0, bh), [&](const cv::Range& range) {
+    // The only working buffer: one float row holding the vertically weighted source rows.
+    thread_local std::vector<float> acc;
+    acc.resize(static_cast<size_t>(w) * 3);
+
+    for (int by = range.start; by < range.end; ++by) {
+      std::fill(acc.begin(), acc.end(), 0.0f);
+      for (const Tap& t : rowTaps[static_cast<size_t>(by)]) {
+        AccumulateWeightedRow(srcRows.ptr<uchar>(t.index - firstRow), t.weight, acc.data(), w * 3);
+      }
+
+      cv::Vec3b* out = small.ptr<cv::Vec3b>(by);
+      for (int bx = 0; bx < bw; ++bx) {
+        float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f;
+        for (const Tap& t : colTaps[static_cast<size_t>(bx)]) {
+          const float* a = acc.data() + t.index * 3;
+          s0 += t.weight * a[0];
+          s1 += t.weight * a[1];
+          s2 += t.weight * a[2];
+        }
+        // Truncate like the mean of the blurred image did; the clamp only absorbs float error.
+        out[bx] = cv::Vec3b(static_cast<uchar>(std::min(255.0f, std::max(0.0f, s0))),
+                            static_cast<uchar>(std::min(255.0f, std::max(0.0f, s1))),
+                            static_cast<uchar>(std::min(255.0f, std::max(0.0f, s2))));
+      }
+    }
+  });
+  return small;
+}
+
+cv::Mat BlockKernels::BlockMeanRectBGR(const cv::Mat& srcBgr, int blockSize, int ksize, const cv::Rect& blocks) {
+  if (srcBgr.empty() || srcBgr.type() != CV_8UC3) return {};
+  const int w = srcBgr.cols;
+  const int h = srcBgr.rows;
+  blockSize = std::max(1, std::min(blockSize, 256));
+  const cv::Rect r = blocks & cv::Rect(0, 0, (w + blockSize - 1) / blockSize, (h + blockSize - 1) / blockSize);
+  if (r.empty()) return {};
+  cv::Mat small(r.height, r.width, CV_8UC3);
+
+  if (ksize <= 1) {
+    // Plain means: the same sums and the same cv::mean arithmetic as BlockMeanBGR.
+    cv::parallel_for_(cv::Range(r.y, r.y + r.height), [&](const cv::Range& range) {
+      for (int by = range.start; by < range.end; ++by) {
+        const int y0 = by * blockSize;
+        const int y1 = std::min(y0 + blockSize, h);
+        cv::Vec3b* out = small.ptr<cv::Vec3b>(by - r.y);
+        for (int bx = r.x; bx < r.x + r.width; ++bx) {
+          const int x0 = bx * blockSize;
+          const int x1 = std::min(x0 + blockSize, w);
+          uint32_t s0 = 0, s1 = 0, s2 = 0;
+          for (int y = y0; y < y1; ++y) {
+            for (const uchar* a = srcBgr.ptr<uchar>(y) + x0 * 3, *end = srcBgr.ptr<uchar>(y) + x1 * 3; a < end; a += 3) {
+              s0 += a[0];
+              s1 += a[1];
+              s2 += a[2];
+            }
+          }
+          const double inv = 1.0 / static_cast<double>((x1 - x0) * (y1 - y0));
+          out[bx - r.x] = cv::Vec3b(static_cast<uchar>(s0 * inv),
+                                    static_cast<uchar>(s1 * inv),
+                                    static_cast<uchar>(s2 * inv));
+        }
+      }
+    });
+    return small;
+  }
+
+  ksize |= 1;
+  const std::vector<double>& kernel = GaussianTaps(ksize);
+  BlockTaps& rowTaps = RowTaps();
+  BlockTaps& colTaps = ColTaps();
+  BuildBlockTaps(h, blockSize, kernel, r.y, r.y + r.height, rowTaps);
+  BuildBlockTaps(w, blockSize, kernel, r.x, r.x + r.width, colTaps);
+  // Source columns [c0, c1) cover every column tap; the row buffer holds only those.
+  int c0 = w, c1 = 0;
+  for (const Tap& t : colTaps.taps) {
+    c0 = std::min(c0, t.index);
+    c1 = std::max(c1, t.index + 1);
+  }
+  const int span = c1 - c0;
+
+  cv::parallel_for_(cv::Range(0, r.height), [&](const cv::Range& range) {
+    thread_local std::vector<float> acc;
+    acc.resize(static_cast<size_t>(span) * 3);
+    for (int by = range.start; by < range.end; ++by) {
+      // Same per-element operations in the same order as BlurredBlockMeanRowsBGR.
+      std::fill(acc.begin(), acc.end(), 0.0f);
+      for (const Tap& t : rowTaps[static_cast<size_t>(by)]) {
+        AccumulateWeightedRow(srcBgr.ptr<uchar>(t.index) + c0 * 3, t.weight, acc.data(), span * 3);
+      }
+
+      cv::Vec3b* out = small.ptr<cv::Vec3b>(by);
+      for (int bx = 0; bx < r.width; ++bx) {
+        float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f;
+        for (const Tap& t : colTaps[static_cast<size_t>(bx)]) {
+          const float* a = acc.data() + (t.index - c0) * 3;
+          s0 += t.weight * a[0];
+          s1 += t.weight * a[1];
+          s2 += t.weight * a[2];
+        }
+        out[bx] = cv::Vec3b(static_cast<uchar>(std::min(255.0f, std::max(0.0f, s0))),
+                            static_cast<uchar>(std::min(255.0f, std::max(0.0f, s1))),
+                            static_cast<uchar>(std::min(255.0f, std::max(0.0f, s2))));
+      }
+    }
+  });
+  return small;
+}
+
+cv::Mat BlockKernels::ExpandBlocksBGR(const cv::Mat& smallBgr, const cv::Size& outSize, int blockSize,
+                                      ProcessContext* context) {
+  if (smallBgr.empty() || smallBgr.type() != CV_8UC3) return {};
+  return ExpandBlocks<cv::Vec3b>(smallBgr, outSize, blockSize, context);
+}
+
+cv::Mat BlockKernels::ExpandBlocksIndexed(const cv::Mat& smallIndices, const cv::Size& outSize, int blockSize,
+                                          ProcessContext* context) {
+  if (smallIndices.empty() || smallIndices.type() != CV_8UC1) return {};
+  return ExpandBlocks<uchar>(smallIndices, outSize, blockSize, context);
+}
+
+BlockKernels::BlockGrid BlockKernels::BuildBlockGrid(const cv::Mat& small, const cv::Size& outSize,
+                                                     int blockSize, int radius, ProcessContext* context) {
+  if (small.empty() || outSize.width <= 0 || outSize.height <= 0) return {};
+  if (small.type() == CV_8UC3) return BuildGrid<cv::Vec3b>(small, outSize, blockSize, radius, context);
+  if (small.type() == CV_8UC1) return BuildGrid<uchar>(small, outSize, blockSize, radius, context);
+  return {};
+}
+
+cv::Mat BlockKernels::ExpandBlockGrid(const BlockGrid& grid, ProcessContext* context) {
+  if (grid.image.empty()) return {};
+  if (grid.image.type() == CV_8UC3) return ExpandGrid<cv::Vec3b>(grid, context);
+  if (grid.image.type() == CV_8UC1) return ExpandGrid<uchar>(grid, context);
+  return {};
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+class ProcessContext;
+
+// BlockKernels: low-level N×N block reductions (and the matching expansion) used by
+// PixelArtProcessor.
+// Why this exists:
+// - The straightforward version (ROI + cv::mean per block) pays OpenCV's per-call overhead
+//   once per block; with small blocks on large photos that is millions of calls.
+// - These kernels stream the image row by row instead: each block row accumulates column sums
+//   over its N source rows (vectorised for the CPU at hand, see CpuDispatch),
+//   then reduces the sums horizontally and writes the small image directly.
+// - Block rows are independent, so they are spread across threads with cv::parallel_for_.
+//
+// The optional `context` keeps the buffers between calls (see ProcessContext): block images
+// and grids then live in its scratch slots (valid until the next call that uses the slot),
+// expansions come from its output pool.
+class BlockKernels {
+public:
+  // A block-expanded image with the interior of large blocks collapsed.
+  // After expansion every block is flat, and a local filter of radius R only produces
+  // different values within R pixels of a block edge; the columns (rows) further inside all
+  // see identical neighbourhoods. A grid for radius R keeps the R outer columns / rows of each
+  // block plus one representative interior column / row, so running any chain of local
+  // filters whose radii sum to <= R on `image` and then ExpandBlockGrid gives exactly the
+  // result of running them on the full expansion. colRuns / rowRuns hold how many output
+  // columns / rows each grid column / row stands for.
+  struct BlockGrid {
+    cv::Mat image;
+    std::vector<int> colRuns;
+    std::vector<int> rowRuns;
+  };
+
+  // Per-block mean of an 8-bit 3-channel image. Output size is ceil(w/N) × ceil(h/N);
+  // edge blocks average only the pixels they cover.
+  // Result matches cv::mean on each block ROI bit for bit, including truncation to uchar.
+  // blockSize must be in [1, 256] (column sums are kept in 16 bits).
+  static cv::Mat BlockMeanBGR(const cv::Mat& srcBgr, int blockSize, ProcessContext* context = nullptr);
+
+  // Block mean of GaussianBlur(src, ksize × ksize, sigma 0, BORDER_REFLECT_101) without
+  // materialising the blurred image. Blur and mean are both linear, so each block's value is a
+  // separable weighted sum of the source pixels around it: per block row the source rows are
+  // folded into one float row buffer with the vertical weights, then reduced horizontally.
+  // Differs from the two-pass version by at most ~1 LSB, because the blurred pixels are never
+  // rounded to 8 bits before averaging. Same size rules as BlockMeanBGR; ksize must be odd.
+  static cv::Mat BlurredBlockMeanBGR(const cv::Mat& srcBgr, int blockSize, int ksize,
+                                     ProcessContext* context = nullptr);
+  // Block rows [blockRow0, blockRow1) of BlurredBlockMeanBGR for an image `imageHeight` rows
+  // tall, of which `srcRows` holds rows [firstRow, firstRow + srcRows.rows). Those must include
+  // the ksize / 2 halo rows above and below the block rows (clipped to the image); returns an
+  // empty Mat otherwise. Bit-identical to the matching rows of the whole-image call, so an image
+  // can be reduced strip by strip (see StreamingProcessor).
+  static cv::Mat BlurredBlockMeanRowsBGR(const cv::Mat& srcRows, int firstRow, int imageHeight, int blockSize,
+                                         int ksize, int blockRow0, int blockRow1,
+                                         ProcessContext* context = nullptr);
+  // The blocks inside `blocks` (block coordinates, clipped to the block image) of
+  // BlurredBlockMeanBGR(srcBgr, blockSize, ksize), or of BlockMeanBGR for ksize <= 1; reads
+  // only the source pixels those blocks depend on. Bit-identical to the matching part of the
+  // whole-image call, so an edited image can be re-reduced around the edit only.
+  static cv::Mat BlockMeanRectBGR(const cv::Mat& srcBgr, int blockSize, int ksize, const cv::Rect& blocks);
+
+  // Nearest-neighbour upscale of a block image: every small pixel becomes an N×N block of
+  // `outSize` (cropped at the right / bottom edge; output not covered by the grid is black).
+  // Each block row builds one scanline and memcpys it to its other N-1 rows, instead of one
+  // ROI fill per block; block rows run in parallel.
+  static cv::Mat ExpandBlocksBGR(const cv::Mat& smallBgr, const cv::Size& outSize, int blockSize,
+                                 ProcessContext* context = nullptr);
+  // Same expansion for a palette-index plane (CV_8UC1): one byte moved per pixel instead of
+  // three. Uncovered output gets index 0.
+  static cv::Mat ExpandBlocksIndexed(const cv::Mat& smallIndices, const cv::Size& outSize, int blockSize,
+                                     ProcessContext* context = nullptr);
+
+  // Same geometry as ExpandBlocksBGR(small, outSize, blockSize), collapsed for filters of
+  // total radius `radius` (see BlockGrid). Blocks narrower than 2 * radius + 1 stay whole.
+  // Works on BGR (CV_8UC3) and palette-index (CV_8UC1) images; the grid has the same type.
+  static BlockGrid BuildBlockGrid(const cv::Mat& small, const cv::Size& outSize, int blockSize, int radius,
+                                  ProcessContext* context = nullptr);
+  // Full-resolution image of a (possibly filtered) grid: row-replicating, like ExpandBlocksBGR.
+  static cv::Mat ExpandBlockGrid(const BlockGrid& grid, ProcessContext* context = nullptr);
+};
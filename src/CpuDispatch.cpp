@@ -0,0 +1,164 @@
+#include "CpuDispatch.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(FPW_KERNELS_SSE41) || defined(FPW_KERNELS_AVX2) || defined(FPW_KERNELS_AVX512)
+#define FPW_CPUID 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+using Isa = CpuDispatch::Isa;
+
+// Every variant's table, indexed by Isa; nullptr where not compiled in.
+const CpuKernels* Table(Isa isa) {
+  static const CpuKernels* const kTables[CpuDispatch::kIsaCount] = {
+    &CpuKernelsScalar(), CpuKernelsBaseline(), CpuKernelsSSE41(), CpuKernelsAVX2(), CpuKernelsAVX512(),
+  };
+  const int i = static_cast<int>(isa);
+  return i >= 0 && i < CpuDispatch::kIsaCount ? kTables[i] : nullptr;
+}
+
+#if FPW_CPUID
+struct CpuFeatures {
+  bool sse41 = false;
+  bool avx2 = false;
+  bool avx512 = false; // F + BW + VL
+};
+
+void Cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+  int r[4];
+  __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+  for (int i = 0; i < 4; ++i) regs[i] = static_cast<uint32_t>(r[i]);
+#else
+  if (!__get_cpuid_count(leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3])) {
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+  }
+#endif
+}
+
+// XCR0: which register states the OS saves on context switch.
+uint64_t Xcr0() {
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32_t lo = 0, hi = 0;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return (static_cast<uint64_t>(hi) << 32) | lo;
+#endif
+}
+
+CpuFeatures Detect() {
+  CpuFeatures f;
+  uint32_t r[4] = {};
+  Cpuid(0, 0, r);
+  const uint32_t maxLeaf = r[0];
+  if (maxLeaf < 1) return f;
+  Cpuid(1, 0, r);
+  const uint32_t ecx1 = r[2];
+  f.sse41 = (ecx1 & (1u << 19)) != 0; // (implies SSSE3, which the shuffles use)
+  // AVX state usable only if the OS enabled it (OSXSAVE + XCR0 bits for XMM / YMM).
+  const bool osxsave = (ecx1 & (1u << 27)) != 0 && (ecx1 & (1u << 28)) != 0;
+  if (!osxsave || maxLeaf < 7) return f;
+  const uint64_t xcr0 = Xcr0();
+  Cpuid(7, 0, r);
+  const uint32_t ebx7 = r[1];
+  f.avx2 = (xcr0 & 0x6) == 0x6 && (ebx7 & (1u << 5)) != 0;
+  // ZMM state: opmask, upper halves of ZMM0-15, ZMM16-31.
+  f.avx512 = f.avx2 && (xcr0 & 0xE6) == 0xE6 && (ebx7 & (1u << 16)) != 0 && // F
+             (ebx7 & (1u << 30)) != 0 && (ebx7 & (1u << 31)) != 0;         // BW, VL
+  return f;
+}
+
+const CpuFeatures& Features() {
+  static const CpuFeatures features = Detect();
+  return features;
+}
+#endif
+
+bool CpuSupports(Isa isa) {
+  switch (isa) {
+    case Isa::Scalar:
+    case Isa::Baseline: return true; // the compiler baseline runs everywhere this binary does
+#if FPW_CPUID
+    case Isa::SSE41: return Features().sse41;
+    case Isa::AVX2: return Features().avx2;
+    case Isa::AVX512: return Features().avx512;
+#else
+    default: return false;
+#endif
+  }
+  return false;
+}
+
+// The best supported variant not above `limit`.
+Isa BestUpTo(Isa limit) {
+  for (int i = static_cast<int>(limit); i > 0; --i) {
+    if (CpuDispatch::Supported(static_cast<Isa>(i))) return static_cast<Isa>(i);
+  }
+  return Isa::Scalar;
+}
+
+std::atomic<int>& ActiveIsa() {
+  static std::atomic<int> isa{[] {
+    Isa limit = Isa::AVX512;
+    const char* env = std::getenv("FPW_ISA");
+    if (env) CpuDispatch::ParseIsa(env, limit);
+    return static_cast<int>(BestUpTo(limit));
+  }()};
+  return isa;
+}
+} // namespace
+
+const CpuKernels& CpuDispatch::Kernels() {
+  return *Table(Active());
+}
+
+CpuDispatch::Isa CpuDispatch::Active() {
+  return static_cast<Isa>(ActiveIsa().load(std::memory_order_relaxed));
+}
+
+bool CpuDispatch::Supported(Isa isa) {
+  return Table(isa) != nullptr && CpuSupports(isa);
+}
+
+CpuDispatch::Isa CpuDispatch::Best() {
+  return BestUpTo(Isa::AVX512);
+}
+
+bool CpuDispatch::Select(Isa isa) {
+  if (!Supported(isa)) return false;
+  ActiveIsa().store(static_cast<int>(isa), std::memory_order_relaxed);
+  return true;
+}
+
+const char* CpuDispatch::IsaName(Isa isa) {
+  switch (isa) {
+    case Isa::Scalar: return "scalar";
+    case Isa::Baseline: {
+      const CpuKernels* baseline = CpuKernelsBaseline();
+      return baseline ? baseline->name : "baseline";
+    }
+    case Isa::SSE41: return "sse4.1";
+    case Isa::AVX2: return "avx2";
+    case Isa::AVX512: return "avx512";
+  }
+  return "scalar";
+}
+
+bool CpuDispatch::ParseIsa(const std::string& name, Isa& outIsa) {
+  if (name == "scalar") outIsa = Isa::Scalar;
+  else if (name == "baseline" || name == "sse2" || name == "neon") outIsa = Isa::Baseline;
+  else if (name == "sse4.1" || name == "sse41") outIsa = Isa::SSE41;
+  else if (name == "avx2") outIsa = Isa::AVX2;
+  else if (name == "avx512") outIsa = Isa::AVX512;
+  else return false;
+  return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "CpuKernels.h"
+
+#include <string>
+
+// CpuDispatch: chooses the CpuKernels variant for this machine once, at first use.
+// Why this exists:
+// - The release build must run on any x86-64 (or ARM64) CPU, but the row kernels are 2-4x
+//   faster with AVX2 / AVX-512 where available. CPUID (and XGETBV, so the OS saves the wide
+//   registers) says which variants are safe; the best one wins.
+// - FPW_ISA=scalar|sse2|neon|sse4.1|avx2|avx512 overrides the choice (never above what the CPU
+//   supports), for A/B runs and for reproducing a user's report on a newer machine.
+// - The choice is visible: ProcessStats records it for every run (profiler overlay, JSON /
+//   trace exports, fpw_batch summary).
+//
+// All variants give identical results, so switching only changes speed.
+class CpuDispatch {
+public:
+  enum class Isa {
+    Scalar,   // plain loops
+    Baseline, // OpenCV universal intrinsics at the compiler baseline (SSE2 / NEON)
+    SSE41,
+    AVX2,
+    AVX512,   // F + BW + VL
+  };
+  static constexpr int kIsaCount = 5;
+
+  // The active variant's table. Cheap, but hoist it out of per-pixel loops.
+  static const CpuKernels& Kernels();
+  static Isa Active();
+
+  // Compiled into this binary and supported by this CPU / OS.
+  static bool Supported(Isa isa);
+  // The best supported variant, ignoring FPW_ISA.
+  static Isa Best();
+
+  // Switches every later kernel call to `isa`; false (and no change) if it is not Supported.
+  // Safe while kernels run elsewhere: calls already in flight finish with the old table.
+  static bool Select(Isa isa);
+
+  // "scalar", "sse2" / "neon" (Baseline), "sse4.1", "avx2", "avx512".
+  static const char* IsaName(Isa isa);
+  static bool ParseIsa(const std::string& name, Isa& outIsa);
+};
@@ -0,0 +1,205 @@
+#include "CpuKernels.h"
+
+#include <opencv2/core.hpp>
+
+#include <cstdlib>
+#include <cstring>
+
+// The compiler-baseline variant uses OpenCV universal intrinsics with the function-style API
+// (v_add etc.) that OpenCV 4.9 made the portable spelling: SSE2 on x86-64, NEON on ARM64.
+// Older OpenCV builds, and targets without SIMD, get the scalar table only.
+#if (CV_VERSION_MAJOR > 4) || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 9)
+#include <opencv2/core/hal/intrin.hpp>
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+#define FPW_BASELINE_SIMD 1
+#endif
+#endif
+#ifndef FPW_BASELINE_SIMD
+#define FPW_BASELINE_SIMD 0
+#endif
+
+namespace {
+constexpr int kShift = 8 - CpuKernels::kLutCellBits;
+
+// ---- Scalar ----
+void AccumulateRowScalar(const uint8_t* src, uint16_t* acc, int n) {
+  for (int i = 0; i < n; ++i) acc[i] = static_cast<uint16_t>(acc[i] + src[i]);
+}
+
+// Perceptual luminance exactly as the per-pixel outline computed it (float, truncated).
+inline uint8_t Luminance(uint8_t b, uint8_t g, uint8_t r) {
+  return static_cast<uint8_t>(static_cast<int>(0.299f * r + 0.587f * g + 0.114f * b));
+}
+
+void LuminanceRowScalar(const uint8_t* bgr, uint8_t* lum, int n) {
+  for (int i = 0; i < n; ++i) lum[i] = Luminance(bgr[i * 3], bgr[i * 3 + 1], bgr[i * 3 + 2]);
+}
+
+void PairDiffRowScalar(const uint8_t* a, const uint8_t* b, const uint8_t* lumA, const uint8_t* lumB, uint8_t* out,
+                       int n) {
+  for (int i = 0; i < n; ++i) {
+    const int d0 = a[i * 3] - b[i * 3];
+    const int d1 = a[i * 3 + 1] - b[i * 3 + 1];
+    const int d2 = a[i * 3 + 2] - b[i * 3 + 2];
+    const bool diff = std::abs(lumA[i] - lumB[i]) >= CpuKernels::kOutlineLuminanceThreshold ||
+                      d0 * d0 + d1 * d1 + d2 * d2 >= CpuKernels::kOutlineColorDistanceSq;
+    out[i] = diff ? 255 : 0;
+  }
+}
+
+void ExpandRowBGRScalar(const uint8_t* smallBgr, uint8_t* line, int width, int blockSize) {
+  for (int x = 0, bx = 0; x < width; ++bx) {
+    const uint8_t* c = smallBgr + bx * 3;
+    const int x1 = x + blockSize < width ? x + blockSize : width;
+    for (; x < x1; ++x) {
+      line[x * 3] = c[0];
+      line[x * 3 + 1] = c[1];
+      line[x * 3 + 2] = c[2];
+    }
+  }
+}
+
+void ExpandRowIndexedScalar(const uint8_t* smallIndices, uint8_t* line, int width, int blockSize) {
+  for (int x = 0, bx = 0; x < width; x += blockSize, ++bx) {
+    const int run = x + blockSize < width ? blockSize : width - x;
+    std::memset(line + x, smallIndices[bx], static_cast<size_t>(run));
+  }
+}
+
+// Same search as PaletteLUT::NearestIndex: the cell's candidates in index order, strict < so
+// the lowest index wins ties.
+void NearestRowScalar(const CpuKernels::LutView& lut, const uint8_t* pixels, uint8_t* out, int n) {
+  for (int i = 0; i < n; ++i) {
+    const uint8_t* c = pixels + i * 3;
+    const int cell = ((c[0] >> kShift) << (2 * CpuKernels::kLutCellBits)) |
+                     ((c[1] >> kShift) << CpuKernels::kLutCellBits) | (c[2] >> kShift);
+    const uint32_t begin = lut.cellStart[cell];
+    const uint32_t end = lut.cellStart[cell + 1];
+    int best = lut.candidates[begin];
+    if (end - begin > 1) {
+      int bestDist = 1 << 30;
+      for (uint32_t k = begin; k < end; ++k) {
+        const int idx = lut.candidates[k];
+        const uint8_t* p = lut.colors + idx * 3;
+        const int d0 = c[0] - p[0];
+        const int d1 = c[1] - p[1];
+        const int d2 = c[2] - p[2];
+        const int d = d0 * d0 + d1 * d1 + d2 * d2;
+        if (d < bestDist) {
+          bestDist = d;
+          best = idx;
+        }
+      }
+    }
+    out[i] = static_cast<uint8_t>(best);
+  }
+}
+
+// ---- Compiler baseline (universal intrinsics) ----
+#if FPW_BASELINE_SIMD
+void AccumulateRowBaseline(const uint8_t* src, uint16_t* acc, int n) {
+  int i = 0;
+  const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+  const int half = cv::VTraits<cv::v_uint16>::vlanes();
+  for (; i <= n - lanes; i += lanes) {
+    cv::v_uint16 lo, hi;
+    cv::v_expand(cv::vx_load(src + i), lo, hi);
+    cv::v_store(acc + i, cv::v_add(cv::vx_load(acc + i), lo));
+    cv::v_store(acc + i + half, cv::v_add(cv::vx_load(acc + i + half), hi));
+  }
+  cv::vx_cleanup();
+  AccumulateRowScalar(src + i, acc + i, n - i);
+}
+
+void LuminanceRowBaseline(const uint8_t* bgr, uint8_t* lum, int n) {
+  int i = 0;
+  const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+  const cv::v_float32 kr = cv::vx_setall_f32(0.299f);
+  const cv::v_float32 kg = cv::vx_setall_f32(0.587f);
+  const cv::v_float32 kb = cv::vx_setall_f32(0.114f);
+  // Separate multiplies and adds in the scalar order (no FMA), so results match bit for bit.
+  auto lum32 = [&](const cv::v_uint32& b, const cv::v_uint32& g, const cv::v_uint32& r) {
+    const cv::v_float32 fb = cv::v_cvt_f32(cv::v_reinterpret_as_s32(b));
+    const cv::v_float32 fg = cv::v_cvt_f32(cv::v_reinterpret_as_s32(g));
+    const cv::v_float32 fr = cv::v_cvt_f32(cv::v_reinterpret_as_s32(r));
+    return cv::v_trunc(cv::v_add(cv::v_add(cv::v_mul(kr, fr), cv::v_mul(kg, fg)), cv::v_mul(kb, fb)));
+  };
+  for (; i <= n - lanes; i += lanes) {
+    cv::v_uint8 b, g, r;
+    cv::v_load_deinterleave(bgr + i * 3, b, g, r);
+    cv::v_uint16 b0, b1, g0, g1, r0, r1;
+    cv::v_expand(b, b0, b1);
+    cv::v_expand(g, g0, g1);
+    cv::v_expand(r, r0, r1);
+    cv::v_uint32 b00, b01, b10, b11, g00, g01, g10, g11, r00, r01, r10, r11;
+    cv::v_expand(b0, b00, b01);
+    cv::v_expand(b1, b10, b11);
+    cv::v_expand(g0, g00, g01);
+    cv::v_expand(g1, g10, g11);
+    cv::v_expand(r0, r00, r01);
+    cv::v_expand(r1, r10, r11);
+    const cv::v_int16 lo = cv::v_pack(lum32(b00, g00, r00), lum32(b01, g01, r01));
+    const cv::v_int16 hi = cv::v_pack(lum32(b10, g10, r10), lum32(b11, g11, r11));
+    cv::v_store(lum + i, cv::v_pack_u(lo, hi));
+  }
+  cv::vx_cleanup();
+  LuminanceRowScalar(bgr + i * 3, lum + i, n - i);
+}
+
+void PairDiffRowBaseline(const uint8_t* a, const uint8_t* b, const uint8_t* lumA, const uint8_t* lumB, uint8_t* out,
+                         int n) {
+  int i = 0;
+  const int lanes = cv::VTraits<cv::v_uint8>::vlanes();
+  const cv::v_uint8 lumThr = cv::vx_setall_u8(static_cast<uchar>(CpuKernels::kOutlineLuminanceThreshold));
+  const cv::v_uint16 distThr = cv::vx_setall_u16(static_cast<ushort>(CpuKernels::kOutlineColorDistanceSq));
+  // |d| <= 255, so d² fits in 16 bits; the saturating sum of three still compares correctly
+  // against 1600.
+  auto farApart = [&](const cv::v_uint16& d0, const cv::v_uint16& d1, const cv::v_uint16& d2) {
+    const cv::v_uint16 sq = cv::v_add(cv::v_add(cv::v_mul(d0, d0), cv::v_mul(d1, d1)), cv::v_mul(d2, d2));
+    return cv::v_ge(sq, distThr);
+  };
+  for (; i <= n - lanes; i += lanes) {
+    cv::v_uint8 ab, ag, ar, bb, bg, br;
+    cv::v_load_deinterleave(a + i * 3, ab, ag, ar);
+    cv::v_load_deinterleave(b + i * 3, bb, bg, br);
+    cv::v_uint16 db0, db1, dg0, dg1, dr0, dr1;
+    cv::v_expand(cv::v_absdiff(ab, bb), db0, db1);
+    cv::v_expand(cv::v_absdiff(ag, bg), dg0, dg1);
+    cv::v_expand(cv::v_absdiff(ar, br), dr0, dr1);
+    const cv::v_uint8 color = cv::v_pack(farApart(db0, dg0, dr0), farApart(db1, dg1, dr1));
+    const cv::v_uint8 lum = cv::v_ge(cv::v_absdiff(cv::vx_load(lumA + i), cv::vx_load(lumB + i)), lumThr);
+    cv::v_store(out + i, cv::v_or(color, lum));
+  }
+  cv::vx_cleanup();
+  PairDiffRowScalar(a + i * 3, b + i * 3, lumA + i, lumB + i, out + i, n - i);
+}
+#endif
+} // namespace
+
+const CpuKernels& CpuKernelsScalar() {
+  static const CpuKernels kTable = {
+    "scalar", AccumulateRowScalar, LuminanceRowScalar, PairDiffRowScalar,
+    ExpandRowBGRScalar, ExpandRowIndexedScalar, NearestRowScalar,
+  };
+  return kTable;
+}
+
+const CpuKernels* CpuKernelsBaseline() {
+#if FPW_BASELINE_SIMD
+#if CV_NEON
+  static const char* const kName = "neon";
+#elif CV_SSE2
+  static const char* const kName = "sse2";
+#else
+  static const char* const kName = "baseline";
+#endif
+  // Expansion and the LUT walk have no universal-intrinsics version; they stay scalar here.
+  static const CpuKernels kTable = {
+    kName, AccumulateRowBaseline, LuminanceRowBaseline, PairDiffRowBaseline,
+    ExpandRowBGRScalar, ExpandRowIndexedScalar, NearestRowScalar,
+  };
+  return &kTable;
+#else
+  return nullptr;
+#endif
+}
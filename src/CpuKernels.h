@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+// CpuKernels: one instruction-set variant of the per-row inner loops behind BlockKernels,
+// OutlineKernels and PaletteLUT, as a table of plain function pointers.
+// Why this exists:
+// - One portable binary has to run on everything from old Xeons to AVX-512 machines, so
+//   nothing can be compiled with -mavx2 globally. Each variant lives in its own translation
+//   unit (CpuKernelsSSE41.cpp, ...AVX2.cpp, ...AVX512.cpp) built with that ISA's flags only,
+//   and CpuDispatch picks one table at startup.
+// - OpenCV's universal intrinsics cannot do this for us: outside OpenCV's own build they only
+//   target the compiler baseline (SSE2 / NEON). That baseline stays as its own variant.
+//
+// Rules for the ISA translation units, which must hold for the dispatch to be safe:
+// - Include only this header and the intrinsics headers. No OpenCV, no standard containers or
+//   algorithms: an inline function emitted from a -mavx2 TU may be the copy the linker keeps,
+//   and then baseline code would run AVX2 instructions.
+// - Keep every helper in an anonymous namespace; export only the table getter.
+// - No FMA contraction (-ffp-contract=off): luminance must match the scalar float expression.
+//
+// Every variant gives bit-identical results.
+struct CpuKernels {
+  // Read-only view of a PaletteLUT (see PaletteLUT.h for the cell layout).
+  struct LutView {
+    const uint8_t* colors = nullptr;     // size * 3 bytes
+    int size = 0;
+    const uint32_t* cellStart = nullptr; // kLutCells + 1 entries
+    const uint8_t* candidates = nullptr; // padded by kLutCandidatePadding readable bytes
+  };
+  static constexpr int kLutCellBits = 5;          // cells per axis = 32
+  static constexpr int kLutCandidatePadding = 3;  // 32-bit gathers of one candidate byte
+  static constexpr int kOutlineLuminanceThreshold = 35;
+  static constexpr int kOutlineColorDistanceSq = 40 * 40;
+
+  const char* name; // "scalar", "sse2", "neon", "sse4.1", "avx2", "avx512"
+
+  // acc[i] += src[i] (8-bit samples into 16-bit column sums).
+  void (*accumulateRow)(const uint8_t* src, uint16_t* acc, int n);
+  // lum[i] = (int)(0.299f * r + 0.587f * g + 0.114f * b) of BGR pixel i.
+  void (*luminanceRow)(const uint8_t* bgr, uint8_t* lum, int n);
+  // out[i] = 255 if BGR pixels a[i] and b[i] differ by >= 35 in luminance or >= 40 in RGB
+  // distance, else 0.
+  void (*pairDiffRow)(const uint8_t* a, const uint8_t* b, const uint8_t* lumA, const uint8_t* lumB,
+                      uint8_t* out, int n);
+  // First scanline of a block row: `width` output pixels, each small pixel repeated
+  // `blockSize` times (the last run cropped).
+  void (*expandRowBGR)(const uint8_t* smallBgr, uint8_t* line, int width, int blockSize);
+  void (*expandRowIndexed)(const uint8_t* smallIndices, uint8_t* line, int width, int blockSize);
+  // out[i] = PaletteLUT::NearestIndex of pixel i; `lut` must not be empty.
+  void (*nearestRow)(const LutView& lut, const uint8_t* pixels, uint8_t* out, int n);
+};
+
+// Variant tables; nullptr when the variant was not compiled for this target.
+const CpuKernels& CpuKernelsScalar();
+const CpuKernels* CpuKernelsBaseline();
+const CpuKernels* CpuKernelsSSE41();
+const CpuKernels* CpuKernelsAVX2();
+const CpuKernels* CpuKernelsAVX512();
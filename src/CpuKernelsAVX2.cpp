@@ -0,0 +1,195 @@
+// AVX2 variant of CpuKernels. Built with -mavx2 (see CMakeLists.txt); keep to the rules in
+// CpuKernels.h.
+#include "CpuKernels.h"
+
+#if defined(FPW_KERNELS_AVX2)
+#include <immintrin.h>
+
+namespace {
+constexpr int kShift = 8 - CpuKernels::kLutCellBits;
+
+// Same shuffles as the SSE4.1 variant, applied to both 128-bit lanes: lane 0 deinterleaves
+// pixels 0..7, lane 1 pixels 8..15.
+alignas(16) const int8_t kPickLo[3][16] = {
+  {0, -128, 3, -128, 6, -128, 9, -128, 12, -128, 15, -128, -128, -128, -128, -128},
+  {1, -128, 4, -128, 7, -128, 10, -128, 13, -128, -128, -128, -128, -128, -128, -128},
+  {2, -128, 5, -128, 8, -128, 11, -128, 14, -128, -128, -128, -128, -128, -128, -128},
+};
+alignas(16) const int8_t kPickHi[3][16] = {
+  {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 10, -128, 13, -128},
+  {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 8, -128, 11, -128, 14, -128},
+  {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 9, -128, 12, -128, 15, -128},
+};
+// Byte k of 32-byte chunk m of a repeated BGR pixel is channel (32m + k) % 3.
+alignas(32) const int8_t kRepeat3[3][32] = {
+  {0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1},
+  {2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0},
+  {1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2},
+};
+
+inline __m128i Load(const void* p) { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+inline __m256i Load256(const void* p) { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+inline __m256i Lanes(const uint8_t* lane0, const uint8_t* lane1) {
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(Load(lane0)), Load(lane1), 1);
+}
+
+struct Channels {
+  __m256i b, g, r; // 16 × u16
+};
+
+// 16 packed BGR pixels (48 bytes) into 16-bit channel planes.
+inline Channels Deinterleave16(const uint8_t* bgr) {
+  const __m256i lo = Lanes(bgr, bgr + 24);
+  const __m256i hi = Lanes(bgr + 8, bgr + 32);
+  auto pick = [&](int c) {
+    return _mm256_or_si256(_mm256_shuffle_epi8(lo, _mm256_broadcastsi128_si256(Load(kPickLo[c]))),
+                           _mm256_shuffle_epi8(hi, _mm256_broadcastsi128_si256(Load(kPickHi[c]))));
+  };
+  return {pick(0), pick(1), pick(2)};
+}
+
+// Luminance of 8 pixels (u32 lanes), multiplies and adds in the scalar order.
+inline __m256i Luminance8(__m256i b, __m256i g, __m256i r) {
+  const __m256 y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(0.299f), _mm256_cvtepi32_ps(r)),
+                                               _mm256_mul_ps(_mm256_set1_ps(0.587f), _mm256_cvtepi32_ps(g))),
+                                 _mm256_mul_ps(_mm256_set1_ps(0.114f), _mm256_cvtepi32_ps(b)));
+  return _mm256_cvttps_epi32(y);
+}
+
+// 16 u16 lanes (values <= 255) to 16 bytes in order.
+inline __m128i Narrow16(__m256i v) {
+  return _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+void AccumulateRow(const uint8_t* src, uint16_t* acc, int n) {
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i s = Load256(src + i);
+    __m256i* a = reinterpret_cast<__m256i*>(acc + i);
+    _mm256_storeu_si256(a, _mm256_add_epi16(_mm256_loadu_si256(a), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(s))));
+    _mm256_storeu_si256(a + 1, _mm256_add_epi16(_mm256_loadu_si256(a + 1),
+                                                _mm256_cvtepu8_epi16(_mm256_extracti128_si256(s, 1))));
+  }
+  CpuKernelsScalar().accumulateRow(src + i, acc + i, n - i);
+}
+
+void LuminanceRow(const uint8_t* bgr, uint8_t* lum, int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const Channels c = Deinterleave16(bgr + i * 3);
+    auto half = [](__m256i v, int part) {
+      return _mm256_cvtepu16_epi32(part == 0 ? _mm256_castsi256_si128(v) : _mm256_extracti128_si256(v, 1));
+    };
+    const __m256i lo = Luminance8(half(c.b, 0), half(c.g, 0), half(c.r, 0));
+    const __m256i hi = Luminance8(half(c.b, 1), half(c.g, 1), half(c.r, 1));
+    // packus interleaves 128-bit lanes; the permute restores pixel order.
+    const __m256i y16 = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lum + i), Narrow16(y16));
+  }
+  CpuKernelsScalar().luminanceRow(bgr + i * 3, lum + i, n - i);
+}
+
+void PairDiffRow(const uint8_t* a, const uint8_t* b, const uint8_t* lumA, const uint8_t* lumB, uint8_t* out,
+                 int n) {
+  const __m256i distThr = _mm256_set1_epi16(static_cast<short>(CpuKernels::kOutlineColorDistanceSq));
+  const __m128i lumThr = _mm_set1_epi8(static_cast<char>(CpuKernels::kOutlineLuminanceThreshold));
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const Channels ca = Deinterleave16(a + i * 3);
+    const Channels cb = Deinterleave16(b + i * 3);
+    // |d| <= 255, so d² fits in 16 unsigned bits; the saturating sum still compares correctly.
+    const __m256i d0 = _mm256_abs_epi16(_mm256_sub_epi16(ca.b, cb.b));
+    const __m256i d1 = _mm256_abs_epi16(_mm256_sub_epi16(ca.g, cb.g));
+    const __m256i d2 = _mm256_abs_epi16(_mm256_sub_epi16(ca.r, cb.r));
+    const __m256i sq = _mm256_adds_epu16(_mm256_adds_epu16(_mm256_mullo_epi16(d0, d0), _mm256_mullo_epi16(d1, d1)),
+                                         _mm256_mullo_epi16(d2, d2));
+    const __m256i color = _mm256_cmpeq_epi16(_mm256_max_epu16(sq, distThr), sq);
+    const __m128i la = Load(lumA + i);
+    const __m128i lb = Load(lumB + i);
+    const __m128i dl = _mm_or_si128(_mm_subs_epu8(la, lb), _mm_subs_epu8(lb, la));
+    const __m128i lum = _mm_cmpeq_epi8(_mm_max_epu8(dl, lumThr), dl);
+    const __m128i color8 = _mm_packs_epi16(_mm256_castsi256_si128(color), _mm256_extracti128_si256(color, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(color8, lum));
+  }
+  CpuKernelsScalar().pairDiffRow(a + i * 3, b + i * 3, lumA + i, lumB + i, out + i, n - i);
+}
+
+// Same scheme as the SSE4.1 variant with 32-byte stores.
+void ExpandRowBGR(const uint8_t* smallBgr, uint8_t* line, int width, int blockSize) {
+  const int lineBytes = width * 3;
+  const __m256i repeat[3] = {Load256(kRepeat3[0]), Load256(kRepeat3[1]), Load256(kRepeat3[2])};
+  for (int x = 0, bx = 0; x < width; x += blockSize, ++bx) {
+    const uint8_t* c = smallBgr + bx * 3;
+    const __m256i pixel = _mm256_set1_epi32(c[0] | (c[1] << 8) | (c[2] << 16));
+    const int start = x * 3;
+    const int bytes = (x + blockSize < width ? blockSize : width - x) * 3;
+    int o = 0;
+    for (int m = 0; o < bytes && start + o + 32 <= lineBytes; o += 32, m = m == 2 ? 0 : m + 1) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(line + start + o), _mm256_shuffle_epi8(pixel, repeat[m]));
+    }
+    for (; o < bytes; ++o) line[start + o] = c[o % 3];
+  }
+}
+
+void ExpandRowIndexed(const uint8_t* smallIndices, uint8_t* line, int width, int blockSize) {
+  for (int x = 0, bx = 0; x < width; x += blockSize, ++bx) {
+    const __m256i v = _mm256_set1_epi8(static_cast<char>(smallIndices[bx]));
+    const int end = x + blockSize < width ? x + blockSize : width;
+    int o = x;
+    for (; o < end && o + 32 <= width; o += 32) _mm256_storeu_si256(reinterpret_cast<__m256i*>(line + o), v);
+    for (; o < end; ++o) line[o] = smallIndices[bx];
+  }
+}
+
+// 8 pixels at a time: cell indices in vector lanes, then gathers of the cell ranges and of the
+// first candidate. Lanes whose cell has a single candidate (most of them) are done; the rest
+// go through the scalar search.
+void NearestRow(const CpuKernels::LutView& lut, const uint8_t* pixels, uint8_t* out, int n) {
+  const CpuKernels& scalar = CpuKernelsScalar();
+  const int* cellStart = reinterpret_cast<const int*>(lut.cellStart);
+  const int* candidates = reinterpret_cast<const int*>(lut.candidates);
+  const __m128i pickLo[3] = {Load(kPickLo[0]), Load(kPickLo[1]), Load(kPickLo[2])};
+  const __m128i pickHi[3] = {Load(kPickHi[0]), Load(kPickHi[1]), Load(kPickHi[2])};
+  const __m256i one = _mm256_set1_epi32(1);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const uint8_t* p = pixels + i * 3;
+    const __m128i lo = Load(p);
+    const __m128i hi = Load(p + 8);
+    __m256i ch[3];
+    for (int c = 0; c < 3; ++c) {
+      const __m128i v = _mm_or_si128(_mm_shuffle_epi8(lo, pickLo[c]), _mm_shuffle_epi8(hi, pickHi[c]));
+      ch[c] = _mm256_srli_epi32(_mm256_cvtepu16_epi32(v), kShift);
+    }
+    const __m256i cell = _mm256_or_si256(
+        _mm256_or_si256(_mm256_slli_epi32(ch[0], 2 * CpuKernels::kLutCellBits),
+                        _mm256_slli_epi32(ch[1], CpuKernels::kLutCellBits)),
+        ch[2]);
+    const __m256i begin = _mm256_i32gather_epi32(cellStart, cell, 4);
+    const __m256i end = _mm256_i32gather_epi32(cellStart + 1, cell, 4);
+    // Reads 4 bytes at candidates + begin; the LUT pads its candidate list for this.
+    const __m256i first = _mm256_and_si256(_mm256_i32gather_epi32(candidates, begin, 1), _mm256_set1_epi32(0xFF));
+    const int single = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_sub_epi32(end, begin), one)));
+
+    const __m128i idx16 = _mm_packus_epi32(_mm256_castsi256_si128(first), _mm256_extracti128_si256(first, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(idx16, idx16));
+    if (single != 0xFF) {
+      for (int k = 0; k < 8; ++k) {
+        if (!(single & (1 << k))) scalar.nearestRow(lut, p + k * 3, out + i + k, 1);
+      }
+    }
+  }
+  scalar.nearestRow(lut, pixels + i * 3, out + i, n - i);
+}
+} // namespace
+
+const CpuKernels* CpuKernelsAVX2() {
+  static const CpuKernels kTable = {
+    "avx2", AccumulateRow, LuminanceRow, PairDiffRow,
+    ExpandRowBGR, ExpandRowIndexed, NearestRow,
+  };
+  return &kTable;
+}
+#else
+const CpuKernels* CpuKernelsAVX2() { return nullptr; }
+#endif
@@ -0,0 +1,119 @@
+// AVX-512 (F + BW + VL) variant of CpuKernels. Built with -mavx512f -mavx512bw -mavx512vl (see
+// CMakeLists.txt); keep to the rules in CpuKernels.h.
+#include "CpuKernels.h"
+
+#if defined(FPW_KERNELS_AVX512)
+#include <immintrin.h>
+
+namespace {
+// Same shuffles as the SSE4.1 variant, applied to all four 128-bit lanes: lane k deinterleaves
+// pixels 8k..8k+7.
+alignas(16) const int8_t kPickLo[3][16] = {
+  {0, -128, 3, -128, 6, -128, 9, -128, 12, -128, 15, -128, -128, -128, -128, -128},
+  {1, -128, 4, -128, 7, -128, 10, -128, 13, -128, -128, -128, -128, -128, -128, -128},
+  {2, -128, 5, -128, 8, -128, 11, -128, 14, -128, -128, -128, -128, -128, -128, -128},
+};
+alignas(16) const int8_t kPickHi[3][16] = {
+  {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 10, -128, 13, -128},
+  {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 8, -128, 11, -128, 14, -128},
+  {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 9, -128, 12, -128, 15, -128},
+};
+
+inline __m128i Load(const void* p) { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+inline __m256i Load256(const void* p) { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+// Lane k is the 16 bytes at base + 24k.
+inline __m512i Lanes(const uint8_t* base) {
+  const __m256i lo = _mm256_inserti128_si256(_mm256_castsi128_si256(Load(base)), Load(base + 24), 1);
+  const __m256i hi = _mm256_inserti128_si256(_mm256_castsi128_si256(Load(base + 48)), Load(base + 72), 1);
+  return _mm512_inserti64x4(_mm512_castsi256_si512(lo), hi, 1);
+}
+
+struct Channels {
+  __m512i b, g, r; // 32 × u16
+};
+
+// 32 packed BGR pixels (96 bytes) into 16-bit channel planes.
+inline Channels Deinterleave32(const uint8_t* bgr) {
+  const __m512i lo = Lanes(bgr);
+  const __m512i hi = Lanes(bgr + 8);
+  auto pick = [&](int c) {
+    return _mm512_or_si512(_mm512_shuffle_epi8(lo, _mm512_broadcast_i32x4(Load(kPickLo[c]))),
+                           _mm512_shuffle_epi8(hi, _mm512_broadcast_i32x4(Load(kPickHi[c]))));
+  };
+  return {pick(0), pick(1), pick(2)};
+}
+
+// Luminance of 16 pixels (u16 lanes in, bytes out), multiplies and adds in the scalar order.
+inline __m128i Luminance16(__m256i b, __m256i g, __m256i r) {
+  const __m512 y = _mm512_add_ps(
+      _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(0.299f), _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(r))),
+                    _mm512_mul_ps(_mm512_set1_ps(0.587f), _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(g)))),
+      _mm512_mul_ps(_mm512_set1_ps(0.114f), _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(b))));
+  return _mm512_cvtepi32_epi8(_mm512_cvttps_epi32(y));
+}
+
+void AccumulateRow(const uint8_t* src, uint16_t* acc, int n) {
+  int i = 0;
+  for (; i + 64 <= n; i += 64) {
+    const __m512i s = _mm512_loadu_si512(src + i);
+    uint16_t* a = acc + i;
+    _mm512_storeu_si512(a, _mm512_add_epi16(_mm512_loadu_si512(a), _mm512_cvtepu8_epi16(_mm512_castsi512_si256(s))));
+    _mm512_storeu_si512(a + 32, _mm512_add_epi16(_mm512_loadu_si512(a + 32),
+                                                 _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(s, 1))));
+  }
+  CpuKernelsScalar().accumulateRow(src + i, acc + i, n - i);
+}
+
+void LuminanceRow(const uint8_t* bgr, uint8_t* lum, int n) {
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const Channels c = Deinterleave32(bgr + i * 3);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lum + i),
+                     Luminance16(_mm512_castsi512_si256(c.b), _mm512_castsi512_si256(c.g),
+                                 _mm512_castsi512_si256(c.r)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lum + i + 16),
+                     Luminance16(_mm512_extracti64x4_epi64(c.b, 1), _mm512_extracti64x4_epi64(c.g, 1),
+                                 _mm512_extracti64x4_epi64(c.r, 1)));
+  }
+  CpuKernelsScalar().luminanceRow(bgr + i * 3, lum + i, n - i);
+}
+
+void PairDiffRow(const uint8_t* a, const uint8_t* b, const uint8_t* lumA, const uint8_t* lumB, uint8_t* out,
+                 int n) {
+  const __m512i distThr = _mm512_set1_epi16(static_cast<short>(CpuKernels::kOutlineColorDistanceSq));
+  const __m256i lumThr = _mm256_set1_epi8(static_cast<char>(CpuKernels::kOutlineLuminanceThreshold));
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const Channels ca = Deinterleave32(a + i * 3);
+    const Channels cb = Deinterleave32(b + i * 3);
+    // |d| <= 255, so d² fits in 16 unsigned bits; the saturating sum still compares correctly.
+    const __m512i d0 = _mm512_abs_epi16(_mm512_sub_epi16(ca.b, cb.b));
+    const __m512i d1 = _mm512_abs_epi16(_mm512_sub_epi16(ca.g, cb.g));
+    const __m512i d2 = _mm512_abs_epi16(_mm512_sub_epi16(ca.r, cb.r));
+    const __m512i sq = _mm512_adds_epu16(_mm512_adds_epu16(_mm512_mullo_epi16(d0, d0), _mm512_mullo_epi16(d1, d1)),
+                                         _mm512_mullo_epi16(d2, d2));
+    const __mmask32 color = _mm512_cmpge_epu16_mask(sq, distThr);
+    const __m256i la = Load256(lumA + i);
+    const __m256i lb = Load256(lumB + i);
+    const __m256i dl = _mm256_or_si256(_mm256_subs_epu8(la, lb), _mm256_subs_epu8(lb, la));
+    const __mmask32 lum = _mm256_cmpge_epu8_mask(dl, lumThr);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_movm_epi8(color | lum));
+  }
+  CpuKernelsScalar().pairDiffRow(a + i * 3, b + i * 3, lumA + i, lumB + i, out + i, n - i);
+}
+} // namespace
+
+const CpuKernels* CpuKernelsAVX512() {
+  // Expansion writes block-sized runs and the LUT walk is gather-bound: 64-byte vectors gain
+  // nothing over the AVX2 versions, which this table reuses.
+  const CpuKernels* avx2 = CpuKernelsAVX2();
+  if (!avx2) return nullptr;
+  static const CpuKernels kTable = {
+    "avx512", AccumulateRow, LuminanceRow, PairDiffRow,
+    avx2->expandRowBGR, avx2->expandRowIndexed, avx2->nearestRow,
+  };
+  return &kTable;
+}
+#else
+const CpuKernels* CpuKernelsAVX512() { return nullptr; }
+#endif
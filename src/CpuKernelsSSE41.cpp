@@ -0,0 +1,141 @@
+// SSE4.1 variant of CpuKernels. Built with -msse4.1 (see CMakeLists.txt); keep to the rules in
+// CpuKernels.h.
+#include "CpuKernels.h"
+
+#if defined(FPW_KERNELS_SSE41)
+#include <smmintrin.h>
+
+namespace {
+// Byte shuffles that move channel c of 8 packed BGR pixels (24 bytes) into 16-bit lanes.
+// Byte 3k + c of pixel k comes from `lo` (bytes 0..15) when it is < 16, else from `hi`
+// (bytes 8..23), so both loads stay inside the 24 bytes.
+alignas(16) const int8_t kPickLo[3][16] = {
+  {0, -128, 3, -128, 6, -128, 9, -128, 12, -128, 15, -128, -128, -128, -128, -128},
+  {1, -128, 4, -128, 7, -128, 10, -128, 13, -128, -128, -128, -128, -128, -128, -128},
+  {2, -128, 5, -128, 8, -128, 11, -128, 14, -128, -128, -128, -128, -128, -128, -128},
+};
+alignas(16) const int8_t kPickHi[3][16] = {
+  {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 10, -128, 13, -128},
+  {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 8, -128, 11, -128, 14, -128},
+  {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, 9, -128, 12, -128, 15, -128},
+};
+// Byte k of 16-byte chunk m of a repeated BGR pixel is channel (16m + k) % 3.
+alignas(16) const int8_t kRepeat3[3][16] = {
+  {0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0},
+  {1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1},
+  {2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2},
+};
+
+inline __m128i Load(const void* p) { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+
+struct Channels {
+  __m128i b, g, r; // 8 × u16
+};
+
+inline Channels Deinterleave8(const uint8_t* bgr) {
+  const __m128i lo = Load(bgr);
+  const __m128i hi = Load(bgr + 8);
+  Channels c;
+  c.b = _mm_or_si128(_mm_shuffle_epi8(lo, Load(kPickLo[0])), _mm_shuffle_epi8(hi, Load(kPickHi[0])));
+  c.g = _mm_or_si128(_mm_shuffle_epi8(lo, Load(kPickLo[1])), _mm_shuffle_epi8(hi, Load(kPickHi[1])));
+  c.r = _mm_or_si128(_mm_shuffle_epi8(lo, Load(kPickLo[2])), _mm_shuffle_epi8(hi, Load(kPickHi[2])));
+  return c;
+}
+
+// Luminance of 4 pixels (u32 lanes), multiplies and adds in the scalar order.
+inline __m128i Luminance4(__m128i b, __m128i g, __m128i r) {
+  const __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.299f), _mm_cvtepi32_ps(r)),
+                                         _mm_mul_ps(_mm_set1_ps(0.587f), _mm_cvtepi32_ps(g))),
+                              _mm_mul_ps(_mm_set1_ps(0.114f), _mm_cvtepi32_ps(b)));
+  return _mm_cvttps_epi32(y);
+}
+
+void AccumulateRow(const uint8_t* src, uint16_t* acc, int n) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i s = Load(src + i);
+    __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+    _mm_storeu_si128(a, _mm_add_epi16(_mm_loadu_si128(a), _mm_cvtepu8_epi16(s)));
+    _mm_storeu_si128(a + 1, _mm_add_epi16(_mm_loadu_si128(a + 1), _mm_cvtepu8_epi16(_mm_srli_si128(s, 8))));
+  }
+  CpuKernelsScalar().accumulateRow(src + i, acc + i, n - i);
+}
+
+void LuminanceRow(const uint8_t* bgr, uint8_t* lum, int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const Channels c = Deinterleave8(bgr + i * 3);
+    const __m128i lo = Luminance4(_mm_cvtepu16_epi32(c.b), _mm_cvtepu16_epi32(c.g), _mm_cvtepu16_epi32(c.r));
+    const __m128i hi = Luminance4(_mm_cvtepu16_epi32(_mm_srli_si128(c.b, 8)),
+                                  _mm_cvtepu16_epi32(_mm_srli_si128(c.g, 8)),
+                                  _mm_cvtepu16_epi32(_mm_srli_si128(c.r, 8)));
+    const __m128i y16 = _mm_packus_epi32(lo, hi);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(lum + i), _mm_packus_epi16(y16, y16));
+  }
+  CpuKernelsScalar().luminanceRow(bgr + i * 3, lum + i, n - i);
+}
+
+void PairDiffRow(const uint8_t* a, const uint8_t* b, const uint8_t* lumA, const uint8_t* lumB, uint8_t* out,
+                 int n) {
+  const __m128i distThr = _mm_set1_epi16(static_cast<short>(CpuKernels::kOutlineColorDistanceSq));
+  const __m128i lumThr = _mm_set1_epi8(static_cast<char>(CpuKernels::kOutlineLuminanceThreshold));
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const Channels ca = Deinterleave8(a + i * 3);
+    const Channels cb = Deinterleave8(b + i * 3);
+    // |d| <= 255, so d² fits in 16 unsigned bits; the saturating sum still compares correctly.
+    const __m128i d0 = _mm_abs_epi16(_mm_sub_epi16(ca.b, cb.b));
+    const __m128i d1 = _mm_abs_epi16(_mm_sub_epi16(ca.g, cb.g));
+    const __m128i d2 = _mm_abs_epi16(_mm_sub_epi16(ca.r, cb.r));
+    const __m128i sq = _mm_adds_epu16(_mm_adds_epu16(_mm_mullo_epi16(d0, d0), _mm_mullo_epi16(d1, d1)),
+                                      _mm_mullo_epi16(d2, d2));
+    const __m128i color = _mm_cmpeq_epi16(_mm_max_epu16(sq, distThr), sq);
+    const __m128i la = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(lumA + i));
+    const __m128i lb = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(lumB + i));
+    const __m128i dl = _mm_or_si128(_mm_subs_epu8(la, lb), _mm_subs_epu8(lb, la));
+    const __m128i lum = _mm_cmpeq_epi8(_mm_max_epu8(dl, lumThr), dl);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(_mm_packs_epi16(color, color), lum));
+  }
+  CpuKernelsScalar().pairDiffRow(a + i * 3, b + i * 3, lumA + i, lumB + i, out + i, n - i);
+}
+
+// One 16-byte store per 16 bytes of block. A store may run past its block; the next block
+// then overwrites that part. Stores that would leave the line fall back to bytes.
+void ExpandRowBGR(const uint8_t* smallBgr, uint8_t* line, int width, int blockSize) {
+  const int lineBytes = width * 3;
+  const __m128i repeat[3] = {Load(kRepeat3[0]), Load(kRepeat3[1]), Load(kRepeat3[2])};
+  for (int x = 0, bx = 0; x < width; x += blockSize, ++bx) {
+    const uint8_t* c = smallBgr + bx * 3;
+    const __m128i pixel = _mm_set1_epi32(c[0] | (c[1] << 8) | (c[2] << 16));
+    const int start = x * 3;
+    const int bytes = (x + blockSize < width ? blockSize : width - x) * 3;
+    int o = 0;
+    for (int m = 0; o < bytes && start + o + 16 <= lineBytes; o += 16, m = m == 2 ? 0 : m + 1) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(line + start + o), _mm_shuffle_epi8(pixel, repeat[m]));
+    }
+    for (; o < bytes; ++o) line[start + o] = c[o % 3];
+  }
+}
+
+void ExpandRowIndexed(const uint8_t* smallIndices, uint8_t* line, int width, int blockSize) {
+  for (int x = 0, bx = 0; x < width; x += blockSize, ++bx) {
+    const __m128i v = _mm_set1_epi8(static_cast<char>(smallIndices[bx]));
+    const int end = x + blockSize < width ? x + blockSize : width;
+    int o = x;
+    for (; o < end && o + 16 <= width; o += 16) _mm_storeu_si128(reinterpret_cast<__m128i*>(line + o), v);
+    for (; o < end; ++o) line[o] = smallIndices[bx];
+  }
+}
+} // namespace
+
+const CpuKernels* CpuKernelsSSE41() {
+  // No gathers before AVX2: the LUT walk stays scalar.
+  static const CpuKernels kTable = {
+    "sse4.1", AccumulateRow, LuminanceRow, PairDiffRow,
+    ExpandRowBGR, ExpandRowIndexed, CpuKernelsScalar().nearestRow,
+  };
+  return &kTable;
+}
+#else
+const CpuKernels* CpuKernelsSSE41() { return nullptr; }
+#endif
@@ -0,0 +1,159 @@
+#include "ErrorDiffusion.h"
+
+#include "ProcessContext.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+// Floyd-Steinberg weights (for a left-to-right row; mirrored when scanning right-to-left):
+//    X   7/16
+// 3/16 5/16 1/16
+constexpr float kRight = 7.0f / 16.0f;
+constexpr float kDownBack = 3.0f / 16.0f;
+constexpr float kDown = 5.0f / 16.0f;
+constexpr float kDownAhead = 1.0f / 16.0f;
+
+// Wavefront mode only pays off once rows are long compared to the lag between them.
+constexpr int kMinParallelCols = 128;
+constexpr int kMinParallelRows = 16;
+// Longest span between two progress updates (fewer atomic stores, slightly more lag).
+constexpr int kProgressStep = 16;
+
+inline float Clamp255(float v) {
+  return v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+}
+
+// Error rows are padded by one pixel on each side, so diffusion never needs a bounds check;
+// error pushed into the padding is dropped, exactly like error leaving the image.
+inline int ErrorRowFloats(int cols) { return (cols + 2) * 3; }
+
+// Dithers pixels [begin, end) of one row (left-to-right indices; scanned right-to-left when
+// `reverse`). `errIn` holds the error diffused into this row from the row above; the row adds
+// its own error into `errOut` (which must start zeroed). `carry` is the error travelling along
+// the row, so a row may be processed in consecutive spans (zero it at the start of the row).
+void DitherSpan(const cv::Vec3b* src, uchar* dst, const float* errIn, float* errOut, int begin,
+                int end, bool reverse, const PaletteLUT& lut, float carry[3]) {
+  const int step = reverse ? -1 : 1;
+  const int count = end - begin;
+  int x = reverse ? end - 1 : begin;
+
+  for (int i = 0; i < count; ++i, x += step) {
+    const float* in = errIn + (x + 1) * 3;
+    const float v0 = Clamp255(static_cast<float>(src[x][0]) + in[0] + carry[0]);
+    const float v1 = Clamp255(static_cast<float>(src[x][1]) + in[1] + carry[1]);
+    const float v2 = Clamp255(static_cast<float>(src[x][2]) + in[2] + carry[2]);
+
+    const cv::Vec3b q(static_cast<uchar>(v0 + 0.5f), static_cast<uchar>(v1 + 0.5f),
+                      static_cast<uchar>(v2 + 0.5f));
+    const int idx = lut.NearestIndex(q);
+    const cv::Vec3b& c = lut.Colors()[static_cast<size_t>(idx)];
+    dst[x] = static_cast<uchar>(idx);
+
+    const float e0 = v0 - static_cast<float>(c[0]);
+    const float e1 = v1 - static_cast<float>(c[1]);
+    const float e2 = v2 - static_cast<float>(c[2]);
+
+    float* back = errOut + (x + 1 - step) * 3;
+    float* down = errOut + (x + 1) * 3;
+    float* ahead = errOut + (x + 1 + step) * 3;
+    back[0] += e0 * kDownBack;   back[1] += e1 * kDownBack;   back[2] += e2 * kDownBack;
+    down[0] += e0 * kDown;       down[1] += e1 * kDown;       down[2] += e2 * kDown;
+    ahead[0] += e0 * kDownAhead; ahead[1] += e1 * kDownAhead; ahead[2] += e2 * kDownAhead;
+    carry[0] = e0 * kRight;
+    carry[1] = e1 * kRight;
+    carry[2] = e2 * kRight;
+  }
+}
+
+cv::Mat DitherSerial(const cv::Mat& src, const PaletteLUT& lut, bool serpentine, ProcessContext* context) {
+  cv::Mat dst = ProcessContext::Scratch(context, ProcessContext::Slot::Indices, src.rows, src.cols, CV_8UC1);
+  const int floats = ErrorRowFloats(src.cols);
+  std::vector<float> cur(static_cast<size_t>(floats), 0.0f);
+  std::vector<float> next(static_cast<size_t>(floats), 0.0f);
+
+  for (int y = 0; y < src.rows; ++y) {
+    const bool reverse = serpentine && (y & 1) != 0;
+    float carry[3] = {0.0f, 0.0f, 0.0f};
+    DitherSpan(src.ptr<cv::Vec3b>(y), dst.ptr<uchar>(y), cur.data(), next.data(), 0, src.cols,
+               reverse, lut, carry);
+    cur.swap(next);
+    std::fill(next.begin(), next.end(), 0.0f);
+  }
+  return dst;
+}
+
+// Wavefront raster scan. Workers claim rows in increasing order from a shared counter, so any
+// row a worker waits on has already been claimed by a running worker (no deadlock, whatever
+// number of threads parallel_for_ actually provides). Row y reads error ring slot y % K and
+// writes slot (y + 1) % K; that slot is reused only once its previous reader has finished.
+cv::Mat DitherWavefront(const cv::Mat& src, const PaletteLUT& lut, int threads, ProcessContext* context) {
+  cv::Mat dst = ProcessContext::Scratch(context, ProcessContext::Slot::Indices, src.rows, src.cols, CV_8UC1);
+  const int rows = src.rows;
+  const int cols = src.cols;
+  const int floats = ErrorRowFloats(cols);
+  const int ringSize = threads + 2;
+
+  std::vector<float> ring(static_cast<size_t>(floats) * static_cast<size_t>(ringSize), 0.0f);
+  std::unique_ptr<std::atomic<int>[]> progress(new std::atomic<int>[static_cast<size_t>(rows)]);
+  for (int y = 0; y < rows; ++y) progress[y].store(0, std::memory_order_relaxed);
+  std::atomic<int> nextRow{0};
+
+  auto slot = [&](int y) { return ring.data() + static_cast<size_t>(y % ringSize) * floats; };
+  auto waitFor = [&](int y, int count) {
+    int seen = progress[y].load(std::memory_order_acquire);
+    while (seen < count) {
+      std::this_thread::yield();
+      seen = progress[y].load(std::memory_order_acquire);
+    }
+    return seen;
+  };
+
+  cv::parallel_for_(cv::Range(0, threads), [&](const cv::Range&) {
+    for (;;) {
+      const int y = nextRow.fetch_add(1, std::memory_order_relaxed);
+      if (y >= rows) return;
+
+      // The output slot was last read by row y + 1 - K; zero it once that row is done.
+      float* errOut = slot(y + 1);
+      if (y + 1 - ringSize >= 0) waitFor(y + 1 - ringSize, cols);
+      std::memset(errOut, 0, static_cast<size_t>(floats) * sizeof(float));
+      const float* errIn = slot(y);
+
+      // Pixel x needs the row above to have diffused from x + 1 (i.e. finished x + 2 pixels).
+      // Process the row in spans, each gated by how far the row above has got.
+      const cv::Vec3b* srcRow = src.ptr<cv::Vec3b>(y);
+      uchar* dstRow = dst.ptr<uchar>(y);
+      float carry[3] = {0.0f, 0.0f, 0.0f};
+      int x = 0;
+      while (x < cols) {
+        int end = cols;
+        if (y > 0) {
+          const int above = waitFor(y - 1, std::min(cols, x + 2));
+          end = (above >= cols) ? cols : above - 1;
+        }
+        end = std::min(end, x + kProgressStep);
+        DitherSpan(srcRow, dstRow, errIn, errOut, x, end, false, lut, carry);
+        x = end;
+        progress[y].store(x, std::memory_order_release);
+      }
+    }
+  }, threads);
+  return dst;
+}
+} // namespace
+
+cv::Mat ErrorDiffusion::FloydSteinberg(const cv::Mat& src8u3, const PaletteLUT& lut, const Options& options) {
+  if (src8u3.empty() || src8u3.type() != CV_8UC3 || lut.empty()) return {};
+
+  const int threads = std::max(1, cv::getNumThreads());
+  const bool wavefront = options.parallel && !options.serpentine && threads > 1 &&
+                         src8u3.cols >= kMinParallelCols && src8u3.rows >= kMinParallelRows;
+  return wavefront ? DitherWavefront(src8u3, lut, std::min(threads, src8u3.rows), options.context)
+                   : DitherSerial(src8u3, lut, options.serpentine, options.context);
+}
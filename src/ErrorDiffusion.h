@@ -0,0 +1,31 @@
+#pragma once
+
+#include "PaletteLUT.h"
+
+#include <opencv2/core.hpp>
+
+class ProcessContext;
+
+// ErrorDiffusion: Floyd-Steinberg dithering onto a fixed palette.
+// Why this exists (instead of diffusing error back into the 8-bit image):
+// - Pending error lives in two rolling float rows (current / next), so nothing is clamped or
+//   truncated while it is being spread; only the value that is looked up gets clamped.
+//   The old in-place version lost up to 1 LSB per neighbour update and paid 12 clamps per pixel.
+// - Optional serpentine scanning (alternate row direction) breaks up the diagonal "worm"
+//   artifacts of a plain raster scan.
+// - Raster scans of wide images can run as a wavefront: row y only needs row y-1 to be two
+//   pixels ahead, so several rows are dithered at once, each trailing the one above. The
+//   result is bit-identical to the single-threaded raster scan.
+class ErrorDiffusion {
+public:
+  struct Options {
+    bool serpentine = false; // alternate scan direction per row (always single-threaded)
+    bool parallel = true;    // allow the wavefront mode for raster scans of large images
+    ProcessContext* context = nullptr; // optional: the result lives in its Indices slot
+  };
+
+  // Dithers an 8-bit 3-channel image onto the palette behind `lut` (distances in the image's
+  // channel order) and returns the chosen palette index of every pixel (CV_8UC1).
+  // Returns an empty Mat for empty / non-CV_8UC3 input or an empty LUT.
+  static cv::Mat FloydSteinberg(const cv::Mat& src8u3, const PaletteLUT& lut, const Options& options);
+};
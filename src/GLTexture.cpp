@@ -1,6 +1,9 @@
 #include "GLTexture.h"
 
-#include <opencv2/imgproc.hpp>
+#include "GpuProcessor.h"
+
+#include <cstdint>
+#include <cstdlib>
 
 // Include GL headers *only* in the .cpp to keep headers portable/clean.
 #if defined(_WIN32)
@@ -8,11 +11,107 @@
 #endif
 #include <GL/gl.h>
 
+// The buffer object entry points are not exported by opengl32.lib / libGL on every platform;
+// GLFW resolves them for the current context.
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
 #ifndef GL_CLAMP_TO_EDGE
 // Windows' legacy <GL/gl.h> (OpenGL 1.1) may not define newer constants.
 // GL_CLAMP_TO_EDGE is widely supported by drivers and required to avoid edge sampling artifacts.
 #define GL_CLAMP_TO_EDGE 0x812F
 #endif
+// OpenGL 1.2 pixel formats (EXT_bgra in the 1.1 header).
+#ifndef GL_BGR
+#define GL_BGR 0x80E0
+#endif
+#ifndef GL_BGRA
+#define GL_BGRA 0x80E1
+#endif
+// OpenGL 1.5 / 2.1 buffer objects.
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+#ifndef GL_WRITE_ONLY
+#define GL_WRITE_ONLY 0x88B9
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+namespace {
+struct BufferApi {
+  typedef void(APIENTRY* GenBuffers)(GLsizei, GLuint*);
+  typedef void(APIENTRY* DeleteBuffers)(GLsizei, const GLuint*);
+  typedef void(APIENTRY* BindBuffer)(GLenum, GLuint);
+  typedef void(APIENTRY* BufferData)(GLenum, ptrdiff_t, const void*, GLenum);
+  typedef void*(APIENTRY* MapBuffer)(GLenum, GLenum);
+  typedef GLboolean(APIENTRY* UnmapBuffer)(GLenum);
+
+  GenBuffers genBuffers = nullptr;
+  DeleteBuffers deleteBuffers = nullptr;
+  BindBuffer bindBuffer = nullptr;
+  BufferData bufferData = nullptr;
+  MapBuffer mapBuffer = nullptr;
+  UnmapBuffer unmapBuffer = nullptr;
+  bool available = false;
+};
+
+template <typename Fn>
+Fn LoadProc(const char* name, const char* arbName) {
+  GLFWglproc p = glfwGetProcAddress(name);
+  if (!p) p = glfwGetProcAddress(arbName);
+  return reinterpret_cast<Fn>(p);
+}
+
+// Resolved once, on the first upload (the app has a single GL context).
+const BufferApi& Buffers() {
+  static const BufferApi api = [] {
+    BufferApi a;
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    const double v = version ? std::atof(version) : 0.0;
+    if (v < 2.1 && !glfwExtensionSupported("GL_ARB_pixel_buffer_object")) return a;
+    // FPW_NO_PBO=1 forces the direct path (driver troubleshooting).
+    const char* off = std::getenv("FPW_NO_PBO");
+    if (off && off[0] == '1') return a;
+
+    a.genBuffers = LoadProc<BufferApi::GenBuffers>("glGenBuffers", "glGenBuffersARB");
+    a.deleteBuffers = LoadProc<BufferApi::DeleteBuffers>("glDeleteBuffers", "glDeleteBuffersARB");
+    a.bindBuffer = LoadProc<BufferApi::BindBuffer>("glBindBuffer", "glBindBufferARB");
+    a.bufferData = LoadProc<BufferApi::BufferData>("glBufferData", "glBufferDataARB");
+    a.mapBuffer = LoadProc<BufferApi::MapBuffer>("glMapBuffer", "glMapBufferARB");
+    a.unmapBuffer = LoadProc<BufferApi::UnmapBuffer>("glUnmapBuffer", "glUnmapBufferARB");
+    a.available = a.genBuffers && a.deleteBuffers && a.bindBuffer && a.bufferData && a.mapBuffer &&
+                  a.unmapBuffer;
+    return a;
+  }();
+  return api;
+}
+
+// Streaming pixel buffers shared by every GLTexture (0 when not created yet), used alternately.
+struct StreamBuffers {
+  GLuint ids[2] = {0, 0};
+  int next = 0;
+};
+
+StreamBuffers& Streams() {
+  static StreamBuffers buffers;
+  return buffers;
+}
+
+// GL client format of an accepted input type; 0 for other types.
+GLenum UploadFormat(int type) {
+  switch (type) {
+  case CV_8UC3: return GL_BGR; // OpenCV default channel order
+  case CV_8UC4: return GL_BGRA;
+  case CV_8UC1: return GL_LUMINANCE; // expands to (L, L, L, 1)
+  default: return 0;
+  }
+}
+} // namespace
 
 GLTexture::GLTexture() = default;
 
@@ -30,33 +129,106 @@ void GLTexture::Destroy() {
   height_ = 0;
 }
 
+void GLTexture::DestroyStreamBuffers() {
+  StreamBuffers& streams = Streams();
+  if (streams.ids[0] != 0) {
+    Buffers().deleteBuffers(2, streams.ids);
+    streams.ids[0] = streams.ids[1] = 0;
+  }
+}
+
 void* GLTexture::ImGuiID() const {
   // ImGui OpenGL backends treat ImTextureID as a GLuint cast to void*.
   return (void*)(intptr_t)textureId_;
 }
 
-bool GLTexture::UpdateFromMat(const cv::Mat& mat) {
-  if (mat.empty()) return false;
+bool GLTexture::UploadRegion(const cv::Mat& mat, const cv::Rect& r) {
+  const GLenum format = UploadFormat(mat.type());
+  const size_t pixelBytes = mat.elemSize();
+
+  // Byte alignment is safe for any width (BGR rows are rarely a multiple of 4).
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-  cv::Mat rgba;
-  if (mat.type() == CV_8UC3) {
-    // OpenCV default is BGR; OpenGL expects RGBA (we upload GL_RGBA).
-    cv::cvtColor(mat, rgba, cv::COLOR_BGR2RGBA);
-  } else if (mat.type() == CV_8UC4) {
-    // Assume BGRA and convert to RGBA for consistent upload.
-    cv::cvtColor(mat, rgba, cv::COLOR_BGRA2RGBA);
-  } else if (mat.type() == CV_8UC1) {
-    cv::cvtColor(mat, rgba, cv::COLOR_GRAY2RGBA);
-  } else {
-    return false;
+  const BufferApi& gl = Buffers();
+  StreamBuffers& streams = Streams();
+  if (gl.available && streams.ids[0] == 0) gl.genBuffers(2, streams.ids);
+
+  if (gl.available && streams.ids[0] != 0) {
+    const size_t rowBytes = static_cast<size_t>(r.width) * pixelBytes;
+    const size_t bytes = rowBytes * static_cast<size_t>(r.height);
+    const GLuint pbo = streams.ids[streams.next];
+    streams.next ^= 1;
+
+    gl.bindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    // Orphan the previous storage: the driver hands out fresh memory instead of waiting for a
+    // transfer that may still read the old one.
+    gl.bufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<ptrdiff_t>(bytes), nullptr, GL_STREAM_DRAW);
+    void* dst = gl.mapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    if (dst) {
+      // Tightly packed rows; copyTo handles ROI strides.
+      cv::Mat packed(r.height, r.width, mat.type(), dst, rowBytes);
+      mat(r).copyTo(packed);
+      if (gl.unmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+        // Source offset 0 in the bound buffer: returns without waiting for the transfer.
+        glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height, format, GL_UNSIGNED_BYTE, nullptr);
+        gl.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return true;
+      }
+    }
+    // Mapping failed (or the buffer was lost): upload directly below.
+    gl.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
   }
 
-  if (rgba.empty() || rgba.type() != CV_8UC4) return false;
+  // Direct path: GL reads the rows straight from the Mat, skipping the row padding of ROIs.
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(mat.step[0] / pixelBytes));
+  glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height, format, GL_UNSIGNED_BYTE,
+                  mat.ptr(r.y) + static_cast<size_t>(r.x) * pixelBytes);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  return true;
+}
+
+bool GLTexture::UpdateFromMat(const cv::Mat& mat, const cv::Rect& region) {
+  const cv::Rect r = region & cv::Rect(0, 0, mat.cols, mat.rows);
+  if (textureId_ == 0 || mat.cols != width_ || mat.rows != height_ || r.area() == mat.cols * mat.rows) {
+    return UpdateFromMat(mat);
+  }
+  if (r.empty()) return true; // nothing changed
+  if (UploadFormat(mat.type()) == 0 || mat.step[0] % mat.elemSize() != 0) return false;
 
-  const int w = rgba.cols;
-  const int h = rgba.rows;
+  glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(textureId_));
+  const bool ok = UploadRegion(mat, r);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return ok;
+}
+
+bool GLTexture::UpdateFromMat(const cv::Mat& mat) {
+  if (mat.empty()) return false;
+  // The row length is given to GL in whole pixels.
+  if (UploadFormat(mat.type()) == 0 || mat.step[0] % mat.elemSize() != 0) return false;
+
+  const int w = mat.cols;
+  const int h = mat.rows;
   if (w <= 0 || h <= 0) return false;
 
+  BindStorage(w, h);
+  const bool ok = UploadRegion(mat, cv::Rect(0, 0, w, h));
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return ok;
+}
+
+bool GLTexture::UpdateFromUMat(const cv::UMat& image) {
+  if (image.empty() || image.type() != CV_8UC3) return false;
+  if (GpuProcessor::GLSharingEnabled()) {
+    BindStorage(image.cols, image.rows);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (GpuProcessor::CopyToGLTexture(image, textureId_)) return true;
+  }
+  // No OpenCL / OpenGL sharing: read the image back and upload it as usual.
+  return UpdateFromMat(image.getMat(cv::ACCESS_READ));
+}
+
+void GLTexture::BindStorage(int w, int h) {
   if (textureId_ == 0) {
     GLuint id = 0;
     glGenTextures(1, &id);
@@ -70,20 +242,10 @@ bool GLTexture::UpdateFromMat(const cv::Mat& mat) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-  // Ensure byte alignment is safe for any width (RGBA => 4 bytes per pixel, but still set explicitly).
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-  // If size changed, reallocate texture storage.
+  // If size changed, reallocate texture storage (no data: the upload fills it).
   if (w != width_ || h != height_) {
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
     width_ = w;
     height_ = h;
-  } else {
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data);
   }
-
-  glBindTexture(GL_TEXTURE_2D, 0);
-  return true;
 }
-
-
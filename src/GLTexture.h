@@ -2,13 +2,24 @@
 
 #include <opencv2/core.hpp>
 
+#include <cstddef>
+
 // Minimal OpenGL texture wrapper for displaying OpenCV images in Dear ImGui.
 // Why this exists:
 // - Keeps OpenGL state/texture lifetime out of UI and processing code.
-// - Central place to handle BGR->RGBA conversion, alignment, and resizing.
+// - Central place to handle channel order, row alignment/stride, and resizing.
+// - Uploads never convert on the CPU: BGR / BGRA / gray rows are handed to GL as they are
+//   (GL_BGR / GL_BGRA / GL_LUMINANCE, GL_UNPACK_ROW_LENGTH for ROIs) and the driver swizzles
+//   into the RGBA texture. A 24 MP result used to cost a ~100 MB temporary RGBA Mat per upload.
+// - When pixel buffer objects are available (GL 2.1 / ARB_pixel_buffer_object), uploads go
+//   through two alternating, orphaned PBOs: the rows are copied into driver memory and the
+//   texture transfer runs asynchronously instead of stalling the frame in glTexSubImage2D.
+//   The pair is shared by every texture (one GL context, UI thread only), so dozens of
+//   preview tiles and variant thumbnails do not each hold upload buffers of their own.
 //
 // This uses OpenGL 2.x texture calls (glTexImage2D / glTexSubImage2D),
-// matching ImGui's OpenGL2 backend so we don't need an extra GL loader.
+// matching ImGui's OpenGL2 backend so we don't need an extra GL loader (the few buffer
+// object entry points are fetched with glfwGetProcAddress).
 class GLTexture {
 public:
   GLTexture();
@@ -23,8 +34,17 @@ public:
   // - CV_8UC4 (BGRA)
   // - CV_8UC1 (Gray)
   bool UpdateFromMat(const cv::Mat& mat);
+  // Same, but when the texture already has mat's size only `region` of it is uploaded
+  // (glTexSubImage2D): for results that changed in a small area.
+  bool UpdateFromMat(const cv::Mat& mat, const cv::Rect& region);
+  // A CV_8UC3 GpuProcessor result: copied on the device when OpenCL / OpenGL sharing is on
+  // (GpuProcessor::EnableGLSharing), otherwise read back and uploaded like a Mat.
+  bool UpdateFromUMat(const cv::UMat& image);
 
   void Destroy();
+  // Deletes the shared upload buffers (recreated on the next upload). Call before the GL
+  // context goes away.
+  static void DestroyStreamBuffers();
 
   // For ImGui::Image: cast to ImTextureID.
   void* ImGuiID() const;
@@ -34,9 +54,12 @@ public:
   bool IsValid() const { return textureId_ != 0; }
 
 private:
+  // Creates the texture if needed, binds it and (re)allocates w × h storage on a size change.
+  void BindStorage(int w, int h);
+  // Sends `region` of mat into the bound texture (already allocated at mat's size).
+  bool UploadRegion(const cv::Mat& mat, const cv::Rect& region);
+
   unsigned int textureId_ = 0; // GLuint, kept as unsigned int to avoid including gl headers here.
   int width_ = 0;
   int height_ = 0;
 };
-
-
@@ -0,0 +1,479 @@
+#include "GpuProcessor.h"
+
+#include "OrderedDither.h"
+#include "OutlineKernels.h"
+#include "PaletteRegistry.h"
+
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/core/opengl.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <memory>
+#include <vector>
+
+// OpenCLExecutionContext (4.5+) makes the OpenCL context per thread; the GL-shared one has to
+// be bound on the worker threads explicitly. Older versions have one process-wide context.
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 5)
+#define FPW_OCL_EXECUTION_CONTEXT 1
+#endif
+
+namespace {
+using PAP = PixelArtProcessor;
+using Stage = ProcessStats::Stage;
+
+// Every kernel writes one pixel (or block) per work item, (x, y) = (get_global_id(0), (1)).
+// Mats are passed as KernelArg: pointer, step and offset in bytes, plus rows / cols for the
+// one that defines the work size. FP_CONTRACT off: the luminance must round like the CPU's.
+const char* const kKernelSource = R"CLC(
+#pragma OPENCL FP_CONTRACT OFF
+
+inline int dist2(int c0, int c1, int c2, __global const uchar* p) {
+  const int d0 = c0 - p[0];
+  const int d1 = c1 - p[1];
+  const int d2 = c2 - p[2];
+  return d0 * d0 + d1 * d1 + d2 * d2;
+}
+
+// Brute force over the palette; strict < keeps the lowest index on ties (as PaletteLUT).
+inline int nearest(int c0, int c1, int c2, __global const uchar* colors, int count) {
+  int best = 0;
+  int bestDist = dist2(c0, c1, c2, colors);
+  for (int i = 1; i < count; ++i) {
+    const int d = dist2(c0, c1, c2, colors + i * 3);
+    if (d < bestDist) {
+      bestDist = d;
+      best = i;
+    }
+  }
+  return best;
+}
+
+// Mean of one block (partial blocks at the right / bottom edge), rounded like the CPU's
+// (uchar)(sum * (1.0 / n)) in double: that equals sum / n except for some exact multiples,
+// where the reciprocal lands just below q. `fix` (host-built, see BlockMeanFix) holds the
+// CPU's result for sum = q * n, one row per block shape: full, right, bottom, corner.
+__kernel void block_mean(__global const uchar* src, int src_step, int src_offset, int src_rows, int src_cols,
+                         __global uchar* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+                         int block, __global const uchar* fix, int fix_step, int fix_offset) {
+  const int bx = get_global_id(0);
+  const int by = get_global_id(1);
+  if (bx >= dst_cols || by >= dst_rows) return;
+  const int x0 = bx * block;
+  const int y0 = by * block;
+  const int x1 = min(x0 + block, src_cols);
+  const int y1 = min(y0 + block, src_rows);
+  uint s0 = 0, s1 = 0, s2 = 0;
+  for (int y = y0; y < y1; ++y) {
+    __global const uchar* p = src + src_offset + y * src_step + x0 * 3;
+    for (int x = x0; x < x1; ++x, p += 3) {
+      s0 += p[0];
+      s1 += p[1];
+      s2 += p[2];
+    }
+  }
+  const uint n = (uint)((x1 - x0) * (y1 - y0));
+  __global const uchar* f = fix + fix_offset + ((x1 - x0 < block ? 1 : 0) + (y1 - y0 < block ? 2 : 0)) * fix_step;
+  const uint q0 = s0 / n;
+  const uint q1 = s1 / n;
+  const uint q2 = s2 / n;
+  __global uchar* d = dst + dst_offset + by * dst_step + bx * 3;
+  d[0] = s0 == q0 * n ? f[q0] : (uchar)q0;
+  d[1] = s1 == q1 * n ? f[q1] : (uchar)q1;
+  d[2] = s2 == q2 * n ? f[q2] : (uchar)q2;
+}
+
+__kernel void nearest_index(__global const uchar* src, int src_step, int src_offset,
+                            __global uchar* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+                            __global const uchar* colors, int count) {
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if (x >= dst_cols || y >= dst_rows) return;
+  __global const uchar* p = src + src_offset + y * src_step + x * 3;
+  dst[dst_offset + y * dst_step + x] = (uchar)nearest(p[0], p[1], p[2], colors, count);
+}
+
+// OrderedDither::Apply: the map row's offset added to every channel, clamped, then nearest.
+__kernel void ordered_index(__global const uchar* src, int src_step, int src_offset,
+                            __global uchar* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+                            __global const uchar* offsets, int offsets_step, int offsets_offset, int mask,
+                            __global const uchar* colors, int count) {
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if (x >= dst_cols || y >= dst_rows) return;
+  __global const uchar* p = src + src_offset + y * src_step + x * 3;
+  const int o = *(__global const short*)(offsets + offsets_offset + (y & mask) * offsets_step + x * 2);
+  dst[dst_offset + y * dst_step + x] =
+      (uchar)nearest(clamp(p[0] + o, 0, 255), clamp(p[1] + o, 0, 255), clamp(p[2] + o, 0, 255), colors, count);
+}
+
+// Palette indices of the block image -> colors, `block` output pixels per block.
+__kernel void expand(__global const uchar* src, int src_step, int src_offset,
+                     __global uchar* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+                     __global const uchar* colors, int block) {
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if (x >= dst_cols || y >= dst_rows) return;
+  __global const uchar* c = colors + src[src_offset + (y / block) * src_step + x / block] * 3;
+  __global uchar* d = dst + dst_offset + y * dst_step + x * 3;
+  d[0] = c[0];
+  d[1] = c[1];
+  d[2] = c[2];
+}
+
+inline int luminance(__global const uchar* p) {
+  return (int)(0.299f * p[2] + 0.587f * p[1] + 0.114f * p[0]);
+}
+
+inline bool differs(__global const uchar* a, __global const uchar* b) {
+  const int d0 = a[0] - b[0];
+  const int d1 = a[1] - b[1];
+  const int d2 = a[2] - b[2];
+  return abs(luminance(a) - luminance(b)) >= LUM_THRESHOLD || d0 * d0 + d1 * d1 + d2 * d2 >= DIST_SQ_THRESHOLD;
+}
+
+// 255 where any 4-connected neighbour differs (OutlineKernels::EdgeMask).
+__kernel void edge_mask(__global const uchar* src, int src_step, int src_offset, int rows, int cols,
+                        __global uchar* dst, int dst_step, int dst_offset) {
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if (x >= cols || y >= rows) return;
+  __global const uchar* p = src + src_offset + y * src_step + x * 3;
+  const bool edge = (x + 1 < cols && differs(p, p + 3)) || (y + 1 < rows && differs(p, p + src_step)) ||
+                    (x > 0 && differs(p, p - 3)) || (y > 0 && differs(p, p - src_step));
+  dst[dst_offset + y * dst_step + x] = edge ? 255 : 0;
+}
+
+// Brightness-adaptive darkening under the (opened / dilated) mask.
+__kernel void darken(__global uchar* img, int img_step, int img_offset, int rows, int cols,
+                     __global const uchar* mask, int mask_step, int mask_offset) {
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if (x >= cols || y >= rows || mask[mask_offset + y * mask_step + x] <= 128) return;
+  __global uchar* p = img + img_offset + y * img_step + x * 3;
+  const int brightness = (p[0] + p[1] + p[2]) / 3;
+  const int amount = brightness < 64 ? 40 : (brightness > 192 ? 90 : 70);
+  p[0] = (uchar)max(0, p[0] - amount);
+  p[1] = (uchar)max(0, p[1] - amount);
+  p[2] = (uchar)max(0, p[2] - amount);
+}
+)CLC";
+
+const cv::ocl::ProgramSource& Program() {
+  static const cv::ocl::ProgramSource source(kKernelSource);
+  return source;
+}
+
+const cv::String& BuildOptions() {
+  static const cv::String options =
+      cv::format("-D LUM_THRESHOLD=%d -D DIST_SQ_THRESHOLD=%d", OutlineKernels::kLuminanceThreshold,
+                 OutlineKernels::kColorDistanceThreshold * OutlineKernels::kColorDistanceThreshold);
+  return options;
+}
+
+// Queues kernel `name` over cols × rows work items (OpenCV caches the built program per context).
+template <typename... Args>
+bool RunKernel(const char* name, int cols, int rows, std::string& outError, const Args&... args) {
+  cv::ocl::Kernel kernel(name, Program(), BuildOptions());
+  if (kernel.empty()) {
+    outError = std::string("OpenCL kernel '") + name + "' failed to build.";
+    return false;
+  }
+  kernel.args(args...);
+  size_t global[2] = {static_cast<size_t>(cols), static_cast<size_t>(rows)};
+  if (!kernel.run(2, global, nullptr, false)) {
+    outError = std::string("OpenCL kernel '") + name + "' failed to run.";
+    return false;
+  }
+  return true;
+}
+
+// Stage timings need the queued work to have finished; without stats only the end waits.
+void Sync(const ProcessStats* stats) {
+  if (stats) cv::ocl::finish();
+}
+
+bool IsCancelled(const std::atomic<bool>* cancel) {
+  return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+cv::UMat UploadColors(const std::vector<cv::Vec3b>& colors) {
+  cv::UMat device;
+  cv::Mat(1, static_cast<int>(colors.size()), CV_8UC3, const_cast<cv::Vec3b*>(colors.data())).copyTo(device);
+  return device;
+}
+
+OrderedDither::Matrix OrderedMatrix(PAP::DitherMethod method) {
+  switch (method) {
+    case PAP::DitherMethod::Bayer2: return OrderedDither::Matrix::Bayer2;
+    case PAP::DitherMethod::Bayer8: return OrderedDither::Matrix::Bayer8;
+    case PAP::DitherMethod::BlueNoise: return OrderedDither::Matrix::BlueNoise;
+    default: return OrderedDither::Matrix::Bayer4;
+  }
+}
+
+// PixelArtProcessor::ApplyEdgeEnhancementInPlace, on the device.
+void EnhanceEdges(cv::UMat& bgr, float strength) {
+  cv::UMat blurred, bgrF, blurredF, high;
+  cv::GaussianBlur(bgr, blurred, cv::Size(3, 3), 0.0, 0.0, cv::BORDER_DEFAULT);
+  bgr.convertTo(bgrF, CV_32F);
+  blurred.convertTo(blurredF, CV_32F);
+  cv::subtract(bgrF, blurredF, high);
+  cv::scaleAdd(high, strength, bgrF, blurredF);
+  cv::max(blurredF, 0.0, blurredF);
+  cv::min(blurredF, 255.0, blurredF);
+  blurredF.convertTo(bgr, CV_8UC3);
+}
+
+// ReferenceProcessor::Outline: mask, thin (thickness 1) or thicken it, darken under it.
+bool Outline(cv::UMat& bgr, int thickness, std::string& outError) {
+  cv::UMat edges(bgr.size(), CV_8UC1);
+  if (!RunKernel("edge_mask", bgr.cols, bgr.rows, outError, cv::ocl::KernelArg::ReadOnly(bgr),
+                 cv::ocl::KernelArg::WriteOnlyNoSize(edges))) {
+    return false;
+  }
+  if (thickness == 1) {
+    cv::morphologyEx(edges, edges, cv::MORPH_OPEN, cv::getStructuringElement(cv::MORPH_CROSS, cv::Size(3, 3)));
+  } else {
+    const int k = 2 * thickness + 1;
+    cv::dilate(edges, edges, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(k, k)));
+  }
+  return RunKernel("darken", bgr.cols, bgr.rows, outError, cv::ocl::KernelArg::ReadWrite(bgr),
+                   cv::ocl::KernelArg::ReadOnlyNoSize(edges));
+}
+
+// block_mean's table: row k is the CPU's (uchar)(q * n * (1.0 / n)) for q = 0..255, with n the
+// pixel count of a full block (k = 0), a right-edge (1), bottom-edge (2) and corner block (3).
+// Elsewhere the double product truncates to the integer quotient: its error is far below 1 / n.
+cv::Mat BlockMeanFix(const cv::Size& size, int block) {
+  const int right = size.width - (size.width - 1) / block * block;
+  const int bottom = size.height - (size.height - 1) / block * block;
+  const int counts[4] = {block * block, right * block, block * bottom, right * bottom};
+  cv::Mat fix(4, 256, CV_8UC1);
+  for (int k = 0; k < 4; ++k) {
+    const double inv = 1.0 / static_cast<double>(counts[k]);
+    for (int q = 0; q < 256; ++q) {
+      fix.at<uchar>(k, q) = static_cast<uchar>(static_cast<double>(q * counts[k]) * inv);
+    }
+  }
+  return fix;
+}
+
+std::atomic<bool>& GLSharing() {
+  static std::atomic<bool> enabled{false};
+  return enabled;
+}
+
+#if FPW_OCL_EXECUTION_CONTEXT
+// Written once by EnableGLSharing, before any worker thread runs.
+cv::ocl::OpenCLExecutionContext& SharedContext() {
+  static cv::ocl::OpenCLExecutionContext context;
+  return context;
+}
+#endif
+
+// Makes the calling thread use the GL-shared context, if there is one.
+void BindSharedContext() {
+#if FPW_OCL_EXECUTION_CONTEXT
+  thread_local bool bound = false;
+  if (bound || !GLSharing().load()) return;
+  SharedContext().bind();
+  bound = true;
+#endif
+}
+} // namespace
+
+bool GpuProcessor::Available() {
+  BindSharedContext();
+  static const bool available = [] {
+    try {
+      return cv::ocl::haveOpenCL() && cv::ocl::useOpenCL() && cv::ocl::Device::getDefault().available();
+    } catch (const cv::Exception&) {
+      return false;
+    }
+  }();
+  return available;
+}
+
+std::string GpuProcessor::DeviceName() {
+  if (!Available()) return {};
+  return cv::ocl::Device::getDefault().name();
+}
+
+bool GpuProcessor::EnableGLSharing() {
+  if (GLSharing().load()) return true;
+  try {
+    cv::ogl::ocl::initializeContextFromGL();
+  } catch (const cv::Exception&) {
+    return false; // OpenCV without OpenGL support, or no cl_khr_gl_sharing
+  }
+#if FPW_OCL_EXECUTION_CONTEXT
+  SharedContext() = cv::ocl::OpenCLExecutionContext::getCurrent();
+#endif
+  GLSharing().store(true);
+  return true;
+}
+
+bool GpuProcessor::GLSharingEnabled() {
+  return GLSharing().load();
+}
+
+bool GpuProcessor::Upload(const cv::Mat& inputBgr, cv::UMat& outDevice, std::string& outError) {
+  outError.clear();
+  if (inputBgr.empty() || inputBgr.type() != CV_8UC3) {
+    outError = "GPU processing needs a non-empty BGR image.";
+    return false;
+  }
+  if (!Available()) {
+    outError = "No OpenCL device available.";
+    return false;
+  }
+  try {
+    inputBgr.copyTo(outDevice);
+  } catch (const cv::Exception& e) {
+    outError = std::string("OpenCV error: ") + e.what();
+    return false;
+  }
+  return true;
+}
+
+bool GpuProcessor::Process(const cv::UMat& inputBgr, const Params& params, cv::UMat& outBgr, std::string& outError,
+                           const std::atomic<bool>* cancel, ProcessStats* stats) {
+  outError.clear();
+  if (inputBgr.empty() || inputBgr.type() != CV_8UC3) {
+    outError = "GPU processing needs a non-empty BGR image.";
+    return false;
+  }
+  if (!Available()) {
+    outError = "No OpenCL device available.";
+    return false;
+  }
+  const Params p = PAP::Normalize(params);
+  if (stats) {
+    stats->Begin(inputBgr.size());
+    stats->kernels = "opencl";
+  }
+
+  try {
+    const int bs = p.blockSize;
+    const cv::Size size = inputBgr.size();
+    const cv::Size blocks((size.width + bs - 1) / bs, (size.height + bs - 1) / bs);
+
+    // Steps 1 + 2: pre-blur, then one work item per block.
+    cv::UMat small(blocks, CV_8UC3);
+    {
+      ProcessStats::Scope scope(stats, Stage::Blocks);
+      cv::UMat blurred;
+      if (p.preBlur) {
+        const int ksize = PAP::PreBlurKernelSize(p.blockSize);
+        cv::GaussianBlur(inputBgr, blurred, cv::Size(ksize, ksize), 0.0, 0.0, cv::BORDER_DEFAULT);
+      }
+      cv::UMat fix;
+      BlockMeanFix(size, bs).copyTo(fix);
+      if (!RunKernel("block_mean", blocks.width, blocks.height, outError,
+                     cv::ocl::KernelArg::ReadOnly(p.preBlur ? blurred : inputBgr), cv::ocl::KernelArg::WriteOnly(small),
+                     bs, cv::ocl::KernelArg::ReadOnlyNoSize(fix))) {
+        return false;
+      }
+      Sync(stats);
+    }
+    if (IsCancelled(cancel)) return false;
+
+    // Step 3a: K-means works on the host copy of the block image; fixed palettes need nothing.
+    cv::Mat smallHost;
+    std::shared_ptr<const Palette> palette;
+    {
+      ProcessStats::Scope scope(stats, Stage::Palette);
+      if (p.palettePreset == PAP::PalettePreset::Custom) {
+        small.copyTo(smallHost);
+        palette = PAP::ExtractPalette(smallHost, p);
+      } else if (const Palette* fixed = PAP::ResolvePalette(p)) {
+        palette = std::shared_ptr<const Palette>(std::shared_ptr<const Palette>(), fixed);
+      }
+    }
+    if (!palette || palette->size() == 0) {
+      outError = "No palette.";
+      return false;
+    }
+    const cv::UMat colors = UploadColors(palette->Colors());
+
+    // Step 3b: palette indices. Floyd-Steinberg is serial and Lab palettes come from K-means
+    // (the block image is on the host already): both on the CPU.
+    cv::UMat indices(blocks, CV_8UC1);
+    {
+      ProcessStats::Scope scope(stats, Stage::Quantize);
+      const bool floydSteinberg = p.dither && p.ditherMethod == PAP::DitherMethod::FloydSteinberg;
+      const bool lab = palette->PreferredMetric() == Palette::Metric::Lab;
+      if (floydSteinberg || (!p.dither && lab)) {
+        if (smallHost.empty()) small.copyTo(smallHost);
+        const cv::Mat hostIndices = floydSteinberg
+            ? PAP::QuantizeWithPaletteDither(smallHost, *palette, p.ditherSerpentine)
+            : PAP::QuantizeWithPalette(smallHost, *palette);
+        hostIndices.copyTo(indices);
+      } else if (!p.dither) {
+        if (!RunKernel("nearest_index", blocks.width, blocks.height, outError,
+                       cv::ocl::KernelArg::ReadOnlyNoSize(small), cv::ocl::KernelArg::WriteOnly(indices),
+                       cv::ocl::KernelArg::PtrReadOnly(colors), palette->size())) {
+          return false;
+        }
+      } else {
+        cv::UMat offsets;
+        const cv::Mat hostOffsets = OrderedDither::Offsets(palette->Colors(), OrderedMatrix(p.ditherMethod), blocks.width);
+        hostOffsets.copyTo(offsets);
+        if (!RunKernel("ordered_index", blocks.width, blocks.height, outError,
+                       cv::ocl::KernelArg::ReadOnlyNoSize(small), cv::ocl::KernelArg::WriteOnly(indices),
+                       cv::ocl::KernelArg::ReadOnlyNoSize(offsets), hostOffsets.rows - 1,
+                       cv::ocl::KernelArg::PtrReadOnly(colors), palette->size())) {
+          return false;
+        }
+      }
+      Sync(stats);
+    }
+    if (IsCancelled(cancel)) return false;
+
+    // Step 4: colors at native or full resolution.
+    const bool native = PAP::OutputIsNative(p);
+    const cv::Size outSize = native ? blocks : size;
+    outBgr.create(outSize, CV_8UC3);
+    {
+      ProcessStats::Scope scope(stats, Stage::Expand);
+      if (!RunKernel("expand", outSize.width, outSize.height, outError, cv::ocl::KernelArg::ReadOnlyNoSize(indices),
+                     cv::ocl::KernelArg::WriteOnly(outBgr), cv::ocl::KernelArg::PtrReadOnly(colors),
+                     native ? 1 : bs)) {
+        return false;
+      }
+      Sync(stats);
+    }
+
+    // Steps 5 + 6 at full resolution (cheap here; no block grid needed).
+    if (p.edgeEnhance) {
+      ProcessStats::Scope scope(stats, Stage::Edge);
+      EnhanceEdges(outBgr, 0.7f);
+      Sync(stats);
+    }
+    if (p.outline) {
+      ProcessStats::Scope scope(stats, Stage::Outline);
+      if (!Outline(outBgr, p.outlineThickness, outError)) return false;
+      Sync(stats);
+    }
+    cv::ocl::finish();
+  } catch (const cv::Exception& e) {
+    outError = std::string("OpenCV error: ") + e.what();
+    return false;
+  }
+  if (stats) stats->End();
+  return true;
+}
+
+bool GpuProcessor::CopyToGLTexture(const cv::UMat& bgr, unsigned int textureId) {
+  if (!GLSharingEnabled() || bgr.empty() || bgr.type() != CV_8UC3 || textureId == 0) return false;
+  try {
+    // The texture is RGBA8; the copy is a plain buffer-to-image transfer, so swizzle first.
+    cv::UMat rgba;
+    cv::cvtColor(bgr, rgba, cv::COLOR_BGR2RGBA);
+    cv::ogl::Texture2D texture(bgr.rows, bgr.cols, cv::ogl::Texture2D::RGBA, textureId, false);
+    cv::ogl::convertToGLTexture2D(rgba, texture);
+  } catch (const cv::Exception&) {
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "PixelArtProcessor.h"
+#include "ProcessStats.h"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <string>
+
+// GpuProcessor: PixelArtProcessor::Process on an OpenCL device, through OpenCV's T-API.
+// Why this exists:
+// - Blur, block mean, nearest-palette mapping, ordered dither, expansion and the outline mask
+//   are independent per pixel or per block; for a 4K live preview the CPU pipeline spends
+//   most of its time in them, a GPU runs them in a few milliseconds.
+// - The result stays on the device (cv::UMat). The GUI copies it into its preview texture
+//   with OpenCL / OpenGL sharing when OpenCV supports it (EnableGLSharing), so nothing is
+//   read back until Save.
+//
+// Stage by stage: the pre-blur is cv::GaussianBlur on the UMat, then one work item per block
+// sums it; the mean truncates like the CPU's sum * (1.0 / n) in double (a small host-built
+// table covers the sums where that differs from integer division). K-means and Floyd-Steinberg
+// need the whole block image serially: they run on the CPU on a copy of the block image (1/N²
+// of the input) and only the palette or the indices go back. Nearest color, ordered dither and
+// expansion are brute-force kernels (exact, same tie rule as PaletteLUT); edge enhancement is
+// the CPU code's calls on UMats; the outline is a per-pixel mask kernel, cv::morphologyEx /
+// cv::dilate and a darkening kernel, as in ReferenceProcessor::Outline.
+// Output equals Process except where OpenCV's OpenCL pre-blur and float arithmetic round
+// differently (pre-blur, edge enhancement); RegressionCheck reports that difference.
+//
+// Independent of PixelArtProcessor::Backend: callers choose this path explicitly.
+class GpuProcessor {
+public:
+  using Params = PixelArtProcessor::Params;
+
+  // True if OpenCV has a usable OpenCL device and OpenCL is not switched off
+  // (cv::ocl::setUseOpenCL, OPENCV_OPENCL_DEVICE=disabled). Checked once.
+  static bool Available();
+  // Name of the OpenCL device in use; empty when not Available.
+  static std::string DeviceName();
+
+  // Creates the OpenCL context from the current OpenGL context (cv::ogl::ocl::initializeContextFromGL)
+  // so results can be copied into GL textures on the device. Call on the GL thread after the
+  // context is made current and before any other OpenCL use. False when OpenCV was built
+  // without OpenGL support or the driver cannot share; everything else still works.
+  static bool EnableGLSharing();
+  static bool GLSharingEnabled();
+
+  // Copies a CV_8UC3 input to the device, for Process. False (with outError) on failure.
+  static bool Upload(const cv::Mat& inputBgr, cv::UMat& outDevice, std::string& outError);
+
+  // Process() on the device: `outBgr` is what PixelArtProcessor::Process returns (native or
+  // full resolution), as a UMat. Upload the input once and pass the UMat to run it again with
+  // other params. False (with outError) when OpenCL is unavailable, a kernel fails to build or
+  // `cancel` is set (outError empty). Thread-safe; stats->kernels reads "opencl".
+  static bool Process(const cv::UMat& inputBgr, const Params& params, cv::UMat& outBgr, std::string& outError,
+                      const std::atomic<bool>* cancel = nullptr, ProcessStats* stats = nullptr);
+
+  // Copies a CV_8UC3 device image into the RGBA8 texture `textureId` (width × height = the
+  // image size) without leaving the device. Needs GLSharingEnabled(); call on the GL thread.
+  static bool CopyToGLTexture(const cv::UMat& bgr, unsigned int textureId);
+};
@@ -1,11 +1,90 @@
 #include "ImageLoader.h"
 
+#include "IndexedCodec.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <vector>
+
 #include <opencv2/imgcodecs.hpp>
 
+namespace {
+std::string LowerExtension(const std::string& path) {
+  std::string ext = std::filesystem::path(path).extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return ext;
+}
+
+bool WriteFile(const std::string& path, const std::vector<uint8_t>& bytes, std::string& outError) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    outError = "Cannot create " + path + ". Check the output path.";
+    return false;
+  }
+  out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+  if (!out) {
+    outError = "Write error: " + path;
+    return false;
+  }
+  return true;
+}
+
+std::vector<int> ImwriteParams(const std::string& ext, const ImageLoader::SaveOptions& options) {
+  std::vector<int> params;
+  if (ext == ".png") {
+    if (options.pngCompression >= 0) {
+      params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+      params.push_back(std::min(options.pngCompression, 9));
+    }
+    if (options.pngStrategy != ImageLoader::PngStrategy::Default) {
+      static const int kStrategies[] = {cv::IMWRITE_PNG_STRATEGY_DEFAULT, cv::IMWRITE_PNG_STRATEGY_FILTERED,
+                                        cv::IMWRITE_PNG_STRATEGY_HUFFMAN_ONLY, cv::IMWRITE_PNG_STRATEGY_RLE,
+                                        cv::IMWRITE_PNG_STRATEGY_FIXED};
+      params.push_back(cv::IMWRITE_PNG_STRATEGY);
+      params.push_back(kStrategies[static_cast<int>(options.pngStrategy)]);
+    }
+  } else if ((ext == ".jpg" || ext == ".jpeg") && options.jpegQuality >= 0) {
+    params.push_back(cv::IMWRITE_JPEG_QUALITY);
+    params.push_back(std::min(options.jpegQuality, 100));
+  } else if (ext == ".webp" && options.webpQuality >= 0) {
+    params.push_back(cv::IMWRITE_WEBP_QUALITY);
+    params.push_back(std::max(1, options.webpQuality));
+  }
+  return params;
+}
+
+// The same knobs for the built-in indexed PNG encoder.
+IndexedCodec::PngOptions IndexedPngOptions(const ImageLoader::SaveOptions& options) {
+  IndexedCodec::PngOptions png;
+  if (options.pngCompression >= 0) png.level = std::min(options.pngCompression, 9);
+  if (options.pngStrategy == ImageLoader::PngStrategy::HuffmanOnly) png.matching = IndexedCodec::PngMatching::None;
+  if (options.pngStrategy == ImageLoader::PngStrategy::RLE) png.matching = IndexedCodec::PngMatching::RunLength;
+  return png;
+}
+} // namespace
+
 bool ImageLoader::LoadBGR(const std::string& path, cv::Mat& outBgr, std::string& outError) {
   outError.clear();
   outBgr.release();
 
+  // Decode straight from the mapped file. imread remains the fallback: for files that cannot
+  // be mapped (e.g. special files), above imdecode's INT_MAX byte limit, or that imdecode fails on.
+  {
+    MappedFile file;
+    std::string mapError;
+    if (file.Open(path, mapError) && file.size() <= static_cast<size_t>(std::numeric_limits<int>::max()) &&
+        DecodeBGR(file.data(), file.size(), outBgr, outError)) {
+      return true;
+    }
+  } // unmapped before imread opens the file
+  outError.clear();
+
   // IMREAD_COLOR => always 8-bit BGR, which is what our processor expects.
   cv::Mat img = cv::imread(path, cv::IMREAD_COLOR);
   if (img.empty()) {
@@ -16,14 +95,52 @@ bool ImageLoader::LoadBGR(const std::string& path, cv::Mat& outBgr, std::string&
   return true;
 }
 
+bool ImageLoader::DecodeBGR(const uint8_t* data, size_t size, cv::Mat& outBgr, std::string& outError) {
+  outError.clear();
+  outBgr.release();
+  if (!data || size == 0 || size > static_cast<size_t>(std::numeric_limits<int>::max())) {
+    outError = "Failed to load image (empty or too large buffer).";
+    return false;
+  }
+  // Wraps the bytes without copying; the decoded image owns its own buffer.
+  const cv::Mat encoded(1, static_cast<int>(size), CV_8UC1, const_cast<uint8_t*>(data));
+  cv::Mat img;
+  try {
+    img = cv::imdecode(encoded, cv::IMREAD_COLOR);
+  } catch (const cv::Exception& e) {
+    outError = std::string("OpenCV error: ") + e.what();
+    return false;
+  }
+  if (img.empty()) {
+    outError = "Failed to load image (empty). Check path and supported formats (png/jpg).";
+    return false;
+  }
+  outBgr = img;
+  return true;
+}
+
 bool ImageLoader::Save(const std::string& path, const cv::Mat& image, std::string& outError) {
+  return Save(path, image, SaveOptions{}, outError);
+}
+
+bool ImageLoader::Save(const std::string& path, const cv::Mat& image, const SaveOptions& options,
+                       std::string& outError) {
   outError.clear();
   if (image.empty()) {
     outError = "Nothing to save (image is empty).";
     return false;
   }
+  const std::string ext = LowerExtension(path);
+  if (ext == ".gif") {
+    IndexedImage indexed;
+    if (image.type() != CV_8UC3 || !IndexedImage::FromBGR(image, indexed)) {
+      outError = "GIF output needs an 8-bit BGR image with at most 256 colors.";
+      return false;
+    }
+    return SaveIndexed(path, indexed, options, outError);
+  }
   try {
-    if (!cv::imwrite(path, image)) {
+    if (!cv::imwrite(path, image, ImwriteParams(ext, options))) {
       outError = "cv::imwrite returned false. Check file extension and output path.";
       return false;
     }
@@ -34,4 +151,32 @@ bool ImageLoader::Save(const std::string& path, const cv::Mat& image, std::strin
   return true;
 }
 
+bool ImageLoader::WritesIndexed(const std::string& path) {
+  const std::string ext = LowerExtension(path);
+  return ext == ".png" || ext == ".gif";
+}
+
+bool ImageLoader::SaveIndexed(const std::string& path, const IndexedImage& image, std::string& outError) {
+  return SaveIndexed(path, image, SaveOptions{}, outError);
+}
 
+bool ImageLoader::SaveIndexed(const std::string& path, const IndexedImage& image, const SaveOptions& options,
+                              std::string& outError) {
+  outError.clear();
+  if (image.empty()) {
+    outError = "Nothing to save (image is empty).";
+    return false;
+  }
+  if (!WritesIndexed(path)) return Save(path, image.ToBGR(), options, outError);
+  const std::string ext = LowerExtension(path);
+
+  std::vector<uint8_t> bytes;
+  const bool ok = ext == ".png" ? IndexedCodec::EncodePNG(image, bytes, IndexedPngOptions(options))
+                                : IndexedCodec::EncodeGIF(image, bytes);
+  if (!ok) {
+    outError = ext == ".gif" ? "GIF encoding failed (at most 256 colors and 65535 x 65535 pixels)."
+                             : "PNG encoding failed (at most 256 colors).";
+    return false;
+  }
+  return WriteFile(path, bytes, outError);
+}
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "IndexedImage.h"
+
 #include <opencv2/core.hpp>
+
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 // ImageLoader: minimal, UI-agnostic image I/O wrapper.
@@ -9,11 +14,42 @@
 // - Centralizes any future format conversions / metadata handling.
 class ImageLoader {
 public:
-  // Loads image as 8-bit BGR (OpenCV default), returns true on success.
+  // PNG deflate strategy (zlib's; see cv::IMWRITE_PNG_STRATEGY_*).
+  enum class PngStrategy {
+    Default,     // LZ77 + Huffman
+    Filtered,    // tuned for filtered (photographic) data
+    HuffmanOnly, // no LZ77 matching: fastest, largest
+    RLE,         // matches at distance 1 only: fast, and good on flat pixel-art rows
+    Fixed        // fixed Huffman codes
+  };
+
+  // Encoder knobs. -1 keeps the encoder's own default.
+  struct SaveOptions {
+    int pngCompression = -1; // 0 (store) .. 9 (smallest, slowest)
+    PngStrategy pngStrategy = PngStrategy::Default;
+    int jpegQuality = -1;    // 0..100
+    int webpQuality = -1;    // 1..100 (above 100: lossless)
+  };
+
+  // Loads image as 8-bit BGR (OpenCV default), returns true on success. The file is memory
+  // mapped and decoded in place (DecodeBGR); files that cannot be mapped or decoded that way
+  // (over 2 GB, formats imdecode rejects) go through cv::imread.
   static bool LoadBGR(const std::string& path, cv::Mat& outBgr, std::string& outError);
 
-  // Saves BGR/RGBA/Gray images using OpenCV imwrite.
-  static bool Save(const std::string& path, const cv::Mat& image, std::string& outError);
-};
+  // Decodes an encoded image held in memory (any format cv::imdecode reads) to 8-bit BGR.
+  static bool DecodeBGR(const uint8_t* data, size_t size, cv::Mat& outBgr, std::string& outError);
 
+  // Saves BGR/RGBA/Gray images using OpenCV imwrite. ".gif" goes through SaveIndexed (the
+  // image must have at most 256 colors), since OpenCV usually cannot write GIF.
+  static bool Save(const std::string& path, const cv::Mat& image, std::string& outError);
+  static bool Save(const std::string& path, const cv::Mat& image, const SaveOptions& options,
+                   std::string& outError);
 
+  // Saves a palette-indexed image: ".png" as an indexed PNG, ".gif" as a GIF (IndexedCodec);
+  // any other extension is expanded to BGR and saved with Save.
+  static bool SaveIndexed(const std::string& path, const IndexedImage& image, std::string& outError);
+  static bool SaveIndexed(const std::string& path, const IndexedImage& image, const SaveOptions& options,
+                          std::string& outError);
+  // True if SaveIndexed writes `path` as an indexed file (".png" / ".gif").
+  static bool WritesIndexed(const std::string& path);
+};
@@ -0,0 +1,450 @@
+#include "IndexedCodec.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+// ---- Shared helpers ----
+void PutU32BE(std::vector<uint8_t>& out, uint32_t v) {
+  out.push_back(static_cast<uint8_t>(v >> 24));
+  out.push_back(static_cast<uint8_t>(v >> 16));
+  out.push_back(static_cast<uint8_t>(v >> 8));
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+void PutU16LE(std::vector<uint8_t>& out, uint32_t v) {
+  out.push_back(static_cast<uint8_t>(v));
+  out.push_back(static_cast<uint8_t>(v >> 8));
+}
+
+// Smallest bit count b with 2^b >= n (at least 1).
+int BitsFor(size_t n) {
+  int bits = 1;
+  while ((size_t{1} << bits) < n) ++bits;
+  return bits;
+}
+
+// LSB-first bit packer (deflate and GIF both pack codes starting at the low bit).
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+  void Put(uint32_t value, int bits) {
+    acc_ |= static_cast<uint64_t>(value) << count_;
+    count_ += bits;
+    while (count_ >= 8) {
+      out_.push_back(static_cast<uint8_t>(acc_));
+      acc_ >>= 8;
+      count_ -= 8;
+    }
+  }
+  void Flush() {
+    if (count_ > 0) out_.push_back(static_cast<uint8_t>(acc_));
+    acc_ = 0;
+    count_ = 0;
+  }
+
+private:
+  std::vector<uint8_t>& out_;
+  uint64_t acc_ = 0;
+  int count_ = 0;
+};
+
+// ---- PNG ----
+const std::array<uint32_t, 256>& CrcTable() {
+  static const std::array<uint32_t, 256> table = [] {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k) c = (c & 1u) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[n] = c;
+    }
+    return t;
+  }();
+  return table;
+}
+
+void PutChunk(std::vector<uint8_t>& out, const char type[4], const std::vector<uint8_t>& data) {
+  PutU32BE(out, static_cast<uint32_t>(data.size()));
+  const size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  const std::array<uint32_t, 256>& table = CrcTable();
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = start; i < out.size(); ++i) crc = table[(crc ^ out[i]) & 0xFFu] ^ (crc >> 8);
+  PutU32BE(out, crc ^ 0xFFFFFFFFu);
+}
+
+uint32_t Adler32(const std::vector<uint8_t>& data) {
+  uint32_t a = 1, b = 0;
+  size_t i = 0;
+  while (i < data.size()) {
+    // 5552 is the largest block for which b cannot overflow before the modulo.
+    const size_t end = std::min(data.size(), i + 5552);
+    for (; i < end; ++i) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521u;
+    b %= 65521u;
+  }
+  return (b << 16) | a;
+}
+
+constexpr int kLengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr int kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr int kDistBase[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                               193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr int kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+uint32_t ReverseBits(uint32_t code, int bits) {
+  uint32_t r = 0;
+  for (int i = 0; i < bits; ++i) r |= ((code >> i) & 1u) << (bits - 1 - i);
+  return r;
+}
+
+// Fixed Huffman literal / length code of symbol s (RFC 1951, 3.2.6), bit-reversed for the
+// LSB-first writer.
+void FixedCode(int s, uint32_t& code, int& bits) {
+  if (s < 144) { code = 0x30u + static_cast<uint32_t>(s); bits = 8; }
+  else if (s < 256) { code = 0x190u + static_cast<uint32_t>(s - 144); bits = 9; }
+  else if (s < 280) { code = static_cast<uint32_t>(s - 256); bits = 7; }
+  else { code = 0xC0u + static_cast<uint32_t>(s - 280); bits = 8; }
+  code = ReverseBits(code, bits);
+}
+
+// Stored (uncompressed) deflate blocks of at most 65535 bytes each.
+void DeflateStored(const std::vector<uint8_t>& data, std::vector<uint8_t>& out) {
+  size_t pos = 0;
+  do {
+    const size_t len = std::min<size_t>(65535, data.size() - pos);
+    out.push_back(pos + len == data.size() ? 1 : 0); // BFINAL, BTYPE = stored, byte aligned
+    PutU16LE(out, static_cast<uint32_t>(len));
+    PutU16LE(out, static_cast<uint32_t>(~len & 0xFFFF));
+    out.insert(out.end(), data.begin() + static_cast<std::ptrdiff_t>(pos),
+               data.begin() + static_cast<std::ptrdiff_t>(pos + len));
+    pos += len;
+  } while (pos < data.size());
+}
+
+// zlib stream of `data`: stored for level 0, otherwise one fixed-Huffman deflate block.
+// Greedy LZ77 over a 32 KB window with hash chains (chain length grows with the level);
+// block-expanded rows compress mostly into 258-byte runs at distance 1 or one row stride.
+void Deflate(const std::vector<uint8_t>& data, const IndexedCodec::PngOptions& options, std::vector<uint8_t>& out) {
+  constexpr int kWindow = 1 << 15;
+  constexpr int kHashBits = 15;
+  constexpr int kMinMatch = 3;
+  constexpr int kMaxMatch = 258;
+  static const int kChainForLevel[10] = {0, 1, 4, 8, 16, 32, 48, 128, 512, 4096};
+  const int level = std::max(0, std::min(options.level, 9));
+  const int maxChain = kChainForLevel[level];
+
+  out.push_back(0x78); // CM = deflate, 32 KB window
+  out.push_back(0x01); // no dictionary, fastest-compression hint; header is a multiple of 31
+  if (level == 0) {
+    DeflateStored(data, out);
+    PutU32BE(out, Adler32(data));
+    return;
+  }
+
+  std::array<uint32_t, 288> litCode{};
+  std::array<int, 288> litBits{};
+  for (int s = 0; s < 288; ++s) FixedCode(s, litCode[static_cast<size_t>(s)], litBits[static_cast<size_t>(s)]);
+  std::array<uint32_t, 30> distCode{};
+  for (int d = 0; d < 30; ++d) distCode[static_cast<size_t>(d)] = ReverseBits(static_cast<uint32_t>(d), 5);
+
+  BitWriter bw(out);
+  bw.Put(1, 1); // BFINAL
+  bw.Put(1, 2); // BTYPE = fixed Huffman
+
+  const int n = static_cast<int>(data.size());
+  std::vector<int> head(size_t{1} << kHashBits, -1);
+  std::vector<int> prev(kWindow, -1);
+  auto hashAt = [&](int p) {
+    const uint32_t v = static_cast<uint32_t>(data[static_cast<size_t>(p)]) |
+                       (static_cast<uint32_t>(data[static_cast<size_t>(p) + 1]) << 8) |
+                       (static_cast<uint32_t>(data[static_cast<size_t>(p) + 2]) << 16);
+    return static_cast<size_t>((v * 2654435761u) >> (32 - kHashBits));
+  };
+  auto insert = [&](int p) {
+    if (p + kMinMatch > n) return;
+    const size_t h = hashAt(p);
+    prev[static_cast<size_t>(p & (kWindow - 1))] = head[h];
+    head[h] = p;
+  };
+  auto literal = [&](int s) { bw.Put(litCode[static_cast<size_t>(s)], litBits[static_cast<size_t>(s)]); };
+
+  int pos = 0;
+  while (pos < n) {
+    int bestLen = 0, bestDist = 0;
+    if (options.matching == IndexedCodec::PngMatching::RunLength && pos > 0) {
+      // zlib's Z_RLE: only repeats of the previous byte.
+      const int limit = std::min(kMaxMatch, n - pos);
+      const uint8_t v = data[static_cast<size_t>(pos) - 1];
+      while (bestLen < limit && data[static_cast<size_t>(pos + bestLen)] == v) ++bestLen;
+      bestDist = 1;
+    } else if (options.matching == IndexedCodec::PngMatching::LZ77 && pos + kMinMatch <= n) {
+      const int limit = std::min(kMaxMatch, n - pos);
+      int cand = head[hashAt(pos)];
+      for (int chain = 0; cand >= 0 && pos - cand <= kWindow && chain < maxChain; ++chain) {
+        const uint8_t* a = data.data() + cand;
+        const uint8_t* b = data.data() + pos;
+        if (a[bestLen] == b[bestLen]) {
+          int len = 0;
+          while (len < limit && a[len] == b[len]) ++len;
+          if (len > bestLen) {
+            bestLen = len;
+            bestDist = pos - cand;
+            if (len == limit) break;
+          }
+        }
+        const int next = prev[static_cast<size_t>(cand & (kWindow - 1))];
+        if (next >= cand) break; // slot reused by a newer position: chain ends
+        cand = next;
+      }
+    }
+
+    if (bestLen >= kMinMatch) {
+      int lc = 28;
+      while (kLengthBase[lc] > bestLen) --lc;
+      literal(257 + lc);
+      bw.Put(static_cast<uint32_t>(bestLen - kLengthBase[lc]), kLengthExtra[lc]);
+      int dc = 29;
+      while (kDistBase[dc] > bestDist) --dc;
+      bw.Put(distCode[static_cast<size_t>(dc)], 5);
+      bw.Put(static_cast<uint32_t>(bestDist - kDistBase[dc]), kDistExtra[dc]);
+      for (int i = 0; i < bestLen; ++i) insert(pos + i);
+      pos += bestLen;
+    } else {
+      literal(data[static_cast<size_t>(pos)]);
+      insert(pos);
+      ++pos;
+    }
+  }
+  literal(256); // end of block
+  bw.Flush();
+  PutU32BE(out, Adler32(data));
+}
+
+// ---- GIF ----
+// Variable-width LZW (GIF89a flavour: codes grow up to 12 bits, then a clear code resets the
+// table). Dictionary entries (prefix code, next index) live in an open-addressing hash table.
+void LzwEncode(const cv::Mat& indices, int minCodeSize, std::vector<uint8_t>& codes) {
+  constexpr int kMaxCode = 4095;
+  constexpr int kTableBits = 13;
+  constexpr size_t kTableSize = size_t{1} << kTableBits;
+  const int clearCode = 1 << minCodeSize;
+  const int endCode = clearCode + 1;
+
+  std::vector<int32_t> keys(kTableSize, -1);
+  std::vector<int16_t> values(kTableSize, 0);
+  auto slotOf = [&](int32_t key) {
+    size_t h = (static_cast<uint32_t>(key) * 2654435761u) >> (32 - kTableBits);
+    while (keys[h] != -1 && keys[h] != key) h = (h + 1) & (kTableSize - 1);
+    return h;
+  };
+
+  BitWriter bw(codes);
+  int codeSize = minCodeSize + 1;
+  int maxCode = endCode;
+  bw.Put(static_cast<uint32_t>(clearCode), codeSize);
+
+  int cur = -1;
+  for (int y = 0; y < indices.rows; ++y) {
+    const uchar* row = indices.ptr<uchar>(y);
+    for (int x = 0; x < indices.cols; ++x) {
+      const int next = row[x];
+      if (cur < 0) {
+        cur = next;
+        continue;
+      }
+      const int32_t key = (cur << 8) | next;
+      const size_t slot = slotOf(key);
+      if (keys[slot] == key) {
+        cur = values[slot];
+        continue;
+      }
+      bw.Put(static_cast<uint32_t>(cur), codeSize);
+      keys[slot] = key;
+      values[slot] = static_cast<int16_t>(++maxCode);
+      if (maxCode >= (1 << codeSize)) ++codeSize;
+      if (maxCode == kMaxCode) {
+        bw.Put(static_cast<uint32_t>(clearCode), codeSize);
+        std::fill(keys.begin(), keys.end(), -1);
+        codeSize = minCodeSize + 1;
+        maxCode = endCode;
+      }
+      cur = next;
+    }
+  }
+  if (cur >= 0) bw.Put(static_cast<uint32_t>(cur), codeSize);
+  bw.Put(static_cast<uint32_t>(endCode), codeSize);
+  bw.Flush();
+}
+
+// 2^bits RGB entries; unused slots are black.
+void PutColorTable(std::vector<uint8_t>& out, const std::vector<cv::Vec3b>& colors, int bits) {
+  for (size_t i = 0; i < (size_t{1} << bits); ++i) {
+    const cv::Vec3b c = i < colors.size() ? colors[i] : cv::Vec3b(0, 0, 0);
+    out.push_back(c[2]);
+    out.push_back(c[1]);
+    out.push_back(c[0]);
+  }
+}
+} // namespace
+
+bool IndexedCodec::EncodePNG(const IndexedImage& image, std::vector<uint8_t>& out) {
+  return EncodePNG(image, out, PngOptions{});
+}
+
+bool IndexedCodec::EncodePNG(const IndexedImage& image, std::vector<uint8_t>& out, const PngOptions& options) {
+  if (image.empty() || image.indices.type() != CV_8UC1 || image.colors.size() > 256) return false;
+  const int w = image.indices.cols;
+  const int h = image.indices.rows;
+
+  // Smallest legal bit depth for the palette: sprites with 2-16 colors pack 8-2 pixels per byte.
+  const size_t n = image.colors.size();
+  const int depth = n <= 2 ? 1 : (n <= 4 ? 2 : (n <= 16 ? 4 : 8));
+  const size_t rowBytes = (static_cast<size_t>(w) * static_cast<size_t>(depth) + 7) / 8;
+  const int perByte = 8 / depth;
+
+  // Filter type 0 (None) on every row: the usual choice for palette images.
+  std::vector<uint8_t> raw;
+  raw.reserve((rowBytes + 1) * static_cast<size_t>(h));
+  for (int y = 0; y < h; ++y) {
+    const uchar* src = image.indices.ptr<uchar>(y);
+    raw.push_back(0);
+    if (depth == 8) {
+      raw.insert(raw.end(), src, src + w);
+      continue;
+    }
+    const uint8_t mask = static_cast<uint8_t>((1 << depth) - 1);
+    for (int x = 0; x < w; x += perByte) {
+      uint8_t packed = 0;
+      for (int k = 0; k < perByte; ++k) {
+        const uint8_t v = x + k < w ? static_cast<uint8_t>(src[x + k] & mask) : 0;
+        packed = static_cast<uint8_t>(packed | (v << (8 - depth * (k + 1))));
+      }
+      raw.push_back(packed);
+    }
+  }
+
+  static const uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  out.insert(out.end(), kSignature, kSignature + 8);
+
+  std::vector<uint8_t> ihdr;
+  PutU32BE(ihdr, static_cast<uint32_t>(w));
+  PutU32BE(ihdr, static_cast<uint32_t>(h));
+  ihdr.push_back(static_cast<uint8_t>(depth));
+  ihdr.push_back(3); // color type: palette
+  ihdr.push_back(0); // compression: deflate
+  ihdr.push_back(0); // filter method 0
+  ihdr.push_back(0); // no interlace
+  PutChunk(out, "IHDR", ihdr);
+
+  std::vector<uint8_t> plte;
+  for (const cv::Vec3b& c : image.colors) {
+    plte.push_back(c[2]);
+    plte.push_back(c[1]);
+    plte.push_back(c[0]);
+  }
+  PutChunk(out, "PLTE", plte);
+
+  std::vector<uint8_t> idat;
+  Deflate(raw, options, idat);
+  PutChunk(out, "IDAT", idat);
+  PutChunk(out, "IEND", {});
+  return true;
+}
+
+bool IndexedCodec::EncodeGIF(const IndexedImage& image, std::vector<uint8_t>& out) {
+  if (image.empty() || image.indices.type() != CV_8UC1 || image.colors.size() > 256) return false;
+  if (!BeginGIF(image.indices.size(), image.colors, -1, out)) return false;
+  if (!AppendGIFFrame(image, cv::Point(0, 0), -1, false, out)) return false;
+  EndGIF(out);
+  return true;
+}
+
+bool IndexedCodec::BeginGIF(const cv::Size& canvas, const std::vector<cv::Vec3b>& globalColors, int loopCount,
+                            std::vector<uint8_t>& out) {
+  if (canvas.width <= 0 || canvas.height <= 0 || canvas.width > 65535 || canvas.height > 65535) return false;
+  if (globalColors.empty() || globalColors.size() > 256) return false;
+  const int bits = BitsFor(globalColors.size());
+
+  static const char kHeader[6] = {'G', 'I', 'F', '8', '9', 'a'};
+  out.insert(out.end(), kHeader, kHeader + 6);
+  // Logical screen descriptor with a global color table of 2^bits entries.
+  PutU16LE(out, static_cast<uint32_t>(canvas.width));
+  PutU16LE(out, static_cast<uint32_t>(canvas.height));
+  out.push_back(static_cast<uint8_t>(0x80 | ((bits - 1) << 4) | (bits - 1)));
+  out.push_back(0); // background color index
+  out.push_back(0); // no aspect ratio
+  PutColorTable(out, globalColors, bits);
+
+  if (loopCount >= 0) {
+    // NETSCAPE2.0 application extension: loop count (0 = forever).
+    static const char kNetscape[11] = {'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0'};
+    out.push_back(0x21);
+    out.push_back(0xFF);
+    out.push_back(11);
+    out.insert(out.end(), kNetscape, kNetscape + 11);
+    out.push_back(3);
+    out.push_back(1);
+    PutU16LE(out, static_cast<uint32_t>(std::min(loopCount, 65535)));
+    out.push_back(0);
+  }
+  return true;
+}
+
+bool IndexedCodec::AppendGIFFrame(const IndexedImage& frame, const cv::Point& offset, int delayCs,
+                                  bool localColors, std::vector<uint8_t>& out) {
+  if (frame.empty() || frame.indices.type() != CV_8UC1 || frame.colors.size() > 256) return false;
+  const int w = frame.indices.cols;
+  const int h = frame.indices.rows;
+  if (offset.x < 0 || offset.y < 0 || offset.x + w > 65535 || offset.y + h > 65535) return false;
+
+  if (delayCs >= 0) {
+    // Graphic control extension: "do not dispose", so a sub-rectangle frame draws over the
+    // previous frame. Always the first 8 bytes of the frame (see SetGIFFrameDelay).
+    out.push_back(0x21);
+    out.push_back(0xF9);
+    out.push_back(4);
+    out.push_back(0x04);
+    PutU16LE(out, static_cast<uint32_t>(std::min(delayCs, 65535)));
+    out.push_back(0); // no transparent color
+    out.push_back(0);
+  }
+
+  // Image descriptor, optionally with a local color table; not interlaced.
+  const int bits = BitsFor(frame.colors.size());
+  out.push_back(0x2C);
+  PutU16LE(out, static_cast<uint32_t>(offset.x));
+  PutU16LE(out, static_cast<uint32_t>(offset.y));
+  PutU16LE(out, static_cast<uint32_t>(w));
+  PutU16LE(out, static_cast<uint32_t>(h));
+  out.push_back(localColors ? static_cast<uint8_t>(0x80 | (bits - 1)) : 0);
+  if (localColors) PutColorTable(out, frame.colors, bits);
+
+  const int minCodeSize = std::max(2, bits);
+  out.push_back(static_cast<uint8_t>(minCodeSize));
+  std::vector<uint8_t> codes;
+  LzwEncode(frame.indices, minCodeSize, codes);
+  for (size_t i = 0; i < codes.size(); i += 255) {
+    const size_t len = std::min<size_t>(255, codes.size() - i);
+    out.push_back(static_cast<uint8_t>(len));
+    out.insert(out.end(), codes.begin() + static_cast<std::ptrdiff_t>(i),
+               codes.begin() + static_cast<std::ptrdiff_t>(i + len));
+  }
+  out.push_back(0); // block terminator
+  return true;
+}
+
+void IndexedCodec::EndGIF(std::vector<uint8_t>& out) { out.push_back(0x3B); }
+
+bool IndexedCodec::SetGIFFrameDelay(std::vector<uint8_t>& frameBytes, int delayCs) {
+  if (frameBytes.size() < 8 || frameBytes[0] != 0x21 || frameBytes[1] != 0xF9) return false;
+  const uint32_t d = static_cast<uint32_t>(std::max(0, std::min(delayCs, 65535)));
+  frameBytes[4] = static_cast<uint8_t>(d);
+  frameBytes[5] = static_cast<uint8_t>(d >> 8);
+  return true;
+}
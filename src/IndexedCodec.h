@@ -0,0 +1,58 @@
+#pragma once
+
+#include "IndexedImage.h"
+
+#include <cstdint>
+#include <vector>
+
+// IndexedCodec: encoders for palette-indexed PNG and GIF.
+// Why this exists:
+// - cv::imwrite always writes 24-bit PNG, and most OpenCV builds cannot write GIF at all.
+// - Pixel-art output has at most 256 colors: an indexed PNG (PLTE chunk, 1/2/4/8-bit indices)
+//   or a GIF stores 1 byte (or less) per pixel before compression instead of 3, so files are
+//   several times smaller and faster to encode.
+// - Self-contained (no zlib / giflib dependency): PNG uses a small LZ77 + fixed-Huffman
+//   deflate, which suits the long runs and repeated rows of block-expanded images; GIF uses
+//   standard variable-width LZW.
+//
+// Palette entries are stored in the processor's channel order (BGR), exactly like cv::imwrite
+// would store the same image as 24-bit.
+class IndexedCodec {
+public:
+  // Match search of the PNG deflate stream.
+  enum class PngMatching {
+    LZ77,      // hash-chain search (effort set by the level)
+    RunLength, // repeats of the previous byte only (zlib Z_RLE): fast, good on flat rows
+    None       // literals only (zlib Z_HUFFMAN_ONLY)
+  };
+
+  struct PngOptions {
+    int level = 6; // 0 = stored (no compression); 1..9 = longer match search, smaller files
+    PngMatching matching = PngMatching::LZ77;
+  };
+
+  // Appends a complete PNG file to `out`. Fails on an empty image or more than 256 colors.
+  static bool EncodePNG(const IndexedImage& image, std::vector<uint8_t>& out);
+  static bool EncodePNG(const IndexedImage& image, std::vector<uint8_t>& out, const PngOptions& options);
+
+  // Appends a complete single-frame GIF89a file to `out`. Fails on an empty image, more than
+  // 256 colors or a side longer than 65535.
+  static bool EncodeGIF(const IndexedImage& image, std::vector<uint8_t>& out);
+
+  // ---- Animated GIF, piece by piece (EncodeGIF = BeginGIF + AppendGIFFrame + EndGIF) ----
+  // Header, logical screen of `canvas` with `globalColors` as the global color table, and
+  // (loopCount >= 0) a NETSCAPE2.0 loop extension; 0 loops forever.
+  static bool BeginGIF(const cv::Size& canvas, const std::vector<cv::Vec3b>& globalColors, int loopCount,
+                       std::vector<uint8_t>& out);
+  // One frame at `offset` of the canvas. `frame.colors` is the palette its indices refer to:
+  // written as a local color table with `localColors`, otherwise it must be (a prefix of) the
+  // global one. delayCs >= 0 adds a graphic control extension (delay in 1/100 s, "do not
+  // dispose", so sub-rectangle frames draw over the previous frame). Frames are independent,
+  // so they can be encoded on different threads and appended in order.
+  static bool AppendGIFFrame(const IndexedImage& frame, const cv::Point& offset, int delayCs,
+                             bool localColors, std::vector<uint8_t>& out);
+  static void EndGIF(std::vector<uint8_t>& out);
+  // Rewrites the delay of a frame produced by AppendGIFFrame with delayCs >= 0 (e.g. to hold
+  // it for following duplicate frames).
+  static bool SetGIFFrameDelay(std::vector<uint8_t>& frameBytes, int delayCs);
+};
@@ -0,0 +1,68 @@
+#include "IndexedImage.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+cv::Mat IndexedImage::ToBGR(const cv::Mat& indices, const std::vector<cv::Vec3b>& colors) {
+  cv::Mat out;
+  ToBGR(indices, colors, out);
+  return out;
+}
+
+void IndexedImage::ToBGR(const cv::Mat& indices, const std::vector<cv::Vec3b>& colors, cv::Mat& dst) {
+  if (indices.empty() || indices.type() != CV_8UC1) {
+    dst.release();
+    return;
+  }
+  // Full 256-entry table, so the pixel loop needs no bounds check.
+  cv::Vec3b table[256];
+  for (size_t i = 0; i < 256; ++i) table[i] = i < colors.size() ? colors[i] : cv::Vec3b(0, 0, 0);
+
+  dst.create(indices.size(), CV_8UC3);
+  cv::parallel_for_(cv::Range(0, indices.rows), [&](const cv::Range& range) {
+    for (int y = range.start; y < range.end; ++y) {
+      const uchar* src = indices.ptr<uchar>(y);
+      cv::Vec3b* row = dst.ptr<cv::Vec3b>(y);
+      for (int x = 0; x < indices.cols; ++x) row[x] = table[src[x]];
+    }
+  });
+}
+
+bool IndexedImage::FromBGR(const cv::Mat& bgr, IndexedImage& out, int maxColors) {
+  out = IndexedImage{};
+  if (bgr.empty() || bgr.type() != CV_8UC3) return false;
+  maxColors = std::max(1, std::min(maxColors, 256));
+
+  cv::Mat indices(bgr.size(), CV_8UC1);
+  std::vector<cv::Vec3b> colors;
+  std::unordered_map<uint32_t, uchar> lookup;
+  auto key = [](const cv::Vec3b& c) {
+    return static_cast<uint32_t>(c[0]) | (static_cast<uint32_t>(c[1]) << 8) | (static_cast<uint32_t>(c[2]) << 16);
+  };
+
+  for (int y = 0; y < bgr.rows; ++y) {
+    const cv::Vec3b* src = bgr.ptr<cv::Vec3b>(y);
+    uchar* dst = indices.ptr<uchar>(y);
+    // Block-expanded images are long runs of one color: only look up color changes.
+    uint32_t lastKey = key(src[0]) ^ 1u;
+    uchar lastIndex = 0;
+    for (int x = 0; x < bgr.cols; ++x) {
+      const uint32_t k = key(src[x]);
+      if (k != lastKey) {
+        auto it = lookup.find(k);
+        if (it == lookup.end()) {
+          if (static_cast<int>(colors.size()) >= maxColors) return false;
+          it = lookup.emplace(k, static_cast<uchar>(colors.size())).first;
+          colors.push_back(src[x]);
+        }
+        lastKey = k;
+        lastIndex = it->second;
+      }
+      dst[x] = lastIndex;
+    }
+  }
+  out.indices = indices;
+  out.colors = std::move(colors);
+  return true;
+}
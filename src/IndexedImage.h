@@ -0,0 +1,30 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+// IndexedImage: palette-indexed 8-bit image (at most 256 colors).
+// Why this exists:
+// - After palette limitation every pixel is one of <= 256 palette entries. Carrying the index
+//   plane instead of BGR moves one byte per pixel through block expansion and outlining
+//   instead of three.
+// - Indexed PNG / GIF files are written straight from it (see IndexedCodec), which is several
+//   times smaller and faster to encode than 24-bit output.
+struct IndexedImage {
+  cv::Mat indices;               // CV_8UC1
+  std::vector<cv::Vec3b> colors; // entry per index, in the processor's channel order
+
+  bool empty() const { return indices.empty() || colors.empty(); }
+
+  // Expands to an 8-bit 3-channel image; indices without an entry map to black.
+  cv::Mat ToBGR() const { return ToBGR(indices, colors); }
+  static cv::Mat ToBGR(const cv::Mat& indices, const std::vector<cv::Vec3b>& colors);
+  // Same into `dst`, which is only reallocated if its size or type differ (e.g. a
+  // ProcessContext buffer). Leaves `dst` empty for invalid input.
+  static void ToBGR(const cv::Mat& indices, const std::vector<cv::Vec3b>& colors, cv::Mat& dst);
+
+  // Exact conversion of an 8-bit 3-channel image with at most `maxColors` (<= 256) distinct
+  // colors; colors are numbered in order of first appearance. Returns false otherwise.
+  static bool FromBGR(const cv::Mat& bgr, IndexedImage& out, int maxColors = 256);
+};
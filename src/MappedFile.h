@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// MappedFile: read-only memory mapping of a whole file.
+// Why this exists:
+// - ImageLoader decodes from memory (cv::imdecode). Mapping the file hands the decoder the
+//   page cache directly, instead of reading it into a heap buffer first.
+// - Batch runs decode many files concurrently; mapped pages are shared and dropped by the OS
+//   under memory pressure, unlike per-worker read buffers.
+//
+// Move-only; the mapping is released by the destructor or Close().
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Maps `path`. Fails on missing / unreadable files and on empty files (nothing to map).
+  bool Open(const std::string& path, std::string& outError);
+  void Close();
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  void* file_ = nullptr;    // HANDLE
+  void* mapping_ = nullptr; // HANDLE
+#endif
+};
@@ -0,0 +1,226 @@
+#include "OrderedDither.h"
+
+#include "ProcessContext.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace {
+// Threshold map: size × size values in [-0.5, 0.5), row-major. size is a power of two.
+struct ThresholdMap {
+  int size = 0;
+  std::vector<float> values;
+};
+
+// Ranks 0..size²-1 -> centred thresholds.
+ThresholdMap FromRanks(int size, const std::vector<int>& ranks) {
+  ThresholdMap map;
+  map.size = size;
+  map.values.resize(ranks.size());
+  const float inv = 1.0f / static_cast<float>(ranks.size());
+  for (size_t i = 0; i < ranks.size(); ++i) {
+    map.values[i] = (static_cast<float>(ranks[i]) + 0.5f) * inv - 0.5f;
+  }
+  return map;
+}
+
+// Recursive Bayer construction: M(2n) = [4M, 4M+2; 4M+3, 4M+1].
+ThresholdMap MakeBayer(int size) {
+  std::vector<int> ranks{0};
+  for (int n = 1; n < size; n *= 2) {
+    const int m = n * 2;
+    std::vector<int> next(static_cast<size_t>(m * m));
+    for (int y = 0; y < n; ++y) {
+      for (int x = 0; x < n; ++x) {
+        const int v = 4 * ranks[static_cast<size_t>(y * n + x)];
+        next[static_cast<size_t>(y * m + x)] = v;
+        next[static_cast<size_t>(y * m + x + n)] = v + 2;
+        next[static_cast<size_t>((y + n) * m + x)] = v + 3;
+        next[static_cast<size_t>((y + n) * m + x + n)] = v + 1;
+      }
+    }
+    ranks.swap(next);
+  }
+  return FromRanks(size, ranks);
+}
+
+// Void-and-cluster (Ulichney 1993) on a toroidal size × size grid with a Gaussian energy filter.
+// Seeded, so every run builds the same texture.
+ThresholdMap MakeBlueNoise(int size) {
+  const int n = size * size;
+  const int mask = size - 1;
+  const double sigma = 1.5;
+
+  std::vector<double> kernel(static_cast<size_t>(n));
+  for (int dy = 0; dy < size; ++dy) {
+    for (int dx = 0; dx < size; ++dx) {
+      const int wx = std::min(dx, size - dx);
+      const int wy = std::min(dy, size - dy);
+      kernel[static_cast<size_t>(dy * size + dx)] = std::exp(-(wx * wx + wy * wy) / (2.0 * sigma * sigma));
+    }
+  }
+
+  auto toggle = [&](std::vector<double>& energy, int idx, double sign) {
+    const int ix = idx & mask;
+    const int iy = idx / size;
+    for (int y = 0; y < size; ++y) {
+      const double* krow = kernel.data() + static_cast<size_t>(((y - iy) & mask) * size);
+      double* erow = energy.data() + static_cast<size_t>(y * size);
+      for (int x = 0; x < size; ++x) erow[x] += sign * krow[(x - ix) & mask];
+    }
+  };
+  // Tightest cluster = highest energy among set points; largest void = lowest among unset ones.
+  auto tightestCluster = [&](const std::vector<uint8_t>& bits, const std::vector<double>& energy) {
+    int best = -1;
+    for (int i = 0; i < n; ++i) {
+      if (bits[static_cast<size_t>(i)] && (best < 0 || energy[static_cast<size_t>(i)] > energy[static_cast<size_t>(best)])) best = i;
+    }
+    return best;
+  };
+  auto largestVoid = [&](const std::vector<uint8_t>& bits, const std::vector<double>& energy) {
+    int best = -1;
+    for (int i = 0; i < n; ++i) {
+      if (!bits[static_cast<size_t>(i)] && (best < 0 || energy[static_cast<size_t>(i)] < energy[static_cast<size_t>(best)])) best = i;
+    }
+    return best;
+  };
+
+  // Initial pattern: ~10% random points, then relaxed until the tightest cluster is also the
+  // largest void.
+  std::vector<uint8_t> bits(static_cast<size_t>(n), 0);
+  std::vector<double> energy(static_cast<size_t>(n), 0.0);
+  std::mt19937 rng(0x5EED);
+  int ones = 0;
+  while (ones < n / 10) {
+    const int idx = static_cast<int>(rng() % static_cast<uint32_t>(n));
+    if (bits[static_cast<size_t>(idx)]) continue;
+    bits[static_cast<size_t>(idx)] = 1;
+    toggle(energy, idx, 1.0);
+    ++ones;
+  }
+  for (int iter = 0; iter < n; ++iter) {
+    const int cluster = tightestCluster(bits, energy);
+    bits[static_cast<size_t>(cluster)] = 0;
+    toggle(energy, cluster, -1.0);
+    const int hole = largestVoid(bits, energy);
+    bits[static_cast<size_t>(hole)] = 1;
+    toggle(energy, hole, 1.0);
+    if (hole == cluster) break;
+  }
+
+  std::vector<int> ranks(static_cast<size_t>(n), 0);
+
+  // Phase 1: remove points from the initial pattern, tightest cluster first.
+  {
+    std::vector<uint8_t> b = bits;
+    std::vector<double> e = energy;
+    for (int rank = ones - 1; rank >= 0; --rank) {
+      const int cluster = tightestCluster(b, e);
+      b[static_cast<size_t>(cluster)] = 0;
+      toggle(e, cluster, -1.0);
+      ranks[static_cast<size_t>(cluster)] = rank;
+    }
+  }
+  // Phases 2 + 3: fill the remaining cells, largest void first.
+  for (int rank = ones; rank < n; ++rank) {
+    const int hole = largestVoid(bits, energy);
+    bits[static_cast<size_t>(hole)] = 1;
+    toggle(energy, hole, 1.0);
+    ranks[static_cast<size_t>(hole)] = rank;
+  }
+  return FromRanks(size, ranks);
+}
+
+const ThresholdMap& GetMap(OrderedDither::Matrix matrix) {
+  static const ThresholdMap kBayer2 = MakeBayer(2);
+  static const ThresholdMap kBayer4 = MakeBayer(4);
+  static const ThresholdMap kBayer8 = MakeBayer(8);
+  switch (matrix) {
+    case OrderedDither::Matrix::Bayer2: return kBayer2;
+    case OrderedDither::Matrix::Bayer4: return kBayer4;
+    case OrderedDither::Matrix::Bayer8: return kBayer8;
+    case OrderedDither::Matrix::BlueNoise: break;
+  }
+  // Generating the texture takes a few tens of milliseconds; only pay for it when it is used.
+  static std::once_flag once;
+  static ThresholdMap blueNoise;
+  std::call_once(once, [] { blueNoise = MakeBlueNoise(64); });
+  return blueNoise;
+}
+
+// Threshold amplitude (per channel): mean distance from each palette entry to its nearest
+// neighbour, i.e. the typical gap the dither has to bridge, spread over the three channels
+// (exact for gray ramps, where black -> white is 255 per channel but 255·√3 in distance).
+float PaletteSpread(const std::vector<cv::Vec3b>& colors) {
+  if (colors.size() < 2) return 0.0f;
+  double sum = 0.0;
+  for (size_t i = 0; i < colors.size(); ++i) {
+    int best = std::numeric_limits<int>::max();
+    for (size_t j = 0; j < colors.size(); ++j) {
+      if (i != j) best = std::min(best, PaletteLUT::DistanceSquared(colors[i], colors[j]));
+    }
+    sum += std::sqrt(static_cast<double>(best));
+  }
+  return static_cast<float>(sum / (static_cast<double>(colors.size()) * std::sqrt(3.0)));
+}
+
+// Per map row, the integer offset of every output column, so the pixel loop is just
+// add + clamp + lookup (and the same offsets serve every channel).
+void BuildOffsets(const std::vector<cv::Vec3b>& colors, const ThresholdMap& map, int cols, int originX,
+                  std::vector<int16_t>& offsets) {
+  const int size = map.size;
+  const int mask = size - 1;
+  const float spread = PaletteSpread(colors);
+  offsets.resize(static_cast<size_t>(size) * static_cast<size_t>(cols));
+  for (int my = 0; my < size; ++my) {
+    int16_t* row = offsets.data() + static_cast<size_t>(my) * static_cast<size_t>(cols);
+    const float* mrow = map.values.data() + static_cast<size_t>(my * size);
+    for (int x = 0; x < cols; ++x) {
+      row[x] = static_cast<int16_t>(std::lround(mrow[(x + originX) & mask] * spread));
+    }
+  }
+}
+} // namespace
+
+cv::Mat OrderedDither::Offsets(const std::vector<cv::Vec3b>& colors, Matrix matrix, int cols, int originX) {
+  if (cols <= 0) return {};
+  const ThresholdMap& map = GetMap(matrix);
+  std::vector<int16_t> offsets;
+  BuildOffsets(colors, map, cols, originX, offsets);
+  return cv::Mat(map.size, cols, CV_16SC1, offsets.data()).clone();
+}
+
+cv::Mat OrderedDither::Apply(const cv::Mat& src8u3, const PaletteLUT& lut, Matrix matrix, cv::Point origin,
+                             ProcessContext* context) {
+  if (src8u3.empty() || src8u3.type() != CV_8UC3 || lut.empty()) return {};
+
+  const ThresholdMap& map = GetMap(matrix);
+  const int mask = map.size - 1;
+  const int cols = src8u3.cols;
+  std::vector<int16_t> offsets;
+  BuildOffsets(lut.Colors(), map, cols, origin.x, offsets);
+
+  cv::Mat dst = ProcessContext::Scratch(context, ProcessContext::Slot::Indices, src8u3.rows, cols, CV_8UC1);
+  cv::parallel_for_(cv::Range(0, src8u3.rows), [&](const cv::Range& range) {
+    // Thresholded row first, then one vectorised LUT pass over it (row kept per pool thread).
+    thread_local std::vector<cv::Vec3b> shifted;
+    shifted.resize(static_cast<size_t>(cols));
+    for (int y = range.start; y < range.end; ++y) {
+      const cv::Vec3b* s = src8u3.ptr<cv::Vec3b>(y);
+      const int16_t* off = offsets.data() + static_cast<size_t>((y + origin.y) & mask) * static_cast<size_t>(cols);
+      for (int x = 0; x < cols; ++x) {
+        const int o = off[x];
+        shifted[static_cast<size_t>(x)] = cv::Vec3b(static_cast<uchar>(std::min(255, std::max(0, s[x][0] + o))),
+                                                    static_cast<uchar>(std::min(255, std::max(0, s[x][1] + o))),
+                                                    static_cast<uchar>(std::min(255, std::max(0, s[x][2] + o))));
+      }
+      lut.NearestIndexRow(shifted.data()->val, dst.ptr<uchar>(y), cols);
+    }
+  });
+  return dst;
+}
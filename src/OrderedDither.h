@@ -0,0 +1,39 @@
+#pragma once
+
+#include "PaletteLUT.h"
+
+#include <opencv2/core.hpp>
+
+class ProcessContext;
+
+// OrderedDither: threshold-map dithering onto a fixed palette.
+// Why this exists (next to ErrorDiffusion):
+// - Every pixel depends only on its own color and its position in the threshold map, so rows
+//   run fully in parallel and the per-pixel work is a branch-free add + clamp + table lookup.
+// - The map is indexed by absolute image coordinates (plus `origin`), so a tiled or streamed
+//   image dithers to exactly the same result as the whole image at once.
+// - The pattern is stable under small edits (no error propagating across the image), which
+//   suits live preview and animation frames.
+class OrderedDither {
+public:
+  enum class Matrix {
+    Bayer2,   // 2×2 Bayer
+    Bayer4,   // 4×4 Bayer
+    Bayer8,   // 8×8 Bayer
+    BlueNoise // 64×64 void-and-cluster blue noise (generated once, deterministic)
+  };
+
+  // Dithers an 8-bit 3-channel image onto the palette behind `lut`. The threshold amplitude is
+  // derived from the palette (mean distance between neighbouring entries), so sparse palettes
+  // get stronger dithering than dense ones. `origin` is the position of src(0, 0) in the full
+  // image. Returns the chosen palette index of every pixel (CV_8UC1), or an empty Mat for
+  // empty / non-CV_8UC3 input or an empty LUT. With a `context` the result lives in its Indices
+  // slot (see ProcessContext).
+  static cv::Mat Apply(const cv::Mat& src8u3, const PaletteLUT& lut, Matrix matrix,
+                       cv::Point origin = cv::Point(0, 0), ProcessContext* context = nullptr);
+
+  // The threshold offset Apply adds to every channel before the lookup, for kernels that
+  // dither elsewhere (GpuProcessor): map size rows × `cols` (CV_16SC1); image row y uses row
+  // (y + origin.y) & (rows - 1). Empty for cols <= 0.
+  static cv::Mat Offsets(const std::vector<cv::Vec3b>& colors, Matrix matrix, int cols, int originX = 0);
+};
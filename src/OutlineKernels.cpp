@@ -0,0 +1,234 @@
+#include "OutlineKernels.h"
+
+#include "CpuDispatch.h"
+#include "ProcessContext.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace {
+static_assert(OutlineKernels::kLuminanceThreshold == CpuKernels::kOutlineLuminanceThreshold &&
+                  OutlineKernels::kColorDistanceThreshold * OutlineKernels::kColorDistanceThreshold ==
+                      CpuKernels::kOutlineColorDistanceSq,
+              "the row kernels test the same thresholds");
+
+// Adaptive darkening: darker pixels get less darkening, bright ones more, so outlines look
+// natural on any color.
+inline void Darken(cv::Vec3b& pixel) {
+  const int brightness = (static_cast<int>(pixel[0]) + static_cast<int>(pixel[1]) + static_cast<int>(pixel[2])) / 3;
+  const int amount = brightness < 64 ? 40 : (brightness > 192 ? 90 : 70);
+  pixel[0] = static_cast<uchar>(std::max(0, pixel[0] - amount));
+  pixel[1] = static_cast<uchar>(std::max(0, pixel[1] - amount));
+  pixel[2] = static_cast<uchar>(std::max(0, pixel[2] - amount));
+}
+} // namespace
+
+cv::Mat OutlineKernels::EdgeMask(const cv::Mat& bgr, ProcessContext* context) {
+  if (bgr.empty() || bgr.type() != CV_8UC3) return {};
+  const int rows = bgr.rows;
+  const int cols = bgr.cols;
+
+  const CpuKernels& kernels = CpuDispatch::Kernels();
+  cv::Mat lum = ProcessContext::Scratch(context, ProcessContext::Slot::OutlineLuminance, rows, cols, CV_8UC1);
+  cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+    for (int y = range.start; y < range.end; ++y) kernels.luminanceRow(bgr.ptr<uchar>(y), lum.ptr<uchar>(y), cols);
+  });
+
+  cv::Mat mask = ProcessContext::Scratch(context, ProcessContext::Slot::OutlineMask, rows, cols, CV_8UC1);
+  cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+    // Pair tests: right neighbour (h) and lower neighbour (vBelow); vAbove is the previous
+    // row's vBelow (recomputed once at the start of each stripe). Kept per (pool) thread.
+    thread_local std::vector<uchar> h, vAbove, vBelow;
+    h.assign(static_cast<size_t>(cols), 0);
+    vAbove.assign(static_cast<size_t>(cols), 0);
+    vBelow.assign(static_cast<size_t>(cols), 0);
+    if (range.start > 0) {
+      const int y = range.start - 1;
+      kernels.pairDiffRow(bgr.ptr<uchar>(y), bgr.ptr<uchar>(y + 1), lum.ptr<uchar>(y), lum.ptr<uchar>(y + 1),
+                          vAbove.data(), cols);
+    }
+    for (int y = range.start; y < range.end; ++y) {
+      const uchar* row = bgr.ptr<uchar>(y);
+      const uchar* lumRow = lum.ptr<uchar>(y);
+      if (cols > 1) kernels.pairDiffRow(row, row + 3, lumRow, lumRow + 1, h.data(), cols - 1);
+      if (y + 1 < rows) {
+        kernels.pairDiffRow(row, bgr.ptr<uchar>(y + 1), lumRow, lum.ptr<uchar>(y + 1), vBelow.data(), cols);
+      } else {
+        std::fill(vBelow.begin(), vBelow.end(), static_cast<uchar>(0));
+      }
+
+      uchar* out = mask.ptr<uchar>(y);
+      for (int x = 0; x < cols; ++x) {
+        const uchar right = x + 1 < cols ? h[static_cast<size_t>(x)] : 0;
+        const uchar left = x > 0 ? h[static_cast<size_t>(x) - 1] : 0;
+        out[x] = static_cast<uchar>(right | left | vBelow[static_cast<size_t>(x)] | vAbove[static_cast<size_t>(x)]);
+      }
+      vAbove.swap(vBelow);
+    }
+  });
+  return mask;
+}
+
+namespace {
+// Outline morphology of `edgeMask` (see OutlineKernels::DarkenOutline), calling
+// darken(y, x) for every pixel under the final outline. The last morphology pass is fused with
+// the callback, so no output mask is ever written.
+template <typename DarkenFn>
+void ForEachOutlinePixel(const cv::Mat& edgeMask, int thickness, ProcessContext* context, DarkenFn darken) {
+  const int rows = edgeMask.rows;
+  const int cols = edgeMask.cols;
+
+  // First pass: erosion with a 3x3 cross (thickness 1; outside the image counts as set, like
+  // cv::erode's default border) or the horizontal half of the square dilation (outside = 0).
+  cv::Mat stage = ProcessContext::Scratch(context, ProcessContext::Slot::OutlineStage, rows, cols, CV_8UC1);
+  cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+    for (int y = range.start; y < range.end; ++y) {
+      const uchar* m = edgeMask.ptr<uchar>(y);
+      uchar* out = stage.ptr<uchar>(y);
+      if (thickness == 1) {
+        const uchar* up = y > 0 ? edgeMask.ptr<uchar>(y - 1) : nullptr;
+        const uchar* down = y + 1 < rows ? edgeMask.ptr<uchar>(y + 1) : nullptr;
+        for (int x = 0; x < cols; ++x) {
+          uchar v = m[x];
+          if (x > 0) v = std::min(v, m[x - 1]);
+          if (x + 1 < cols) v = std::min(v, m[x + 1]);
+          if (up) v = std::min(v, up[x]);
+          if (down) v = std::min(v, down[x]);
+          out[x] = v;
+        }
+      } else {
+        // Max over [x - t, x + t] as 2t+1 shifted passes (vectorisable inner loops).
+        std::copy(m, m + cols, out);
+        for (int d = 1; d <= thickness && d < cols; ++d) {
+          for (int x = 0; x + d < cols; ++x) out[x] = std::max(out[x], m[x + d]);
+          for (int x = d; x < cols; ++x) out[x] = std::max(out[x], m[x - d]);
+        }
+      }
+    }
+  });
+
+  // Second pass: the dilation (3x3 cross, or the vertical half of the square), fused with the
+  // darkening of every pixel it covers.
+  cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+    thread_local std::vector<uchar> column; // vertical max of the current row
+    column.resize(static_cast<size_t>(cols));
+    for (int y = range.start; y < range.end; ++y) {
+      if (thickness == 1) {
+        const uchar* e = stage.ptr<uchar>(y);
+        const uchar* up = y > 0 ? stage.ptr<uchar>(y - 1) : nullptr;
+        const uchar* down = y + 1 < rows ? stage.ptr<uchar>(y + 1) : nullptr;
+        for (int x = 0; x < cols; ++x) {
+          uchar v = e[x];
+          if (x > 0) v = std::max(v, e[x - 1]);
+          if (x + 1 < cols) v = std::max(v, e[x + 1]);
+          if (up) v = std::max(v, up[x]);
+          if (down) v = std::max(v, down[x]);
+          if (v > 128) darken(y, x);
+        }
+      } else {
+        const int y0 = std::max(0, y - thickness);
+        const int y1 = std::min(rows - 1, y + thickness);
+        std::copy(stage.ptr<uchar>(y0), stage.ptr<uchar>(y0) + cols, column.begin());
+        for (int i = y0 + 1; i <= y1; ++i) {
+          const uchar* s = stage.ptr<uchar>(i);
+          for (int x = 0; x < cols; ++x) column[static_cast<size_t>(x)] = std::max(column[static_cast<size_t>(x)], s[x]);
+        }
+        for (int x = 0; x < cols; ++x) {
+          if (column[static_cast<size_t>(x)] > 128) darken(y, x);
+        }
+      }
+    }
+  });
+}
+} // namespace
+
+void OutlineKernels::DarkenOutline(cv::Mat& bgr, const cv::Mat& edgeMask, int thickness,
+                                   ProcessContext* context) {
+  if (bgr.empty() || bgr.type() != CV_8UC3) return;
+  if (edgeMask.type() != CV_8UC1 || edgeMask.size() != bgr.size()) return;
+  thickness = std::max(1, std::min(thickness, 5));
+  ForEachOutlinePixel(edgeMask, thickness, context, [&](int y, int x) { Darken(bgr.ptr<cv::Vec3b>(y)[x]); });
+}
+
+cv::Mat OutlineKernels::EdgeMaskIndexed(const cv::Mat& indices, const std::vector<cv::Vec3b>& colors,
+                                        ProcessContext* context) {
+  if (indices.empty() || indices.type() != CV_8UC1 || colors.empty() || colors.size() > 256) return {};
+  const int rows = indices.rows;
+  const int cols = indices.cols;
+
+  // The pair test depends only on the two colors: evaluate it once per palette pair.
+  // Indices without a palette entry count as black, like IndexedImage::ToBGR.
+  // Fixed-size tables, kept per calling thread; the stripes read `differs` through a local
+  // reference (the thread_local name would resolve to the pool thread's copy).
+  thread_local std::vector<cv::Vec3b> entries, same;
+  thread_local std::vector<uchar> lum, differsTable, sameLum;
+  entries.assign(colors.begin(), colors.end());
+  entries.resize(256, cv::Vec3b(0, 0, 0));
+  const CpuKernels& kernels = CpuDispatch::Kernels();
+  lum.resize(256);
+  kernels.luminanceRow(reinterpret_cast<const uchar*>(entries.data()), lum.data(), 256);
+  std::vector<uchar>& differs = differsTable;
+  differs.resize(256 * 256);
+  same.resize(256);
+  sameLum.resize(256);
+  for (size_t i = 0; i < 256; ++i) {
+    std::fill(same.begin(), same.end(), entries[i]);
+    std::fill(sameLum.begin(), sameLum.end(), lum[i]);
+    kernels.pairDiffRow(reinterpret_cast<const uchar*>(same.data()), reinterpret_cast<const uchar*>(entries.data()),
+                        sameLum.data(), lum.data(), differs.data() + i * 256, 256);
+  }
+
+  cv::Mat mask = ProcessContext::Scratch(context, ProcessContext::Slot::OutlineMask, rows, cols, CV_8UC1);
+  cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+    for (int y = range.start; y < range.end; ++y) {
+      const uchar* row = indices.ptr<uchar>(y);
+      const uchar* up = y > 0 ? indices.ptr<uchar>(y - 1) : nullptr;
+      const uchar* down = y + 1 < rows ? indices.ptr<uchar>(y + 1) : nullptr;
+      uchar* out = mask.ptr<uchar>(y);
+      for (int x = 0; x < cols; ++x) {
+        const uchar* d = differs.data() + static_cast<size_t>(row[x]) * 256;
+        uchar v = 0;
+        if (x + 1 < cols) v |= d[row[x + 1]];
+        if (x > 0) v |= d[row[x - 1]];
+        if (down) v |= d[down[x]];
+        if (up) v |= d[up[x]];
+        out[x] = v;
+      }
+    }
+  });
+  return mask;
+}
+
+bool OutlineKernels::DarkenedPalette(const std::vector<cv::Vec3b>& colors, std::vector<cv::Vec3b>& outColors,
+                                     std::vector<uchar>& outDarkIndex) {
+  if (colors.empty() || colors.size() > 256) return false;
+  std::vector<cv::Vec3b> extended(colors);
+  std::vector<uchar> darkIndex(256, 0);
+  for (size_t i = 0; i < colors.size(); ++i) {
+    cv::Vec3b dark = colors[i];
+    Darken(dark);
+    // Reuse an existing entry (e.g. black stays black, or the palette already has the shade).
+    size_t j = 0;
+    while (j < extended.size() && extended[j] != dark) ++j;
+    if (j == extended.size()) {
+      if (extended.size() >= 256) return false;
+      extended.push_back(dark);
+    }
+    darkIndex[i] = static_cast<uchar>(j);
+  }
+  outColors = std::move(extended);
+  outDarkIndex = std::move(darkIndex);
+  return true;
+}
+
+void OutlineKernels::DarkenOutlineIndexed(cv::Mat& indices, const std::vector<uchar>& darkIndex,
+                                          const cv::Mat& edgeMask, int thickness, ProcessContext* context) {
+  if (indices.empty() || indices.type() != CV_8UC1 || darkIndex.size() < 256) return;
+  if (edgeMask.type() != CV_8UC1 || edgeMask.size() != indices.size()) return;
+  thickness = std::max(1, std::min(thickness, 5));
+  ForEachOutlinePixel(edgeMask, thickness, context, [&](int y, int x) {
+    uchar& idx = indices.ptr<uchar>(y)[x];
+    idx = darkIndex[idx];
+  });
+}
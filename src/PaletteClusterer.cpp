@@ -0,0 +1,299 @@
+#include "PaletteClusterer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace {
+inline float DistSq(const cv::Vec3f& a, const cv::Vec3f& b) {
+  const float d0 = a[0] - b[0];
+  const float d1 = a[1] - b[1];
+  const float d2 = a[2] - b[2];
+  return d0 * d0 + d1 * d1 + d2 * d2;
+}
+
+// Uniform double in [0, 1). std::uniform_real_distribution is implementation-defined,
+// so it would make palettes differ between compilers for the same seed.
+inline double Uniform01(std::mt19937& rng) {
+  return static_cast<double>(rng() >> 5) * (1.0 / 134217728.0);
+}
+
+// Picks an index with probability proportional to weights[i] (sum given).
+size_t SampleWeighted(const std::vector<double>& weights, double sum, std::mt19937& rng) {
+  const double target = Uniform01(rng) * sum;
+  double acc = 0.0;
+  for (size_t i = 0; i < weights.size(); ++i) {
+    acc += weights[i];
+    if (acc > target) return i;
+  }
+  return weights.size() - 1;
+}
+
+// Weighted k-means++ seeding.
+std::vector<cv::Vec3f> SeedPlusPlus(const PaletteClusterer::Histogram& h, int k, std::mt19937& rng) {
+  const size_t n = h.colors.size();
+  std::vector<cv::Vec3f> centers;
+  centers.reserve(static_cast<size_t>(k));
+
+  std::vector<double> prob(h.weights.begin(), h.weights.end());
+  double sum = 0.0;
+  for (double w : prob) sum += w;
+  centers.push_back(h.colors[SampleWeighted(prob, sum, rng)]);
+
+  std::vector<float> nearest(n, std::numeric_limits<float>::max());
+  while (static_cast<int>(centers.size()) < k) {
+    sum = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+      nearest[i] = std::min(nearest[i], DistSq(h.colors[i], centers.back()));
+      prob[i] = static_cast<double>(h.weights[i]) * nearest[i];
+      sum += prob[i];
+    }
+    if (sum <= 0.0) break; // fewer distinct colors than k (callers clamp k, but be safe)
+    centers.push_back(h.colors[SampleWeighted(prob, sum, rng)]);
+  }
+  return centers;
+}
+
+double Compactness(const PaletteClusterer::Histogram& h, const std::vector<cv::Vec3f>& centers) {
+  double total = 0.0;
+  for (size_t i = 0; i < h.colors.size(); ++i) {
+    const int c = PaletteClusterer::NearestCenter(centers, h.colors[i]);
+    total += static_cast<double>(h.weights[i]) * DistSq(h.colors[i], centers[static_cast<size_t>(c)]);
+  }
+  return total;
+}
+
+// Full-batch Lloyd iterations with Hamerly's bounds:
+// - u[i]: upper bound on the distance to the assigned center,
+// - l[i]: lower bound on the distance to every other center,
+// - s[j]: half the distance from center j to its nearest other center.
+// A point keeps its center without any scan when u[i] <= max(s[a[i]], l[i]).
+int RunHamerly(const PaletteClusterer::Histogram& h, std::vector<cv::Vec3f>& centers,
+               int maxIterations, float epsilon) {
+  const size_t n = h.colors.size();
+  const size_t k = centers.size();
+  std::vector<int> assign(n, 0);
+  std::vector<float> upper(n), lower(n), half(k), move(k);
+  std::vector<double> sums(k * 3), mass(k);
+  std::vector<size_t> reseeded;
+
+  auto fullSearch = [&](size_t i) {
+    float best = std::numeric_limits<float>::max(), second = best;
+    int bestIdx = 0;
+    for (size_t j = 0; j < k; ++j) {
+      const float d = DistSq(h.colors[i], centers[j]);
+      if (d < best) {
+        second = best;
+        best = d;
+        bestIdx = static_cast<int>(j);
+      } else if (d < second) {
+        second = d;
+      }
+    }
+    assign[i] = bestIdx;
+    upper[i] = std::sqrt(best);
+    lower[i] = k > 1 ? std::sqrt(second) : std::numeric_limits<float>::max();
+  };
+  for (size_t i = 0; i < n; ++i) fullSearch(i);
+
+  int iter = 0;
+  while (iter < maxIterations) {
+    ++iter;
+
+    // Update step: weighted means (accumulated in double, in index order: deterministic).
+    std::fill(sums.begin(), sums.end(), 0.0);
+    std::fill(mass.begin(), mass.end(), 0.0);
+    for (size_t i = 0; i < n; ++i) {
+      const size_t c = static_cast<size_t>(assign[i]);
+      const double w = h.weights[i];
+      sums[c * 3 + 0] += w * h.colors[i][0];
+      sums[c * 3 + 1] += w * h.colors[i][1];
+      sums[c * 3 + 2] += w * h.colors[i][2];
+      mass[c] += w;
+    }
+    float maxMove = 0.0f, secondMove = 0.0f;
+    size_t maxMoveIdx = 0;
+    reseeded.clear();
+    for (size_t j = 0; j < k; ++j) {
+      cv::Vec3f next = centers[j];
+      if (mass[j] > 0.0) {
+        next = cv::Vec3f(static_cast<float>(sums[j * 3 + 0] / mass[j]),
+                         static_cast<float>(sums[j * 3 + 1] / mass[j]),
+                         static_cast<float>(sums[j * 3 + 2] / mass[j]));
+      } else {
+        // Empty cluster: move it onto the point that is currently worst served.
+        size_t far = 0;
+        for (size_t i = 1; i < n; ++i) {
+          if (upper[i] > upper[far]) far = i;
+        }
+        next = h.colors[far];
+        upper[far] = 0.0f; // so a second empty cluster picks a different point
+        assign[far] = static_cast<int>(j);
+        reseeded.push_back(far);
+      }
+      move[j] = std::sqrt(DistSq(next, centers[j]));
+      centers[j] = next;
+      if (move[j] > maxMove) {
+        secondMove = maxMove;
+        maxMove = move[j];
+        maxMoveIdx = j;
+      } else if (move[j] > secondMove) {
+        secondMove = move[j];
+      }
+    }
+    // Reseeded points have no valid bounds; force a full search for them.
+    for (size_t i : reseeded) {
+      upper[i] = std::numeric_limits<float>::max();
+      lower[i] = 0.0f;
+    }
+    if (maxMove <= epsilon) break;
+
+    // Keep the bounds valid for the moved centers.
+    for (size_t i = 0; i < n; ++i) {
+      const size_t c = static_cast<size_t>(assign[i]);
+      upper[i] += move[c];
+      lower[i] -= (c == maxMoveIdx) ? secondMove : maxMove;
+    }
+    for (size_t j = 0; j < k; ++j) {
+      float nearest = std::numeric_limits<float>::max();
+      for (size_t j2 = 0; j2 < k; ++j2) {
+        if (j2 != j) nearest = std::min(nearest, DistSq(centers[j], centers[j2]));
+      }
+      half[j] = 0.5f * std::sqrt(nearest);
+    }
+
+    // Assignment step.
+    for (size_t i = 0; i < n; ++i) {
+      const size_t c = static_cast<size_t>(assign[i]);
+      const float bound = std::max(half[c], lower[i]);
+      if (upper[i] <= bound) continue;
+      upper[i] = std::sqrt(DistSq(h.colors[i], centers[c]));
+      if (upper[i] <= bound) continue;
+      fullSearch(i);
+    }
+  }
+  return iter;
+}
+
+// Sculley-style mini-batch k-means: each iteration samples `batch` points by weight and moves
+// their nearest centers with a per-center decaying learning rate.
+void RunMiniBatch(const PaletteClusterer::Histogram& h, std::vector<cv::Vec3f>& centers,
+                  int iterations, int batch, std::mt19937& rng) {
+  std::vector<double> cumulative(h.weights.size());
+  double sum = 0.0;
+  for (size_t i = 0; i < h.weights.size(); ++i) {
+    sum += h.weights[i];
+    cumulative[i] = sum;
+  }
+  std::vector<double> counts(centers.size(), 0.0);
+  std::vector<size_t> picks(static_cast<size_t>(batch));
+  std::vector<int> nearest(static_cast<size_t>(batch));
+
+  for (int it = 0; it < iterations; ++it) {
+    for (int b = 0; b < batch; ++b) {
+      const double target = Uniform01(rng) * sum;
+      const size_t i = static_cast<size_t>(std::upper_bound(cumulative.begin(), cumulative.end(), target) -
+                                           cumulative.begin());
+      picks[static_cast<size_t>(b)] = std::min(i, h.colors.size() - 1);
+    }
+    // Assign the whole batch against the same centers, then apply the updates.
+    for (int b = 0; b < batch; ++b) {
+      nearest[static_cast<size_t>(b)] = PaletteClusterer::NearestCenter(centers, h.colors[picks[static_cast<size_t>(b)]]);
+    }
+    for (int b = 0; b < batch; ++b) {
+      const size_t c = static_cast<size_t>(nearest[static_cast<size_t>(b)]);
+      counts[c] += 1.0;
+      const float eta = static_cast<float>(1.0 / counts[c]);
+      const cv::Vec3f& x = h.colors[picks[static_cast<size_t>(b)]];
+      for (int ch = 0; ch < 3; ++ch) centers[c][ch] += (x[ch] - centers[c][ch]) * eta;
+    }
+  }
+}
+} // namespace
+
+PaletteClusterer::Histogram PaletteClusterer::BuildHistogram(const cv::Mat& image8u3,
+                                                             std::vector<int>* outPixelBins) {
+  Histogram h;
+  if (image8u3.empty() || image8u3.type() != CV_8UC3) return h;
+  const int total = image8u3.rows * image8u3.cols;
+  h.totalPixels = total;
+
+  // Sort (color, pixel index) pairs packed into 64 bits; runs of equal colors become bins.
+  std::vector<uint64_t> keys;
+  keys.reserve(static_cast<size_t>(total));
+  for (int y = 0; y < image8u3.rows; ++y) {
+    const cv::Vec3b* row = image8u3.ptr<cv::Vec3b>(y);
+    for (int x = 0; x < image8u3.cols; ++x) {
+      const uint64_t color = (static_cast<uint64_t>(row[x][0]) << 16) | (static_cast<uint64_t>(row[x][1]) << 8) | row[x][2];
+      keys.push_back((color << 32) | static_cast<uint32_t>(y * image8u3.cols + x));
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+
+  if (outPixelBins) outPixelBins->assign(static_cast<size_t>(total), 0);
+  uint64_t prevColor = ~0ull;
+  for (uint64_t key : keys) {
+    const uint64_t color = key >> 32;
+    if (color != prevColor) {
+      h.colors.emplace_back(static_cast<float>((color >> 16) & 0xFF), static_cast<float>((color >> 8) & 0xFF),
+                            static_cast<float>(color & 0xFF));
+      h.weights.push_back(0.0f);
+      prevColor = color;
+    }
+    h.weights.back() += 1.0f;
+    if (outPixelBins) (*outPixelBins)[static_cast<size_t>(key & 0xFFFFFFFFu)] = static_cast<int>(h.colors.size()) - 1;
+  }
+  return h;
+}
+
+PaletteClusterer::Result PaletteClusterer::Cluster(const Histogram& histogram, const Options& options) {
+  Result best;
+  const int distinct = static_cast<int>(histogram.colors.size());
+  if (distinct == 0) return best;
+  const int k = std::max(1, std::min(options.k, distinct));
+
+  // No clustering needed: every distinct color gets its own center.
+  if (k == distinct) {
+    best.centers = histogram.colors;
+    return best;
+  }
+
+  const bool warm = options.warmStart && static_cast<int>(options.warmStart->size()) == k;
+  const int attempts = warm ? 1 : std::max(1, options.attempts);
+  best.compactness = std::numeric_limits<double>::max();
+
+  for (int a = 0; a < attempts; ++a) {
+    std::mt19937 rng(options.seed + static_cast<uint32_t>(a) * 0x9E3779B9u);
+    std::vector<cv::Vec3f> centers = warm ? *options.warmStart : SeedPlusPlus(histogram, k, rng);
+    int iterations = 0;
+    if (options.miniBatchSize > 0) {
+      RunMiniBatch(histogram, centers, options.maxIterations, options.miniBatchSize, rng);
+      // Short exact pass so the result is a proper local optimum.
+      iterations = options.maxIterations + RunHamerly(histogram, centers, 3, options.epsilon);
+    } else {
+      iterations = RunHamerly(histogram, centers, options.maxIterations, options.epsilon);
+    }
+
+    const double compactness = Compactness(histogram, centers);
+    if (compactness < best.compactness) {
+      best.centers = std::move(centers);
+      best.compactness = compactness;
+      best.iterations = iterations;
+    }
+  }
+  return best;
+}
+
+int PaletteClusterer::NearestCenter(const std::vector<cv::Vec3f>& centers, const cv::Vec3f& p) {
+  int best = 0;
+  float bestDist = std::numeric_limits<float>::max();
+  for (size_t j = 0; j < centers.size(); ++j) {
+    const float d = DistSq(p, centers[j]);
+    if (d < bestDist) {
+      bestDist = d;
+      best = static_cast<int>(j);
+    }
+  }
+  return best;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// PaletteClusterer: weighted K-means tuned for palette extraction.
+// Why this exists (instead of cv::kmeans on every block):
+// - Block images repeat colors heavily. Clustering a histogram of distinct colors with pixel
+//   counts as weights gives the same optimum with far fewer points.
+// - Full-batch iterations use Hamerly's bounds, so most points skip the distance scan to every
+//   center once the clustering settles. Very large histograms can use mini-batch updates
+//   instead, followed by a short exact pass.
+// - A run can warm-start from earlier centers (e.g. the previous live-preview run).
+// - Seeding and sampling use std::mt19937 with our own integer-to-float mapping, so a
+//   given seed produces the same palette on every platform and standard library.
+class PaletteClusterer {
+public:
+  // Distinct colors of an image and how many pixels use each.
+  struct Histogram {
+    std::vector<cv::Vec3f> colors;
+    std::vector<float> weights;
+    int totalPixels = 0;
+  };
+
+  struct Options {
+    int k = 16;
+    uint32_t seed = 1;
+    int attempts = 3;          // k-means++ restarts; the most compact one wins (1 when warm starting)
+    int maxIterations = 30;
+    float epsilon = 1.0f;      // stop once no center moves farther than this
+    int miniBatchSize = 0;     // > 0: mini-batch updates with this many samples per iteration
+    const std::vector<cv::Vec3f>* warmStart = nullptr; // used when it holds exactly k centers
+  };
+
+  struct Result {
+    std::vector<cv::Vec3f> centers; // at most k (fewer if the image has fewer distinct colors)
+    double compactness = 0.0;       // sum of weight * squared distance to the nearest center
+    int iterations = 0;
+  };
+
+  // Collapses an 8-bit 3-channel image into distinct colors. If `outPixelBins` is given it
+  // receives, for every pixel in row-major order, the index of its color in the histogram.
+  static Histogram BuildHistogram(const cv::Mat& image8u3, std::vector<int>* outPixelBins = nullptr);
+
+  static Result Cluster(const Histogram& histogram, const Options& options);
+
+  // Index of the center nearest to `p` (lowest index on ties).
+  static int NearestCenter(const std::vector<cv::Vec3f>& centers, const cv::Vec3f& p);
+};
@@ -0,0 +1,67 @@
+#include "PaletteLUT.h"
+
+#include "CpuDispatch.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+PaletteLUT::PaletteLUT(std::vector<cv::Vec3b> colors) : colors_(std::move(colors)) {
+  if (colors_.size() > 256) colors_.resize(256); // indices are stored as uint8
+  if (colors_.empty()) return;
+
+  constexpr int kCells = 1 << kBits;
+  constexpr int kCellEdge = 1 << kShift;
+  const int n = static_cast<int>(colors_.size());
+
+  cellStart_.reserve(static_cast<size_t>(kCells) * kCells * kCells + 1);
+  candidates_.reserve(static_cast<size_t>(kCells) * kCells * kCells);
+  std::vector<int> minDist(static_cast<size_t>(n));
+
+  // Per-axis distance from value v to the interval [lo, lo + kCellEdge - 1].
+  auto axisMin = [](int v, int lo) {
+    const int hi = lo + kCellEdge - 1;
+    const int d = v < lo ? lo - v : (v > hi ? v - hi : 0);
+    return d * d;
+  };
+  auto axisMax = [](int v, int lo) {
+    const int hi = lo + kCellEdge - 1;
+    const int d = std::max(std::abs(v - lo), std::abs(v - hi));
+    return d * d;
+  };
+
+  // Cell order matches NearestIndex: channel 0 is the most significant.
+  for (int c0 = 0; c0 < kCells; ++c0) {
+    for (int c1 = 0; c1 < kCells; ++c1) {
+      for (int c2 = 0; c2 < kCells; ++c2) {
+        const int lo0 = c0 << kShift, lo1 = c1 << kShift, lo2 = c2 << kShift;
+        int bound = std::numeric_limits<int>::max();
+        for (int i = 0; i < n; ++i) {
+          const cv::Vec3b& p = colors_[static_cast<size_t>(i)];
+          minDist[static_cast<size_t>(i)] = axisMin(p[0], lo0) + axisMin(p[1], lo1) + axisMin(p[2], lo2);
+          bound = std::min(bound, axisMax(p[0], lo0) + axisMax(p[1], lo1) + axisMax(p[2], lo2));
+        }
+        // Any entry farther than `bound` from the whole cell loses to the entry that achieves
+        // it, for every color in the cell. Keeping "<=" preserves ties for the index rule.
+        cellStart_.push_back(static_cast<uint32_t>(candidates_.size()));
+        for (int i = 0; i < n; ++i) {
+          if (minDist[static_cast<size_t>(i)] <= bound) candidates_.push_back(static_cast<uint8_t>(i));
+        }
+      }
+    }
+  }
+  cellStart_.push_back(static_cast<uint32_t>(candidates_.size()));
+  candidates_.resize(candidates_.size() + CpuKernels::kLutCandidatePadding, 0);
+  candidates_.shrink_to_fit();
+}
+
+void PaletteLUT::NearestIndexRow(const uchar* pixels, uchar* out, int n) const {
+  static_assert(kBits == CpuKernels::kLutCellBits, "the row kernels use the same cell layout");
+  if (colors_.empty() || n <= 0) return;
+  CpuKernels::LutView view;
+  view.colors = colors_.front().val;
+  view.size = size();
+  view.cellStart = cellStart_.data();
+  view.candidates = candidates_.data();
+  CpuDispatch::Kernels().nearestRow(view, pixels, out, n);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// PaletteLUT: exact nearest-palette-color lookup for fixed palettes (up to 256 entries).
+// Why this exists:
+// - Brute force costs one distance per palette entry per pixel; with the 54-color NES palette
+//   that dominates fixed-palette quantization and especially the dither path.
+// - The 8-bit color cube is split into 32×32×32 cells. For each cell we keep only the
+//   palette entries that can be nearest to *some* color in it: entry p survives if its
+//   minimum distance to the cell box is <= the smallest maximum distance of any entry.
+//   Most cells end up with a single candidate; the rest are refined exactly at lookup.
+//
+// Results are identical to the brute-force search: squared Euclidean distance over the three
+// channels, lowest palette index wins ties. Immutable after construction, so one instance can
+// be shared by any number of threads.
+class PaletteLUT {
+public:
+  PaletteLUT() = default;
+  explicit PaletteLUT(std::vector<cv::Vec3b> colors);
+
+  bool empty() const { return colors_.empty(); }
+  int size() const { return static_cast<int>(colors_.size()); }
+  const std::vector<cv::Vec3b>& Colors() const { return colors_; }
+
+  // Returns the palette index nearest to `c`, or -1 for an empty palette.
+  int NearestIndex(const cv::Vec3b& c) const {
+    if (colors_.empty()) return -1;
+    const int cell = ((c[0] >> kShift) << (2 * kBits)) | ((c[1] >> kShift) << kBits) | (c[2] >> kShift);
+    const uint32_t begin = cellStart_[static_cast<size_t>(cell)];
+    const uint32_t end = cellStart_[static_cast<size_t>(cell) + 1];
+    if (end - begin == 1) return candidates_[begin];
+
+    int best = candidates_[begin];
+    int bestDist = DistanceSquared(c, colors_[static_cast<size_t>(best)]);
+    for (uint32_t i = begin + 1; i < end; ++i) {
+      const int idx = candidates_[i];
+      const int d = DistanceSquared(c, colors_[static_cast<size_t>(idx)]);
+      if (d < bestDist) { // candidates are in index order, so strict < keeps the lowest index on ties
+        bestDist = d;
+        best = idx;
+      }
+    }
+    return best;
+  }
+
+  // NearestIndex for `n` packed 3-channel pixels, vectorised where the CPU allows (see
+  // CpuDispatch). Writes nothing for an empty palette.
+  void NearestIndexRow(const uchar* pixels, uchar* out, int n) const;
+
+  // Nearest palette color; returns `c` unchanged for an empty palette.
+  cv::Vec3b Nearest(const cv::Vec3b& c) const {
+    const int idx = NearestIndex(c);
+    return idx < 0 ? c : colors_[static_cast<size_t>(idx)];
+  }
+
+  static int DistanceSquared(const cv::Vec3b& a, const cv::Vec3b& b) {
+    const int d0 = a[0] - b[0];
+    const int d1 = a[1] - b[1];
+    const int d2 = a[2] - b[2];
+    return d0 * d0 + d1 * d1 + d2 * d2;
+  }
+
+private:
+  static constexpr int kBits = 5;           // cells per axis = 32
+  static constexpr int kShift = 8 - kBits;  // 8 colour values per cell edge
+
+  std::vector<cv::Vec3b> colors_;
+  std::vector<uint32_t> cellStart_; // candidates of cell i: [cellStart_[i], cellStart_[i + 1])
+  std::vector<uint8_t> candidates_; // palette indices, ascending within each cell; padded at the end
+                                    // so vector gathers may read 4 bytes at any entry
+};
@@ -0,0 +1,334 @@
+#include "PaletteRegistry.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <utility>
+
+namespace {
+// One palette entry as stored in the built-in tables: R, G, B, as the palettes are published
+// (and as .hex / .gpl files store them). Converted to BGR with FromRgb when registered.
+struct Color8 {
+  uint8_t r, g, b;
+};
+
+// File and table colors are real RGB; cv::Vec3b entries are BGR.
+cv::Vec3b FromRgb(int r, int g, int b) {
+  return cv::Vec3b(static_cast<uchar>(b), static_cast<uchar>(g), static_cast<uchar>(r));
+}
+
+// NES palette (54 colors) - classic console colors
+// Reference: https://lospec.com/palette-list/nes-palette
+constexpr Color8 kNES[] = {
+  {124, 124, 124}, {0, 0, 252}, {0, 0, 188}, {68, 40, 188},
+  {148, 0, 132}, {168, 0, 32}, {168, 16, 0}, {136, 20, 0},
+  {80, 48, 0}, {0, 120, 0}, {0, 104, 0}, {0, 88, 0},
+  {0, 64, 88}, {0, 0, 0}, {0, 0, 0}, {188, 188, 188},
+  {0, 120, 248}, {0, 88, 248}, {104, 68, 252}, {216, 0, 204},
+  {228, 0, 88}, {248, 56, 0}, {228, 92, 16}, {172, 124, 0},
+  {0, 184, 0}, {0, 168, 0}, {0, 168, 68}, {0, 136, 136},
+  {248, 248, 248}, {60, 188, 252}, {104, 136, 252}, {152, 120, 248},
+  {248, 120, 248}, {248, 88, 152}, {248, 120, 88}, {252, 160, 68},
+  {248, 184, 0}, {184, 248, 24}, {88, 216, 84}, {88, 248, 152},
+  {0, 232, 216}, {120, 120, 120}, {252, 252, 252}, {164, 228, 252},
+  {184, 184, 248}, {216, 184, 248}, {248, 184, 248}, {248, 164, 192},
+  {240, 208, 176}, {252, 224, 168}, {248, 216, 120}, {216, 248, 120},
+  {184, 248, 184}, {184, 248, 216}, {0, 252, 252}, {248, 216, 248}
+};
+
+// Original Game Boy (4 colors: green monochrome)
+// Darkest to lightest green
+constexpr Color8 kGameBoy[] = {
+  {15, 56, 15},    // Darkest green
+  {48, 98, 48},    // Dark green
+  {139, 172, 15},  // Light green
+  {155, 188, 15}   // Lightest green
+};
+
+// Game Boy Pocket (4 colors: monochrome)
+constexpr Color8 kGameBoyPocket[] = {
+  {15, 15, 15},    // Black
+  {79, 79, 79},    // Dark gray
+  {163, 163, 163}, // Light gray
+  {255, 255, 255}  // White
+};
+
+// Pico-8 fantasy console palette (16 colors)
+// Reference: https://lospec.com/palette-list/pico-8
+constexpr Color8 kPico8[] = {
+  {0, 0, 0},       // Black
+  {29, 43, 83},    // Dark blue
+  {126, 37, 83},   // Dark purple
+  {0, 135, 81},    // Dark green
+  {171, 82, 54},   // Brown
+  {95, 87, 79},    // Dark gray
+  {194, 195, 199}, // Light gray
+  {255, 241, 232}, // White
+  {255, 0, 77},    // Red
+  {255, 163, 0},   // Orange
+  {255, 236, 39},  // Yellow
+  {0, 228, 54},    // Green
+  {41, 173, 255},  // Blue
+  {131, 118, 156}, // Indigo
+  {255, 119, 168}, // Pink
+  {255, 204, 170}  // Peach
+};
+
+// CGA 4-color mode palette (Cyan/Magenta/White)
+constexpr Color8 kCGA[] = {
+  {0, 0, 0},       // Black
+  {85, 255, 255},  // Cyan
+  {255, 85, 255},  // Magenta
+  {255, 255, 255}  // White
+};
+
+// EGA 16-color palette
+constexpr Color8 kEGA[] = {
+  {0, 0, 0},       // Black
+  {0, 0, 170},     // Blue
+  {0, 170, 0},     // Green
+  {0, 170, 170},   // Cyan
+  {170, 0, 0},     // Red
+  {170, 0, 170},   // Magenta
+  {170, 85, 0},    // Brown
+  {170, 170, 170}, // Light gray
+  {85, 85, 85},    // Dark gray
+  {85, 85, 255},   // Bright blue
+  {85, 255, 85},   // Bright green
+  {85, 255, 255},  // Bright cyan
+  {255, 85, 85},   // Bright red
+  {255, 85, 255},  // Bright magenta
+  {255, 255, 85},  // Yellow
+  {255, 255, 255}  // White
+};
+
+// Commodore 64 palette (16 colors)
+constexpr Color8 kCommodore64[] = {
+  {0, 0, 0},       // Black
+  {255, 255, 255}, // White
+  {136, 0, 0},     // Red
+  {170, 255, 238}, // Cyan
+  {204, 68, 204},  // Purple
+  {0, 204, 85},    // Green
+  {0, 0, 170},     // Blue
+  {238, 238, 119}, // Yellow
+  {221, 136, 85},  // Orange
+  {102, 68, 0},    // Brown
+  {255, 119, 119}, // Light red
+  {51, 51, 51},    // Dark gray
+  {119, 119, 119}, // Medium gray
+  {170, 255, 102}, // Light green
+  {0, 136, 255},   // Light blue
+  {187, 187, 187}  // Light gray
+};
+
+struct BuiltinPalette {
+  const char* name;
+  const Color8* colors;
+  size_t count;
+};
+
+// Order must match PixelArtProcessor::PalettePreset (NES ... Commodore64).
+constexpr BuiltinPalette kBuiltins[] = {
+  {"NES", kNES, std::size(kNES)},
+  {"Game Boy", kGameBoy, std::size(kGameBoy)},
+  {"Game Boy Pocket", kGameBoyPocket, std::size(kGameBoyPocket)},
+  {"Pico-8", kPico8, std::size(kPico8)},
+  {"CGA", kCGA, std::size(kCGA)},
+  {"EGA", kEGA, std::size(kEGA)},
+  {"Commodore 64", kCommodore64, std::size(kCommodore64)},
+};
+constexpr int kBuiltinCount = static_cast<int>(std::size(kBuiltins));
+constexpr size_t kMaxColors = 256;
+
+struct RegistryState {
+  std::mutex mutex;
+  std::deque<std::unique_ptr<Palette>> palettes; // deque: element addresses never move
+  std::vector<std::pair<std::string, int>> loadedFiles;
+
+  RegistryState() {
+    for (const BuiltinPalette& b : kBuiltins) {
+      std::vector<cv::Vec3b> colors;
+      colors.reserve(b.count);
+      for (size_t i = 0; i < b.count; ++i) colors.push_back(FromRgb(b.colors[i].r, b.colors[i].g, b.colors[i].b));
+      palettes.push_back(std::make_unique<Palette>(b.name, std::move(colors)));
+    }
+  }
+};
+
+RegistryState& State() {
+  static RegistryState state;
+  return state;
+}
+
+std::string Trim(const std::string& s) {
+  size_t a = 0, b = s.size();
+  while (a < b && std::isspace(static_cast<unsigned char>(s[a]))) ++a;
+  while (b > a && std::isspace(static_cast<unsigned char>(s[b - 1]))) --b;
+  return s.substr(a, b - a);
+}
+
+std::string LowerExtension(const std::filesystem::path& p) {
+  std::string ext = p.extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return ext;
+}
+
+bool ParseHex(std::istream& in, std::vector<cv::Vec3b>& out, std::string& outError) {
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(in, line)) {
+    ++lineNo;
+    std::string t = Trim(line);
+    if (t.empty() || t[0] == ';') continue;
+    if (t[0] == '#') t.erase(0, 1);
+    if (t.size() != 6 || !std::all_of(t.begin(), t.end(), [](unsigned char c) { return std::isxdigit(c) != 0; })) {
+      outError = "line " + std::to_string(lineNo) + ": expected RRGGBB";
+      return false;
+    }
+    const long v = std::strtol(t.c_str(), nullptr, 16);
+    out.push_back(FromRgb(static_cast<int>((v >> 16) & 0xFF), static_cast<int>((v >> 8) & 0xFF),
+                          static_cast<int>(v & 0xFF)));
+  }
+  return true;
+}
+
+bool ParseGpl(std::istream& in, std::vector<cv::Vec3b>& out, std::string& name, std::string& outError) {
+  std::string line;
+  if (!std::getline(in, line) || Trim(line) != "GIMP Palette") {
+    outError = "missing 'GIMP Palette' header";
+    return false;
+  }
+  int lineNo = 1;
+  while (std::getline(in, line)) {
+    ++lineNo;
+    const std::string t = Trim(line);
+    if (t.empty() || t[0] == '#') continue;
+    if (t.rfind("Name:", 0) == 0) {
+      name = Trim(t.substr(5));
+      continue;
+    }
+    if (t.rfind("Columns:", 0) == 0) continue;
+
+    std::istringstream fields(t);
+    int r = -1, g = -1, b = -1;
+    if (!(fields >> r >> g >> b) || r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255) {
+      outError = "line " + std::to_string(lineNo) + ": expected 'R G B [name]' with values 0-255";
+      return false;
+    }
+    out.push_back(FromRgb(r, g, b));
+  }
+  return true;
+}
+} // namespace
+
+Palette::Palette(std::string name, std::vector<cv::Vec3b> colors, Metric metric)
+    : name_(std::move(name)), metric_(metric), colors_(std::move(colors)) {
+  if (colors_.size() > kMaxColors) colors_.resize(kMaxColors);
+  if (colors_.empty()) return;
+
+  cv::Mat bgr(1, static_cast<int>(colors_.size()), CV_8UC3, colors_.data());
+  cv::Mat lab;
+  cv::cvtColor(bgr, lab, cv::COLOR_BGR2Lab);
+  const cv::Vec3b* row = lab.ptr<cv::Vec3b>(0);
+  lab_.assign(row, row + lab.cols);
+}
+
+const PaletteLUT& Palette::LUT() const {
+  std::call_once(lutOnce_, [this] { lut_ = PaletteLUT(colors_); });
+  return lut_;
+}
+
+const PaletteLUT& Palette::LabLUT() const {
+  std::call_once(labLutOnce_, [this] { labLut_ = PaletteLUT(lab_); });
+  return labLut_;
+}
+
+int PaletteRegistry::BuiltinCount() {
+  return kBuiltinCount;
+}
+
+int PaletteRegistry::Count() {
+  RegistryState& s = State();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  return static_cast<int>(s.palettes.size());
+}
+
+const Palette* PaletteRegistry::Get(int id) {
+  RegistryState& s = State();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (id < 0 || id >= static_cast<int>(s.palettes.size())) return nullptr;
+  return s.palettes[static_cast<size_t>(id)].get();
+}
+
+int PaletteRegistry::Register(std::string name, std::vector<cv::Vec3b> colors, Palette::Metric metric) {
+  // Build (and convert to Lab) outside the lock; only the push is serialised.
+  auto palette = std::make_unique<Palette>(std::move(name), std::move(colors), metric);
+  RegistryState& s = State();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.palettes.push_back(std::move(palette));
+  return static_cast<int>(s.palettes.size()) - 1;
+}
+
+bool PaletteRegistry::LoadFile(const std::string& path, int& outId, std::string& outError) {
+  outError.clear();
+  std::error_code ec;
+  const std::filesystem::path p(path);
+  const std::string key = std::filesystem::weakly_canonical(p, ec).string();
+  {
+    RegistryState& s = State();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for (const auto& entry : s.loadedFiles) {
+      if (entry.first == key) {
+        outId = entry.second;
+        return true;
+      }
+    }
+  }
+
+  std::ifstream in(path);
+  if (!in) {
+    outError = "Cannot open palette: " + path;
+    return false;
+  }
+
+  std::vector<cv::Vec3b> colors;
+  std::string name = p.stem().string();
+  std::string err;
+  const std::string ext = LowerExtension(p);
+  bool ok = false;
+  if (ext == ".hex") {
+    ok = ParseHex(in, colors, err);
+  } else if (ext == ".gpl") {
+    ok = ParseGpl(in, colors, name, err);
+  } else {
+    err = "unsupported palette format (use .hex or .gpl)";
+  }
+  if (ok && colors.empty()) {
+    ok = false;
+    err = "no colors found";
+  } else if (ok && colors.size() > kMaxColors) {
+    ok = false;
+    err = "too many colors (" + std::to_string(colors.size()) + ", max 256)";
+  }
+  if (!ok) {
+    outError = path + ": " + err;
+    return false;
+  }
+
+  outId = Register(name, std::move(colors));
+  RegistryState& s = State();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.loadedFiles.emplace_back(key, outId);
+  return true;
+}
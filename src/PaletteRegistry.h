@@ -0,0 +1,75 @@
+#pragma once
+
+#include "PaletteLUT.h"
+
+#include <opencv2/core.hpp>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Palette: an immutable color palette plus data derived from it once.
+// Colors are cv::Vec3b in the processor's channel order; Lab holds the same entries converted
+// with cv::COLOR_BGR2Lab (8-bit OpenCV Lab). LUT() / LabLUT() are exact nearest-color tables
+// over Colors() / Lab(), built on first use. Safe to share between threads.
+class Palette {
+public:
+  // Distance used when mapping a color onto the palette without dithering.
+  enum class Metric {
+    RGB, // fixed retro palettes: nearest entry in RGB, as the presets always did
+    Lab  // K-means palettes: nearest entry in Lab, the space they were clustered in
+  };
+
+  Palette(std::string name, std::vector<cv::Vec3b> colors, Metric metric = Metric::RGB);
+
+  Palette(const Palette&) = delete;
+  Palette& operator=(const Palette&) = delete;
+
+  const std::string& Name() const { return name_; }
+  Metric PreferredMetric() const { return metric_; }
+  int size() const { return static_cast<int>(colors_.size()); }
+  const std::vector<cv::Vec3b>& Colors() const { return colors_; }
+  const std::vector<cv::Vec3b>& Lab() const { return lab_; }
+  const PaletteLUT& LUT() const;
+  const PaletteLUT& LabLUT() const;
+
+private:
+  std::string name_;
+  Metric metric_;
+  std::vector<cv::Vec3b> colors_;
+  std::vector<cv::Vec3b> lab_;
+  mutable std::once_flag lutOnce_;
+  mutable PaletteLUT lut_;
+  mutable std::once_flag labLutOnce_;
+  mutable PaletteLUT labLut_;
+};
+
+// PaletteRegistry: process-wide list of fixed palettes.
+// Why this exists:
+// - The built-in retro palettes are compile-time tables; the registry wraps each one in a
+//   Palette exactly once, so quantization never rebuilds a palette or its lookup table.
+// - Studio palettes loaded at runtime (.hex / .gpl) are registered the same way and get the
+//   same precomputed fast path.
+//
+// Ids are stable for the lifetime of the process: built-ins come first, in
+// PixelArtProcessor::PalettePreset order (NES = 0 ... Commodore64 = BuiltinCount() - 1),
+// followed by user palettes in registration order. Palettes are never removed, so returned
+// references stay valid. All functions are thread-safe.
+class PaletteRegistry {
+public:
+  static int BuiltinCount();
+  static int Count();
+
+  // Returns nullptr for an unknown id.
+  static const Palette* Get(int id);
+
+  // Registers a palette and returns its id (1..256 colors; extra entries are dropped).
+  static int Register(std::string name, std::vector<cv::Vec3b> colors,
+                      Palette::Metric metric = Palette::Metric::RGB);
+
+  // Loads a palette file and registers it. Supported formats:
+  // - .hex: one RRGGBB value per line (optional leading '#'), as exported by Lospec.
+  // - .gpl: GIMP palette ("GIMP Palette" header, then "R G B [name]" lines).
+  // Loading the same path again returns the existing id instead of registering a duplicate.
+  static bool LoadFile(const std::string& path, int& outId, std::string& outError);
+};
@@ -0,0 +1,264 @@
+#include "ParamsFile.h"
+
+#include "PaletteRegistry.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace {
+using PAP = PixelArtProcessor;
+
+struct PresetEntry { const char* name; PAP::PalettePreset preset; };
+const PresetEntry kPresets[] = {
+  {"custom", PAP::PalettePreset::Custom}, {"nes", PAP::PalettePreset::NES},
+  {"gameboy", PAP::PalettePreset::GameBoy}, {"gbpocket", PAP::PalettePreset::GameBoyPocket},
+  {"pico8", PAP::PalettePreset::Pico8}, {"cga", PAP::PalettePreset::CGA},
+  {"ega", PAP::PalettePreset::EGA}, {"c64", PAP::PalettePreset::Commodore64},
+};
+
+struct MethodEntry { const char* name; PAP::DitherMethod method; };
+const MethodEntry kMethods[] = {
+  {"fs", PAP::DitherMethod::FloydSteinberg}, {"bayer2", PAP::DitherMethod::Bayer2},
+  {"bayer4", PAP::DitherMethod::Bayer4}, {"bayer8", PAP::DitherMethod::Bayer8},
+  {"bluenoise", PAP::DitherMethod::BlueNoise},
+};
+
+std::string Trim(const std::string& s) {
+  size_t b = 0;
+  size_t e = s.size();
+  while (b < e && std::isspace(static_cast<unsigned char>(s[b]))) ++b;
+  while (e > b && std::isspace(static_cast<unsigned char>(s[e - 1]))) --e;
+  return s.substr(b, e - b);
+}
+
+bool ParseBool(const std::string& s, bool& out) {
+  if (s == "true" || s == "1" || s == "yes" || s == "on") {
+    out = true;
+  } else if (s == "false" || s == "0" || s == "no" || s == "off") {
+    out = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ParseInt(const std::string& s, long long& out) {
+  if (s.empty()) return false;
+  char* end = nullptr;
+  out = std::strtoll(s.c_str(), &end, 10);
+  return *end == '\0';
+}
+
+// "RRGGBB RRGGBB ..." (optional '#'), to processor (BGR) order.
+bool ParseColors(const std::string& s, std::vector<cv::Vec3b>& out) {
+  std::istringstream in(s);
+  std::string token;
+  while (in >> token) {
+    if (token[0] == '#') token.erase(0, 1);
+    if (token.size() != 6) return false;
+    char* end = nullptr;
+    const unsigned long rgb = std::strtoul(token.c_str(), &end, 16);
+    if (*end != '\0') return false;
+    out.emplace_back(static_cast<uchar>(rgb & 0xFF), static_cast<uchar>((rgb >> 8) & 0xFF),
+                     static_cast<uchar>((rgb >> 16) & 0xFF));
+  }
+  return !out.empty();
+}
+
+// An already registered user palette with these colors and metric, else a new one.
+int FindOrRegister(const std::string& name, const std::vector<cv::Vec3b>& colors, Palette::Metric metric) {
+  for (int id = PaletteRegistry::BuiltinCount(), n = PaletteRegistry::Count(); id < n; ++id) {
+    const Palette* p = PaletteRegistry::Get(id);
+    if (p && p->PreferredMetric() == metric && p->Colors() == colors) return id;
+  }
+  return PaletteRegistry::Register(name, colors, metric);
+}
+} // namespace
+
+const char* ParamsFile::PresetName(PAP::PalettePreset preset) {
+  if (preset == PAP::PalettePreset::User) return "user";
+  for (const PresetEntry& e : kPresets) {
+    if (e.preset == preset) return e.name;
+  }
+  return "custom";
+}
+
+bool ParamsFile::ParsePreset(const std::string& name, PAP::PalettePreset& out) {
+  for (const PresetEntry& e : kPresets) {
+    if (name == e.name) {
+      out = e.preset;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* ParamsFile::DitherMethodName(PAP::DitherMethod method) {
+  for (const MethodEntry& e : kMethods) {
+    if (e.method == method) return e.name;
+  }
+  return "fs";
+}
+
+bool ParamsFile::ParseDitherMethod(const std::string& name, PAP::DitherMethod& out) {
+  for (const MethodEntry& e : kMethods) {
+    if (name == e.name) {
+      out = e.method;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string ParamsFile::ToText(const Params& p) {
+  auto b = [](bool v) { return v ? "true" : "false"; };
+  char buf[512];
+  std::snprintf(buf, sizeof(buf),
+                "block_size = %d\n"
+                "palette = %s\n"
+                "palette_size = %d\n"
+                "kmeans_seed = %u\n"
+                "pre_blur = %s\n"
+                "edge_enhance = %s\n"
+                "dither = %s\n"
+                "dither_method = %s\n"
+                "dither_serpentine = %s\n"
+                "outline = %s\n"
+                "outline_thickness = %d\n"
+                "native_output = %s\n",
+                p.blockSize, PresetName(p.palettePreset), p.paletteSize, static_cast<unsigned>(p.kmeansSeed),
+                b(p.preBlur), b(p.edgeEnhance), b(p.dither), DitherMethodName(p.ditherMethod),
+                b(p.ditherSerpentine), b(p.outline), p.outlineThickness, b(p.nativeOutput));
+  std::string text = buf;
+
+  const Palette* user =
+      p.palettePreset == PAP::PalettePreset::User ? PaletteRegistry::Get(p.userPaletteId) : nullptr;
+  if (user) {
+    const bool lab = user->PreferredMetric() == Palette::Metric::Lab;
+    text += "palette_name = " + user->Name() + "\n";
+    text += std::string("palette_metric = ") + (lab ? "lab" : "rgb") + "\n";
+    text += "palette_colors =";
+    for (const cv::Vec3b& c : user->Colors()) {
+      std::snprintf(buf, sizeof(buf), " %02X%02X%02X", c[2], c[1], c[0]);
+      text += buf;
+    }
+    text += "\n";
+  }
+  return text;
+}
+
+bool ParamsFile::FromText(const std::string& text, Params& inOutParams, std::string& outError) {
+  outError.clear();
+  Params p = inOutParams;
+  std::string paletteName = "params file palette";
+  Palette::Metric paletteMetric = Palette::Metric::RGB;
+  std::vector<cv::Vec3b> paletteColors;
+
+  std::istringstream in(text);
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(in, line)) {
+    ++lineNo;
+    line = Trim(line);
+    // '#' inside palette_colors values is a color prefix, not a comment.
+    const size_t hash = line.find('#');
+    if (hash != std::string::npos && line.compare(0, 14, "palette_colors") != 0) line = Trim(line.erase(hash));
+    if (line.empty()) continue;
+    const size_t eq = line.find('=');
+    const std::string key = eq == std::string::npos ? line : Trim(line.substr(0, eq));
+    const std::string value = eq == std::string::npos ? std::string() : Trim(line.substr(eq + 1));
+    auto fail = [&](const char* what) {
+      outError = "Line " + std::to_string(lineNo) + ": " + what + " '" + line + "'";
+      return false;
+    };
+    if (eq == std::string::npos) return fail("expected key = value:");
+
+    long long n = 0;
+    bool flag = false;
+    if (key == "block_size" || key == "palette_size" || key == "kmeans_seed" || key == "outline_thickness") {
+      if (!ParseInt(value, n)) return fail("invalid integer in");
+      if (key == "block_size") p.blockSize = static_cast<int>(n);
+      if (key == "palette_size") p.paletteSize = static_cast<int>(n);
+      if (key == "kmeans_seed") p.kmeansSeed = static_cast<uint32_t>(n);
+      if (key == "outline_thickness") p.outlineThickness = static_cast<int>(n);
+    } else if (key == "pre_blur" || key == "edge_enhance" || key == "dither" || key == "dither_serpentine" ||
+               key == "outline" || key == "native_output") {
+      if (!ParseBool(value, flag)) return fail("invalid boolean in");
+      if (key == "pre_blur") p.preBlur = flag;
+      if (key == "edge_enhance") p.edgeEnhance = flag;
+      if (key == "dither") p.dither = flag;
+      if (key == "dither_serpentine") p.ditherSerpentine = flag;
+      if (key == "outline") p.outline = flag;
+      if (key == "native_output") p.nativeOutput = flag;
+    } else if (key == "palette") {
+      if (value == "user") {
+        p.palettePreset = PAP::PalettePreset::User;
+      } else if (!ParsePreset(value, p.palettePreset)) {
+        return fail("unknown palette in");
+      }
+    } else if (key == "dither_method") {
+      if (!ParseDitherMethod(value, p.ditherMethod)) return fail("unknown dither method in");
+    } else if (key == "palette_name") {
+      paletteName = value;
+    } else if (key == "palette_metric") {
+      if (value == "rgb") {
+        paletteMetric = Palette::Metric::RGB;
+      } else if (value == "lab") {
+        paletteMetric = Palette::Metric::Lab;
+      } else {
+        return fail("unknown palette metric in");
+      }
+    } else if (key == "palette_colors") {
+      paletteColors.clear();
+      if (!ParseColors(value, paletteColors)) return fail("invalid colors in");
+    } else {
+      return fail("unknown key in");
+    }
+  }
+
+  if (p.palettePreset == PAP::PalettePreset::User) {
+    if (paletteColors.empty()) {
+      outError = "palette = user needs palette_colors";
+      return false;
+    }
+    p.userPaletteId = FindOrRegister(paletteName, paletteColors, paletteMetric);
+  }
+  inOutParams = p;
+  return true;
+}
+
+bool ParamsFile::Save(const std::string& path, const Params& params, std::string& outError) {
+  outError.clear();
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    outError = "Cannot write " + path;
+    return false;
+  }
+  out << "# FordPixelWizard params\n" << ToText(params);
+  out.close();
+  if (!out) {
+    outError = "Failed to write " + path;
+    return false;
+  }
+  return true;
+}
+
+bool ParamsFile::Load(const std::string& path, Params& inOutParams, std::string& outError) {
+  outError.clear();
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    outError = "Cannot open params file: " + path;
+    return false;
+  }
+  std::ostringstream text;
+  text << in.rdbuf();
+  if (!FromText(text.str(), inOutParams, outError)) {
+    outError = path + ": " + outError;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "PixelArtProcessor.h"
+
+#include <string>
+
+// ParamsFile: PixelArtProcessor::Params as a small text file, one "key = value" per line.
+// Why this exists:
+// - A look found with "Random Config" or tuned for an asset set should be reproducible later
+//   and shareable between the GUI and fpw_batch (--params / --save-params).
+// - The text of the normalized params is also what ResultCache hashes, so two configs that
+//   process the same way share cache entries.
+//
+// Format ('#' starts a comment, keys in any order, missing keys keep their current value):
+//   block_size = 8
+//   palette = pico8          (custom|nes|gameboy|gbpocket|pico8|cga|ega|c64|user)
+//   dither_method = bayer4   (fs|bayer2|bayer4|bayer8|bluenoise)
+//   pre_blur = true ...
+// A user palette is stored by value (palette_name, palette_metric, palette_colors as
+// RRGGBB hex), since PaletteRegistry ids only live as long as the process; loading the file
+// registers it again, or reuses an identical palette already registered.
+class ParamsFile {
+public:
+  using Params = PixelArtProcessor::Params;
+
+  // Every field of `params`, in the format above (the user palette, if any, by value).
+  static std::string ToText(const Params& params);
+  // Parses ToText's format over `inOutParams`. False (with outError naming the line) on an
+  // unknown key or a malformed value; `inOutParams` is unchanged then.
+  static bool FromText(const std::string& text, Params& inOutParams, std::string& outError);
+
+  static bool Save(const std::string& path, const Params& params, std::string& outError);
+  static bool Load(const std::string& path, Params& inOutParams, std::string& outError);
+
+  // Names used by the file format and fpw_batch's --preset / --dither-method.
+  static const char* PresetName(PixelArtProcessor::PalettePreset preset);
+  static bool ParsePreset(const std::string& name, PixelArtProcessor::PalettePreset& out);
+  static const char* DitherMethodName(PixelArtProcessor::DitherMethod method);
+  static bool ParseDitherMethod(const std::string& name, PixelArtProcessor::DitherMethod& out);
+};
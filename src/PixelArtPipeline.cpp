@@ -0,0 +1,380 @@
+#include "PixelArtPipeline.h"
+
+#include "BlockKernels.h"
+#include "PaletteClusterer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+namespace {
+// splitmix64 finalizer: cheap, well-distributed mixing for combining small integer fields.
+inline uint64_t Mix(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+inline uint64_t HashCombine(uint64_t seed, uint64_t value) {
+  return Mix(seed ^ Mix(value));
+}
+
+inline bool IsCancelled(const std::atomic<bool>* cancel) {
+  return cancel && cancel->load(std::memory_order_relaxed);
+}
+} // namespace
+
+void PixelArtPipeline::Clear() {
+  blocks_ = Stage{};
+  paletteKey_ = 0;
+  palette_.reset();
+  lastCentersLab_.clear();
+  clusterStatsValid_ = false;
+  quantized_ = Stage{};
+  edge_ = Stage{};
+  gridColRuns_.clear();
+  gridRowRuns_.clear();
+  outline_ = Stage{};
+}
+
+PixelArtPipeline::Keys PixelArtPipeline::MakeKeys(uint64_t inputId, const cv::Size& size,
+                                                  const PixelArtProcessor::Params& p) {
+  using PalettePreset = PixelArtProcessor::PalettePreset;
+  // Stage keys. Each one folds in the key of the stage it consumes, so invalidation
+  // propagates downstream automatically. Fields a stage ignores are left out on purpose
+  // (e.g. paletteSize with a fixed preset) so toggling them keeps the cache warm.
+  uint64_t inputKey = HashCombine(inputId, static_cast<uint64_t>(size.width));
+  inputKey = HashCombine(inputKey, static_cast<uint64_t>(size.height));
+
+  uint64_t blocksKey = HashCombine(inputKey, static_cast<uint64_t>(p.blockSize));
+  blocksKey = HashCombine(blocksKey, p.preBlur ? 1u : 0u);
+
+  uint64_t paletteKey = HashCombine(blocksKey, static_cast<uint64_t>(p.palettePreset));
+  paletteKey = HashCombine(paletteKey, p.palettePreset == PalettePreset::Custom
+                                           ? static_cast<uint64_t>(p.paletteSize) : 0u);
+  paletteKey = HashCombine(paletteKey, p.palettePreset == PalettePreset::Custom ? p.kmeansSeed : 0u);
+  paletteKey = HashCombine(paletteKey, static_cast<uint64_t>(static_cast<int64_t>(p.userPaletteId)));
+
+  uint64_t quantKey = HashCombine(paletteKey, p.dither ? 1u : 0u);
+  quantKey = HashCombine(quantKey, p.dither ? static_cast<uint64_t>(p.ditherMethod) : 0u);
+  quantKey = HashCombine(quantKey, p.dither && p.ditherMethod == PixelArtProcessor::DitherMethod::FloydSteinberg &&
+                                           p.ditherSerpentine ? 1u : 0u);
+
+  // Post-processing runs on a block grid whose geometry depends on the total filter radius.
+  const int radius = PixelArtProcessor::PostProcessRadius(p);
+  const uint64_t gridKey = HashCombine(quantKey, static_cast<uint64_t>(radius));
+  Keys keys;
+  keys.blocks = blocksKey;
+  keys.palette = paletteKey;
+  keys.quant = quantKey;
+  keys.edge = HashCombine(gridKey, p.edgeEnhance ? 1u : 0u);
+  keys.outline = HashCombine(keys.edge, p.outline ? static_cast<uint64_t>(p.outlineThickness) : 0u);
+  return keys;
+}
+
+cv::Mat PixelArtPipeline::Run(const cv::Mat& inputBgr, uint64_t inputId,
+                              const PixelArtProcessor::Params& params,
+                              const std::atomic<bool>* cancel, ProcessStats* stats) {
+  if (PixelArtProcessor::ActiveBackend() == PixelArtProcessor::Backend::Reference) {
+    // The reference backend is for A/B checks: uncached, and nothing it produces is kept.
+    Clear();
+    return PixelArtProcessor::Process(inputBgr, params, cancel, stats);
+  }
+  if (stats) stats->Begin(inputBgr.size());
+  cv::Mat out = RunStages(inputBgr, inputId, params, cancel, stats);
+  if (stats) stats->End();
+  return out;
+}
+
+cv::Mat PixelArtPipeline::RunStages(const cv::Mat& inputBgr, uint64_t inputId,
+                                    const PixelArtProcessor::Params& params,
+                                    const std::atomic<bool>* cancel, ProcessStats* stats) {
+  using PalettePreset = PixelArtProcessor::PalettePreset;
+  using StatStage = ProcessStats::Stage;
+  if (inputBgr.empty() || inputBgr.type() != CV_8UC3) return {};
+  const PixelArtProcessor::Params p = PixelArtProcessor::Normalize(params);
+
+  const Keys keys = MakeKeys(inputId, inputBgr.size(), p);
+  const int radius = PixelArtProcessor::PostProcessRadius(p);
+
+  const bool native = PixelArtProcessor::OutputIsNative(p);
+  if (!native && outline_.Matches(keys.outline)) return outline_.data;
+
+  // Steps 1 + 2: blur + block averaging (fused; no full-resolution intermediate).
+  if (!blocks_.Matches(keys.blocks)) {
+    ProcessStats::Scope scope(stats, StatStage::Blocks);
+    blocks_.Store(keys.blocks, PixelArtProcessor::BuildBlockColorImage(inputBgr, p));
+    if (!blocks_.valid || IsCancelled(cancel)) return {};
+  }
+
+  // Step 3a: palette extraction (K-means or registry lookup); independent of dithering.
+  if (!palette_ || paletteKey_ != keys.palette) {
+    ProcessStats::Scope scope(stats, StatStage::Palette);
+    palette_.reset();
+    const bool warm = warmStartPalette_ && p.palettePreset == PalettePreset::Custom &&
+                      static_cast<int>(lastCentersLab_.size()) == p.paletteSize;
+    std::vector<cv::Vec3f> centersLab;
+    palette_ = PixelArtProcessor::ExtractPalette(blocks_.data, p, warm ? &lastCentersLab_ : nullptr,
+                                                 &centersLab);
+    if (!palette_ || IsCancelled(cancel)) {
+      palette_.reset();
+      return {};
+    }
+    paletteKey_ = keys.palette;
+    if (!centersLab.empty()) lastCentersLab_ = std::move(centersLab);
+    clusterStatsValid_ = false;
+  }
+
+  // Step 3b: palette application (plain or dithered).
+  if (!quantized_.Matches(keys.quant)) {
+    ProcessStats::Scope scope(stats, StatStage::Quantize);
+    quantized_.Store(keys.quant, PixelArtProcessor::ApplyPaletteIndices(blocks_.data, *palette_, p));
+    if (!quantized_.valid || IsCancelled(cancel)) return {};
+  }
+  const std::vector<cv::Vec3b>& colors = palette_->Colors();
+  // Native output: the block image is the result; no full-resolution buffer at all.
+  if (native) {
+    ProcessStats::Scope scope(stats, StatStage::Expand);
+    return IndexedImage::ToBGR(quantized_.data, colors);
+  }
+
+  // Step 4 without post-processing: plain expansion is the final output.
+  if (radius == 0) {
+    ProcessStats::Scope scope(stats, StatStage::Expand);
+    outline_.Store(keys.outline, PixelArtProcessor::ExpandBlocksBGR(IndexedImage::ToBGR(quantized_.data, colors),
+                                                                  inputBgr.size(), p.blockSize));
+    return outline_.data;
+  }
+
+  // Steps 4 + 5: block grid for the enabled filters, edge-enhanced (in place) if requested.
+  // The grid stays palette-indexed unless edge enhancement needs true color.
+  if (!edge_.Matches(keys.edge)) {
+    BlockKernels::BlockGrid grid;
+    {
+      ProcessStats::Scope scope(stats, StatStage::Expand);
+      grid = BlockKernels::BuildBlockGrid(quantized_.data, inputBgr.size(), p.blockSize, radius);
+    }
+    if (p.edgeEnhance) {
+      ProcessStats::Scope scope(stats, StatStage::Edge);
+      grid.image = IndexedImage::ToBGR(grid.image, colors);
+      PixelArtProcessor::ApplyEdgeEnhancementInPlace(grid.image, 0.7f);
+    }
+    edge_.Store(keys.edge, grid.image);
+    gridColRuns_ = std::move(grid.colRuns);
+    gridRowRuns_ = std::move(grid.rowRuns);
+    if (!edge_.valid || IsCancelled(cancel)) return {};
+  }
+
+  // Step 6: outline (in place, on a copy of the cached grid), then expansion. Indexed grids
+  // are outlined on indices; the shades need room in the palette, else it runs on colors.
+  BlockKernels::BlockGrid grid{edge_.data, gridColRuns_, gridRowRuns_};
+  if (p.outline) {
+    ProcessStats::Scope scope(stats, StatStage::Outline);
+    grid.image = edge_.data.clone();
+    std::vector<cv::Vec3b> outlined = colors;
+    if (grid.image.type() == CV_8UC1 &&
+        PixelArtProcessor::ApplyPixelArtOutlineIndexed(grid.image, outlined, p.outlineThickness)) {
+      grid.image = IndexedImage::ToBGR(grid.image, outlined);
+    } else {
+      if (grid.image.type() == CV_8UC1) grid.image = IndexedImage::ToBGR(edge_.data, colors);
+      PixelArtProcessor::ApplyPixelArtOutline(grid.image, p.outlineThickness);
+    }
+  }
+  ProcessStats::Scope scope(stats, StatStage::Expand);
+  if (grid.image.type() == CV_8UC1) grid.image = IndexedImage::ToBGR(grid.image, colors);
+  outline_.Store(keys.outline, BlockKernels::ExpandBlockGrid(grid));
+  return outline_.data;
+}
+
+bool PixelArtPipeline::PaletteSurvivesEdit(const cv::Mat& oldBlocks, const cv::Mat& newBlocks) {
+  if (lastCentersLab_.empty()) return false;
+  // Adds (sign 1) or removes (sign -1) every block of a BGR block image to / from the cluster
+  // of its nearest center.
+  auto accumulate = [&](const cv::Mat& blocks, double sign) {
+    cv::Mat lab;
+    cv::cvtColor(blocks, lab, cv::COLOR_BGR2Lab);
+    for (int y = 0; y < lab.rows; ++y) {
+      const cv::Vec3b* row = lab.ptr<cv::Vec3b>(y);
+      for (int x = 0; x < lab.cols; ++x) {
+        const cv::Vec3f c(row[x][0], row[x][1], row[x][2]);
+        ClusterStats& s = clusterStats_[static_cast<size_t>(PaletteClusterer::NearestCenter(lastCentersLab_, c))];
+        for (int ch = 0; ch < 3; ++ch) s.sum[ch] += sign * c[ch];
+        s.count += sign;
+      }
+    }
+  };
+  if (!clusterStatsValid_) {
+    // Once per extraction: the clusters of the whole (pre-edit) block image.
+    clusterStats_.assign(lastCentersLab_.size(), ClusterStats{});
+    accumulate(blocks_.data, 1.0);
+    for (ClusterStats& s : clusterStats_) {
+      s.used = s.count > 0.5;
+      for (int ch = 0; ch < 3; ++ch) s.mean[ch] = s.used ? s.sum[ch] / s.count : 0.0;
+    }
+    clusterStatsValid_ = true;
+  }
+
+  // Means are compared with the ones at extraction time, so drift adds up over edits.
+  accumulate(oldBlocks, -1.0);
+  accumulate(newBlocks, 1.0);
+  const double tolerance = std::max(0.0f, paletteTolerance_);
+  for (const ClusterStats& s : clusterStats_) {
+    if (s.count < 0.5) {
+      // A cluster the edit emptied would be re-seeded by a fresh run.
+      if (s.used) return false;
+      continue;
+    }
+    double d2 = 0.0;
+    for (int ch = 0; ch < 3; ++ch) {
+      const double d = s.sum[ch] / s.count - s.mean[ch];
+      d2 += d * d;
+    }
+    if (d2 > tolerance * tolerance) return false;
+  }
+  return true;
+}
+
+cv::Mat PixelArtPipeline::RunEdited(const cv::Mat& inputBgr, uint64_t inputId, uint64_t previousInputId,
+                                    const cv::Rect& dirty, const PixelArtProcessor::Params& params,
+                                    cv::Rect* outChangedRect, const std::atomic<bool>* cancel, ProcessStats* stats) {
+  if (PixelArtProcessor::ActiveBackend() == PixelArtProcessor::Backend::Reference) {
+    cv::Mat out = Run(inputBgr, inputId, params, cancel, stats);
+    if (outChangedRect) *outChangedRect = out.empty() ? cv::Rect() : cv::Rect(0, 0, out.cols, out.rows);
+    return out;
+  }
+  if (stats) stats->Begin(inputBgr.size());
+  cv::Mat out = RunEditedStages(inputBgr, inputId, previousInputId, dirty, params, outChangedRect, cancel, stats);
+  if (stats) stats->End();
+  return out;
+}
+
+cv::Mat PixelArtPipeline::RunEditedStages(const cv::Mat& inputBgr, uint64_t inputId, uint64_t previousInputId,
+                                          const cv::Rect& dirty, const PixelArtProcessor::Params& params,
+                                          cv::Rect* outChangedRect, const std::atomic<bool>* cancel,
+                                          ProcessStats* stats) {
+  using PalettePreset = PixelArtProcessor::PalettePreset;
+  using StatStage = ProcessStats::Stage;
+  if (outChangedRect) *outChangedRect = cv::Rect();
+  if (inputBgr.empty() || inputBgr.type() != CV_8UC3) return {};
+  const PixelArtProcessor::Params p = PixelArtProcessor::Normalize(params);
+  const bool native = PixelArtProcessor::OutputIsNative(p);
+
+  auto fullRun = [&] {
+    cv::Mat out = RunStages(inputBgr, inputId, params, cancel, stats);
+    if (outChangedRect && !out.empty()) *outChangedRect = cv::Rect(0, 0, out.cols, out.rows);
+    return out;
+  };
+
+  // Patching needs every stage of the previous version with these params.
+  const Keys prev = MakeKeys(previousInputId, inputBgr.size(), p);
+  const Keys keys = MakeKeys(inputId, inputBgr.size(), p);
+  if (!blocks_.Matches(prev.blocks) || !palette_ || paletteKey_ != prev.palette ||
+      !quantized_.Matches(prev.quant) || (!native && !outline_.Matches(prev.outline))) {
+    return fullRun();
+  }
+
+  // Steps 1 + 2 for the blocks that read a dirty pixel: the blur reaches ksize / 2 pixels.
+  const int bs = p.blockSize;
+  const cv::Rect all(0, 0, blocks_.data.cols, blocks_.data.rows);
+  const int ksize = p.preBlur ? PixelArtProcessor::PreBlurKernelSize(bs) : 1;
+  const int reach = ksize / 2;
+  const cv::Rect dirtyPx = dirty & cv::Rect(0, 0, inputBgr.cols, inputBgr.rows);
+  if (dirtyPx.empty()) {
+    blocks_.key = keys.blocks;
+    paletteKey_ = keys.palette;
+    quantized_.key = keys.quant;
+    if (native) return IndexedImage::ToBGR(quantized_.data, palette_->Colors());
+    edge_.valid = edge_.valid && edge_.key == prev.edge;
+    edge_.key = keys.edge;
+    outline_.key = keys.outline;
+    return outline_.data;
+  }
+  const int bx0 = std::max(0, dirtyPx.x - reach) / bs;
+  const int by0 = std::max(0, dirtyPx.y - reach) / bs;
+  const int bx1 = (dirtyPx.x + dirtyPx.width + reach + bs - 1) / bs;
+  const int by1 = (dirtyPx.y + dirtyPx.height + reach + bs - 1) / bs;
+  const cv::Rect dirtyBlocks = cv::Rect(bx0, by0, bx1 - bx0, by1 - by0) & all;
+  cv::Mat patched;
+  {
+    ProcessStats::Scope scope(stats, StatStage::Blocks);
+    patched = BlockKernels::BlockMeanRectBGR(inputBgr, bs, ksize, dirtyBlocks);
+  }
+  if (patched.empty() || IsCancelled(cancel)) return {};
+  const cv::Mat oldBlocks = blocks_.data(dirtyBlocks).clone();
+
+  // Step 3a: keep the palette unless the edit would move it.
+  bool newPalette = false;
+  if (p.palettePreset == PalettePreset::Custom) {
+    ProcessStats::Scope scope(stats, StatStage::Palette);
+    newPalette = !PaletteSurvivesEdit(oldBlocks, patched);
+  }
+  patched.copyTo(blocks_.data(dirtyBlocks));
+  blocks_.key = keys.blocks;
+  if (newPalette) {
+    // Downstream stages no longer match; Run re-clusters and rebuilds from the patched blocks.
+    palette_.reset();
+    return fullRun();
+  }
+  paletteKey_ = keys.palette;
+
+  // Step 3b: re-map the edited blocks. Plain mapping is per block. Ordered dithering depends on
+  // the position in its threshold map, so the region starts on a map tile (<= 64 blocks).
+  // Error diffusion carries error across the whole image: it is re-run in full.
+  cv::Rect quantRegion = dirtyBlocks;
+  if (p.dither) {
+    if (p.ditherMethod == PixelArtProcessor::DitherMethod::FloydSteinberg) {
+      quantRegion = all;
+    } else {
+      const int x0 = quantRegion.x & ~63;
+      const int y0 = quantRegion.y & ~63;
+      quantRegion = cv::Rect(x0, y0, quantRegion.x + quantRegion.width - x0, quantRegion.y + quantRegion.height - y0);
+    }
+  }
+  cv::Mat indices;
+  {
+    ProcessStats::Scope scope(stats, StatStage::Quantize);
+    indices = PixelArtProcessor::ApplyPaletteIndices(blocks_.data(quantRegion), *palette_, p);
+  }
+  if (indices.empty() || IsCancelled(cancel)) {
+    quantized_.valid = false;
+    return {};
+  }
+  cv::Rect changedBlocks = PixelArtProcessor::DiffRect(quantized_.data(quantRegion), indices);
+  indices.copyTo(quantized_.data(quantRegion));
+  quantized_.key = keys.quant;
+  changedBlocks.x += quantRegion.x;
+  changedBlocks.y += quantRegion.y;
+
+  const std::vector<cv::Vec3b>& colors = palette_->Colors();
+  if (native) {
+    ProcessStats::Scope scope(stats, StatStage::Expand);
+    if (outChangedRect) *outChangedRect = changedBlocks;
+    return IndexedImage::ToBGR(quantized_.data, colors);
+  }
+  if (changedBlocks.empty()) {
+    edge_.valid = edge_.valid && edge_.key == prev.edge;
+    edge_.key = keys.edge;
+    outline_.key = keys.outline;
+    return outline_.data;
+  }
+
+  // Steps 4-6 around the changed blocks, pasted into a copy of the previous output. The cached
+  // block grid is stale now; it is rebuilt if a later run needs it.
+  cv::Rect rect;
+  IndexedImage unusedIndexed;
+  cv::Mat region;
+  if (!PixelArtProcessor::ExpandAndPostProcessRegion(IndexedImage{quantized_.data, colors}, changedBlocks,
+                                                     inputBgr.size(), p, false, rect, unusedIndexed, region,
+                                                     stats) ||
+      IsCancelled(cancel)) {
+    return {};
+  }
+  edge_.valid = false;
+  cv::Mat out = outline_.data.clone();
+  region.copyTo(out(rect));
+  outline_.Store(keys.outline, out);
+  if (outChangedRect) *outChangedRect = rect;
+  return out;
+}
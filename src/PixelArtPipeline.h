@@ -0,0 +1,116 @@
+#pragma once
+
+#include "PixelArtProcessor.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// PixelArtPipeline: incremental, cached version of PixelArtProcessor::Process.
+// Why this exists:
+// - Most UI interactions change a single parameter; Process recomputes every stage anyway.
+// - Each stage keeps its last output keyed by a hash of (input id, the params that stage
+//   depends on, the key of the stage it consumes). A stage only recomputes when its key
+//   changes, so e.g. toggling outline reruns just the (block grid) post-processing, switching
+//   palette preset reuses the blur + block averaging result, and toggling dither reuses the
+//   extracted palette (no re-clustering).
+//
+// - RunEdited handles a source that was touched up in place: only the blocks around the edit are
+//   reduced, quantized and post-processed again, and the palette is kept while the edit moves
+//   no K-means cluster mean further than a tolerance.
+//
+// Output is identical to PixelArtProcessor::Process for the same input and params, unless
+// warm-start palettes are enabled or RunEdited kept a palette the edit moved slightly.
+// With the Reference backend active (PixelArtProcessor::ActiveBackend) every call is a plain,
+// uncached Process.
+// Not thread-safe: use one pipeline per thread.
+class PixelArtPipeline {
+public:
+  // `inputId` must identify the pixel content of `inputBgr`: callers give every distinct image
+  // (or edited version of one) a new id. The image size is part of every key as well.
+  // The returned Mat may be shared with the cache: treat it as read-only.
+  // `stats` (optional) receives the timings of the stages that actually ran (cached ones read 0).
+  cv::Mat Run(const cv::Mat& inputBgr, uint64_t inputId, const PixelArtProcessor::Params& params,
+              const std::atomic<bool>* cancel = nullptr, ProcessStats* stats = nullptr);
+
+  // Run for `inputBgr` = the image last run as `previousInputId`, changed only inside `dirty`
+  // (input pixels). Every stage is patched around the edit instead of recomputed; the result
+  // is a new Mat (results handed out earlier stay valid). `outChangedRect` receives the part
+  // of the output that may differ from the previous result (the whole output when the
+  // pipeline had to fall back to Run: other params, other cache contents, a new palette).
+  // A Custom palette is kept if no cluster mean moved more than the palette tolerance.
+  cv::Mat RunEdited(const cv::Mat& inputBgr, uint64_t inputId, uint64_t previousInputId, const cv::Rect& dirty,
+                    const PixelArtProcessor::Params& params, cv::Rect* outChangedRect = nullptr,
+                    const std::atomic<bool>* cancel = nullptr, ProcessStats* stats = nullptr);
+
+  // Drops every cached stage (frees memory).
+  void Clear();
+
+  // When enabled, K-means extraction starts from the centers of the previous extraction
+  // (same palette size) instead of k-means++ seeding. Much cheaper while a slider is dragged,
+  // but the palette then depends on the run history: leave it off for reproducible output.
+  void SetWarmStartPalette(bool enabled) { warmStartPalette_ = enabled; }
+
+  // How far (Lab, 8-bit scale) an edit may move the mean of any K-means cluster before
+  // RunEdited re-clusters. The default matches the clusterer's own convergence threshold:
+  // a fresh run would hardly stop closer. 0 re-clusters on every edit that moves a mean.
+  void SetPaletteTolerance(float labDistance) { paletteTolerance_ = labDistance; }
+
+private:
+  struct Stage {
+    uint64_t key = 0;
+    bool valid = false;
+    cv::Mat data;
+
+    bool Matches(uint64_t k) const { return valid && key == k; }
+    void Store(uint64_t k, const cv::Mat& m) {
+      key = k;
+      data = m;
+      valid = !m.empty();
+    }
+  };
+
+  // Keys of every stage for one input version and params set (see Run).
+  struct Keys {
+    uint64_t blocks = 0;
+    uint64_t palette = 0;
+    uint64_t quant = 0;
+    uint64_t edge = 0;
+    uint64_t outline = 0;
+  };
+  static Keys MakeKeys(uint64_t inputId, const cv::Size& size, const PixelArtProcessor::Params& p);
+  // Run / RunEdited without the ProcessStats Begin / End around them.
+  cv::Mat RunStages(const cv::Mat& inputBgr, uint64_t inputId, const PixelArtProcessor::Params& params,
+                    const std::atomic<bool>* cancel, ProcessStats* stats);
+  cv::Mat RunEditedStages(const cv::Mat& inputBgr, uint64_t inputId, uint64_t previousInputId, const cv::Rect& dirty,
+                          const PixelArtProcessor::Params& params, cv::Rect* outChangedRect,
+                          const std::atomic<bool>* cancel, ProcessStats* stats);
+  // Moves the per-cluster block statistics from `oldBlocks` to `newBlocks` (same region of the
+  // block image); false if some cluster mean moved beyond the tolerance (or disappeared).
+  bool PaletteSurvivesEdit(const cv::Mat& oldBlocks, const cv::Mat& newBlocks);
+
+  Stage blocks_;    // blur + per-block mean (small image)
+  uint64_t paletteKey_ = 0;                 // palette extracted from blocks_ (or a fixed preset)
+  std::shared_ptr<const Palette> palette_;
+  std::vector<cv::Vec3f> lastCentersLab_;   // K-means centers of the newest extraction
+  bool warmStartPalette_ = false;
+  float paletteTolerance_ = 1.0f;
+  // The blocks (Lab) nearest to one of lastCentersLab_: running sum / count, and their mean
+  // when the palette was extracted. Built by the first RunEdited after an extraction.
+  struct ClusterStats {
+    double sum[3] = {0.0, 0.0, 0.0};
+    double count = 0.0;
+    double mean[3] = {0.0, 0.0, 0.0};
+    bool used = false; // had blocks at extraction time
+  };
+  bool clusterStatsValid_ = false;
+  std::vector<ClusterStats> clusterStats_;
+  Stage quantized_; // palette indices of the small image (CV_8UC1; colors in palette_)
+  Stage edge_;      // block grid (see BlockKernels::BlockGrid): indices, or BGR after edge enhancement
+  std::vector<int> gridColRuns_;
+  std::vector<int> gridRowRuns_;
+  Stage outline_;   // full resolution final output
+};
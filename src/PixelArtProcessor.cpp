@@ -1,7 +1,16 @@
 #include "PixelArtProcessor.h"
 
+#include "BlockKernels.h"
+#include "ErrorDiffusion.h"
+#include "OrderedDither.h"
+#include "OutlineKernels.h"
+#include "PaletteClusterer.h"
+#include "ReferenceProcessor.h"
+
 #include <cmath>
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <limits>
 #include <opencv2/imgproc.hpp>
@@ -9,738 +18,603 @@
 namespace {
 inline int ClampInt(int v, int lo, int hi) { return std::max(lo, std::min(v, hi)); }
 
-// Helper: compute squared Euclidean distance in RGB space
-inline float ColorDistanceSquared(const cv::Vec3b& a, const cv::Vec3b& b) {
-  const float dr = static_cast<float>(a[2]) - static_cast<float>(b[2]);
-  const float dg = static_cast<float>(a[1]) - static_cast<float>(b[1]);
-  const float db = static_cast<float>(a[0]) - static_cast<float>(b[0]);
-  return dr * dr + dg * dg + db * db;
+inline bool IsCancelled(const std::atomic<bool>* cancel) {
+  return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+using Backend = PixelArtProcessor::Backend;
+
+std::atomic<int>& ProcessBackend() {
+  static std::atomic<int> backend{[] {
+    Backend b = Backend::Optimized;
+    const char* env = std::getenv("FPW_BACKEND");
+    if (env) PixelArtProcessor::ParseBackend(env, b);
+    return static_cast<int>(b);
+  }()};
+  return backend;
+}
+
+thread_local int t_backendOverride = -1; // BackendScope; -1 = none
+
+inline bool UseReference() {
+  return PixelArtProcessor::ActiveBackend() == Backend::Reference;
+}
+
+// Steps 1-3 shared by Process and ProcessIndexed: the quantized block image as indices.
+IndexedImage QuantizeToIndices(const cv::Mat& inputBgr, const PixelArtProcessor::Params& p,
+                               const std::atomic<bool>* cancel, ProcessStats* stats, ProcessContext* context) {
+  using Stage = ProcessStats::Stage;
+  // Steps 1 + 2: optional pre-blur fused with the explicit block-based representative colors.
+  // IMPORTANT: This is not resize-based downsampling; we iterate blocks and compute per-block mean.
+  cv::Mat smallBlocksBgr;
+  {
+    ProcessStats::Scope scope(stats, Stage::Blocks);
+    smallBlocksBgr = PixelArtProcessor::BuildBlockColorImage(inputBgr, p, context);
+  }
+  if (smallBlocksBgr.empty() || IsCancelled(cancel)) return {};
+
+  // Step 3: Palette limitation. The block image is kept as palette indices from here on.
+  std::shared_ptr<const Palette> palette;
+  {
+    ProcessStats::Scope scope(stats, Stage::Palette);
+    palette = PixelArtProcessor::ExtractPalette(smallBlocksBgr, p, nullptr, nullptr, context);
+  }
+  if (!palette) return {};
+  IndexedImage quantized;
+  {
+    ProcessStats::Scope scope(stats, Stage::Quantize);
+    quantized.indices = PixelArtProcessor::ApplyPaletteIndices(smallBlocksBgr, *palette, p, context);
+  }
+  quantized.colors = palette->Colors();
+  if (quantized.empty() || IsCancelled(cancel)) return {};
+  return quantized;
 }
 } // namespace
 
-cv::Mat PixelArtProcessor::Process(const cv::Mat& inputBgr, const Params& params) {
+cv::Mat PixelArtProcessor::Process(const cv::Mat& inputBgr, const Params& params,
+                                   const std::atomic<bool>* cancel, ProcessStats* stats, ProcessContext* context) {
   if (inputBgr.empty()) return {};
   if (inputBgr.type() != CV_8UC3) return {};
 
+  const Params p = Normalize(params);
+  if (stats) stats->Begin(inputBgr.size());
+
+  // Steps 1-3: block colors and palette limitation.
+  const IndexedImage quantized = QuantizeToIndices(inputBgr, p, cancel, stats, context);
+  cv::Mat out;
+  if (!quantized.empty() && OutputIsNative(p)) {
+    ProcessStats::Scope scope(stats, ProcessStats::Stage::Expand);
+    out = ProcessContext::Output(context, quantized.indices.rows, quantized.indices.cols, CV_8UC3);
+    IndexedImage::ToBGR(quantized.indices, quantized.colors, out);
+  } else if (!quantized.empty()) {
+    // Steps 4-6: expansion to full resolution, with the optional post-processing run on the
+    // collapsed block grid instead of the full-resolution image.
+    IndexedImage unused;
+    ExpandAndPostProcess(quantized, inputBgr.size(), p, false, unused, out, stats, context);
+  }
+  if (stats) stats->End();
+  return out;
+}
+
+bool PixelArtProcessor::ProcessIndexed(const cv::Mat& inputBgr, const Params& params, IndexedImage& outIndexed,
+                                       cv::Mat& outBgr, const std::atomic<bool>* cancel, ProcessStats* stats,
+                                       ProcessContext* context) {
+  outIndexed = {};
+  outBgr.release();
+  if (inputBgr.empty() || inputBgr.type() != CV_8UC3) return false;
+
+  const Params p = Normalize(params);
+  if (stats) stats->Begin(inputBgr.size());
+  IndexedImage quantized = QuantizeToIndices(inputBgr, p, cancel, stats, context);
+  bool ok = false;
+  if (!quantized.empty() && OutputIsNative(p)) {
+    // The index plane is the result; with a context it is a scratch slot, so copy it out.
+    outIndexed.colors = std::move(quantized.colors);
+    if (context) {
+      outIndexed.indices = ProcessContext::Output(context, quantized.indices.rows, quantized.indices.cols, CV_8UC1);
+      quantized.indices.copyTo(outIndexed.indices);
+    } else {
+      outIndexed.indices = quantized.indices;
+    }
+    ok = true;
+  } else if (!quantized.empty()) {
+    ok = ExpandAndPostProcess(quantized, inputBgr.size(), p, true, outIndexed, outBgr, stats, context);
+  }
+  if (stats) stats->End();
+  return ok;
+}
+
+void PixelArtProcessor::SetBackend(Backend backend) {
+  ProcessBackend().store(static_cast<int>(backend), std::memory_order_relaxed);
+}
+
+PixelArtProcessor::Backend PixelArtProcessor::ActiveBackend() {
+  if (t_backendOverride >= 0) return static_cast<Backend>(t_backendOverride);
+  return static_cast<Backend>(ProcessBackend().load(std::memory_order_relaxed));
+}
+
+const char* PixelArtProcessor::BackendName(Backend backend) {
+  return backend == Backend::Reference ? "reference" : "optimized";
+}
+
+bool PixelArtProcessor::ParseBackend(const std::string& name, Backend& out) {
+  if (name == "optimized") {
+    out = Backend::Optimized;
+  } else if (name == "reference") {
+    out = Backend::Reference;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+PixelArtProcessor::BackendScope::BackendScope(Backend backend) : previous_(t_backendOverride) {
+  t_backendOverride = static_cast<int>(backend);
+}
+
+PixelArtProcessor::BackendScope::~BackendScope() {
+  t_backendOverride = previous_;
+}
+
+PixelArtProcessor::Params PixelArtProcessor::Normalize(const Params& params) {
   Params p = params;
   p.blockSize = ClampInt(p.blockSize, 1, 256);
   p.paletteSize = ClampInt(p.paletteSize, 2, 256);
+  p.outlineThickness = ClampInt(p.outlineThickness, 1, 5);
+  p.ditherMethod = static_cast<DitherMethod>(ClampInt(static_cast<int>(p.ditherMethod), 0,
+                                                      static_cast<int>(DitherMethod::BlueNoise)));
+  if (p.palettePreset == PalettePreset::User && !ResolvePalette(p)) p.palettePreset = PalettePreset::Custom;
+  if (p.palettePreset != PalettePreset::User) p.userPaletteId = -1;
+  return p;
+}
 
-  cv::Mat work = inputBgr.clone();
+bool PixelArtProcessor::OutputIsNative(const Params& params) {
+  return params.nativeOutput && !params.edgeEnhance && !params.outline;
+}
 
-  // Step 1: Optional pre-blur.
-  // Why: pixel-art block averaging is sensitive to salt-and-pepper noise and fine texture.
-  // A small Gaussian blur nudges the block representative colors toward stable "flat" colors.
-  if (p.preBlur) {
-    // Kernel size must be odd. Keep it modest relative to block size.
-    int k = std::max(3, (p.blockSize / 2) | 1);
-    cv::GaussianBlur(work, work, cv::Size(k, k), 0.0, 0.0, cv::BORDER_DEFAULT);
+int PixelArtProcessor::PostProcessRadius(const Params& params) {
+  int radius = 0;
+  // Unsharp mask: 3x3 Gaussian.
+  if (params.edgeEnhance) radius += 1;
+  // Outline: 4-neighbour edge test, then MORPH_OPEN with a 3x3 cross (erode + dilate) for
+  // thickness 1, or a (2t+1)-square dilation.
+  if (params.outline) {
+    const int t = ClampInt(params.outlineThickness, 1, 5);
+    radius += 1 + (t == 1 ? 2 : t);
   }
+  return radius;
+}
 
-  // Step 2: Explicit block-based representative color image.
-  // IMPORTANT: This is not resize-based downsampling; we iterate blocks and compute per-block mean.
-  cv::Mat smallBlocksBgr = BuildBlockColorImageBGR(work, p.blockSize);
-  if (smallBlocksBgr.empty()) return {};
-
-  // Step 3: Palette limitation
-  // - If Custom: use K-means clustering in Lab space (perceptual color quantization)
-  // - If fixed preset: quantize to predefined retro palette (NES/GB/Pico-8/etc)
-  // - Optionally apply Floyd-Steinberg dithering to reduce color banding
-  cv::Mat quantizedSmallBgr;
-  if (p.dither) {
-    // Use dithering versions
-    if (p.palettePreset == PalettePreset::Custom) {
-      quantizedSmallBgr = QuantizeWithKMeansLabDither(smallBlocksBgr, p.paletteSize);
-    } else {
-      quantizedSmallBgr = QuantizeWithFixedPaletteDither(smallBlocksBgr, p.palettePreset);
-    }
-  } else {
-    // Standard quantization without dithering
-    if (p.palettePreset == PalettePreset::Custom) {
-      quantizedSmallBgr = QuantizeWithKMeansLab(smallBlocksBgr, p.paletteSize);
-    } else {
-      quantizedSmallBgr = QuantizeWithFixedPalette(smallBlocksBgr, p.palettePreset);
-    }
-  }
-  if (quantizedSmallBgr.empty()) return {};
+cv::Mat PixelArtProcessor::ExpandAndPostProcess(const cv::Mat& quantizedSmallBgr, const cv::Size& outSize,
+                                                const Params& params) {
+  if (quantizedSmallBgr.empty() || quantizedSmallBgr.type() != CV_8UC3) return {};
+  if (UseReference()) return ReferenceProcessor::ExpandAndPostProcess(quantizedSmallBgr, outSize, params);
+  const int blockSize = std::max(1, params.blockSize);
+  const int radius = PostProcessRadius(params);
 
   // Step 4: Expand blocks back to full resolution by filling each N×N block with its quantized color.
-  cv::Mat out = ExpandBlocksBGR(quantizedSmallBgr, inputBgr.size(), p.blockSize);
+  if (radius == 0) return ExpandBlocksBGR(quantizedSmallBgr, outSize, blockSize);
+
+  // The expansion is flat inside every block, so the post-processing only has work to do
+  // near block edges. Run it on the block grid (edges + one interior sample per block) and
+  // expand that: bit-identical to filtering the full expansion, at a fraction of the pixels.
+  BlockKernels::BlockGrid grid = BlockKernels::BuildBlockGrid(quantizedSmallBgr, outSize, blockSize, radius);
 
   // Step 5 (optional): Edge enhancement on the final pixelated result.
   // Why: pixel art often has crisp separations; a gentle unsharp mask helps emphasize edges
   // without reintroducing continuous-tone gradients.
-  if (p.edgeEnhance && !out.empty()) {
-    ApplyEdgeEnhancementInPlace(out, 0.7f);
-  }
+  if (params.edgeEnhance) ApplyEdgeEnhancementInPlace(grid.image, 0.7f);
 
   // Step 6 (optional): Extract contours and draw pixel-art style outlines.
   // Why: outlines give pixel art a distinctive cartoon-like appearance, separating objects from background.
-  if (p.outline && !out.empty()) {
-    p.outlineThickness = ClampInt(p.outlineThickness, 1, 5);
-    ApplyPixelArtOutline(out, p.outlineThickness);
-  }
-  return out;
-}
+  if (params.outline) ApplyPixelArtOutline(grid.image, params.outlineThickness);
 
-cv::Mat PixelArtProcessor::BuildBlockColorImageBGR(const cv::Mat& inputBgr, int blockSize) {
-  const int w = inputBgr.cols;
-  const int h = inputBgr.rows;
-  if (w <= 0 || h <= 0) return {};
-  blockSize = std::max(1, blockSize);
+  return BlockKernels::ExpandBlockGrid(grid);
+}
 
-  const int bw = (w + blockSize - 1) / blockSize;
-  const int bh = (h + blockSize - 1) / blockSize;
+bool PixelArtProcessor::ExpandAndPostProcess(const IndexedImage& quantizedSmall, const cv::Size& outSize,
+                                             const Params& params, bool keepIndexed, IndexedImage& outIndexed,
+                                             cv::Mat& outBgr, ProcessStats* stats, ProcessContext* context) {
+  using Stage = ProcessStats::Stage;
+  using Slot = ProcessContext::Slot;
+  outIndexed = {};
+  outBgr.release();
+  if (quantizedSmall.empty() || quantizedSmall.indices.type() != CV_8UC1) return false;
+  if (UseReference()) {
+    ProcessStats::Scope scope(stats, Stage::Expand);
+    outBgr = ReferenceProcessor::ExpandAndPostProcess(quantizedSmall.ToBGR(), outSize, params);
+    return !outBgr.empty();
+  }
+  const int blockSize = std::max(1, params.blockSize);
+  const int radius = PostProcessRadius(params);
+
+  // Output beyond the block image is black in the BGR expansion; an index plane has no
+  // black to give it, so such sizes take the BGR route.
+  const cv::Mat& indices = quantizedSmall.indices;
+  const bool covered = static_cast<int64_t>(indices.cols) * blockSize >= outSize.width &&
+                       static_cast<int64_t>(indices.rows) * blockSize >= outSize.height;
+  if (!covered) {
+    ProcessStats::Scope scope(stats, Stage::Expand);
+    outBgr = ExpandAndPostProcess(quantizedSmall.ToBGR(), outSize, params);
+    return !outBgr.empty();
+  }
 
-  cv::Mat small(bh, bw, CV_8UC3, cv::Scalar(0, 0, 0));
+  // Index plane -> colors, into a scratch slot.
+  auto toBgr = [&](const cv::Mat& src, Slot slot, const std::vector<cv::Vec3b>& palette) {
+    cv::Mat bgr = ProcessContext::Scratch(context, slot, src.rows, src.cols, CV_8UC3);
+    IndexedImage::ToBGR(src, palette, bgr);
+    return bgr;
+  };
+
+  // Step 4: plain expansion, of indices (1 byte per pixel) or colors.
+  if (radius == 0) {
+    ProcessStats::Scope scope(stats, Stage::Expand);
+    if (keepIndexed) {
+      outIndexed.indices = BlockKernels::ExpandBlocksIndexed(indices, outSize, blockSize, context);
+      outIndexed.colors = quantizedSmall.colors;
+      return !outIndexed.empty();
+    }
+    outBgr = ExpandBlocksBGR(toBgr(indices, Slot::QuantizedBgr, quantizedSmall.colors), outSize, blockSize, context);
+    return !outBgr.empty();
+  }
 
-  for (int by = 0; by < bh; ++by) {
-    for (int bx = 0; bx < bw; ++bx) {
-      const int x0 = bx * blockSize;
-      const int y0 = by * blockSize;
-      const int x1 = std::min(x0 + blockSize, w);
-      const int y1 = std::min(y0 + blockSize, h);
+  // Steps 5 + 6 on the block grid, as in the BGR overload. The grid stays indexed unless
+  // edge enhancement (continuous-tone) runs or the outline shades do not fit the palette.
+  BlockKernels::BlockGrid grid;
+  {
+    ProcessStats::Scope scope(stats, Stage::Expand);
+    grid = BlockKernels::BuildBlockGrid(indices, outSize, blockSize, radius, context);
+  }
+  std::vector<cv::Vec3b> colors = quantizedSmall.colors;
+  bool indexed = true;
+  if (params.edgeEnhance) {
+    ProcessStats::Scope scope(stats, Stage::Edge);
+    grid.image = toBgr(grid.image, Slot::GridBgr, colors);
+    indexed = false;
+    ApplyEdgeEnhancementInPlace(grid.image, 0.7f, context);
+  }
+  if (params.outline) {
+    ProcessStats::Scope scope(stats, Stage::Outline);
+    if (!indexed || !ApplyPixelArtOutlineIndexed(grid.image, colors, params.outlineThickness, context)) {
+      if (indexed) grid.image = toBgr(grid.image, Slot::GridBgr, colors);
+      indexed = false;
+      ApplyPixelArtOutline(grid.image, params.outlineThickness, context);
+    }
+  }
 
-      cv::Rect roi(x0, y0, x1 - x0, y1 - y0);
-      cv::Mat block = inputBgr(roi);
+  ProcessStats::Scope scope(stats, Stage::Expand);
+  if (indexed && keepIndexed) {
+    outIndexed.indices = BlockKernels::ExpandBlockGrid(grid, context);
+    outIndexed.colors = std::move(colors);
+    return !outIndexed.empty();
+  }
+  if (indexed) grid.image = toBgr(grid.image, Slot::GridBgr, colors);
+  outBgr = BlockKernels::ExpandBlockGrid(grid, context);
+  return !outBgr.empty();
+}
 
-      // Representative color: mean color in BGR.
-      // Why mean: fast, stable, and works well once we apply a mild pre-blur.
-      const cv::Scalar m = cv::mean(block);
-      small.at<cv::Vec3b>(by, bx) = cv::Vec3b(
-          static_cast<uchar>(m[0]),
-          static_cast<uchar>(m[1]),
-          static_cast<uchar>(m[2]));
-    }
+bool PixelArtProcessor::ExpandAndPostProcessRegion(const IndexedImage& quantizedSmall, const cv::Rect& changedBlocks,
+                                                   const cv::Size& outSize, const Params& params, bool keepIndexed,
+                                                   cv::Rect& outRect, IndexedImage& outIndexed, cv::Mat& outBgr,
+                                                   ProcessStats* stats) {
+  outIndexed = {};
+  outBgr.release();
+  outRect = cv::Rect();
+  if (quantizedSmall.empty() || quantizedSmall.indices.type() != CV_8UC1) return false;
+  const int bs = std::max(1, params.blockSize);
+  const cv::Rect all(0, 0, quantizedSmall.indices.cols, quantizedSmall.indices.rows);
+  const cv::Rect changed = changedBlocks & all;
+  if (changed.empty()) return false;
+
+  // Output within `radius` pixels of a changed block changes too, and a region run on its own
+  // gets an artificial border reaching `radius` grid cells inwards. A block spans
+  // min(bs, 2R + 1) grid cells, so both are covered by `halo` blocks.
+  const int radius = PostProcessRadius(params);
+  const int cells = std::min(bs, 2 * radius + 1);
+  const int halo = radius > 0 ? (radius + cells - 1) / cells : 0;
+  auto grow = [&](const cv::Rect& r, int by) {
+    return cv::Rect(r.x - by, r.y - by, r.width + 2 * by, r.height + 2 * by) & all;
+  };
+  const cv::Size covered(std::min(outSize.width, all.width * bs), std::min(outSize.height, all.height * bs));
+  // Output not covered by the block grid (black) borders the last blocks; include it in a
+  // rect that reaches them so the whole affected part of the image is returned.
+  auto toPixels = [&](const cv::Rect& r) {
+    const int x1 = r.x + r.width == all.width ? outSize.width : std::min(covered.width, (r.x + r.width) * bs);
+    const int y1 = r.y + r.height == all.height ? outSize.height : std::min(covered.height, (r.y + r.height) * bs);
+    return cv::Rect(r.x * bs, r.y * bs, x1 - r.x * bs, y1 - r.y * bs);
+  };
+  const cv::Rect inner = grow(changed, halo);
+  const cv::Rect outer = grow(inner, halo);
+  const cv::Rect outerPx = toPixels(outer);
+  outRect = toPixels(inner);
+  if (outRect.empty()) return false;
+
+  IndexedImage region;
+  region.indices = quantizedSmall.indices(outer);
+  region.colors = quantizedSmall.colors;
+  IndexedImage expanded;
+  cv::Mat expandedBgr;
+  if (!ExpandAndPostProcess(region, outerPx.size(), params, keepIndexed, expanded, expandedBgr, stats)) return false;
+  const cv::Rect crop(outRect.x - outerPx.x, outRect.y - outerPx.y, outRect.width, outRect.height);
+  if (!expanded.empty()) {
+    outIndexed.indices = expanded.indices(crop).clone();
+    outIndexed.colors = std::move(expanded.colors);
+  } else {
+    outBgr = expandedBgr(crop).clone();
   }
-  return small;
+  return true;
 }
 
-cv::Mat PixelArtProcessor::QuantizeWithKMeansLab(const cv::Mat& smallBgr, int paletteSize) {
-  if (smallBgr.empty() || smallBgr.type() != CV_8UC3) return {};
+cv::Rect PixelArtProcessor::DiffRect(const cv::Mat& a, const cv::Mat& b) {
+  if (a.empty() || a.size() != b.size() || a.type() != b.type()) return {};
+  const size_t px = a.elemSize();
+  int x0 = a.cols, y0 = a.rows, x1 = 0, y1 = 0;
+  for (int y = 0; y < a.rows; ++y) {
+    const uchar* ra = a.ptr<uchar>(y);
+    const uchar* rb = b.ptr<uchar>(y);
+    if (std::memcmp(ra, rb, px * static_cast<size_t>(a.cols)) == 0) continue;
+    int first = 0;
+    while (std::memcmp(ra + first * px, rb + first * px, px) == 0) ++first;
+    int last = a.cols - 1;
+    while (last > first && std::memcmp(ra + last * px, rb + last * px, px) == 0) --last;
+    x0 = std::min(x0, first);
+    x1 = std::max(x1, last + 1);
+    y0 = std::min(y0, y);
+    y1 = y + 1;
+  }
+  return x1 > x0 ? cv::Rect(x0, y0, x1 - x0, y1 - y0) : cv::Rect();
+}
 
-  const int total = smallBgr.rows * smallBgr.cols;
-  if (total <= 0) return {};
+int PixelArtProcessor::PreBlurKernelSize(int blockSize) {
+  // Kernel size must be odd. Keep it modest relative to block size.
+  return std::max(3, (blockSize / 2) | 1);
+}
 
-  paletteSize = std::max(2, std::min(paletteSize, total));
+cv::Mat PixelArtProcessor::BuildBlockColorImage(const cv::Mat& inputBgr, const Params& params,
+                                                ProcessContext* context) {
+  if (UseReference()) return ReferenceProcessor::BuildBlockColorImage(inputBgr, params);
+  // Why: pixel-art block averaging is sensitive to salt-and-pepper noise and fine texture.
+  // A small Gaussian blur nudges the block representative colors toward stable "flat" colors.
+  // The blur is folded into the block reduction, so no full-resolution blurred copy is made;
+  // without it the input is only read, so it is not copied either.
+  if (params.preBlur) {
+    return BlockKernels::BlurredBlockMeanBGR(inputBgr, ClampInt(params.blockSize, 1, 256),
+                                             PreBlurKernelSize(params.blockSize), context);
+  }
+  return BuildBlockColorImageBGR(inputBgr, params.blockSize, context);
+}
 
-  // Convert to Lab for perceptual clustering.
-  cv::Mat smallLab;
-  cv::cvtColor(smallBgr, smallLab, cv::COLOR_BGR2Lab);
+cv::Mat PixelArtProcessor::QuantizeBlocks(const cv::Mat& smallBgr, const Params& params) {
+  // Palette limitation = extraction (what colors) + application (how pixels map onto them).
+  const std::shared_ptr<const Palette> palette = ExtractPalette(smallBgr, params);
+  if (!palette) return {};
+  return ApplyPalette(smallBgr, *palette, params);
+}
 
-  // Flatten to N x 3 float samples for kmeans.
-  cv::Mat samples(total, 3, CV_32F);
-  for (int y = 0; y < smallLab.rows; ++y) {
-    const cv::Vec3b* row = smallLab.ptr<cv::Vec3b>(y);
-    for (int x = 0; x < smallLab.cols; ++x) {
-      const int i = y * smallLab.cols + x;
-      samples.at<float>(i, 0) = static_cast<float>(row[x][0]);
-      samples.at<float>(i, 1) = static_cast<float>(row[x][1]);
-      samples.at<float>(i, 2) = static_cast<float>(row[x][2]);
-    }
+std::shared_ptr<const Palette> PixelArtProcessor::ExtractPalette(const cv::Mat& smallBgr, const Params& params,
+                                                                 const std::vector<cv::Vec3f>* warmStartLab,
+                                                                 std::vector<cv::Vec3f>* outCentersLab,
+                                                                 ProcessContext* context) {
+  if (UseReference()) {
+    // The reference K-means has no warm start; callers simply get no centers back.
+    if (outCentersLab) outCentersLab->clear();
+    return ReferenceProcessor::ExtractPalette(smallBgr, params);
   }
+  // - If Custom: use K-means clustering in Lab space (perceptual color quantization)
+  // - If fixed preset / user palette: the registry's palette (NES/GB/Pico-8/etc)
+  if (params.palettePreset == PalettePreset::Custom) {
+    return ExtractKMeansPalette(smallBgr, params.paletteSize, params.kmeansSeed, warmStartLab, outCentersLab,
+                                context);
+  }
+  // Registry palettes live for the whole process: hand out a non-owning pointer.
+  const Palette* fixed = ResolvePalette(params);
+  if (!fixed) return {};
+  return std::shared_ptr<const Palette>(std::shared_ptr<const Palette>(), fixed);
+}
 
-  cv::Mat labels;
-  cv::Mat centers;
-  const int attempts = 3;
-  cv::TermCriteria criteria(cv::TermCriteria::EPS + cv::TermCriteria::MAX_ITER, 30, 1.0);
-
-  // K-means clustering in Lab.
-  // NOTE: We keep data small by clustering only the per-block representative colors.
-  // This is much faster than clustering every original pixel while still producing a clean palette.
-  cv::kmeans(samples, paletteSize, labels, criteria, attempts, cv::KMEANS_PP_CENTERS, centers);
-
-  // Reconstruct quantized small image in Lab using cluster centers, then convert back to BGR.
-  cv::Mat quantLab(smallLab.size(), CV_8UC3);
-  for (int y = 0; y < quantLab.rows; ++y) {
-    cv::Vec3b* outRow = quantLab.ptr<cv::Vec3b>(y);
-    for (int x = 0; x < quantLab.cols; ++x) {
-      const int i = y * quantLab.cols + x;
-      const int label = labels.at<int>(i, 0);
-      const cv::Vec3f c(
-          centers.at<float>(label, 0),
-          centers.at<float>(label, 1),
-          centers.at<float>(label, 2));
-
-      outRow[x] = cv::Vec3b(
-          static_cast<uchar>(ClampInt(static_cast<int>(std::lround(c[0])), 0, 255)),
-          static_cast<uchar>(ClampInt(static_cast<int>(std::lround(c[1])), 0, 255)),
-          static_cast<uchar>(ClampInt(static_cast<int>(std::lround(c[2])), 0, 255)));
-    }
+cv::Mat PixelArtProcessor::ApplyPaletteIndices(const cv::Mat& smallBgr, const Palette& palette,
+                                               const Params& params, ProcessContext* context) {
+  if (UseReference()) return ReferenceProcessor::ApplyPaletteIndices(smallBgr, palette, params);
+  // Optionally apply dithering to reduce color banding
+  if (!params.dither) return QuantizeWithPalette(smallBgr, palette, context);
+  if (params.ditherMethod == DitherMethod::FloydSteinberg) {
+    return QuantizeWithPaletteDither(smallBgr, palette, params.ditherSerpentine, context);
   }
+  return QuantizeWithPaletteOrdered(smallBgr, palette, params.ditherMethod, context);
+}
 
-  cv::Mat quantBgr;
-  cv::cvtColor(quantLab, quantBgr, cv::COLOR_Lab2BGR);
-  return quantBgr;
+cv::Mat PixelArtProcessor::ApplyPalette(const cv::Mat& smallBgr, const Palette& palette, const Params& params) {
+  const cv::Mat indices = ApplyPaletteIndices(smallBgr, palette, params);
+  if (indices.empty()) return {};
+  return IndexedImage::ToBGR(indices, palette.Colors());
 }
 
-cv::Mat PixelArtProcessor::ExpandBlocksBGR(const cv::Mat& smallBgr, const cv::Size& outSize, int blockSize) {
-  if (smallBgr.empty() || smallBgr.type() != CV_8UC3) return {};
-  blockSize = std::max(1, blockSize);
+const Palette* PixelArtProcessor::ResolvePalette(const Params& params) {
+  switch (params.palettePreset) {
+    case PalettePreset::Custom:
+      return nullptr;
+    case PalettePreset::User:
+      // Only user palettes are addressable here; ids below BuiltinCount() belong to presets.
+      return params.userPaletteId >= PaletteRegistry::BuiltinCount()
+                 ? PaletteRegistry::Get(params.userPaletteId) : nullptr;
+    default:
+      // Built-ins are registered in enum order, starting at NES = id 0.
+      return PaletteRegistry::Get(static_cast<int>(params.palettePreset) - 1);
+  }
+}
 
-  cv::Mat out(outSize, CV_8UC3, cv::Scalar(0, 0, 0));
+cv::Mat PixelArtProcessor::BuildBlockColorImageBGR(const cv::Mat& inputBgr, int blockSize, ProcessContext* context) {
+  if (inputBgr.cols <= 0 || inputBgr.rows <= 0) return {};
 
-  const int bw = smallBgr.cols;
-  const int bh = smallBgr.rows;
+  // Representative color: mean color in BGR.
+  // Why mean: fast, stable, and works well once we apply a mild pre-blur.
+  // BlockKernels streams the image once instead of calling cv::mean per block ROI;
+  // the result is identical (same truncation).
+  return BlockKernels::BlockMeanBGR(inputBgr, ClampInt(blockSize, 1, 256), context);
+}
 
-  for (int by = 0; by < bh; ++by) {
-    for (int bx = 0; bx < bw; ++bx) {
-      const cv::Vec3b c = smallBgr.at<cv::Vec3b>(by, bx);
+std::shared_ptr<const Palette> PixelArtProcessor::ExtractKMeansPalette(
+    const cv::Mat& smallBgr, int paletteSize, uint32_t seed,
+    const std::vector<cv::Vec3f>* warmStartLab, std::vector<cv::Vec3f>* outCentersLab, ProcessContext* context) {
+  using Slot = ProcessContext::Slot;
+  if (smallBgr.empty() || smallBgr.type() != CV_8UC3) return {};
 
-      const int x0 = bx * blockSize;
-      const int y0 = by * blockSize;
-      const int x1 = std::min(x0 + blockSize, out.cols);
-      const int y1 = std::min(y0 + blockSize, out.rows);
-      if (x0 >= x1 || y0 >= y1) continue;
+  // Convert to Lab for perceptual clustering.
+  cv::Mat smallLab = ProcessContext::Scratch(context, Slot::BlocksLab, smallBgr.rows, smallBgr.cols, CV_8UC3);
+  cv::cvtColor(smallBgr, smallLab, cv::COLOR_BGR2Lab);
 
-      cv::Rect roi(x0, y0, x1 - x0, y1 - y0);
-      out(roi).setTo(cv::Scalar(c[0], c[1], c[2]));
-    }
+  // K-means clustering in Lab.
+  // NOTE: We keep data small by clustering only the per-block representative colors, and
+  // PaletteClusterer further collapses repeated colors into a weighted histogram.
+  const PaletteClusterer::Histogram hist = PaletteClusterer::BuildHistogram(smallLab);
+  if (hist.colors.empty()) return {};
+
+  PaletteClusterer::Options opts;
+  opts.k = std::max(2, paletteSize);
+  opts.seed = seed;
+  opts.attempts = 3;
+  opts.maxIterations = 30;
+  opts.epsilon = 1.0f;
+  opts.warmStart = warmStartLab;
+  // Exact iterations are cheap on typical block histograms; only switch to mini-batch
+  // for very colorful inputs (tiny block sizes on large photos).
+  if (hist.colors.size() > 65536) opts.miniBatchSize = 4096;
+  PaletteClusterer::Result clusters = PaletteClusterer::Cluster(hist, opts);
+
+  // Convert all centers Lab -> BGR in one call.
+  const int k = static_cast<int>(clusters.centers.size());
+  cv::Mat centersLab = ProcessContext::Scratch(context, Slot::CentersLab, 1, k, CV_8UC3);
+  for (int i = 0; i < k; ++i) {
+    const cv::Vec3f& c = clusters.centers[static_cast<size_t>(i)];
+    centersLab.at<cv::Vec3b>(0, i) = cv::Vec3b(
+        static_cast<uchar>(ClampInt(static_cast<int>(std::lround(c[0])), 0, 255)),
+        static_cast<uchar>(ClampInt(static_cast<int>(std::lround(c[1])), 0, 255)),
+        static_cast<uchar>(ClampInt(static_cast<int>(std::lround(c[2])), 0, 255)));
   }
+  cv::Mat centersBgr = ProcessContext::Scratch(context, Slot::CentersBgr, 1, k, CV_8UC3);
+  cv::cvtColor(centersLab, centersBgr, cv::COLOR_Lab2BGR);
+  const cv::Vec3b* row = centersBgr.ptr<cv::Vec3b>(0);
 
-  return out;
+  if (outCentersLab) *outCentersLab = std::move(clusters.centers);
+  return std::make_shared<const Palette>("K-means", std::vector<cv::Vec3b>(row, row + k), Palette::Metric::Lab);
 }
 
-void PixelArtProcessor::ApplyEdgeEnhancementInPlace(cv::Mat& bgr, float strength) {
+cv::Mat PixelArtProcessor::ExpandBlocksBGR(const cv::Mat& smallBgr, const cv::Size& outSize, int blockSize,
+                                           ProcessContext* context) {
+  if (smallBgr.empty() || smallBgr.type() != CV_8UC3) return {};
+  return BlockKernels::ExpandBlocksBGR(smallBgr, outSize, std::max(1, blockSize), context);
+}
+
+void PixelArtProcessor::ApplyEdgeEnhancementInPlace(cv::Mat& bgr, float strength, ProcessContext* context) {
+  using Slot = ProcessContext::Slot;
   if (bgr.empty() || bgr.type() != CV_8UC3) return;
   strength = std::max(0.0f, std::min(strength, 2.0f));
+  const int rows = bgr.rows;
+  const int cols = bgr.cols;
 
   // Simple unsharp mask:
   // - Blur a bit
   // - Add back high-frequency component
-  cv::Mat blurred;
+  cv::Mat blurred = ProcessContext::Scratch(context, Slot::EdgeBlurred, rows, cols, CV_8UC3);
   cv::GaussianBlur(bgr, blurred, cv::Size(3, 3), 0.0, 0.0, cv::BORDER_DEFAULT);
 
-  cv::Mat bgrF, blurredF;
+  cv::Mat bgrF = ProcessContext::Scratch(context, Slot::EdgeFloat, rows, cols, CV_32FC3);
+  cv::Mat blurredF = ProcessContext::Scratch(context, Slot::EdgeBlurredFloat, rows, cols, CV_32FC3);
   bgr.convertTo(bgrF, CV_32F);
   blurred.convertTo(blurredF, CV_32F);
 
-  cv::Mat high = bgrF - blurredF;
-  cv::Mat sharpened = bgrF + high * strength;
+  // sharpened = bgrF + (bgrF - blurredF) * strength, spelled out as the calls those Mat
+  // expressions evaluate to (same results) so no temporary is allocated; it reuses blurredF.
+  cv::Mat high = ProcessContext::Scratch(context, Slot::EdgeDetail, rows, cols, CV_32FC3);
+  cv::subtract(bgrF, blurredF, high);
+  cv::Mat& sharpened = blurredF;
+  cv::scaleAdd(high, strength, bgrF, sharpened);
 
   // Clamp and convert back.
-  sharpened = cv::min(cv::max(sharpened, 0.0f), 255.0f);
+  cv::max(sharpened, 0.0, sharpened);
+  cv::min(sharpened, 255.0, sharpened);
   sharpened.convertTo(bgr, CV_8UC3);
 }
 
-std::vector<cv::Vec3b> PixelArtProcessor::GetPaletteColors(PalettePreset preset) {
-  std::vector<cv::Vec3b> colors;
-  
-  switch (preset) {
-    case PalettePreset::NES: {
-      // NES palette (54 colors) - classic console colors
-      // Reference: https://lospec.com/palette-list/nes-palette
-      colors = {
-        cv::Vec3b(124, 124, 124), cv::Vec3b(0, 0, 252), cv::Vec3b(0, 0, 188), cv::Vec3b(68, 40, 188),
-        cv::Vec3b(148, 0, 132), cv::Vec3b(168, 0, 32), cv::Vec3b(168, 16, 0), cv::Vec3b(136, 20, 0),
-        cv::Vec3b(80, 48, 0), cv::Vec3b(0, 120, 0), cv::Vec3b(0, 104, 0), cv::Vec3b(0, 88, 0),
-        cv::Vec3b(0, 64, 88), cv::Vec3b(0, 0, 0), cv::Vec3b(0, 0, 0), cv::Vec3b(188, 188, 188),
-        cv::Vec3b(0, 120, 248), cv::Vec3b(0, 88, 248), cv::Vec3b(104, 68, 252), cv::Vec3b(216, 0, 204),
-        cv::Vec3b(228, 0, 88), cv::Vec3b(248, 56, 0), cv::Vec3b(228, 92, 16), cv::Vec3b(172, 124, 0),
-        cv::Vec3b(0, 184, 0), cv::Vec3b(0, 168, 0), cv::Vec3b(0, 168, 68), cv::Vec3b(0, 136, 136),
-        cv::Vec3b(248, 248, 248), cv::Vec3b(60, 188, 252), cv::Vec3b(104, 136, 252), cv::Vec3b(152, 120, 248),
-        cv::Vec3b(248, 120, 248), cv::Vec3b(248, 88, 152), cv::Vec3b(248, 120, 88), cv::Vec3b(252, 160, 68),
-        cv::Vec3b(248, 184, 0), cv::Vec3b(184, 248, 24), cv::Vec3b(88, 216, 84), cv::Vec3b(88, 248, 152),
-        cv::Vec3b(0, 232, 216), cv::Vec3b(120, 120, 120), cv::Vec3b(252, 252, 252), cv::Vec3b(164, 228, 252),
-        cv::Vec3b(184, 184, 248), cv::Vec3b(216, 184, 248), cv::Vec3b(248, 184, 248), cv::Vec3b(248, 164, 192),
-        cv::Vec3b(240, 208, 176), cv::Vec3b(252, 224, 168), cv::Vec3b(248, 216, 120), cv::Vec3b(216, 248, 120),
-        cv::Vec3b(184, 248, 184), cv::Vec3b(184, 248, 216), cv::Vec3b(0, 252, 252), cv::Vec3b(248, 216, 248)
-      };
-      break;
-    }
-    
-    case PalettePreset::GameBoy: {
-      // Original Game Boy (4 colors: green monochrome)
-      // Darkest to lightest green
-      colors = {
-        cv::Vec3b(15, 56, 15),    // Darkest green
-        cv::Vec3b(48, 98, 48),    // Dark green
-        cv::Vec3b(139, 172, 15),  // Light green
-        cv::Vec3b(155, 188, 15)   // Lightest green
-      };
-      break;
-    }
-    
-    case PalettePreset::GameBoyPocket: {
-      // Game Boy Pocket (4 colors: monochrome)
-      colors = {
-        cv::Vec3b(15, 15, 15),    // Black
-        cv::Vec3b(79, 79, 79),    // Dark gray
-        cv::Vec3b(163, 163, 163), // Light gray
-        cv::Vec3b(255, 255, 255)  // White
-      };
-      break;
-    }
-    
-    case PalettePreset::Pico8: {
-      // Pico-8 fantasy console palette (16 colors)
-      // Reference: https://lospec.com/palette-list/pico-8
-      colors = {
-        cv::Vec3b(0, 0, 0),       // Black
-        cv::Vec3b(29, 43, 83),    // Dark blue
-        cv::Vec3b(126, 37, 83),   // Dark purple
-        cv::Vec3b(0, 135, 81),    // Dark green
-        cv::Vec3b(171, 82, 54),   // Brown
-        cv::Vec3b(95, 87, 79),    // Dark gray
-        cv::Vec3b(194, 195, 199), // Light gray
-        cv::Vec3b(255, 241, 232), // White
-        cv::Vec3b(255, 0, 77),    // Red
-        cv::Vec3b(255, 163, 0),   // Orange
-        cv::Vec3b(255, 236, 39),  // Yellow
-        cv::Vec3b(0, 228, 54),    // Green
-        cv::Vec3b(41, 173, 255),  // Blue
-        cv::Vec3b(131, 118, 156), // Indigo
-        cv::Vec3b(255, 119, 168), // Pink
-        cv::Vec3b(255, 204, 170)  // Peach
-      };
-      break;
-    }
-    
-    case PalettePreset::CGA: {
-      // CGA 4-color mode palette (Cyan/Magenta/White)
-      colors = {
-        cv::Vec3b(0, 0, 0),       // Black
-        cv::Vec3b(85, 255, 255),  // Cyan
-        cv::Vec3b(255, 85, 255),  // Magenta
-        cv::Vec3b(255, 255, 255)  // White
-      };
-      break;
-    }
-    
-    case PalettePreset::EGA: {
-      // EGA 16-color palette
-      colors = {
-        cv::Vec3b(0, 0, 0),       // Black
-        cv::Vec3b(0, 0, 170),     // Blue
-        cv::Vec3b(0, 170, 0),     // Green
-        cv::Vec3b(0, 170, 170),   // Cyan
-        cv::Vec3b(170, 0, 0),     // Red
-        cv::Vec3b(170, 0, 170),   // Magenta
-        cv::Vec3b(170, 85, 0),    // Brown
-        cv::Vec3b(170, 170, 170), // Light gray
-        cv::Vec3b(85, 85, 85),    // Dark gray
-        cv::Vec3b(85, 85, 255),   // Bright blue
-        cv::Vec3b(85, 255, 85),   // Bright green
-        cv::Vec3b(85, 255, 255),  // Bright cyan
-        cv::Vec3b(255, 85, 85),   // Bright red
-        cv::Vec3b(255, 85, 255),  // Bright magenta
-        cv::Vec3b(255, 255, 85),  // Yellow
-        cv::Vec3b(255, 255, 255)  // White
-      };
-      break;
-    }
-    
-    case PalettePreset::Commodore64: {
-      // Commodore 64 palette (16 colors)
-      colors = {
-        cv::Vec3b(0, 0, 0),       // Black
-        cv::Vec3b(255, 255, 255), // White
-        cv::Vec3b(136, 0, 0),     // Red
-        cv::Vec3b(170, 255, 238), // Cyan
-        cv::Vec3b(204, 68, 204),  // Purple
-        cv::Vec3b(0, 204, 85),    // Green
-        cv::Vec3b(0, 0, 170),     // Blue
-        cv::Vec3b(238, 238, 119), // Yellow
-        cv::Vec3b(221, 136, 85),  // Orange
-        cv::Vec3b(102, 68, 0),    // Brown
-        cv::Vec3b(255, 119, 119), // Light red
-        cv::Vec3b(51, 51, 51),    // Dark gray
-        cv::Vec3b(119, 119, 119), // Medium gray
-        cv::Vec3b(170, 255, 102), // Light green
-        cv::Vec3b(0, 136, 255),   // Light blue
-        cv::Vec3b(187, 187, 187)  // Light gray
-      };
-      break;
-    }
-    
-    default:
-      // Custom or unknown - return empty (should not be called)
-      break;
-  }
-  
-  return colors;
-}
-
-cv::Mat PixelArtProcessor::QuantizeWithFixedPalette(const cv::Mat& smallBgr, PalettePreset preset) {
+cv::Mat PixelArtProcessor::QuantizeWithPalette(const cv::Mat& smallBgr, const Palette& palette,
+                                               ProcessContext* context) {
+  using Slot = ProcessContext::Slot;
   if (smallBgr.empty() || smallBgr.type() != CV_8UC3) return {};
+  if (palette.size() == 0) return {};
   
-  std::vector<cv::Vec3b> palette = GetPaletteColors(preset);
-  if (palette.empty()) return {};
+  cv::Mat result = ProcessContext::Scratch(context, Slot::Indices, smallBgr.rows, smallBgr.cols, CV_8UC1);
   
-  cv::Mat result(smallBgr.size(), CV_8UC3);
+  if (palette.PreferredMetric() == Palette::Metric::Lab) {
+    // K-means palettes: nearest entry in Lab, the space the palette was clustered in.
+    cv::Mat smallLab = ProcessContext::Scratch(context, Slot::BlocksLab, smallBgr.rows, smallBgr.cols, CV_8UC3);
+    cv::cvtColor(smallBgr, smallLab, cv::COLOR_BGR2Lab);
+    const PaletteLUT& lut = palette.LabLUT();
+    for (int y = 0; y < smallBgr.rows; ++y) {
+      lut.NearestIndexRow(smallLab.ptr<uchar>(y), result.ptr<uchar>(y), smallBgr.cols);
+    }
+    return result;
+  }
   
   // For each pixel, find the closest color in the fixed palette
+  // (Euclidean distance in RGB, resolved through the cached lookup table).
+  const PaletteLUT& lut = palette.LUT();
   for (int y = 0; y < smallBgr.rows; ++y) {
-    const cv::Vec3b* srcRow = smallBgr.ptr<cv::Vec3b>(y);
-    cv::Vec3b* dstRow = result.ptr<cv::Vec3b>(y);
-    
-    for (int x = 0; x < smallBgr.cols; ++x) {
-      const cv::Vec3b& pixel = srcRow[x];
-      
-      // Find nearest palette color using Euclidean distance in RGB
-      float minDist = std::numeric_limits<float>::max();
-      int bestIdx = 0;
-      
-      for (size_t i = 0; i < palette.size(); ++i) {
-        float dist = ColorDistanceSquared(pixel, palette[i]);
-        if (dist < minDist) {
-          minDist = dist;
-          bestIdx = static_cast<int>(i);
-        }
-      }
-      
-      dstRow[x] = palette[bestIdx];
-    }
+    lut.NearestIndexRow(smallBgr.ptr<uchar>(y), result.ptr<uchar>(y), smallBgr.cols);
   }
   
   return result;
 }
 
-cv::Vec3b PixelArtProcessor::FindNearestPaletteColor(const cv::Vec3b& color, const std::vector<cv::Vec3b>& palette) {
-  if (palette.empty()) return color;
-  
-  float minDist = std::numeric_limits<float>::max();
-  size_t bestIdx = 0;
-  
-  for (size_t i = 0; i < palette.size(); ++i) {
-    float dist = ColorDistanceSquared(color, palette[i]);
-    if (dist < minDist) {
-      minDist = dist;
-      bestIdx = i;
-    }
-  }
-  
-  return palette[bestIdx];
-}
-
-cv::Mat PixelArtProcessor::QuantizeWithFixedPaletteDither(const cv::Mat& smallBgr, PalettePreset preset) {
+cv::Mat PixelArtProcessor::QuantizeWithPaletteDither(const cv::Mat& smallBgr, const Palette& palette,
+                                                     bool serpentine, ProcessContext* context) {
   if (smallBgr.empty() || smallBgr.type() != CV_8UC3) return {};
   
-  std::vector<cv::Vec3b> palette = GetPaletteColors(preset);
-  if (palette.empty()) return {};
-  
-  // Work on a copy to allow in-place modification during dithering
-  cv::Mat work = smallBgr.clone();
-  
-  // Floyd-Steinberg dithering: scan left-to-right, top-to-bottom
-  // Error distribution weights:
-  //    X   7/16
-  // 3/16 5/16 1/16
-  const float w_right = 7.0f / 16.0f;
-  const float w_down_left = 3.0f / 16.0f;
-  const float w_down = 5.0f / 16.0f;
-  const float w_down_right = 1.0f / 16.0f;
-  
-  for (int y = 0; y < work.rows; ++y) {
-    cv::Vec3b* row = work.ptr<cv::Vec3b>(y);
-    
-    for (int x = 0; x < work.cols; ++x) {
-      cv::Vec3b& oldPixel = row[x];
-      
-      // Clamp pixel values to valid range (may have been modified by error diffusion)
-      oldPixel[0] = static_cast<uchar>(ClampInt(static_cast<int>(oldPixel[0]), 0, 255));
-      oldPixel[1] = static_cast<uchar>(ClampInt(static_cast<int>(oldPixel[1]), 0, 255));
-      oldPixel[2] = static_cast<uchar>(ClampInt(static_cast<int>(oldPixel[2]), 0, 255));
-      
-      // Find nearest palette color
-      cv::Vec3b newPixel = FindNearestPaletteColor(oldPixel, palette);
-      
-      // Calculate quantization error
-      cv::Vec3f error(
-          static_cast<float>(oldPixel[0]) - static_cast<float>(newPixel[0]),
-          static_cast<float>(oldPixel[1]) - static_cast<float>(newPixel[1]),
-          static_cast<float>(oldPixel[2]) - static_cast<float>(newPixel[2]));
-      
-      // Replace current pixel with quantized color
-      oldPixel = newPixel;
-      
-      // Distribute error to neighboring pixels (Floyd-Steinberg pattern)
-      if (x + 1 < work.cols) {
-        // Right neighbor
-        cv::Vec3b& right = row[x + 1];
-        right[0] = static_cast<uchar>(ClampInt(static_cast<int>(right[0] + error[0] * w_right), 0, 255));
-        right[1] = static_cast<uchar>(ClampInt(static_cast<int>(right[1] + error[1] * w_right), 0, 255));
-        right[2] = static_cast<uchar>(ClampInt(static_cast<int>(right[2] + error[2] * w_right), 0, 255));
-      }
-      
-      if (y + 1 < work.rows) {
-        cv::Vec3b* nextRow = work.ptr<cv::Vec3b>(y + 1);
-        
-        if (x - 1 >= 0) {
-          // Bottom-left neighbor
-          cv::Vec3b& downLeft = nextRow[x - 1];
-          downLeft[0] = static_cast<uchar>(ClampInt(static_cast<int>(downLeft[0] + error[0] * w_down_left), 0, 255));
-          downLeft[1] = static_cast<uchar>(ClampInt(static_cast<int>(downLeft[1] + error[1] * w_down_left), 0, 255));
-          downLeft[2] = static_cast<uchar>(ClampInt(static_cast<int>(downLeft[2] + error[2] * w_down_left), 0, 255));
-        }
-        
-        // Bottom neighbor
-        cv::Vec3b& down = nextRow[x];
-        down[0] = static_cast<uchar>(ClampInt(static_cast<int>(down[0] + error[0] * w_down), 0, 255));
-        down[1] = static_cast<uchar>(ClampInt(static_cast<int>(down[1] + error[1] * w_down), 0, 255));
-        down[2] = static_cast<uchar>(ClampInt(static_cast<int>(down[2] + error[2] * w_down), 0, 255));
-        
-        if (x + 1 < work.cols) {
-          // Bottom-right neighbor
-          cv::Vec3b& downRight = nextRow[x + 1];
-          downRight[0] = static_cast<uchar>(ClampInt(static_cast<int>(downRight[0] + error[0] * w_down_right), 0, 255));
-          downRight[1] = static_cast<uchar>(ClampInt(static_cast<int>(downRight[1] + error[1] * w_down_right), 0, 255));
-          downRight[2] = static_cast<uchar>(ClampInt(static_cast<int>(downRight[2] + error[2] * w_down_right), 0, 255));
-        }
-      }
-    }
-  }
-  
-  return work;
+  // Error diffusion always measures in RGB (it propagates BGR errors), for every palette type.
+  ErrorDiffusion::Options opts;
+  opts.serpentine = serpentine;
+  opts.context = context;
+  return ErrorDiffusion::FloydSteinberg(smallBgr, palette.LUT(), opts);
 }
 
-cv::Mat PixelArtProcessor::QuantizeWithKMeansLabDither(const cv::Mat& smallBgr, int paletteSize) {
+cv::Mat PixelArtProcessor::QuantizeWithPaletteOrdered(const cv::Mat& smallBgr, const Palette& palette,
+                                                      DitherMethod method, ProcessContext* context) {
   if (smallBgr.empty() || smallBgr.type() != CV_8UC3) return {};
   
-  const int total = smallBgr.rows * smallBgr.cols;
-  if (total <= 0) return {};
-  
-  paletteSize = std::max(2, std::min(paletteSize, total));
-  
-  // Step 1: Build palette using K-means (same as non-dither version)
-  cv::Mat smallLab;
-  cv::cvtColor(smallBgr, smallLab, cv::COLOR_BGR2Lab);
-  
-  cv::Mat samples(total, 3, CV_32F);
-  for (int y = 0; y < smallLab.rows; ++y) {
-    const cv::Vec3b* row = smallLab.ptr<cv::Vec3b>(y);
-    for (int x = 0; x < smallLab.cols; ++x) {
-      const int i = y * smallLab.cols + x;
-      samples.at<float>(i, 0) = static_cast<float>(row[x][0]);
-      samples.at<float>(i, 1) = static_cast<float>(row[x][1]);
-      samples.at<float>(i, 2) = static_cast<float>(row[x][2]);
-    }
+  // Thresholds are applied in RGB like error diffusion, for every palette type.
+  OrderedDither::Matrix matrix = OrderedDither::Matrix::Bayer4;
+  switch (method) {
+    case DitherMethod::Bayer2: matrix = OrderedDither::Matrix::Bayer2; break;
+    case DitherMethod::Bayer4: matrix = OrderedDither::Matrix::Bayer4; break;
+    case DitherMethod::Bayer8: matrix = OrderedDither::Matrix::Bayer8; break;
+    case DitherMethod::BlueNoise: matrix = OrderedDither::Matrix::BlueNoise; break;
+    case DitherMethod::FloydSteinberg: break;
   }
-  
-  cv::Mat labels;
-  cv::Mat centers;
-  const int attempts = 3;
-  cv::TermCriteria criteria(cv::TermCriteria::EPS + cv::TermCriteria::MAX_ITER, 30, 1.0);
-  cv::kmeans(samples, paletteSize, labels, criteria, attempts, cv::KMEANS_PP_CENTERS, centers);
-  
-  // Convert cluster centers from Lab to BGR to build palette
-  std::vector<cv::Vec3b> palette;
-  palette.reserve(paletteSize);
-  for (int i = 0; i < paletteSize; ++i) {
-    cv::Mat labPixel(1, 1, CV_8UC3);
-    labPixel.at<cv::Vec3b>(0, 0) = cv::Vec3b(
-        static_cast<uchar>(ClampInt(static_cast<int>(std::lround(centers.at<float>(i, 0))), 0, 255)),
-        static_cast<uchar>(ClampInt(static_cast<int>(std::lround(centers.at<float>(i, 1))), 0, 255)),
-        static_cast<uchar>(ClampInt(static_cast<int>(std::lround(centers.at<float>(i, 2))), 0, 255)));
-    
-    cv::Mat bgrPixel;
-    cv::cvtColor(labPixel, bgrPixel, cv::COLOR_Lab2BGR);
-    palette.push_back(bgrPixel.at<cv::Vec3b>(0, 0));
-  }
-  
-  // Step 2: Apply Floyd-Steinberg dithering using the K-means palette
-  cv::Mat work = smallBgr.clone();
-  
-  const float w_right = 7.0f / 16.0f;
-  const float w_down_left = 3.0f / 16.0f;
-  const float w_down = 5.0f / 16.0f;
-  const float w_down_right = 1.0f / 16.0f;
-  
-  for (int y = 0; y < work.rows; ++y) {
-    cv::Vec3b* row = work.ptr<cv::Vec3b>(y);
-    
-    for (int x = 0; x < work.cols; ++x) {
-      cv::Vec3b& oldPixel = row[x];
-      
-      // Clamp pixel values
-      oldPixel[0] = static_cast<uchar>(ClampInt(static_cast<int>(oldPixel[0]), 0, 255));
-      oldPixel[1] = static_cast<uchar>(ClampInt(static_cast<int>(oldPixel[1]), 0, 255));
-      oldPixel[2] = static_cast<uchar>(ClampInt(static_cast<int>(oldPixel[2]), 0, 255));
-      
-      // Find nearest palette color
-      cv::Vec3b newPixel = FindNearestPaletteColor(oldPixel, palette);
-      
-      // Calculate quantization error
-      cv::Vec3f error(
-          static_cast<float>(oldPixel[0]) - static_cast<float>(newPixel[0]),
-          static_cast<float>(oldPixel[1]) - static_cast<float>(newPixel[1]),
-          static_cast<float>(oldPixel[2]) - static_cast<float>(newPixel[2]));
-      
-      // Replace current pixel with quantized color
-      oldPixel = newPixel;
-      
-      // Distribute error to neighboring pixels
-      if (x + 1 < work.cols) {
-        cv::Vec3b& right = row[x + 1];
-        right[0] = static_cast<uchar>(ClampInt(static_cast<int>(right[0] + error[0] * w_right), 0, 255));
-        right[1] = static_cast<uchar>(ClampInt(static_cast<int>(right[1] + error[1] * w_right), 0, 255));
-        right[2] = static_cast<uchar>(ClampInt(static_cast<int>(right[2] + error[2] * w_right), 0, 255));
-      }
-      
-      if (y + 1 < work.rows) {
-        cv::Vec3b* nextRow = work.ptr<cv::Vec3b>(y + 1);
-        
-        if (x - 1 >= 0) {
-          cv::Vec3b& downLeft = nextRow[x - 1];
-          downLeft[0] = static_cast<uchar>(ClampInt(static_cast<int>(downLeft[0] + error[0] * w_down_left), 0, 255));
-          downLeft[1] = static_cast<uchar>(ClampInt(static_cast<int>(downLeft[1] + error[1] * w_down_left), 0, 255));
-          downLeft[2] = static_cast<uchar>(ClampInt(static_cast<int>(downLeft[2] + error[2] * w_down_left), 0, 255));
-        }
-        
-        cv::Vec3b& down = nextRow[x];
-        down[0] = static_cast<uchar>(ClampInt(static_cast<int>(down[0] + error[0] * w_down), 0, 255));
-        down[1] = static_cast<uchar>(ClampInt(static_cast<int>(down[1] + error[1] * w_down), 0, 255));
-        down[2] = static_cast<uchar>(ClampInt(static_cast<int>(down[2] + error[2] * w_down), 0, 255));
-        
-        if (x + 1 < work.cols) {
-          cv::Vec3b& downRight = nextRow[x + 1];
-          downRight[0] = static_cast<uchar>(ClampInt(static_cast<int>(downRight[0] + error[0] * w_down_right), 0, 255));
-          downRight[1] = static_cast<uchar>(ClampInt(static_cast<int>(downRight[1] + error[1] * w_down_right), 0, 255));
-          downRight[2] = static_cast<uchar>(ClampInt(static_cast<int>(downRight[2] + error[2] * w_down_right), 0, 255));
-        }
-      }
-    }
-  }
-  
-  return work;
+  return OrderedDither::Apply(smallBgr, palette.LUT(), matrix, cv::Point(0, 0), context);
 }
 
-void PixelArtProcessor::ApplyPixelArtOutline(cv::Mat& bgr, int thickness) {
+void PixelArtProcessor::ApplyPixelArtOutline(cv::Mat& bgr, int thickness, ProcessContext* context) {
   if (bgr.empty() || bgr.type() != CV_8UC3) return;
   thickness = std::max(1, std::min(thickness, 5));
 
-  // Create edge mask by detecting significant color differences
-  // For pixel art, we detect edges where adjacent pixels have large color differences
-  cv::Mat edges(bgr.size(), CV_8UC1, cv::Scalar(0));
-  
-  // Threshold for considering two colors "different" enough to draw an outline
-  // Using both luminance and color distance for better detection
-  const int luminanceThreshold = 35; // Luminance difference threshold
-  const int colorDistanceThreshold = 40; // RGB color distance threshold
-  
-  for (int y = 0; y < bgr.rows; ++y) {
-    const cv::Vec3b* row = bgr.ptr<cv::Vec3b>(y);
-    uchar* edgeRow = edges.ptr<uchar>(y);
-    
-    for (int x = 0; x < bgr.cols; ++x) {
-      const cv::Vec3b& current = row[x];
-      
-      // Calculate luminance (perceptual luminance: 0.299*R + 0.587*G + 0.114*B)
-      int lumCurrent = static_cast<int>(
-          0.299f * current[2] + 0.587f * current[1] + 0.114f * current[0]);
-      
-      // Check 4-connected neighbors (up, down, left, right)
-      // If any neighbor is significantly different, mark as edge
-      bool isEdge = false;
-      
-      // Right neighbor
-      if (x + 1 < bgr.cols) {
-        const cv::Vec3b& neighbor = row[x + 1];
-        int lumNeighbor = static_cast<int>(
-            0.299f * neighbor[2] + 0.587f * neighbor[1] + 0.114f * neighbor[0]);
-        
-        // Check both luminance and color distance
-        int lumDiff = std::abs(lumCurrent - lumNeighbor);
-        float colorDist = std::sqrt(ColorDistanceSquared(current, neighbor));
-        
-        if (lumDiff >= luminanceThreshold || colorDist >= colorDistanceThreshold) {
-          isEdge = true;
-        }
-      }
-      
-      // Bottom neighbor
-      if (!isEdge && y + 1 < bgr.rows) {
-        const cv::Vec3b* nextRow = bgr.ptr<cv::Vec3b>(y + 1);
-        const cv::Vec3b& neighbor = nextRow[x];
-        int lumNeighbor = static_cast<int>(
-            0.299f * neighbor[2] + 0.587f * neighbor[1] + 0.114f * neighbor[0]);
-        
-        int lumDiff = std::abs(lumCurrent - lumNeighbor);
-        float colorDist = std::sqrt(ColorDistanceSquared(current, neighbor));
-        
-        if (lumDiff >= luminanceThreshold || colorDist >= colorDistanceThreshold) {
-          isEdge = true;
-        }
-      }
-      
-      // Left neighbor
-      if (!isEdge && x > 0) {
-        const cv::Vec3b& neighbor = row[x - 1];
-        int lumNeighbor = static_cast<int>(
-            0.299f * neighbor[2] + 0.587f * neighbor[1] + 0.114f * neighbor[0]);
-        
-        int lumDiff = std::abs(lumCurrent - lumNeighbor);
-        float colorDist = std::sqrt(ColorDistanceSquared(current, neighbor));
-        
-        if (lumDiff >= luminanceThreshold || colorDist >= colorDistanceThreshold) {
-          isEdge = true;
-        }
-      }
-      
-      // Top neighbor
-      if (!isEdge && y > 0) {
-        const cv::Vec3b* prevRow = bgr.ptr<cv::Vec3b>(y - 1);
-        const cv::Vec3b& neighbor = prevRow[x];
-        int lumNeighbor = static_cast<int>(
-            0.299f * neighbor[2] + 0.587f * neighbor[1] + 0.114f * neighbor[0]);
-        
-        int lumDiff = std::abs(lumCurrent - lumNeighbor);
-        float colorDist = std::sqrt(ColorDistanceSquared(current, neighbor));
-        
-        if (lumDiff >= luminanceThreshold || colorDist >= colorDistanceThreshold) {
-          isEdge = true;
-        }
-      }
-      
-      edgeRow[x] = isEdge ? 255 : 0;
-    }
-  }
-  
-  // Apply morphology operations based on thickness
-  if (thickness == 1) {
-    // Keep single-pixel edges - apply slight erosion to remove noise
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_CROSS, cv::Size(3, 3));
-    cv::morphologyEx(edges, edges, cv::MORPH_OPEN, kernel);
-  } else {
-    // Thicken edges for thicker outlines using dilation
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * thickness + 1, 2 * thickness + 1));
-    cv::dilate(edges, edges, kernel);
-  }
-  
-  // Draw dark outlines on the original image
-  // Use adaptive darkening: darken pixels at edge locations
-  for (int y = 0; y < bgr.rows; ++y) {
-    cv::Vec3b* row = bgr.ptr<cv::Vec3b>(y);
-    const uchar* edgeRow = edges.ptr<uchar>(y);
-    
-    for (int x = 0; x < bgr.cols; ++x) {
-      if (edgeRow[x] > 128) {
-        // Edge pixel: draw dark outline
-        cv::Vec3b& pixel = row[x];
-        
-        // Adaptive darkening: darken by 50-70% depending on original brightness
-        // This creates more natural-looking outlines that adapt to the pixel color
-        int darkenAmount = 70; // Base darkening amount
-        
-        // Calculate brightness of original pixel
-        int brightness = (static_cast<int>(pixel[0]) + static_cast<int>(pixel[1]) + static_cast<int>(pixel[2])) / 3;
-        
-        // Adjust darkening based on brightness (darker pixels get less darkening)
-        if (brightness < 64) {
-          darkenAmount = 40; // Less darkening for already dark pixels
-        } else if (brightness > 192) {
-          darkenAmount = 90; // More darkening for bright pixels
-        }
-        
-        pixel[0] = static_cast<uchar>(std::max(0, pixel[0] - darkenAmount)); // B
-        pixel[1] = static_cast<uchar>(std::max(0, pixel[1] - darkenAmount)); // G
-        pixel[2] = static_cast<uchar>(std::max(0, pixel[2] - darkenAmount)); // R
-        
-        // Alternative: Use pure black outline (uncomment to use)
-        // row[x] = cv::Vec3b(0, 0, 0);
-      }
-    }
-  }
+  // Edge mask: a pixel is an edge when any 4-connected neighbour differs by >= 35 luminance
+  // or >= 40 RGB distance. Then thin (thickness 1) or thicken it and darken the pixels under it,
+  // adaptively by brightness. Both steps are vectorised / fused in OutlineKernels.
+  const cv::Mat edges = OutlineKernels::EdgeMask(bgr, context);
+  OutlineKernels::DarkenOutline(bgr, edges, thickness, context);
 }
 
+bool PixelArtProcessor::ApplyPixelArtOutlineIndexed(cv::Mat& indices, std::vector<cv::Vec3b>& colors, int thickness,
+                                                    ProcessContext* context) {
+  if (indices.empty() || indices.type() != CV_8UC1 || colors.empty()) return false;
+  thickness = std::max(1, std::min(thickness, 5));
 
+  // Same mask and morphology as ApplyPixelArtOutline; darkening becomes an index remap onto
+  // shades appended to the palette.
+  std::vector<cv::Vec3b> outColors;
+  std::vector<uchar> darkIndex;
+  if (!OutlineKernels::DarkenedPalette(colors, outColors, darkIndex)) return false;
+  const cv::Mat edges = OutlineKernels::EdgeMaskIndexed(indices, colors, context);
+  OutlineKernels::DarkenOutlineIndexed(indices, darkIndex, edges, thickness, context);
+  colors = std::move(outColors);
+  return true;
+}
@@ -1,7 +1,18 @@
 #pragma once
 
+#include "IndexedImage.h"
+#include "PaletteRegistry.h"
+#include "ProcessContext.h"
+#include "ProcessStats.h"
+
 #include <opencv2/core.hpp>
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 // PixelArtProcessor:
 // - Independent of UI and rendering.
 // - Converts a normal image into a pixel-art style image by:
@@ -20,7 +31,17 @@ public:
     Pico8,         // Pico-8 fantasy console (16 colors)
     CGA,           // CGA 4-color mode (4 colors)
     EGA,           // EGA 16-color mode (16 colors)
-    Commodore64    // Commodore 64 (16 colors)
+    Commodore64,   // Commodore 64 (16 colors)
+    User           // Palette loaded at runtime (PaletteRegistry id in Params::userPaletteId)
+  };
+
+  // How dithering distributes quantization error (used when Params::dither is set)
+  enum class DitherMethod {
+    FloydSteinberg, // error diffusion (serial / wavefront; highest quality)
+    Bayer2,         // ordered dithering, 2x2 Bayer matrix
+    Bayer4,         // ordered dithering, 4x4 Bayer matrix
+    Bayer8,         // ordered dithering, 8x8 Bayer matrix
+    BlueNoise       // ordered dithering, 64x64 blue-noise texture
   };
 
   struct Params {
@@ -28,31 +49,167 @@ public:
     int paletteSize = 16;     // K: number of colors in final palette (only used when palettePreset == Custom)
     bool preBlur = true;      // reduces high-frequency noise before block averaging
     bool edgeEnhance = false; // optional crisp outline enhancement
-    bool dither = false;      // Floyd-Steinberg dithering (reduces color banding artifacts)
+    bool dither = false;      // dither with ditherMethod (reduces color banding artifacts)
+    DitherMethod ditherMethod = DitherMethod::FloydSteinberg; // error diffusion or an ordered matrix
+    bool ditherSerpentine = false; // alternate the scan direction per row (error diffusion only)
     bool outline = false;     // extract contours and draw pixel-art style outlines
     int outlineThickness = 1; // outline line thickness in pixels (1-3 typical)
     PalettePreset palettePreset = PalettePreset::Custom; // Fixed palette preset or custom K-means
+    int userPaletteId = -1;   // PaletteRegistry id (only used when palettePreset == User)
+    uint32_t kmeansSeed = 1;  // K-means seeding (Custom only); same seed + input = same palette
+    bool nativeOutput = false; // return one pixel per block (skip expansion) when nothing needs full resolution
+
+    bool operator==(const Params& o) const {
+      return blockSize == o.blockSize && paletteSize == o.paletteSize && preBlur == o.preBlur &&
+             edgeEnhance == o.edgeEnhance && dither == o.dither && ditherMethod == o.ditherMethod &&
+             ditherSerpentine == o.ditherSerpentine && outline == o.outline &&
+             outlineThickness == o.outlineThickness && palettePreset == o.palettePreset &&
+             userPaletteId == o.userPaletteId && kmeansSeed == o.kmeansSeed &&
+             nativeOutput == o.nativeOutput;
+    }
+    bool operator!=(const Params& o) const { return !(*this == o); }
   };
 
   // Input must be 8-bit 3-channel BGR (CV_8UC3).
   // Output is 8-bit 3-channel BGR (CV_8UC3).
-  static cv::Mat Process(const cv::Mat& inputBgr, const Params& params);
-
-private:
-  static cv::Mat BuildBlockColorImageBGR(const cv::Mat& inputBgr, int blockSize);
-  static cv::Mat QuantizeWithKMeansLab(const cv::Mat& smallBgr, int paletteSize);
-  static cv::Mat QuantizeWithFixedPalette(const cv::Mat& smallBgr, PalettePreset preset);
-  static cv::Mat QuantizeWithKMeansLabDither(const cv::Mat& smallBgr, int paletteSize);
-  static cv::Mat QuantizeWithFixedPaletteDither(const cv::Mat& smallBgr, PalettePreset preset);
-  static cv::Mat ExpandBlocksBGR(const cv::Mat& smallBgr, const cv::Size& outSize, int blockSize);
-  static void ApplyEdgeEnhancementInPlace(cv::Mat& bgr, float strength = 0.6f);
-  static void ApplyPixelArtOutline(cv::Mat& bgr, int thickness = 1);
-  
-  // Get fixed palette colors (BGR format)
-  static std::vector<cv::Vec3b> GetPaletteColors(PalettePreset preset);
-  
-  // Helper: find nearest palette color
-  static cv::Vec3b FindNearestPaletteColor(const cv::Vec3b& color, const std::vector<cv::Vec3b>& palette);
+  // `cancel` (optional) is polled between pipeline steps; once it reads true the call
+  // stops early and returns an empty Mat. Used by the GUI worker for latest-wins jobs.
+  // `stats` (optional) receives per-stage timings and peak memory of the call.
+  // `context` (optional) keeps the intermediate buffers for the next call (see ProcessContext);
+  // the result then comes from its output pool. Keep one per thread.
+  static cv::Mat Process(const cv::Mat& inputBgr, const Params& params,
+                         const std::atomic<bool>* cancel = nullptr, ProcessStats* stats = nullptr,
+                         ProcessContext* context = nullptr);
+
+  // Process, keeping the result palette-indexed (for indexed PNG / GIF output). On success
+  // exactly one output is filled: `outIndexed` normally, `outBgr` when the result needs true
+  // color (edge enhancement, or outline shades that do not fit in 256 colors).
+  static bool ProcessIndexed(const cv::Mat& inputBgr, const Params& params, IndexedImage& outIndexed,
+                             cv::Mat& outBgr, const std::atomic<bool>* cancel = nullptr,
+                             ProcessStats* stats = nullptr, ProcessContext* context = nullptr);
+
+  // Returns params with every field clamped to the range Process actually uses.
+  // An unknown user palette falls back to Custom.
+  static Params Normalize(const Params& params);
+
+  // True if Process returns the block image itself (ceil(w/N) × ceil(h/N), one pixel per
+  // block) rather than a full-resolution image: nativeOutput is set and no enabled step
+  // works at full resolution (edge enhancement and outlines do). Upscale such a result with
+  // ExpandBlocksBGR(result, inputSize, blockSize), or display it with nearest filtering.
+  static bool OutputIsNative(const Params& params);
+
+  // Fixed palette selected by params (built-in preset or user palette); nullptr for Custom.
+  static const Palette* ResolvePalette(const Params& params);
+
+  // ---- Backend ----
+  // Which implementation the stage entry points below (and so Process, PixelArtPipeline and
+  // SequenceProcessor) run. The individual kernels further down are always the optimised ones;
+  // StreamingProcessor calls the kernels directly and always uses them.
+  enum class Backend {
+    Optimized, // BlockKernels / PaletteLUT / ErrorDiffusion / OutlineKernels / block grid
+    Reference  // ReferenceProcessor: straightforward scalar code, to A/B suspicious output
+  };
+  // Process-wide choice; starts as FPW_BACKEND from the environment ("reference" or
+  // "optimized"), Optimized otherwise.
+  static void SetBackend(Backend backend);
+  // The calling thread's BackendScope if one is active, else the process-wide choice.
+  static Backend ActiveBackend();
+  static const char* BackendName(Backend backend);
+  static bool ParseBackend(const std::string& name, Backend& out);
+
+  // Overrides the backend for the calling thread while it lives (RegressionCheck runs both
+  // sides in one process without touching other threads).
+  class BackendScope {
+  public:
+    explicit BackendScope(Backend backend);
+    ~BackendScope();
+    BackendScope(const BackendScope&) = delete;
+    BackendScope& operator=(const BackendScope&) = delete;
+
+  private:
+    int previous_;
+  };
+
+  // ---- Pipeline stages ----
+  // Exposed so callers (e.g. PixelArtPipeline) can run and cache stages individually.
+  // Process() is exactly: BuildBlockColorImage -> ExtractPalette -> ApplyPaletteIndices ->
+  // ExpandAndPostProcess, which equals ExpandBlocksBGR -> [ApplyEdgeEnhancementInPlace] ->
+  // [ApplyPixelArtOutline] but runs the optional steps on a BlockKernels::BlockGrid, on
+  // palette indices while the image is still indexed.
+  // With a `context`, results that Process consumes internally (block image, palette indices,
+  // grids) live in its scratch slots and are only valid until the next call that uses the
+  // slot; the final images come from its output pool.
+
+  // Steps 1 + 2: per-block representative colors, with the optional pre-blur fused in
+  // (see BlockKernels::BlurredBlockMeanBGR). Never copies the input.
+  static cv::Mat BuildBlockColorImage(const cv::Mat& inputBgr, const Params& params,
+                                      ProcessContext* context = nullptr);
+  // Gaussian kernel size used by the pre-blur for a given block size (always odd, >= 3).
+  static int PreBlurKernelSize(int blockSize);
+  // Step 3: palette limitation = ExtractPalette + ApplyPalette.
+  static cv::Mat QuantizeBlocks(const cv::Mat& smallBgr, const Params& params);
+  // Step 3a: the palette for params: K-means (clustered in Lab) for Custom, otherwise the
+  // registry palette. Independent of dithering, so the result can be cached and reused for
+  // other images. `warmStartLab` / `outCentersLab` seed / receive the K-means centers
+  // (Lab, 8-bit scale); both are ignored for fixed palettes.
+  static std::shared_ptr<const Palette> ExtractPalette(const cv::Mat& smallBgr, const Params& params,
+                                                       const std::vector<cv::Vec3f>* warmStartLab = nullptr,
+                                                       std::vector<cv::Vec3f>* outCentersLab = nullptr,
+                                                       ProcessContext* context = nullptr);
+  // Step 3b: maps every block onto the palette, plainly (nearest entry in the palette's
+  // preferred metric) or dithered (params.dither / ditherMethod / ditherSerpentine).
+  // Returns the palette index of every block (CV_8UC1): the canonical quantized image.
+  static cv::Mat ApplyPaletteIndices(const cv::Mat& smallBgr, const Palette& palette, const Params& params,
+                                     ProcessContext* context = nullptr);
+  // ApplyPaletteIndices expanded to palette colors (CV_8UC3).
+  static cv::Mat ApplyPalette(const cv::Mat& smallBgr, const Palette& palette, const Params& params);
+  // Steps 4-6: expansion to outSize plus edge enhancement / outline as enabled in params.
+  static cv::Mat ExpandAndPostProcess(const cv::Mat& quantizedSmallBgr, const cv::Size& outSize,
+                                      const Params& params);
+  // Steps 4-6 from the quantized index plane; outlines run on indices (1 byte per pixel).
+  // With `keepIndexed` the result stays indexed in `outIndexed` when possible (see
+  // ProcessIndexed); otherwise it is expanded to `outBgr`. Exactly one of them is filled.
+  // `stats` (optional) receives the expand / edge / outline timings.
+  static bool ExpandAndPostProcess(const IndexedImage& quantizedSmall, const cv::Size& outSize,
+                                   const Params& params, bool keepIndexed, IndexedImage& outIndexed,
+                                   cv::Mat& outBgr, ProcessStats* stats = nullptr,
+                                   ProcessContext* context = nullptr);
+  // Total filter radius of the enabled post-processing steps (0 = plain expansion); the block
+  // grid radius for ExpandAndPostProcess.
+  static int PostProcessRadius(const Params& params);
+  // Steps 4-6 for just the part of the output a change of `changedBlocks` affects: `outRect`
+  // (the changed blocks grown by the post-processing halo, in output pixels) is filled exactly
+  // as in the whole-image ExpandAndPostProcess result. Runs on the blocks around outRect only.
+  // Same outputs as the IndexedImage overload, sized outRect.
+  static bool ExpandAndPostProcessRegion(const IndexedImage& quantizedSmall, const cv::Rect& changedBlocks,
+                                         const cv::Size& outSize, const Params& params, bool keepIndexed,
+                                         cv::Rect& outRect, IndexedImage& outIndexed, cv::Mat& outBgr,
+                                         ProcessStats* stats = nullptr);
+  // Bounding box of the pixels that differ between two images of equal size and type (empty
+  // if they are identical). Used to find edited / changed regions of inputs and block images.
+  static cv::Rect DiffRect(const cv::Mat& a, const cv::Mat& b);
+
+  static cv::Mat BuildBlockColorImageBGR(const cv::Mat& inputBgr, int blockSize, ProcessContext* context = nullptr);
+  static std::shared_ptr<const Palette> ExtractKMeansPalette(const cv::Mat& smallBgr, int paletteSize, uint32_t seed,
+                                                             const std::vector<cv::Vec3f>* warmStartLab = nullptr,
+                                                             std::vector<cv::Vec3f>* outCentersLab = nullptr,
+                                                             ProcessContext* context = nullptr);
+  // Palette index planes (CV_8UC1) for the three palette mappings.
+  static cv::Mat QuantizeWithPalette(const cv::Mat& smallBgr, const Palette& palette,
+                                     ProcessContext* context = nullptr);
+  static cv::Mat QuantizeWithPaletteDither(const cv::Mat& smallBgr, const Palette& palette, bool serpentine,
+                                           ProcessContext* context = nullptr);
+  static cv::Mat QuantizeWithPaletteOrdered(const cv::Mat& smallBgr, const Palette& palette, DitherMethod method,
+                                            ProcessContext* context = nullptr);
+  static cv::Mat ExpandBlocksBGR(const cv::Mat& smallBgr, const cv::Size& outSize, int blockSize,
+                                 ProcessContext* context = nullptr);
+  static void ApplyEdgeEnhancementInPlace(cv::Mat& bgr, float strength = 0.6f, ProcessContext* context = nullptr);
+  static void ApplyPixelArtOutline(cv::Mat& bgr, int thickness = 1, ProcessContext* context = nullptr);
+  // ApplyPixelArtOutline on an index plane: the darkened shades are appended to `colors`.
+  // Returns false (nothing changed) if palette plus shades exceed 256 colors.
+  static bool ApplyPixelArtOutlineIndexed(cv::Mat& indices, std::vector<cv::Vec3b>& colors, int thickness = 1,
+                                          ProcessContext* context = nullptr);
+
 };
 
 
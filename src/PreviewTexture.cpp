@@ -0,0 +1,223 @@
+#include "PreviewTexture.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Include GL headers *only* in the .cpp to keep headers portable/clean.
+#if defined(_WIN32)
+  #include <Windows.h>
+#endif
+#include <GL/gl.h>
+
+namespace {
+constexpr int kTileSize = 512;
+constexpr size_t kMaxTiles = 48;         // ~48 MB of RGBA8 tiles (uploads share GLTexture's two PBOs)
+constexpr int kTileUploadsPerFrame = 4;  // keeps zooming / panning into new areas smooth
+
+int MaxTextureSize() {
+  static const int size = [] {
+    GLint v = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &v);
+    return v > 0 ? static_cast<int>(v) : 2048;
+  }();
+  return size;
+}
+
+int OverviewLimit(int requested) {
+  return std::max(1, std::min(requested, MaxTextureSize()));
+}
+} // namespace
+
+bool PreviewTexture::Update(const cv::Mat& mat) {
+  return Update(mat, cv::Size2f(static_cast<float>(mat.cols), static_cast<float>(mat.rows)));
+}
+
+bool PreviewTexture::Update(const cv::Mat& mat, const cv::Size2f& content) {
+  source_ = mat;
+  deviceSize_ = cv::Size();
+  content_ = content;
+  tiles_.clear();
+  return RebuildOverview();
+}
+
+bool PreviewTexture::Update(const cv::Mat& mat, const cv::Size2f& content, const cv::Rect& changed) {
+  if (!IsValid() || mat.size() != source_.size() || mat.type() != source_.type()) {
+    return Update(mat, content);
+  }
+  source_ = mat;
+  content_ = content;
+  const cv::Rect r = changed & cv::Rect(0, 0, source_.cols, source_.rows);
+  if (r.empty()) return true;
+
+  for (auto& entry : tiles_) {
+    const cv::Rect tr = TileRect(entry.first.first, entry.first.second);
+    const cv::Rect hit = r & tr;
+    if (!hit.empty()) entry.second.texture.UpdateFromMat(source_(tr), hit - tr.tl());
+  }
+  return RefreshOverview(r);
+}
+
+bool PreviewTexture::Update(const cv::UMat& image, const cv::Size2f& content) {
+  if (image.empty()) return false;
+  if (std::max(image.cols, image.rows) > MaxTextureSize()) {
+    // Needs the overview + tiles path, which works on host pixels.
+    cv::Mat host;
+    image.copyTo(host);
+    return Update(host, content);
+  }
+  source_.release();
+  overviewMat_.release();
+  tiles_.clear();
+  deviceSize_ = image.size();
+  content_ = content;
+  return overview_.UpdateFromUMat(image);
+}
+
+void PreviewTexture::SetPanelSize(const ImVec2& size) {
+  const float want = std::max(size.x, size.y);
+  int side = 256;
+  while (static_cast<float>(side) < want && side < 8192) side *= 2;
+  if (side == overviewSide_) return;
+
+  // Images that fit under both limits are shown as they are either way.
+  const int longest = std::max(source_.cols, source_.rows);
+  const bool same = longest <= OverviewLimit(overviewSide_) && longest <= OverviewLimit(side);
+  overviewSide_ = side;
+  if (!source_.empty() && !same) RebuildOverview();
+}
+
+bool PreviewTexture::RebuildOverview() {
+  overviewMat_.release();
+  if (source_.empty()) {
+    overview_.Destroy();
+    return false;
+  }
+  const int limit = OverviewLimit(overviewSide_);
+  const int longest = std::max(source_.cols, source_.rows);
+  if (longest <= limit) return overview_.UpdateFromMat(source_);
+
+  const double s = static_cast<double>(limit) / static_cast<double>(longest);
+  const cv::Size size(std::max(1, static_cast<int>(std::lround(source_.cols * s))),
+                      std::max(1, static_cast<int>(std::lround(source_.rows * s))));
+  cv::resize(source_, overviewMat_, size, 0.0, 0.0, cv::INTER_AREA);
+  return overview_.UpdateFromMat(overviewMat_);
+}
+
+bool PreviewTexture::RefreshOverview(const cv::Rect& changed) {
+  if (overviewMat_.empty()) return overview_.UpdateFromMat(source_, changed);
+
+  // Overview pixels whose footprint touches the change, and the source area they cover.
+  const double sx = static_cast<double>(overviewMat_.cols) / static_cast<double>(source_.cols);
+  const double sy = static_cast<double>(overviewMat_.rows) / static_cast<double>(source_.rows);
+  const int ox0 = static_cast<int>(std::floor(changed.x * sx));
+  const int oy0 = static_cast<int>(std::floor(changed.y * sy));
+  const int ox1 = std::min(overviewMat_.cols, static_cast<int>(std::ceil((changed.x + changed.width) * sx)));
+  const int oy1 = std::min(overviewMat_.rows, static_cast<int>(std::ceil((changed.y + changed.height) * sy)));
+  const int srcX0 = static_cast<int>(std::floor(ox0 / sx));
+  const int srcY0 = static_cast<int>(std::floor(oy0 / sy));
+  const int srcX1 = std::min(source_.cols, static_cast<int>(std::ceil(ox1 / sx)));
+  const int srcY1 = std::min(source_.rows, static_cast<int>(std::ceil(oy1 / sy)));
+  const cv::Rect ovRect(ox0, oy0, ox1 - ox0, oy1 - oy0);
+  const cv::Rect srcRect(srcX0, srcY0, srcX1 - srcX0, srcY1 - srcY0);
+  if (ovRect.empty() || srcRect.empty()) return true;
+
+  cv::Mat patch;
+  cv::resize(source_(srcRect), patch, ovRect.size(), 0.0, 0.0, cv::INTER_AREA);
+  cv::Mat dst = overviewMat_(ovRect);
+  patch.copyTo(dst);
+  return overview_.UpdateFromMat(overviewMat_, ovRect);
+}
+
+cv::Rect PreviewTexture::TileRect(int tx, int ty) const {
+  return cv::Rect(tx * kTileSize, ty * kTileSize, kTileSize, kTileSize) & cv::Rect(0, 0, source_.cols, source_.rows);
+}
+
+void PreviewTexture::EvictTiles() {
+  while (tiles_.size() > kMaxTiles) {
+    auto oldest = tiles_.end();
+    for (auto it = tiles_.begin(); it != tiles_.end(); ++it) {
+      if (it->second.lastUsed == frame_) continue; // visible right now
+      if (oldest == tiles_.end() || it->second.lastUsed < oldest->second.lastUsed) oldest = it;
+    }
+    if (oldest == tiles_.end()) return;
+    tiles_.erase(oldest);
+  }
+}
+
+void PreviewTexture::Draw(ImDrawList* drawList, const ImVec2& p0, const ImVec2& p1, const ImVec2& uv0,
+                          const ImVec2& uv1) {
+  if (!IsValid() || content_.width <= 0.0f || content_.height <= 0.0f) return;
+  ++frame_;
+
+  // View rect in source texels, and screen pixels per texel.
+  const float vx0 = uv0.x * content_.width;
+  const float vy0 = uv0.y * content_.height;
+  const float vx1 = uv1.x * content_.width;
+  const float vy1 = uv1.y * content_.height;
+  if (vx1 <= vx0 || vy1 <= vy0) return;
+  const float pptX = (p1.x - p0.x) / (vx1 - vx0);
+  const float pptY = (p1.y - p0.y) / (vy1 - vy0);
+
+  const cv::Size texels = source_.empty() ? deviceSize_ : source_.size();
+  const float cols = static_cast<float>(texels.width);
+  const float rows = static_cast<float>(texels.height);
+  drawList->AddImage(overview_.ImGuiID(), p0, p1, ImVec2(vx0 / cols, vy0 / rows), ImVec2(vx1 / cols, vy1 / rows));
+
+  // Full-resolution tiles only where the overview would be magnified.
+  if (overviewMat_.empty()) return;
+  const float overviewDensity = static_cast<float>(overviewMat_.cols) / cols;
+  if (pptX <= overviewDensity) return;
+
+  const int lastTx = (source_.cols - 1) / kTileSize;
+  const int lastTy = (source_.rows - 1) / kTileSize;
+  const int tx0 = std::clamp(static_cast<int>(vx0) / kTileSize, 0, lastTx);
+  const int ty0 = std::clamp(static_cast<int>(vy0) / kTileSize, 0, lastTy);
+  const int tx1 = std::clamp((static_cast<int>(std::ceil(vx1)) - 1) / kTileSize, 0, lastTx);
+  const int ty1 = std::clamp((static_cast<int>(std::ceil(vy1)) - 1) / kTileSize, 0, lastTy);
+
+  int uploads = 0;
+  for (int ty = ty0; ty <= ty1; ++ty) {
+    for (int tx = tx0; tx <= tx1; ++tx) {
+      const std::pair<int, int> key(tx, ty);
+      const cv::Rect tr = TileRect(tx, ty);
+      auto it = tiles_.find(key);
+      if (it == tiles_.end()) {
+        // Not resident yet: the overview shows through until a later frame uploads it.
+        if (uploads >= kTileUploadsPerFrame) continue;
+        ++uploads;
+        Tile& tile = tiles_[key];
+        if (!tile.texture.UpdateFromMat(source_(tr))) {
+          tiles_.erase(key);
+          continue;
+        }
+        it = tiles_.find(key);
+      }
+      it->second.lastUsed = frame_;
+
+      // Visible part of the tile.
+      const float ax0 = std::max(vx0, static_cast<float>(tr.x));
+      const float ay0 = std::max(vy0, static_cast<float>(tr.y));
+      const float ax1 = std::min(vx1, static_cast<float>(tr.x + tr.width));
+      const float ay1 = std::min(vy1, static_cast<float>(tr.y + tr.height));
+      if (ax1 <= ax0 || ay1 <= ay0) continue;
+      const ImVec2 s0(p0.x + (ax0 - vx0) * pptX, p0.y + (ay0 - vy0) * pptY);
+      const ImVec2 s1(p0.x + (ax1 - vx0) * pptX, p0.y + (ay1 - vy0) * pptY);
+      const float tw = static_cast<float>(tr.width);
+      const float th = static_cast<float>(tr.height);
+      drawList->AddImage(it->second.texture.ImGuiID(), s0, s1, ImVec2((ax0 - tr.x) / tw, (ay0 - tr.y) / th),
+                         ImVec2((ax1 - tr.x) / tw, (ay1 - tr.y) / th));
+    }
+  }
+  EvictTiles();
+}
+
+void PreviewTexture::Destroy() {
+  tiles_.clear();
+  overview_.Destroy();
+  overviewMat_.release();
+  source_.release();
+  deviceSize_ = cv::Size();
+  content_ = cv::Size2f();
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "GLTexture.h"
+
+#include <opencv2/core.hpp>
+
+#include <imgui.h>
+
+#include <cstdint>
+#include <map>
+#include <utility>
+
+// PreviewTexture: an image of any size as a display-resolution overview texture plus
+// full-resolution tiles that are uploaded only while they are visible under zoom.
+// Why this exists:
+// - The preview panels are ~700 px wide, yet one GLTexture per image meant a full-resolution
+//   upload (VRAM, bandwidth) for every result, and failed outright above GL_MAX_TEXTURE_SIZE.
+// - The overview is downsampled to the panel size (SetPanelSize, rounded up to a power of
+//   two) and never exceeds the GL limit; images that already fit are shown as they are.
+// - When zoomed in past the overview's resolution, the visible 512 x 512 source tiles are
+//   uploaded on demand (a few per frame, the overview fills in meanwhile) and kept in a small
+//   LRU set, so inspecting single blocks of a 24 MP image costs a few MB of VRAM.
+//
+// Coordinates: `content` is the texel extent of the mat that maps onto the display area
+// (native results cover partial blocks at the right / bottom edge); Draw takes a view rect
+// in normalized content coordinates.
+class PreviewTexture {
+public:
+  PreviewTexture() = default;
+  PreviewTexture(const PreviewTexture&) = delete;
+  PreviewTexture& operator=(const PreviewTexture&) = delete;
+
+  // Shows `mat` (CV_8UC1/3/4, see GLTexture). The mat is referenced, not copied.
+  bool Update(const cv::Mat& mat);
+  bool Update(const cv::Mat& mat, const cv::Size2f& content);
+  // Same, but when mat has the size of the image shown, only `changed` (mat pixels) is
+  // refreshed in the overview and in resident tiles.
+  bool Update(const cv::Mat& mat, const cv::Size2f& content, const cv::Rect& changed);
+  // Shows a GpuProcessor result: copied straight into a full-resolution texture when it fits
+  // under GL_MAX_TEXTURE_SIZE (no overview, no tiles), otherwise read back and shown as a Mat.
+  bool Update(const cv::UMat& image, const cv::Size2f& content);
+
+  // Display size (framebuffer pixels) of the whole image at fit zoom; picks the overview
+  // resolution and rebuilds it when that changes.
+  void SetPanelSize(const ImVec2& size);
+
+  // Draws the content region uv0..uv1 (normalized) into the screen rect p0..p1.
+  void Draw(ImDrawList* drawList, const ImVec2& p0, const ImVec2& p1, const ImVec2& uv0, const ImVec2& uv1);
+
+  void Destroy();
+
+  bool IsValid() const { return overview_.IsValid(); }
+  const cv::Size2f& Content() const { return content_; }
+
+private:
+  struct Tile {
+    GLTexture texture;
+    uint64_t lastUsed = 0;
+  };
+
+  bool RebuildOverview();
+  // Re-downsamples the overview pixels covering `changed` (mat pixels) and uploads them.
+  bool RefreshOverview(const cv::Rect& changed);
+  cv::Rect TileRect(int tx, int ty) const;
+  void EvictTiles();
+
+  cv::Mat source_;
+  cv::Size deviceSize_;     // size of the UMat shown when source_ is empty
+  cv::Size2f content_;
+  int overviewSide_ = 1024; // longest overview side requested by SetPanelSize
+  cv::Mat overviewMat_;     // downsampled copy; empty when the overview is source_ itself
+  GLTexture overview_;
+
+  std::map<std::pair<int, int>, Tile> tiles_;
+  uint64_t frame_ = 0;
+};
@@ -0,0 +1,46 @@
+#include "ProcessContext.h"
+
+namespace {
+// Only the context references the buffer (or there is none): safe to overwrite.
+// The atomic read pairs with the reference drop of whichever thread released it last.
+bool Unshared(cv::Mat& m) {
+  return m.empty() || (m.u && CV_XADD(&m.u->refcount, 0) == 1);
+}
+} // namespace
+
+cv::Mat ProcessContext::Scratch(ProcessContext* context, Slot slot, int rows, int cols, int type) {
+  if (!context) return cv::Mat(rows, cols, type);
+  cv::Mat& m = context->slots_[static_cast<int>(slot)];
+  m.create(rows, cols, type);
+  return m;
+}
+
+cv::Mat ProcessContext::Output(ProcessContext* context, int rows, int cols, int type) {
+  if (!context) return cv::Mat(rows, cols, type);
+  // An exact fit first; otherwise an empty entry rather than one holding another size or type
+  // (a batch may alternate between BGR and indexed results).
+  cv::Mat* reuse = nullptr;
+  for (cv::Mat& m : context->outputs_) {
+    if (!Unshared(m)) continue;
+    if (m.rows == rows && m.cols == cols && m.type() == type) {
+      reuse = &m;
+      break;
+    }
+    if (!reuse || (!reuse->empty() && m.empty())) reuse = &m;
+  }
+  if (!reuse) return cv::Mat(rows, cols, type); // every pooled output is still in use
+  reuse->create(rows, cols, type);
+  return *reuse;
+}
+
+size_t ProcessContext::Bytes() const {
+  size_t bytes = 0;
+  for (const cv::Mat& m : slots_) bytes += m.total() * m.elemSize();
+  for (const cv::Mat& m : outputs_) bytes += m.total() * m.elemSize();
+  return bytes;
+}
+
+void ProcessContext::Release() {
+  for (cv::Mat& m : slots_) m.release();
+  for (cv::Mat& m : outputs_) m.release();
+}
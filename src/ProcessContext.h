@@ -0,0 +1,66 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+
+// ProcessContext: scratch buffers that PixelArtProcessor::Process reuses from call to call.
+// Why this exists:
+// - Every Process call used to allocate its intermediates afresh: block image, Lab copy, index
+//   plane, block grid, the edge enhancement and outline temporaries and the full-resolution
+//   output. For a batch of same-sized images that is the same dozen buffers allocated, page
+//   faulted in and freed again per image.
+// - A context keeps one buffer per use (Slot) and only reallocates it when the requested size
+//   or type changes, so steady-state processing of same-sized images allocates no Mat memory.
+// - Results handed to the caller come from a small pool of output buffers; one is reused only
+//   once nothing outside the context references it any more (the caller, or the encoder it
+//   was passed to, released it).
+//
+// Every entry point takes an optional `ProcessContext*` (default nullptr = allocate as before).
+// Small per-row working buffers inside the parallel kernels are thread_local instead: they run
+// on OpenCV's pool threads, not the thread that owns the context.
+// Not thread-safe: keep one per worker thread.
+class ProcessContext {
+public:
+  enum class Slot {
+    Blocks,           // block colors (BuildBlockColorImage)
+    BlocksLab,        // block colors in Lab (K-means, Lab palette lookup)
+    CentersLab,       // K-means centers, Lab and BGR
+    CentersBgr,
+    Indices,          // palette indices of the block image (ApplyPaletteIndices)
+    QuantizedBgr,     // the same as colors, for plain BGR expansion
+    Grid,             // block grid (BlockKernels::BuildBlockGrid)
+    GridBgr,          // block grid as colors, for edge enhancement / color outlines
+    EdgeBlurred,      // ApplyEdgeEnhancementInPlace temporaries
+    EdgeFloat,
+    EdgeBlurredFloat,
+    EdgeDetail,
+    OutlineLuminance, // OutlineKernels temporaries
+    OutlineMask,
+    OutlineStage,
+  };
+  static constexpr int kSlotCount = 15;
+  // Results that may be alive outside the context at once (e.g. queued for encoding).
+  static constexpr int kOutputCount = 4;
+
+  ProcessContext() = default;
+  ProcessContext(const ProcessContext&) = delete;
+  ProcessContext& operator=(const ProcessContext&) = delete;
+
+  // The `slot` buffer, rows × cols of `type` (contents undefined). Valid until the slot is
+  // requested again; never hand it to a caller. With a null context this is just a new Mat.
+  static cv::Mat Scratch(ProcessContext* context, Slot slot, int rows, int cols, int type);
+  // A buffer for a result the caller keeps: a pooled one nothing else references (same size
+  // and type preferred), else a new one, pooled while there is room. With a null context this
+  // is just a new Mat.
+  static cv::Mat Output(ProcessContext* context, int rows, int cols, int type);
+
+  // Bytes held by the slots and the output pool (outputs still in use included).
+  size_t Bytes() const;
+  // Frees everything; outputs still referenced elsewhere stay valid.
+  void Release();
+
+private:
+  cv::Mat slots_[kSlotCount];
+  cv::Mat outputs_[kOutputCount];
+};
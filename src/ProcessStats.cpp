@@ -0,0 +1,241 @@
+#include "ProcessStats.h"
+
+#include "CpuDispatch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Trace timestamps of all runs share one origin so concurrent runs line up.
+Clock::time_point TraceEpoch() {
+  static const Clock::time_point epoch = Clock::now();
+  return epoch;
+}
+
+double MicrosSinceEpoch(Clock::time_point t) {
+  return std::chrono::duration<double, std::micro>(t - TraceEpoch()).count();
+}
+
+uint32_t ThreadIndex() {
+  static std::atomic<uint32_t> next{1};
+  thread_local const uint32_t index = next.fetch_add(1);
+  return index;
+}
+
+// Mat bytes allocated by one thread and still alive (a Mat freed on another thread is
+// subtracted from the thread that allocated it), the high-water mark of that, and how many
+// buffers the thread allocated in total.
+struct ThreadBytes {
+  std::atomic<int64_t> live{0};
+  std::atomic<int64_t> peak{0};        // written by the owning thread only
+  std::atomic<int64_t> allocations{0}; // written by the owning thread only
+};
+
+ThreadBytes& ThisThreadBytes() {
+  // Never freed: Mats may outlive the thread that allocated them.
+  thread_local ThreadBytes* bytes = new ThreadBytes;
+  return *bytes;
+}
+
+// cv::Mat's standard allocator plus byte counting. UMatData::userdata remembers the counter
+// of the allocating thread.
+constexpr size_t kAutoStep = 0x7fffffff; // CV_AUTOSTEP (C API header)
+
+class CountingAllocator : public cv::MatAllocator {
+public:
+  cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step, cv::AccessFlag,
+                         cv::UMatUsageFlags) const override {
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; --i) {
+      if (step) {
+        if (data0 && step[i] != kAutoStep) {
+          CV_Assert(total <= step[i]);
+          total = step[i];
+        } else {
+          step[i] = total;
+        }
+      }
+      total *= static_cast<size_t>(sizes[i]);
+    }
+    uchar* data = data0 ? static_cast<uchar*>(data0) : static_cast<uchar*>(cv::fastMalloc(total));
+    cv::UMatData* u = new cv::UMatData(this);
+    u->data = u->origdata = data;
+    u->size = total;
+    if (data0) {
+      u->flags |= cv::UMatData::USER_ALLOCATED;
+    } else {
+      ThreadBytes& bytes = ThisThreadBytes();
+      const int64_t live = bytes.live.fetch_add(static_cast<int64_t>(total)) + static_cast<int64_t>(total);
+      if (live > bytes.peak.load(std::memory_order_relaxed)) bytes.peak.store(live, std::memory_order_relaxed);
+      bytes.allocations.store(bytes.allocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      u->userdata = &bytes;
+    }
+    return u;
+  }
+
+  bool allocate(cv::UMatData* u, cv::AccessFlag, cv::UMatUsageFlags) const override { return u != nullptr; }
+
+  void deallocate(cv::UMatData* u) const override {
+    if (!u) return;
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+    if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+      if (u->userdata) static_cast<ThreadBytes*>(u->userdata)->live.fetch_sub(static_cast<int64_t>(u->size));
+      cv::fastFree(u->origdata);
+      u->origdata = nullptr;
+    }
+    delete u;
+  }
+};
+
+std::atomic<bool> g_trackingEnabled{false};
+
+void AppendEscaped(std::string& out, const char* s) {
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\') out += '\\';
+    out += *s;
+  }
+}
+} // namespace
+
+const char* ProcessStats::StageName(Stage stage) {
+  switch (stage) {
+  case Stage::Blocks: return "blocks";
+  case Stage::Palette: return "palette";
+  case Stage::Quantize: return "quantize";
+  case Stage::Expand: return "expand";
+  case Stage::Edge: return "edge";
+  case Stage::Outline: return "outline";
+  }
+  return "unknown";
+}
+
+const char* ProcessStats::StageLabel(Stage stage) {
+  switch (stage) {
+  case Stage::Blocks: return "Blur + block mean";
+  case Stage::Palette: return "Palette (K-means)";
+  case Stage::Quantize: return "Quantize / dither";
+  case Stage::Expand: return "Expand";
+  case Stage::Edge: return "Edge enhance";
+  case Stage::Outline: return "Outline";
+  }
+  return "?";
+}
+
+ProcessStats::Scope::Scope(ProcessStats* stats, Stage stage) : stats_(stats), stage_(stage) {
+  if (stats_) start_ = Clock::now();
+}
+
+ProcessStats::Scope::~Scope() {
+  if (!stats_) return;
+  const Clock::time_point end = Clock::now();
+  Event e;
+  e.stage = stage_;
+  e.startUs = MicrosSinceEpoch(start_);
+  e.durationUs = std::chrono::duration<double, std::micro>(end - start_).count();
+  stats_->stageSeconds[static_cast<int>(stage_)] += e.durationUs * 1e-6;
+  stats_->events.push_back(e);
+}
+
+void ProcessStats::Begin(const cv::Size& size) {
+  *this = ProcessStats{};
+  inputSize = size;
+  thread = ThreadIndex();
+  kernels = CpuDispatch::IsaName(CpuDispatch::Active());
+  TraceEpoch(); // the first run starts the trace clock at 0
+  begin_ = Clock::now();
+  startUs = MicrosSinceEpoch(begin_);
+  if (AllocationTrackingEnabled()) {
+    ThreadBytes& bytes = ThisThreadBytes();
+    baselineBytes_ = bytes.live.load();
+    bytes.peak.store(baselineBytes_, std::memory_order_relaxed);
+    baselineAllocations_ = bytes.allocations.load(std::memory_order_relaxed);
+  }
+}
+
+void ProcessStats::End() {
+  totalSeconds = std::chrono::duration<double>(Clock::now() - begin_).count();
+  if (AllocationTrackingEnabled()) {
+    const ThreadBytes& bytes = ThisThreadBytes();
+    peakBytes = std::max<int64_t>(0, bytes.peak.load(std::memory_order_relaxed) - baselineBytes_);
+    matAllocations = bytes.allocations.load(std::memory_order_relaxed) - baselineAllocations_;
+  }
+}
+
+std::string ProcessStats::ToJson() const {
+  std::string out;
+  char buf[200];
+  std::snprintf(buf, sizeof(buf),
+                "{\n  \"input\": [%d, %d],\n  \"total_ms\": %.3f,\n  \"peak_bytes\": %lld,\n"
+                "  \"mat_allocations\": %lld,\n  \"kernels\": \"%s\",\n",
+                inputSize.width, inputSize.height, totalSeconds * 1000.0, static_cast<long long>(peakBytes),
+                static_cast<long long>(matAllocations), kernels);
+  out += buf;
+  out += "  \"stages_ms\": {";
+  for (int i = 0; i < kStageCount; ++i) {
+    std::snprintf(buf, sizeof(buf), "%s\"%s\": %.3f", i ? ", " : "", StageName(static_cast<Stage>(i)),
+                  stageSeconds[i] * 1000.0);
+    out += buf;
+  }
+  out += "}\n}\n";
+  return out;
+}
+
+std::string ProcessStats::ToChromeTrace(const std::vector<ProcessStats>& runs) {
+  // Trace Event Format: complete ("X") events in microseconds, one track (tid) per thread.
+  std::string out = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  bool first = true;
+  auto event = [&](const char* name, double ts, double dur, uint32_t tid, const char* args) {
+    out += first ? "  " : ",\n  ";
+    first = false;
+    out += "{\"name\": \"";
+    AppendEscaped(out, name);
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "\", \"cat\": \"fpw\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %u",
+                  ts, dur, tid);
+    out += buf;
+    if (args) out += args;
+    out += "}";
+  };
+  for (const ProcessStats& run : runs) {
+    char buf[192];
+    std::snprintf(buf, sizeof(buf),
+                  ", \"args\": {\"width\": %d, \"height\": %d, \"peak_bytes\": %lld, \"mat_allocations\": %lld, "
+                  "\"kernels\": \"%s\"}",
+                  run.inputSize.width, run.inputSize.height, static_cast<long long>(run.peakBytes),
+                  static_cast<long long>(run.matAllocations), run.kernels);
+    event("process", run.startUs, run.totalSeconds * 1e6, run.thread, buf);
+    for (const Event& e : run.events) event(StageName(e.stage), e.startUs, e.durationUs, run.thread, nullptr);
+  }
+  out += "\n]}\n";
+  return out;
+}
+
+bool ProcessStats::WriteFile(const std::string& path, const std::string& text, std::string& outError) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    outError = "Cannot open '" + path + "' for writing.";
+    return false;
+  }
+  file.write(text.data(), static_cast<std::streamsize>(text.size()));
+  if (!file) {
+    outError = "Failed to write '" + path + "'.";
+    return false;
+  }
+  return true;
+}
+
+void ProcessStats::EnableAllocationTracking() {
+  if (g_trackingEnabled.exchange(true)) return;
+  // Leaked on purpose: Mats allocated through it may be freed during static destruction.
+  static CountingAllocator* allocator = new CountingAllocator;
+  cv::Mat::setDefaultAllocator(allocator);
+}
+
+bool ProcessStats::AllocationTrackingEnabled() {
+  return g_trackingEnabled.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ProcessStats: per-stage wall time and peak memory of one PixelArtProcessor::Process /
+// PixelArtPipeline run.
+// Why this exists:
+// - Process is a black box returning a Mat; without numbers per stage, slow runs (and
+//   regressions) cannot be attributed to K-means, dithering or the post-processing.
+// - Optional and nearly free: every entry point takes a `ProcessStats*` that defaults to
+//   nullptr, and a null Scope does nothing.
+// - Runs export as JSON (one run) or Chrome trace event format (any number of runs, one
+//   track per thread; open in chrome://tracing or Perfetto) to attach to regression tickets.
+//
+// Stages the pipeline skipped (cached, or not enabled) read 0. The pre-blur is fused into the
+// block reduction (BlockKernels::BlurredBlockMeanBGR), so "blocks" is blur + block mean.
+// Peak memory and the allocation count need EnableAllocationTracking(); without it peakBytes
+// and matAllocations stay -1.
+struct ProcessStats {
+  enum class Stage {
+    Blocks,   // pre-blur + per-block mean
+    Palette,  // palette extraction (K-means for Custom)
+    Quantize, // palette application (plain or dithered)
+    Expand,   // block grid / expansion to full resolution
+    Edge,     // edge enhancement
+    Outline   // outline
+  };
+  static constexpr int kStageCount = 6;
+
+  // Stage id used in exports ("blocks", "palette", ...) and a label for display.
+  static const char* StageName(Stage stage);
+  static const char* StageLabel(Stage stage);
+
+  // One timed interval (a stage may run more than once per call, e.g. Expand).
+  struct Event {
+    Stage stage = Stage::Blocks;
+    double startUs = 0.0; // since the process-wide trace epoch
+    double durationUs = 0.0;
+  };
+
+  // Times one stage for its lifetime; does nothing when `stats` is null.
+  class Scope {
+  public:
+    Scope(ProcessStats* stats, Stage stage);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    ProcessStats* stats_;
+    Stage stage_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  cv::Size inputSize;
+  double stageSeconds[kStageCount] = {};
+  double totalSeconds = 0.0;
+  int64_t peakBytes = -1;  // Mat memory allocated on the calling thread above its level at Begin
+  int64_t matAllocations = -1; // Mat buffers allocated on the calling thread during the run
+  double startUs = 0.0;    // since the process-wide trace epoch
+  uint32_t thread = 0;     // small per-thread index (trace track)
+  const char* kernels = ""; // CpuDispatch variant the run used ("avx2", ...)
+  std::vector<Event> events;
+
+  double Seconds(Stage stage) const { return stageSeconds[static_cast<int>(stage)]; }
+
+  // Resets everything and starts the clock (and the peak window) for a run on this thread.
+  void Begin(const cv::Size& size);
+  // Stops the clock; fills totalSeconds, peakBytes and matAllocations.
+  void End();
+
+  std::string ToJson() const;
+  static std::string ToChromeTrace(const std::vector<ProcessStats>& runs);
+  static bool WriteFile(const std::string& path, const std::string& text, std::string& outError);
+
+  // Routes cv::Mat allocations through a counting allocator so Begin / End can report the
+  // peak. Process-wide and permanent; call once at startup, before worker threads exist.
+  static void EnableAllocationTracking();
+  static bool AllocationTrackingEnabled();
+
+private:
+  std::chrono::steady_clock::time_point begin_;
+  int64_t baselineBytes_ = 0;
+  int64_t baselineAllocations_ = 0;
+};
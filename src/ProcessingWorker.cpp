@@ -0,0 +1,214 @@
+#include "ProcessingWorker.h"
+
+#include "GpuProcessor.h"
+#include "ImageLoader.h"
+
+#include <chrono>
+
+ProcessingWorker::~ProcessingWorker() {
+  Stop();
+}
+
+bool ProcessingWorker::EnableCache(const std::string& dir, uint64_t maxBytes, std::string& outError) {
+  if (!cache_.Open(dir, outError)) return false;
+  if (maxBytes > 0) cache_.Trim(maxBytes);
+  // One encoder is plenty for results a person asked for one at a time; stores beyond
+  // kCacheStoreQueue waiting results are dropped rather than holding more full-size images.
+  cacheWriter_ = std::make_unique<AsyncImageWriter>(
+      1, kCacheStoreQueue, ImageLoader::SaveOptions{}, [this](const AsyncImageWriter::Result& r) {
+        std::string err;
+        cache_.EndStore(r.path, r.ok, err); // best effort; a failed store is only a later miss
+      });
+  return true;
+}
+
+ResultCache::Stats ProcessingWorker::CacheStats(bool& enabled) const {
+  enabled = cache_.IsOpen();
+  return cache_.GetStats();
+}
+
+void ProcessingWorker::Start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (thread_.joinable()) return;
+  stop_ = false;
+  thread_ = std::thread(&ProcessingWorker::ThreadMain, this);
+}
+
+void ProcessingWorker::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+    pending_.reset();
+    if (cancelRunning_) cancelRunning_->store(true);
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) thread_.join();
+}
+
+uint64_t ProcessingWorker::Submit(const cv::Mat& inputBgr, uint64_t inputId,
+                                  const PixelArtProcessor::Params& params, bool warmStartPalette) {
+  uint64_t id = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    id = ++latestId_;
+    pending_ = Job{id, inputBgr, inputId, params, warmStartPalette, 0, cv::Rect(), useGpu_};
+    // The running job can no longer produce the newest result; stop it at the next step boundary.
+    if (cancelRunning_) cancelRunning_->store(true);
+  }
+  cv_.notify_one();
+  return id;
+}
+
+uint64_t ProcessingWorker::SubmitEdited(const cv::Mat& inputBgr, uint64_t inputId, uint64_t previousInputId,
+                                        const cv::Rect& dirty, const PixelArtProcessor::Params& params) {
+  uint64_t id = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    id = ++latestId_;
+    pending_ = Job{id, inputBgr, inputId, params, false, previousInputId, dirty, false};
+    if (cancelRunning_) cancelRunning_->store(true);
+  }
+  cv_.notify_one();
+  return id;
+}
+
+void ProcessingWorker::SetUseGpu(bool useGpu) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  useGpu_ = useGpu && GpuProcessor::Available();
+}
+
+void ProcessingWorker::Cancel() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++latestId_;
+  pending_.reset();
+  result_.reset();
+  if (cancelRunning_) cancelRunning_->store(true);
+}
+
+bool ProcessingWorker::TryTakeResult(Result& out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!result_) return false;
+  out = std::move(*result_);
+  result_.reset();
+  return true;
+}
+
+bool ProcessingWorker::IsBusy() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return running_ || pending_.has_value();
+}
+
+PixelArtPipeline& ProcessingWorker::PipelineFor(uint64_t inputId, uint64_t previousInputId) {
+  PipelineSlot* victim = &slots_[0];
+  PipelineSlot* previous = nullptr;
+  for (PipelineSlot& slot : slots_) {
+    if (slot.used && slot.inputId == inputId) {
+      slot.lastUse = ++useCounter_;
+      return slot.pipeline;
+    }
+    if (previousInputId != 0 && slot.used && slot.inputId == previousInputId) previous = &slot;
+    if (!slot.used || (victim->used && slot.lastUse < victim->lastUse)) victim = &slot;
+  }
+  if (previous) {
+    // The edited image takes over the cache of the version it was edited from.
+    previous->inputId = inputId;
+    previous->lastUse = ++useCounter_;
+    return previous->pipeline;
+  }
+  // Least recently used slot gets recycled for the new input.
+  victim->pipeline.Clear();
+  victim->inputId = inputId;
+  victim->used = true;
+  victim->lastUse = ++useCounter_;
+  return victim->pipeline;
+}
+
+void ProcessingWorker::ThreadMain() {
+  for (;;) {
+    Job job;
+    std::shared_ptr<std::atomic<bool>> cancel;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stop_ || pending_.has_value(); });
+      if (stop_) return;
+      job = std::move(*pending_);
+      pending_.reset();
+      cancel = std::make_shared<std::atomic<bool>>(false);
+      cancelRunning_ = cancel;
+      running_ = true;
+    }
+
+    const auto t0 = std::chrono::steady_clock::now();
+    cv::Rect changedRect;
+    ProcessStats stats;
+    cv::Mat output;
+    cv::UMat deviceOutput;
+    std::string gpuError;
+    bool done = false;
+    if (job.gpu && job.previousInputId == 0) {
+      bool uploaded = deviceInputId_ == job.inputId && !deviceInput_.empty();
+      if (!uploaded) {
+        deviceInput_.release();
+        uploaded = GpuProcessor::Upload(job.input, deviceInput_, gpuError);
+        deviceInputId_ = uploaded ? job.inputId : 0;
+      }
+      // A cancelled run (no error) has nothing to publish either way.
+      done = uploaded && (GpuProcessor::Process(deviceInput_, job.params, deviceOutput, gpuError, cancel.get(),
+                                                &stats) ||
+                          gpuError.empty());
+      if (!deviceOutput.empty()) changedRect = cv::Rect(0, 0, deviceOutput.cols, deviceOutput.rows);
+    }
+    // Warm-started palettes (live proxies) are not reproducible, and edits go through the
+    // pipeline cache of the previous version: neither uses the result cache.
+    std::string cacheKey;
+    bool fromCache = false;
+    if (!done && cache_.IsOpen() && job.previousInputId == 0 && !job.warmStartPalette) {
+      if (cacheInputId_ != job.inputId) {
+        cacheInputDigest_ = ResultCache::HashImage(job.input);
+        cacheInputId_ = job.inputId;
+      }
+      cacheKey = ResultCache::Key(cacheInputDigest_, job.params, "gui png");
+      std::string path;
+      std::string err;
+      if (cache_.Lookup(cacheKey, path) && ImageLoader::LoadBGR(path, output, err)) {
+        changedRect = cv::Rect(0, 0, output.cols, output.rows);
+        fromCache = done = true;
+        cacheKey.clear();
+      }
+    }
+    if (!done) {
+      deviceOutput.release();
+      PixelArtPipeline& pipeline = PipelineFor(job.inputId, job.previousInputId);
+      pipeline.SetWarmStartPalette(job.warmStartPalette);
+      output = job.previousInputId != 0
+          ? pipeline.RunEdited(job.input, job.inputId, job.previousInputId, job.dirty, job.params, &changedRect,
+                               cancel.get(), &stats)
+          : pipeline.Run(job.input, job.inputId, job.params, cancel.get(), &stats);
+      if (job.previousInputId == 0) changedRect = cv::Rect(0, 0, output.cols, output.rows);
+    }
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    // Release our reference to the input outside the lock; it may be the last one.
+    const cv::Size inputSize = job.input.size();
+    job.input.release();
+    // Queued after publishing; a cancelled run's output is incomplete. The output is shared,
+    // not copied: results are never modified in place.
+    const cv::Mat toStore = cacheKey.empty() || cancel->load() ? cv::Mat() : output;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+      cancelRunning_.reset();
+      // Only publish if nothing newer was submitted meanwhile (latest wins).
+      if (!cancel->load() && job.id == latestId_) {
+        result_ = Result{job.id, std::move(output), std::move(deviceOutput), std::move(gpuError), job.params,
+                         seconds, inputSize, job.inputId, job.previousInputId, changedRect, std::move(stats),
+                         fromCache};
+      }
+    }
+    // Dropped while the encoder is behind: a skipped store is only a later miss, a wait here
+    // would delay the next job.
+    if (!toStore.empty() && cacheWriter_) cacheWriter_->TrySubmit(cache_.BeginStore(cacheKey, ".png"), toStore);
+  }
+}
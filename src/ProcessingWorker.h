@@ -0,0 +1,149 @@
+#pragma once
+
+#include "AsyncImageWriter.h"
+#include "PixelArtPipeline.h"
+#include "PixelArtProcessor.h"
+#include "ResultCache.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include <opencv2/core.hpp>
+
+// ProcessingWorker: runs PixelArtProcessor::Process on a background thread.
+// Why this exists:
+// - Process can take seconds on large photos; running it inside the UI handler freezes the window.
+// - Latest-wins semantics: a new Submit replaces any pending job and cancels the running one,
+//   so dragging a slider never builds up a backlog of stale work.
+// - Jobs run through cached PixelArtPipelines (one per recently used input id), so
+//   re-running with a small param change only recomputes the invalidated stages.
+// - With EnableCache, reproducible jobs check the on-disk ResultCache first (keyed by the
+//   input pixels and params) and store their results there, so reopening an image with a
+//   config used before shows the result without running the pipeline. Results are stored by
+//   an encoder thread, so the PNG encode never delays the next job.
+//
+// Threading contract:
+// - Submit / TryTakeResult / Cancel are called from the UI thread only.
+// - Input Mats are shared by reference count, never copied. Callers must not modify an input
+//   in place after submitting it (replacing the Mat with a new one is fine).
+class ProcessingWorker {
+public:
+  struct Result {
+    uint64_t jobId = 0;
+    cv::Mat output;                   // empty if processing failed or ran on the GPU
+    cv::UMat deviceOutput;            // the output of a GPU job (see SetUseGpu); empty otherwise
+    std::string gpuError;             // why a GPU job fell back to the CPU; empty otherwise
+    PixelArtProcessor::Params params; // snapshot the output was produced with
+    double seconds = 0.0;             // wall time spent in Process
+    cv::Size inputSize;               // size of the job's input (output may be native, see Params)
+    uint64_t inputId = 0;             // the job's inputId
+    uint64_t editedFrom = 0;          // SubmitEdited jobs: previousInputId; 0 otherwise
+    cv::Rect changedRect;             // part of output that differs from the previous result of
+                                      // (editedFrom, params); the whole output otherwise
+    ProcessStats stats;               // per-stage timings of the run (cached stages read 0)
+    bool fromCache = false;           // output was read from the ResultCache (stats are empty)
+  };
+
+  ProcessingWorker() = default;
+  ~ProcessingWorker();
+
+  ProcessingWorker(const ProcessingWorker&) = delete;
+  ProcessingWorker& operator=(const ProcessingWorker&) = delete;
+
+  // Uses `dir` as the ResultCache, trimmed to `maxBytes` (0 = no limit) now. Call before Start.
+  bool EnableCache(const std::string& dir, uint64_t maxBytes, std::string& outError);
+  // Hit / miss counts so far; `enabled` false when EnableCache was not called.
+  ResultCache::Stats CacheStats(bool& enabled) const;
+
+  void Start();
+  // Cancels outstanding work and joins the thread. Safe to call more than once.
+  void Stop();
+
+  // Queues a job and returns its id. Supersedes any pending job and cancels the running one.
+  // `inputId` identifies the image content for the stage cache (see PixelArtPipeline::Run).
+  // `warmStartPalette` lets K-means start from the previous palette of this input (see
+  // PixelArtPipeline::SetWarmStartPalette): fast, but not reproducible run to run.
+  uint64_t Submit(const cv::Mat& inputBgr, uint64_t inputId, const PixelArtProcessor::Params& params,
+                  bool warmStartPalette = false);
+
+  // Like Submit, for an edited version of the image last submitted as `previousInputId` that
+  // differs only inside `dirty`: the job patches that input's cached pipeline around the edit
+  // (see PixelArtPipeline::RunEdited) and reports the changed part of the output.
+  uint64_t SubmitEdited(const cv::Mat& inputBgr, uint64_t inputId, uint64_t previousInputId, const cv::Rect& dirty,
+                        const PixelArtProcessor::Params& params);
+
+  // Runs the following (non-edit) jobs with GpuProcessor when it is Available. The result is
+  // then Result::deviceOutput; the input is uploaded once per inputId and kept on the device.
+  // Jobs fall back to the CPU pipeline if the GPU path fails. Edit jobs always use the CPU.
+  void SetUseGpu(bool useGpu);
+
+  // Drops pending work and cancels the running job; results of older jobs are discarded.
+  void Cancel();
+
+  // Returns the finished result of the newest job, if one is ready. Non-blocking.
+  bool TryTakeResult(Result& out);
+
+  // True while a job is queued or running.
+  bool IsBusy() const;
+
+private:
+  struct Job {
+    uint64_t id = 0;
+    cv::Mat input;
+    uint64_t inputId = 0;
+    PixelArtProcessor::Params params;
+    bool warmStartPalette = false;
+    uint64_t previousInputId = 0; // edit jobs only
+    cv::Rect dirty;
+    bool gpu = false;
+  };
+
+  // Cached pipelines, enough for a live-preview proxy and its full-resolution source.
+  // Only touched by the worker thread.
+  struct PipelineSlot {
+    PixelArtPipeline pipeline;
+    uint64_t inputId = 0;
+    uint64_t lastUse = 0;
+    bool used = false;
+  };
+  static constexpr int kPipelineSlots = 2;
+  static constexpr size_t kCacheStoreQueue = 2; // results waiting for the cache encoder
+
+  void ThreadMain();
+  // The cached pipeline of `inputId`; failing that, the one of `previousInputId` (an edit
+  // carries its cache over to the new version), else the least recently used one, cleared.
+  PixelArtPipeline& PipelineFor(uint64_t inputId, uint64_t previousInputId = 0);
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::thread thread_;
+  bool stop_ = false;
+  bool running_ = false;
+  bool useGpu_ = false;
+
+  uint64_t latestId_ = 0;                       // id of the newest submitted job
+  std::optional<Job> pending_;                  // at most one queued job (latest wins)
+  std::shared_ptr<std::atomic<bool>> cancelRunning_; // cancel token of the running job
+  std::optional<Result> result_;                // newest finished result, not yet taken
+
+  PipelineSlot slots_[kPipelineSlots];
+  uint64_t useCounter_ = 0;
+
+  // Device copy of the input of the last GPU job. Only touched by the worker thread.
+  cv::UMat deviceInput_;
+  uint64_t deviceInputId_ = 0;
+
+  // Result cache; the digest of the last input looked up is only touched by the worker thread.
+  ResultCache cache_;
+  uint64_t cacheInputId_ = 0;
+  ResultCache::Digest cacheInputDigest_;
+  // Encodes results into the cache. Declared after cache_: it drains (using cache_) on destruction.
+  std::unique_ptr<AsyncImageWriter> cacheWriter_;
+};
@@ -0,0 +1,265 @@
+#include "ReferenceProcessor.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+inline int ClampInt(int v, int lo, int hi) { return std::max(lo, std::min(v, hi)); }
+
+inline int DistanceSquared(const cv::Vec3b& a, const cv::Vec3b& b) {
+  const int d0 = a[0] - b[0];
+  const int d1 = a[1] - b[1];
+  const int d2 = a[2] - b[2];
+  return d0 * d0 + d1 * d1 + d2 * d2;
+}
+
+int NearestIndex(const cv::Vec3b& c, const std::vector<cv::Vec3b>& colors) {
+  int best = 0;
+  int bestDist = DistanceSquared(c, colors[0]);
+  for (size_t i = 1; i < colors.size(); ++i) {
+    const int d = DistanceSquared(c, colors[i]);
+    if (d < bestDist) {
+      bestDist = d;
+      best = static_cast<int>(i);
+    }
+  }
+  return best;
+}
+
+inline float Clamp255(float v) {
+  return v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+}
+
+inline int Luminance(const cv::Vec3b& c) {
+  return static_cast<int>(0.299f * c[2] + 0.587f * c[1] + 0.114f * c[0]);
+}
+
+inline bool Differs(const cv::Vec3b& a, const cv::Vec3b& b) {
+  const int lumDiff = std::abs(Luminance(a) - Luminance(b));
+  const float colorDist = std::sqrt(static_cast<float>(DistanceSquared(a, b)));
+  return lumDiff >= 35 || colorDist >= 40.0f;
+}
+} // namespace
+
+cv::Mat ReferenceProcessor::BlockMean(const cv::Mat& srcBgr, int blockSize) {
+  const int w = srcBgr.cols;
+  const int h = srcBgr.rows;
+  if (w <= 0 || h <= 0 || srcBgr.type() != CV_8UC3) return {};
+  blockSize = std::max(1, blockSize);
+
+  const int bw = (w + blockSize - 1) / blockSize;
+  const int bh = (h + blockSize - 1) / blockSize;
+  cv::Mat small(bh, bw, CV_8UC3, cv::Scalar(0, 0, 0));
+  for (int by = 0; by < bh; ++by) {
+    for (int bx = 0; bx < bw; ++bx) {
+      const int x0 = bx * blockSize;
+      const int y0 = by * blockSize;
+      const cv::Rect roi(x0, y0, std::min(x0 + blockSize, w) - x0, std::min(y0 + blockSize, h) - y0);
+      const cv::Scalar m = cv::mean(srcBgr(roi));
+      small.at<cv::Vec3b>(by, bx) =
+          cv::Vec3b(static_cast<uchar>(m[0]), static_cast<uchar>(m[1]), static_cast<uchar>(m[2]));
+    }
+  }
+  return small;
+}
+
+cv::Mat ReferenceProcessor::BlurredBlockMean(const cv::Mat& srcBgr, int blockSize, int ksize) {
+  if (srcBgr.empty() || srcBgr.type() != CV_8UC3) return {};
+  cv::Mat blurred;
+  cv::GaussianBlur(srcBgr, blurred, cv::Size(ksize, ksize), 0.0, 0.0, cv::BORDER_DEFAULT);
+  return BlockMean(blurred, blockSize);
+}
+
+std::shared_ptr<const Palette> ReferenceProcessor::KMeansPalette(const cv::Mat& smallBgr, int paletteSize,
+                                                                 uint32_t seed) {
+  if (smallBgr.empty() || smallBgr.type() != CV_8UC3) return {};
+  const int total = smallBgr.rows * smallBgr.cols;
+  const int k = std::max(1, std::min(std::max(2, paletteSize), total));
+
+  cv::Mat smallLab;
+  cv::cvtColor(smallBgr, smallLab, cv::COLOR_BGR2Lab);
+  cv::Mat samples;
+  smallLab.reshape(1, total).convertTo(samples, CV_32F);
+
+  // cv::kmeans draws its k-means++ seeds from the thread's RNG; seed it for repeatable runs.
+  cv::RNG& rng = cv::theRNG();
+  const uint64_t saved = rng.state;
+  rng.state = seed ? seed : 1;
+  cv::Mat labels;
+  cv::Mat centers;
+  cv::kmeans(samples, k, labels, cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::MAX_ITER, 30, 1.0),
+             3, cv::KMEANS_PP_CENTERS, centers);
+  rng.state = saved;
+
+  cv::Mat centersLab(1, k, CV_8UC3);
+  for (int i = 0; i < k; ++i) {
+    centersLab.at<cv::Vec3b>(0, i) = cv::Vec3b(
+        static_cast<uchar>(ClampInt(static_cast<int>(std::lround(centers.at<float>(i, 0))), 0, 255)),
+        static_cast<uchar>(ClampInt(static_cast<int>(std::lround(centers.at<float>(i, 1))), 0, 255)),
+        static_cast<uchar>(ClampInt(static_cast<int>(std::lround(centers.at<float>(i, 2))), 0, 255)));
+  }
+  cv::Mat centersBgr;
+  cv::cvtColor(centersLab, centersBgr, cv::COLOR_Lab2BGR);
+  const cv::Vec3b* row = centersBgr.ptr<cv::Vec3b>(0);
+  return std::make_shared<const Palette>("K-means (reference)", std::vector<cv::Vec3b>(row, row + k),
+                                         Palette::Metric::Lab);
+}
+
+cv::Mat ReferenceProcessor::NearestIndices(const cv::Mat& smallBgr, const Palette& palette) {
+  if (smallBgr.empty() || smallBgr.type() != CV_8UC3 || palette.size() == 0) return {};
+
+  cv::Mat src = smallBgr;
+  const std::vector<cv::Vec3b>* colors = &palette.Colors();
+  if (palette.PreferredMetric() == Palette::Metric::Lab) {
+    cv::cvtColor(smallBgr, src, cv::COLOR_BGR2Lab);
+    colors = &palette.Lab();
+  }
+  cv::Mat result(smallBgr.size(), CV_8UC1);
+  for (int y = 0; y < src.rows; ++y) {
+    for (int x = 0; x < src.cols; ++x) {
+      result.at<uchar>(y, x) = static_cast<uchar>(NearestIndex(src.at<cv::Vec3b>(y, x), *colors));
+    }
+  }
+  return result;
+}
+
+cv::Mat ReferenceProcessor::FloydSteinbergIndices(const cv::Mat& smallBgr, const Palette& palette,
+                                                  bool serpentine) {
+  if (smallBgr.empty() || smallBgr.type() != CV_8UC3 || palette.size() == 0) return {};
+  const std::vector<cv::Vec3b>& colors = palette.Colors();
+  const int w = smallBgr.cols;
+  const int h = smallBgr.rows;
+
+  // Error diffused from the row above, per pixel; error leaving the image is dropped.
+  cv::Mat err(h, w, CV_32FC3, cv::Scalar::all(0));
+  cv::Mat result(smallBgr.size(), CV_8UC1);
+  for (int y = 0; y < h; ++y) {
+    const bool reverse = serpentine && (y & 1) != 0;
+    const int step = reverse ? -1 : 1;
+    cv::Vec3f carry(0.0f, 0.0f, 0.0f); // 7/16 of the previous pixel's error
+    for (int i = 0; i < w; ++i) {
+      const int x = reverse ? w - 1 - i : i;
+      const cv::Vec3b& s = smallBgr.at<cv::Vec3b>(y, x);
+      const cv::Vec3f& in = err.at<cv::Vec3f>(y, x);
+      cv::Vec3f v;
+      cv::Vec3b q;
+      for (int c = 0; c < 3; ++c) {
+        v[c] = Clamp255(static_cast<float>(s[c]) + in[c] + carry[c]);
+        q[c] = static_cast<uchar>(v[c] + 0.5f);
+      }
+      const int idx = NearestIndex(q, colors);
+      result.at<uchar>(y, x) = static_cast<uchar>(idx);
+
+      cv::Vec3f e;
+      for (int c = 0; c < 3; ++c) e[c] = v[c] - static_cast<float>(colors[static_cast<size_t>(idx)][c]);
+      if (y + 1 < h) {
+        // Behind / below / ahead in scan direction: 3/16, 5/16, 1/16.
+        const int back = x - step;
+        const int ahead = x + step;
+        if (back >= 0 && back < w) {
+          cv::Vec3f& d = err.at<cv::Vec3f>(y + 1, back);
+          for (int c = 0; c < 3; ++c) d[c] += e[c] * (3.0f / 16.0f);
+        }
+        cv::Vec3f& d = err.at<cv::Vec3f>(y + 1, x);
+        for (int c = 0; c < 3; ++c) d[c] += e[c] * (5.0f / 16.0f);
+        if (ahead >= 0 && ahead < w) {
+          cv::Vec3f& a = err.at<cv::Vec3f>(y + 1, ahead);
+          for (int c = 0; c < 3; ++c) a[c] += e[c] * (1.0f / 16.0f);
+        }
+      }
+      for (int c = 0; c < 3; ++c) carry[c] = e[c] * (7.0f / 16.0f);
+    }
+  }
+  return result;
+}
+
+cv::Mat ReferenceProcessor::ExpandBlocks(const cv::Mat& smallBgr, const cv::Size& outSize, int blockSize) {
+  if (smallBgr.empty() || smallBgr.type() != CV_8UC3) return {};
+  blockSize = std::max(1, blockSize);
+
+  cv::Mat out(outSize, CV_8UC3, cv::Scalar(0, 0, 0));
+  for (int by = 0; by < smallBgr.rows; ++by) {
+    for (int bx = 0; bx < smallBgr.cols; ++bx) {
+      const int x0 = bx * blockSize;
+      const int y0 = by * blockSize;
+      const int x1 = std::min(x0 + blockSize, out.cols);
+      const int y1 = std::min(y0 + blockSize, out.rows);
+      if (x0 >= x1 || y0 >= y1) continue;
+      const cv::Vec3b c = smallBgr.at<cv::Vec3b>(by, bx);
+      out(cv::Rect(x0, y0, x1 - x0, y1 - y0)).setTo(cv::Scalar(c[0], c[1], c[2]));
+    }
+  }
+  return out;
+}
+
+void ReferenceProcessor::Outline(cv::Mat& bgr, int thickness) {
+  if (bgr.empty() || bgr.type() != CV_8UC3) return;
+  thickness = ClampInt(thickness, 1, 5);
+
+  // Edge: any 4-connected neighbour differs by >= 35 luminance or >= 40 RGB distance.
+  cv::Mat edges(bgr.size(), CV_8UC1, cv::Scalar(0));
+  for (int y = 0; y < bgr.rows; ++y) {
+    for (int x = 0; x < bgr.cols; ++x) {
+      const cv::Vec3b& c = bgr.at<cv::Vec3b>(y, x);
+      const bool edge = (x + 1 < bgr.cols && Differs(c, bgr.at<cv::Vec3b>(y, x + 1))) ||
+                        (y + 1 < bgr.rows && Differs(c, bgr.at<cv::Vec3b>(y + 1, x))) ||
+                        (x > 0 && Differs(c, bgr.at<cv::Vec3b>(y, x - 1))) ||
+                        (y > 0 && Differs(c, bgr.at<cv::Vec3b>(y - 1, x)));
+      edges.at<uchar>(y, x) = edge ? 255 : 0;
+    }
+  }
+
+  if (thickness == 1) {
+    cv::morphologyEx(edges, edges, cv::MORPH_OPEN, cv::getStructuringElement(cv::MORPH_CROSS, cv::Size(3, 3)));
+  } else {
+    const int k = 2 * thickness + 1;
+    cv::dilate(edges, edges, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(k, k)));
+  }
+
+  // Brightness-adaptive darkening under the mask.
+  for (int y = 0; y < bgr.rows; ++y) {
+    for (int x = 0; x < bgr.cols; ++x) {
+      if (edges.at<uchar>(y, x) <= 128) continue;
+      cv::Vec3b& px = bgr.at<cv::Vec3b>(y, x);
+      const int brightness = (px[0] + px[1] + px[2]) / 3;
+      const int darken = brightness < 64 ? 40 : (brightness > 192 ? 90 : 70);
+      for (int c = 0; c < 3; ++c) px[c] = static_cast<uchar>(std::max(0, px[c] - darken));
+    }
+  }
+}
+
+cv::Mat ReferenceProcessor::BuildBlockColorImage(const cv::Mat& inputBgr, const Params& params) {
+  const int bs = ClampInt(params.blockSize, 1, 256);
+  if (params.preBlur) return BlurredBlockMean(inputBgr, bs, PixelArtProcessor::PreBlurKernelSize(params.blockSize));
+  return BlockMean(inputBgr, bs);
+}
+
+std::shared_ptr<const Palette> ReferenceProcessor::ExtractPalette(const cv::Mat& smallBgr, const Params& params) {
+  if (params.palettePreset == PixelArtProcessor::PalettePreset::Custom) {
+    return KMeansPalette(smallBgr, params.paletteSize, params.kmeansSeed);
+  }
+  const Palette* fixed = PixelArtProcessor::ResolvePalette(params);
+  if (!fixed) return {};
+  return std::shared_ptr<const Palette>(std::shared_ptr<const Palette>(), fixed);
+}
+
+cv::Mat ReferenceProcessor::ApplyPaletteIndices(const cv::Mat& smallBgr, const Palette& palette,
+                                                const Params& params) {
+  if (!params.dither) return NearestIndices(smallBgr, palette);
+  if (params.ditherMethod == PixelArtProcessor::DitherMethod::FloydSteinberg) {
+    return FloydSteinbergIndices(smallBgr, palette, params.ditherSerpentine);
+  }
+  return PixelArtProcessor::QuantizeWithPaletteOrdered(smallBgr, palette, params.ditherMethod);
+}
+
+cv::Mat ReferenceProcessor::ExpandAndPostProcess(const cv::Mat& quantizedSmallBgr, const cv::Size& outSize,
+                                                 const Params& params) {
+  cv::Mat out = ExpandBlocks(quantizedSmallBgr, outSize, params.blockSize);
+  if (out.empty()) return out;
+  if (params.edgeEnhance) PixelArtProcessor::ApplyEdgeEnhancementInPlace(out, 0.7f);
+  if (params.outline) Outline(out, params.outlineThickness);
+  return out;
+}
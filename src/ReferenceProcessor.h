@@ -0,0 +1,53 @@
+#pragma once
+
+#include "PixelArtProcessor.h"
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <memory>
+
+// ReferenceProcessor: the straightforward scalar version of every PixelArtProcessor stage.
+// Why this exists:
+// - The optimised kernels (BlockKernels, PaletteLUT, ErrorDiffusion, OutlineKernels, the
+//   block grid) promise bit-identical output, or a bounded difference where a change was
+//   intentional (fused pre-blur, the histogram K-means). These implementations are what they
+//   are checked against (RegressionCheck, `fpw_batch --verify`).
+// - Selecting PixelArtProcessor::Backend::Reference at runtime (FPW_BACKEND=reference, or
+//   `fpw_batch --backend reference`) routes the stage entry points here, to A/B a suspicious
+//   result without a rebuild.
+//
+// Clarity over speed, and no code shared with the kernels under test: per-block cv::mean after
+// a full-resolution GaussianBlur, cv::kmeans, brute-force nearest-color search, a whole-image
+// error buffer for Floyd-Steinberg, one ROI fill per block, the per-pixel outline test.
+// Ordered dithering and the unsharp mask have no separate fast path and are shared.
+class ReferenceProcessor {
+public:
+  using Params = PixelArtProcessor::Params;
+
+  // ---- Kernels ----
+  // Per-block cv::mean (truncated to 8 bits); ceil(w/N) × ceil(h/N).
+  static cv::Mat BlockMean(const cv::Mat& srcBgr, int blockSize);
+  // BlockMean of GaussianBlur(src, ksize × ksize, BORDER_DEFAULT).
+  static cv::Mat BlurredBlockMean(const cv::Mat& srcBgr, int blockSize, int ksize);
+  // cv::kmeans (k-means++ seeding from `seed`, 3 attempts) over the block colors in Lab.
+  static std::shared_ptr<const Palette> KMeansPalette(const cv::Mat& smallBgr, int paletteSize, uint32_t seed);
+  // Nearest palette index per pixel by exhaustive search in the palette's preferred metric
+  // (squared distance, lowest index wins ties).
+  static cv::Mat NearestIndices(const cv::Mat& smallBgr, const Palette& palette);
+  // Floyd-Steinberg in RGB with the pending error kept in a float image (plus the error
+  // carried along the row), exhaustive nearest search per pixel.
+  static cv::Mat FloydSteinbergIndices(const cv::Mat& smallBgr, const Palette& palette, bool serpentine);
+  // One ROI fill per block; output not covered by the blocks is black.
+  static cv::Mat ExpandBlocks(const cv::Mat& smallBgr, const cv::Size& outSize, int blockSize);
+  // Per-pixel outline: 4-neighbour luminance / RGB distance test, morphology, darkening.
+  static void Outline(cv::Mat& bgr, int thickness);
+
+  // ---- Stages (same contracts as the PixelArtProcessor functions of the same name) ----
+  static cv::Mat BuildBlockColorImage(const cv::Mat& inputBgr, const Params& params);
+  static std::shared_ptr<const Palette> ExtractPalette(const cv::Mat& smallBgr, const Params& params);
+  static cv::Mat ApplyPaletteIndices(const cv::Mat& smallBgr, const Palette& palette, const Params& params);
+  // Expansion, then edge enhancement and outline on the full-resolution image.
+  static cv::Mat ExpandAndPostProcess(const cv::Mat& quantizedSmallBgr, const cv::Size& outSize,
+                                      const Params& params);
+};
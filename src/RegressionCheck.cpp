@@ -0,0 +1,155 @@
+#include "RegressionCheck.h"
+
+#include "BlockKernels.h"
+#include "GpuProcessor.h"
+#include "IndexedImage.h"
+#include "PaletteRegistry.h"
+#include "ReferenceProcessor.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <utility>
+
+namespace {
+using PAP = PixelArtProcessor;
+using Ref = ReferenceProcessor;
+
+cv::Mat Colors(const cv::Mat& indices, const Palette& palette) {
+  return indices.empty() ? cv::Mat() : IndexedImage::ToBGR(indices, palette.Colors());
+}
+} // namespace
+
+RegressionCheck::Result RegressionCheck::Compare(const std::string& check, const cv::Mat& reference,
+                                                 const cv::Mat& optimized, int tolerance) {
+  Result r;
+  r.check = check;
+  r.tolerance = tolerance;
+  if (reference.empty() || reference.size() != optimized.size() || reference.type() != optimized.type()) {
+    r.sameSize = false;
+    return r;
+  }
+
+  cv::Mat diff;
+  cv::absdiff(reference, optimized, diff);
+  const int total = diff.rows * diff.cols;
+  const cv::Mat perChannel = diff.reshape(1, total); // one row per pixel
+  double maxVal = 0.0;
+  cv::minMaxLoc(perChannel, nullptr, &maxVal);
+  r.maxDelta = static_cast<int>(maxVal);
+  if (r.maxDelta == 0) {
+    r.psnr = std::numeric_limits<double>::infinity();
+    return r;
+  }
+  cv::Mat perPixel;
+  cv::reduce(perChannel, perPixel, 1, cv::REDUCE_MAX);
+  r.differing = cv::countNonZero(perPixel);
+  const double mse = cv::norm(reference, optimized, cv::NORM_L2SQR) / (static_cast<double>(total) * diff.channels());
+  r.psnr = 10.0 * std::log10(255.0 * 255.0 / mse);
+  return r;
+}
+
+std::vector<RegressionCheck::Result> RegressionCheck::Run(const cv::Mat& inputBgr,
+                                                          const PixelArtProcessor::Params& params) {
+  std::vector<Result> results;
+  if (inputBgr.empty() || inputBgr.type() != CV_8UC3) return results;
+  const PAP::Params p = PAP::Normalize(params);
+  const int bs = p.blockSize;
+  const int ksize = PAP::PreBlurKernelSize(bs);
+  const cv::Size size = inputBgr.size();
+
+  // The optimised side; the reference side calls ReferenceProcessor directly.
+  PAP::BackendScope optimized(PAP::Backend::Optimized);
+
+  // Steps 1 + 2. The fused blur never rounds the blurred pixels: up to 1 LSB by design.
+  results.push_back(Compare("block mean", Ref::BlockMean(inputBgr, bs), PAP::BuildBlockColorImageBGR(inputBgr, bs), 0));
+  results.push_back(Compare("blur + block mean", Ref::BlurredBlockMean(inputBgr, bs, ksize),
+                            BlockKernels::BlurredBlockMeanBGR(inputBgr, bs, ksize), 1));
+  const cv::Mat small = PAP::BuildBlockColorImage(inputBgr, p);
+  if (small.empty()) return results;
+
+  // Step 3a: the histogram clusterer replaced cv::kmeans; palettes differ by design.
+  const std::shared_ptr<const Palette> kmeans = PAP::ExtractKMeansPalette(small, p.paletteSize, p.kmeansSeed);
+  const std::shared_ptr<const Palette> refKmeans = Ref::KMeansPalette(small, p.paletteSize, p.kmeansSeed);
+  if (kmeans && refKmeans) {
+    results.push_back(Compare("k-means palette", Colors(Ref::NearestIndices(small, *refKmeans), *refKmeans),
+                              Colors(PAP::QuantizeWithPalette(small, *kmeans), *kmeans), kReportOnly));
+  }
+
+  // Step 3b on every built-in palette plus the K-means one (Lab metric).
+  std::vector<std::pair<std::string, const Palette*>> palettes;
+  for (int id = 0; id < PaletteRegistry::BuiltinCount(); ++id) {
+    const Palette* palette = PaletteRegistry::Get(id);
+    if (palette) palettes.emplace_back(palette->Name(), palette);
+  }
+  if (kmeans) palettes.emplace_back("k-means", kmeans.get());
+  for (const auto& entry : palettes) {
+    const Palette& palette = *entry.second;
+    results.push_back(Compare("nearest " + entry.first, Colors(Ref::NearestIndices(small, palette), palette),
+                              Colors(PAP::QuantizeWithPalette(small, palette), palette), 0));
+    results.push_back(Compare("fs " + entry.first, Colors(Ref::FloydSteinbergIndices(small, palette, false), palette),
+                              Colors(PAP::QuantizeWithPaletteDither(small, palette, false), palette), 0));
+    results.push_back(Compare("fs serpentine " + entry.first,
+                              Colors(Ref::FloydSteinbergIndices(small, palette, true), palette),
+                              Colors(PAP::QuantizeWithPaletteDither(small, palette, true), palette), 0));
+  }
+
+  // Steps 4-6 on one quantized image: plain expansion, then every post-processing combination
+  // through both the BGR and the palette-index block grid.
+  PAP::Params pico = p;
+  pico.palettePreset = PAP::PalettePreset::Pico8;
+  const Palette* picoPalette = PAP::ResolvePalette(pico);
+  if (!picoPalette) return results;
+  const IndexedImage quantized{PAP::QuantizeWithPalette(small, *picoPalette), picoPalette->Colors()};
+  const cv::Mat quantizedBgr = quantized.ToBGR();
+  const cv::Mat expanded = Ref::ExpandBlocks(quantizedBgr, size, bs);
+  results.push_back(Compare("expand", expanded, PAP::ExpandBlocksBGR(quantizedBgr, size, bs), 0));
+  results.push_back(Compare("expand indexed", expanded,
+                            IndexedImage::ToBGR(BlockKernels::ExpandBlocksIndexed(quantized.indices, size, bs),
+                                                quantized.colors), 0));
+
+  struct Post { const char* name; bool edge; int outline; };
+  const Post kPosts[] = {
+    {"edge", true, 0}, {"outline1", false, 1}, {"outline2", false, 2}, {"edge+outline1", true, 1},
+  };
+  for (const Post& post : kPosts) {
+    PAP::Params pp = p;
+    pp.edgeEnhance = post.edge;
+    pp.outline = post.outline > 0;
+    pp.outlineThickness = std::max(1, post.outline);
+    const cv::Mat ref = Ref::ExpandAndPostProcess(quantizedBgr, size, pp);
+    results.push_back(Compare(std::string("post ") + post.name, ref, PAP::ExpandAndPostProcess(quantizedBgr, size, pp), 0));
+    IndexedImage outIndexed;
+    cv::Mat outBgr;
+    PAP::ExpandAndPostProcess(quantized, size, pp, true, outIndexed, outBgr);
+    results.push_back(Compare(std::string("post indexed ") + post.name, ref,
+                              outIndexed.empty() ? outBgr : outIndexed.ToBGR(), 0));
+  }
+
+  // The whole pipeline with the caller's params: exact unless it includes a stage that
+  // differs by design.
+  const bool intended = p.preBlur || p.palettePreset == PAP::PalettePreset::Custom;
+  const cv::Mat optimizedOut = PAP::Process(inputBgr, p);
+  cv::Mat referenceOut;
+  {
+    PAP::BackendScope reference(PAP::Backend::Reference);
+    referenceOut = PAP::Process(inputBgr, p);
+  }
+  results.push_back(Compare("process", referenceOut, optimizedOut, intended ? kReportOnly : 0));
+
+  // The OpenCL path against the CPU result, when there is a device: exact unless OpenCV's
+  // OpenCL filters round differently from the CPU ones (pre-blur, edge enhancement).
+  if (GpuProcessor::Available()) {
+    cv::UMat deviceInput, deviceOut;
+    std::string err;
+    cv::Mat gpuOut;
+    if (GpuProcessor::Upload(inputBgr, deviceInput, err) && GpuProcessor::Process(deviceInput, p, deviceOut, err)) {
+      deviceOut.copyTo(gpuOut);
+    }
+    results.push_back(Compare("gpu process", optimizedOut, gpuOut, p.preBlur || p.edgeEnhance ? kReportOnly : 0));
+  }
+  return results;
+}
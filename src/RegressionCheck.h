@@ -0,0 +1,48 @@
+#pragma once
+
+#include "PixelArtProcessor.h"
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// RegressionCheck: runs every optimised stage next to its ReferenceProcessor counterpart on one
+// image and compares the outputs.
+// Why this exists:
+// - The kernels promise bit-identical results (block mean, nearest-color LUT, wavefront
+//   Floyd-Steinberg, block expansion, the block-grid post-processing, the vectorised outline);
+//   an optimisation that breaks that should fail loudly on real images, not show up as a
+//   user report weeks later.
+// - Where a difference is intended (fused pre-blur: <= 1 LSB; histogram K-means vs
+//   cv::kmeans; the whole pipeline, which inherits both) the check reports max delta and PSNR
+//   instead of failing.
+// - Each stage gets the same input on both sides (the optimised output of the stage before),
+//   so a failure names the stage that diverged.
+//
+// Driven by `fpw_batch --verify` over any set of images (the corpus).
+class RegressionCheck {
+public:
+  static constexpr int kReportOnly = -1;
+
+  struct Result {
+    std::string check;    // e.g. "nearest nes", "fs serpentine pico8", "post edge+outline1"
+    int tolerance = 0;    // largest per-channel difference allowed; kReportOnly: never fails
+    bool sameSize = true; // both sides produced an image of the same size and type
+    int64_t differing = 0; // pixels with any channel different
+    int maxDelta = 0;     // largest per-channel difference
+    double psnr = 0.0;    // dB; infinity when identical
+
+    bool Passed() const { return sameSize && (tolerance == kReportOnly || maxDelta <= tolerance); }
+  };
+
+  // All checks for one BGR image. `params` supplies the block size, pre-blur, K-means palette
+  // size / seed and the full-pipeline settings; the per-stage checks sweep every palette
+  // preset, dither mode and post-processing combination themselves.
+  static std::vector<Result> Run(const cv::Mat& inputBgr, const PixelArtProcessor::Params& params);
+
+  // Compares two images (any type, compared per channel).
+  static Result Compare(const std::string& check, const cv::Mat& reference, const cv::Mat& optimized,
+                        int tolerance);
+};
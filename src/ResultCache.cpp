@@ -0,0 +1,288 @@
+#include "ResultCache.h"
+
+#include "MappedFile.h"
+#include "ParamsFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr uint64_t kP1 = 0x9FB21C651E98DF25ull;
+constexpr uint64_t kP2 = 0xFF51AFD7ED558CCDull;
+
+inline uint64_t Rotl(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+// Final avalanche (MurmurHash3's fmix64).
+inline uint64_t Mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDull;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+// Temporary files older than this are left over from a crashed or killed store (writing one
+// entry takes seconds), not one in flight: Trim deletes them.
+constexpr std::chrono::hours kStaleTempAge{1};
+
+std::string Hex(const ResultCache::Digest& d) {
+  char buf[33];
+  std::snprintf(buf, sizeof(buf), "%016llx%016llx", static_cast<unsigned long long>(d.hi),
+                static_cast<unsigned long long>(d.lo));
+  return buf;
+}
+} // namespace
+
+ResultCache::Hasher::Hasher() : a_(0x9E3779B97F4A7C15ull), b_(0xC2B2AE3D27D4EB4Full) {}
+
+// Two independent multiply-rotate lanes over alternating words: the multiplies of one lane
+// overlap with the other's, so hashing runs at several GB/s (well ahead of any decoder).
+void ResultCache::Hasher::Word(uint64_t w) {
+  if (odd_) {
+    b_ = Rotl(b_ ^ w, 31) * kP2;
+  } else {
+    a_ = Rotl(a_ ^ w, 29) * kP1;
+  }
+  odd_ = !odd_;
+}
+
+void ResultCache::Hasher::Update(const void* data, size_t size) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  total_ += size;
+  if (tailSize_ > 0) {
+    const size_t n = std::min(size, sizeof(tail_) - tailSize_);
+    std::memcpy(tail_ + tailSize_, p, n);
+    tailSize_ += n;
+    p += n;
+    size -= n;
+    if (tailSize_ < sizeof(tail_)) return;
+    uint64_t w;
+    std::memcpy(&w, tail_, sizeof(w));
+    Word(w);
+    tailSize_ = 0;
+  }
+  for (; size >= 8; p += 8, size -= 8) {
+    uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    Word(w);
+  }
+  std::memcpy(tail_, p, size);
+  tailSize_ = size;
+}
+
+ResultCache::Digest ResultCache::Hasher::Finish() const {
+  Hasher h = *this;
+  if (h.tailSize_ > 0) {
+    uint64_t w = 0;
+    std::memcpy(&w, h.tail_, h.tailSize_);
+    h.Word(w);
+  }
+  Digest d;
+  d.lo = Mix(h.a_ ^ Rotl(h.b_, 17) ^ total_);
+  d.hi = Mix(h.b_ + h.a_ * kP1 + total_ * kP2);
+  return d;
+}
+
+bool ResultCache::Open(const std::string& dir, std::string& outError) {
+  outError.clear();
+  std::error_code ec;
+  fs::create_directories(dir, ec);
+  if (ec || !fs::is_directory(dir, ec)) {
+    outError = "Cannot create cache directory " + dir + (ec ? ": " + ec.message() : std::string());
+    return false;
+  }
+  dir_ = dir;
+  return true;
+}
+
+ResultCache::Digest ResultCache::Hash(const void* data, size_t size) {
+  Hasher h;
+  h.Update(data, size);
+  return h.Finish();
+}
+
+bool ResultCache::HashFile(const std::string& path, Digest& outDigest, std::string& outError) {
+  MappedFile file;
+  if (!file.Open(path, outError)) return false;
+  outDigest = Hash(file.data(), file.size());
+  return true;
+}
+
+ResultCache::Digest ResultCache::HashImage(const cv::Mat& image) {
+  Hasher h;
+  const int header[3] = {image.rows, image.cols, image.type()};
+  h.Update(header, sizeof(header));
+  const size_t rowBytes = static_cast<size_t>(image.cols) * image.elemSize();
+  if (image.isContinuous()) {
+    h.Update(image.data, rowBytes * static_cast<size_t>(image.rows));
+  } else {
+    for (int y = 0; y < image.rows; ++y) h.Update(image.ptr(y), rowBytes);
+  }
+  return h.Finish();
+}
+
+std::string ResultCache::Key(const Digest& input, const PixelArtProcessor::Params& params,
+                             const std::string& format) {
+  const std::string header = "fpw result v" + std::to_string(kVersion) + "\nbackend = " +
+                             PixelArtProcessor::BackendName(PixelArtProcessor::ActiveBackend()) + "\n" +
+                             ParamsFile::ToText(PixelArtProcessor::Normalize(params)) + "format = " + format + "\n";
+  Hasher h;
+  h.Update(header.data(), header.size());
+  h.Update(&input.lo, sizeof(input.lo));
+  h.Update(&input.hi, sizeof(input.hi));
+  return Hex(h.Finish());
+}
+
+std::string ResultCache::EntryPath(const std::string& key) const {
+  return (fs::path(dir_) / key.substr(0, 2) / key).string();
+}
+
+std::string ResultCache::TempPath(const std::string& key, const char* ext) {
+  // Unique across threads (counter) and across processes sharing the directory (clock).
+  const uint64_t n = tempCounter_.fetch_add(1);
+  const auto now = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+  char suffix[64];
+  std::snprintf(suffix, sizeof(suffix), ".%llx.%llx.tmp%s", static_cast<unsigned long long>(now),
+                static_cast<unsigned long long>(n), ext);
+  return EntryPath(key) + suffix;
+}
+
+bool ResultCache::Commit(const std::string& tmpPath, const std::string& key, std::string& outError) {
+  std::error_code ec;
+  const auto size = fs::file_size(tmpPath, ec);
+  if (!ec) fs::rename(tmpPath, EntryPath(key), ec);
+  if (ec) {
+    outError = "Cannot store cache entry " + key + ": " + ec.message();
+    fs::remove(tmpPath, ec);
+    return false;
+  }
+  stores_.fetch_add(1, std::memory_order_relaxed);
+  bytesStored_.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+  return true;
+}
+
+bool ResultCache::Lookup(const std::string& key, std::string& outPath) {
+  if (!IsOpen()) return false;
+  const std::string path = EntryPath(key);
+  std::error_code ec;
+  const auto size = fs::file_size(path, ec);
+  if (ec) {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec); // LRU; best effort
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  bytesServed_.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+  outPath = path;
+  return true;
+}
+
+bool ResultCache::Fetch(const std::string& key, const std::string& destPath) {
+  std::string path;
+  if (!Lookup(key, path)) return false;
+  std::error_code ec;
+  fs::copy_file(path, destPath, fs::copy_options::overwrite_existing, ec);
+  if (ec) {
+    // Evicted (or unreadable) in the meantime: the caller runs the pipeline after all.
+    hits_.fetch_sub(1, std::memory_order_relaxed);
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+bool ResultCache::Store(const std::string& key, const std::string& srcPath, std::string& outError) {
+  outError.clear();
+  if (!IsOpen()) return false;
+  std::error_code ec;
+  fs::create_directories(fs::path(EntryPath(key)).parent_path(), ec);
+  const std::string tmp = TempPath(key, "");
+  fs::copy_file(srcPath, tmp, fs::copy_options::overwrite_existing, ec);
+  if (ec) {
+    outError = "Cannot copy " + srcPath + " into the cache: " + ec.message();
+    fs::remove(tmp, ec);
+    return false;
+  }
+  return Commit(tmp, key, outError);
+}
+
+std::string ResultCache::BeginStore(const std::string& key, const char* ext) {
+  std::error_code ec;
+  fs::create_directories(fs::path(EntryPath(key)).parent_path(), ec);
+  return TempPath(key, ext);
+}
+
+bool ResultCache::EndStore(const std::string& tmpPath, bool written, std::string& outError) {
+  outError.clear();
+  std::error_code ec;
+  if (!written || !IsOpen()) {
+    fs::remove(tmpPath, ec);
+    return false;
+  }
+  // TempPath names are "<key>.<clock>.<counter>.tmp<ext>".
+  const std::string name = fs::path(tmpPath).filename().string();
+  return Commit(tmpPath, name.substr(0, name.find('.')), outError);
+}
+
+int ResultCache::Trim(uint64_t maxBytes) {
+  if (!IsOpen()) return 0;
+  std::vector<std::tuple<fs::file_time_type, uint64_t, fs::path>> entries;
+  std::vector<fs::path> staleTemps;
+  uint64_t total = 0;
+  std::error_code ec;
+  const fs::file_time_type now = fs::file_time_type::clock::now();
+  for (fs::recursive_directory_iterator it(dir_, ec), end; !ec && it != end; it.increment(ec)) {
+    if (!it->is_regular_file(ec)) continue;
+    const uint64_t size = it->file_size(ec);
+    const fs::file_time_type time = it->last_write_time(ec);
+    if (ec) {
+      ec.clear();
+      continue;
+    }
+    if (it->path().filename().string().find(".tmp") != std::string::npos) {
+      // A recent temporary file is a store still writing it (here or in another process):
+      // evicting it would fail that store. Old ones are leftovers and always go.
+      if (now - time > kStaleTempAge) staleTemps.push_back(it->path());
+      continue;
+    }
+    entries.emplace_back(time, size, it->path());
+    total += size;
+  }
+  int removed = 0;
+  for (const fs::path& path : staleTemps) {
+    if (fs::remove(path, ec)) ++removed;
+  }
+  if (total <= maxBytes) return removed;
+
+  std::sort(entries.begin(), entries.end(),
+            [](const auto& a, const auto& b) { return std::get<0>(a) < std::get<0>(b); });
+  for (const auto& e : entries) {
+    if (total <= maxBytes) break;
+    if (fs::remove(std::get<2>(e), ec)) {
+      total -= std::get<1>(e);
+      ++removed;
+    }
+  }
+  return removed;
+}
+
+ResultCache::Stats ResultCache::GetStats() const {
+  Stats s;
+  s.hits = hits_.load(std::memory_order_relaxed);
+  s.misses = misses_.load(std::memory_order_relaxed);
+  s.stores = stores_.load(std::memory_order_relaxed);
+  s.bytesServed = static_cast<double>(bytesServed_.load(std::memory_order_relaxed));
+  s.bytesStored = static_cast<double>(bytesStored_.load(std::memory_order_relaxed));
+  return s;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "PixelArtProcessor.h"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ResultCache: on-disk, content-addressed store of pipeline results.
+// Why this exists:
+// - Batch jobs re-run the same asset folders with the same params whenever a few files are
+//   added; every unchanged asset was decoded, pixelized and encoded again.
+// - An entry is keyed by a 128-bit hash of the input bytes, the normalized params
+//   (ParamsFile::ToText, user palettes by value), kVersion, the processing backend and the
+//   output format, so a hit is the exact file the pipeline would have written: fpw_batch
+//   copies it to the output and skips the image entirely; the GUI decodes it instead of
+//   running the pipeline.
+//
+// Layout: <dir>/<first two hex digits>/<32 hex digits>, one file per entry. Entries are
+// written to a temporary file and renamed into place, so concurrent writers (batch workers,
+// a GUI and a batch run sharing a directory) never expose a partial file. Hits refresh the
+// entry's modification time; Trim evicts by it (least recently used first).
+//
+// Hashing is deliberately not cryptographic: the cache trusts its directory.
+// Thread-safe after Open.
+class ResultCache {
+public:
+  // Bump whenever a change alters the output of any stage for the same input and params
+  // (new rounding, a different palette table, ...): old entries then simply stop matching.
+  // 2: built-in palettes converted from RGB tables to BGR (they were channel-swapped).
+  static constexpr int kVersion = 2;
+
+  struct Digest {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+  };
+
+  // Incremental Digest over any byte sequence.
+  class Hasher {
+  public:
+    Hasher();
+    void Update(const void* data, size_t size);
+    Digest Finish() const;
+
+  private:
+    void Word(uint64_t w);
+
+    uint64_t a_;
+    uint64_t b_;
+    uint64_t total_ = 0;
+    uint8_t tail_[8] = {};
+    size_t tailSize_ = 0;
+    bool odd_ = false; // the lane the next word goes to
+  };
+
+  struct Stats {
+    int64_t hits = 0;
+    int64_t misses = 0;
+    int64_t stores = 0;
+    double bytesServed = 0.0; // entry bytes handed out on hits
+    double bytesStored = 0.0;
+  };
+
+  ResultCache() = default;
+  ResultCache(const ResultCache&) = delete;
+  ResultCache& operator=(const ResultCache&) = delete;
+
+  // Uses `dir` for entries, creating it if missing. Not thread-safe; call before sharing.
+  bool Open(const std::string& dir, std::string& outError);
+  bool IsOpen() const { return !dir_.empty(); }
+  const std::string& Dir() const { return dir_; }
+
+  static Digest Hash(const void* data, size_t size);
+  // Digest of a file's bytes (memory mapped).
+  static bool HashFile(const std::string& path, Digest& outDigest, std::string& outError);
+  // Digest of an image's size, type and pixels (ROIs hashed row by row).
+  static Digest HashImage(const cv::Mat& image);
+  // Entry key of `input` processed with `params` (normalized here) into `format`, a caller
+  // string naming everything else that changes the bytes (extension, encoder options, ...).
+  static std::string Key(const Digest& input, const PixelArtProcessor::Params& params, const std::string& format);
+
+  // Path of the entry for `key` if there is one (refreshed for LRU). Counts a hit or miss.
+  bool Lookup(const std::string& key, std::string& outPath);
+  // Lookup, then copies the entry to `destPath` (overwriting it).
+  bool Fetch(const std::string& key, const std::string& destPath);
+  // Copies the file at `srcPath` in as the entry for `key`.
+  bool Store(const std::string& key, const std::string& srcPath, std::string& outError);
+  // Two-step store for callers that write the entry file themselves (e.g. on an encoder
+  // thread): BeginStore returns a fresh temporary path for the entry of `key`, ending in `ext`
+  // (its directory created); EndStore then renames it into place, or removes it when
+  // `written` is false.
+  std::string BeginStore(const std::string& key, const char* ext);
+  bool EndStore(const std::string& tmpPath, bool written, std::string& outError);
+
+  // Evicts least recently used entries until at most `maxBytes` remain, and deletes temporary
+  // files left by interrupted stores (older than an hour; newer ones are stores in progress,
+  // here or in another process). Returns files removed.
+  int Trim(uint64_t maxBytes);
+
+  Stats GetStats() const;
+
+private:
+  std::string EntryPath(const std::string& key) const;
+  // A fresh temporary path next to the entry for `key`, ending in `ext`.
+  std::string TempPath(const std::string& key, const char* ext);
+  // Renames `tmpPath` into place as the entry for `key` and counts the store.
+  bool Commit(const std::string& tmpPath, const std::string& key, std::string& outError);
+
+  std::string dir_;
+  std::atomic<uint64_t> tempCounter_{0};
+  std::atomic<int64_t> hits_{0};
+  std::atomic<int64_t> misses_{0};
+  std::atomic<int64_t> stores_{0};
+  std::atomic<int64_t> bytesServed_{0};
+  std::atomic<int64_t> bytesStored_{0};
+};
@@ -0,0 +1,602 @@
+#include "SequenceProcessor.h"
+
+#include "BlockKernels.h"
+#include "ImageLoader.h"
+#include "IndexedCodec.h"
+#include "OutlineKernels.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+namespace fs = std::filesystem;
+
+namespace {
+inline bool IsCancelled(const std::atomic<bool>* cancel) {
+  return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+std::string LowerExtension(const std::string& path) {
+  std::string ext = fs::path(path).extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return ext;
+}
+
+bool IsVideoExtension(const std::string& ext) {
+  return ext == ".avi" || ext == ".mp4" || ext == ".mkv" || ext == ".mov";
+}
+
+// Sequential frame reader over the three input kinds. Sheets and imreadmulti GIFs are held
+// as whole frame lists (random access); videos stream through cv::VideoCapture.
+class FrameSource {
+public:
+  bool Open(const std::string& path, const SequenceProcessor::Options& options, std::string& outError) {
+    path_ = path;
+    next_ = 0;
+    frames_.clear();
+    if (options.sheetColumns > 0) {
+      cv::Mat sheet;
+      if (!ImageLoader::LoadBGR(path, sheet, outError)) return false;
+      const int rows = std::max(1, options.sheetRows);
+      const int cellW = sheet.cols / options.sheetColumns;
+      const int cellH = sheet.rows / rows;
+      if (cellW <= 0 || cellH <= 0) {
+        outError = "Sprite sheet is smaller than its " + std::to_string(options.sheetColumns) + " x " +
+                   std::to_string(rows) + " grid";
+        return false;
+      }
+      const int cells = options.sheetColumns * rows;
+      const int used = options.sheetFrames > 0 ? std::min(options.sheetFrames, cells) : cells;
+      // Cells are views into the sheet: nothing is copied.
+      for (int i = 0; i < used; ++i) {
+        frames_.push_back(sheet(cv::Rect((i % options.sheetColumns) * cellW, (i / options.sheetColumns) * cellH,
+                                         cellW, cellH)));
+      }
+      return true;
+    }
+    if (OpenCapture()) return true;
+    // Not every OpenCV build reads GIF through VideoCapture; imgcodecs may.
+    if (LowerExtension(path) == ".gif") {
+      try {
+        cv::imreadmulti(path, frames_, cv::IMREAD_COLOR);
+      } catch (const cv::Exception&) {
+        frames_.clear();
+      }
+      if (!frames_.empty()) return true;
+    }
+    outError = "Cannot open frame sequence: " + path;
+    return false;
+  }
+
+  bool Next(cv::Mat& frame) {
+    if (capture_.isOpened()) {
+      // VideoCapture converts to 8-bit BGR by default (CAP_PROP_CONVERT_RGB).
+      return capture_.read(frame) && !frame.empty() && frame.type() == CV_8UC3;
+    }
+    if (next_ >= frames_.size()) return false;
+    frame = frames_[next_++];
+    return true;
+  }
+
+  // Frame `index` for palette sampling; the sequential position is restarted afterwards by
+  // Rewind(). False if the source cannot seek.
+  bool ReadAt(int index, cv::Mat& frame) {
+    if (!capture_.isOpened()) {
+      if (index < 0 || static_cast<size_t>(index) >= frames_.size()) return false;
+      frame = frames_[static_cast<size_t>(index)];
+      return true;
+    }
+    return capture_.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(index)) && Next(frame);
+  }
+
+  bool Rewind() {
+    next_ = 0;
+    return !capture_.isOpened() || OpenCapture();
+  }
+
+  // -1 if unknown (some streams do not report it).
+  int FrameCount() const {
+    if (!capture_.isOpened()) return static_cast<int>(frames_.size());
+    const double n = capture_.get(cv::CAP_PROP_FRAME_COUNT);
+    return n >= 1.0 ? static_cast<int>(n) : -1;
+  }
+
+  double Fps() const { return capture_.isOpened() ? capture_.get(cv::CAP_PROP_FPS) : 0.0; }
+
+private:
+  bool OpenCapture() {
+    capture_.release();
+    try {
+      capture_.open(path_);
+    } catch (const cv::Exception&) {
+      capture_.release();
+    }
+    return capture_.isOpened();
+  }
+
+  std::string path_;
+  cv::VideoCapture capture_;
+  std::vector<cv::Mat> frames_;
+  size_t next_ = 0;
+};
+
+// One frame after the parallel stage: the part of the output that changed.
+struct FrameResult {
+  bool unchanged = false;
+  cv::Rect rect;        // output pixels covered by image (the whole frame for the first one)
+  IndexedImage indexed; // the pixels of `rect`, indexed when the result fits 256 colors ...
+  cv::Mat bgr;          // ... otherwise true color
+  std::vector<uint8_t> gifFrame; // GIF output: the encoded frame
+};
+
+enum class OutputKind { Gif, Video, Sheet, Frames };
+
+class Pipeline {
+public:
+  Pipeline(const PixelArtProcessor::Params& params, const SequenceProcessor::Options& options,
+           const std::string& outputPath, OutputKind kind, cv::Size inputFrame, double sourceFps)
+      : p_(params), options_(options), outputPath_(outputPath), kind_(kind), inputFrame_(inputFrame) {
+    const int bs = p_.blockSize;
+    blocksW_ = (inputFrame.width + bs - 1) / bs;
+    blocksH_ = (inputFrame.height + bs - 1) / bs;
+    native_ = PixelArtProcessor::OutputIsNative(p_);
+    outputFrame_ = native_ ? cv::Size(blocksW_, blocksH_) : inputFrame;
+    blockPx_ = native_ ? 1 : bs;
+    delayMs_ = options.frameDelayMs > 0 ? options.frameDelayMs
+                                        : (sourceFps > 0.5 ? static_cast<int>(1000.0 / sourceFps + 0.5) : 100);
+  }
+
+  // The palette every frame uses (Shared mode / fixed presets); null for WarmStart.
+  void SetSharedPalette(std::shared_ptr<const Palette> palette) {
+    shared_ = std::move(palette);
+    if (!shared_) return;
+    // The colors indexed results come back with: the palette plus the outline shades, when
+    // those fit (ApplyPixelArtOutlineIndexed extends the palette the same way).
+    gifColors_ = shared_->Colors();
+    std::vector<cv::Vec3b> extended;
+    std::vector<uchar> darkIndex;
+    if (p_.outline && OutlineKernels::DarkenedPalette(gifColors_, extended, darkIndex)) gifColors_ = extended;
+  }
+
+  bool Run(FrameSource& source, SequenceProcessor::Stats& stats, std::string& outError) {
+    const int hw = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    const int jobs = std::max(1, options_.jobs > 0 ? options_.jobs : hw);
+    // Parallelism is across frames; nested OpenCV threads would only oversubscribe.
+    const int prevCvThreads = cv::getNumThreads();
+    if (jobs > 1) cv::setNumThreads(1);
+
+    std::thread reader([&] { ReadLoop(source, jobs * 2); });
+    std::vector<std::thread> workers;
+    for (int j = 0; j < jobs; ++j) workers.emplace_back([&] { WorkerLoop(); });
+    reader.join();
+    for (std::thread& t : workers) t.join();
+    if (jobs > 1) cv::setNumThreads(prevCvThreads);
+
+    if (!failed_ && !Finish()) Fail(error_.empty() ? "Failed to write " + outputPath_ : error_);
+    stats = stats_;
+    stats.frameSize = inputFrame_;
+    if (failed_) {
+      outError = error_;
+      return false;
+    }
+    return true;
+  }
+
+private:
+  struct Job {
+    int index = 0;
+    cv::Mat frame;
+  };
+
+  void Fail(const std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!failed_) error_ = error;
+    failed_ = true;
+    changed_.notify_all();
+  }
+
+  void ReadLoop(FrameSource& source, size_t maxQueued) {
+    int index = 0;
+    cv::Mat frame;
+    while ((options_.maxFrames <= 0 || index < options_.maxFrames) && source.Next(frame)) {
+      if (frame.size() != inputFrame_) {
+        Fail("Frame " + std::to_string(index) + " has a different size than the first frame");
+        break;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      changed_.wait(lock, [&] { return queue_.size() < maxQueued || failed_; });
+      if (failed_) break;
+      queue_.push_back(Job{index++, frame.clone()});
+      changed_.notify_all();
+      if (IsCancelled(options_.cancel)) {
+        lock.unlock();
+        Fail("Cancelled");
+        break;
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    readerDone_ = true;
+    changed_.notify_all();
+  }
+
+  void WorkerLoop() {
+    for (;;) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [&] { return !queue_.empty() || readerDone_ || failed_; });
+        if (failed_ || queue_.empty()) return;
+        job = std::move(queue_.front());
+        queue_.pop_front();
+        changed_.notify_all();
+      }
+
+      // Steps 1 + 2 in parallel; the input frame is not needed afterwards.
+      const cv::Mat blocks = PixelArtProcessor::BuildBlockColorImage(job.frame, p_);
+      job.frame.release();
+      if (blocks.empty()) {
+        Fail("Block reduction failed");
+        return;
+      }
+
+      // Step 3 in frame order: the palette (and warm-start state) and the change detection
+      // depend on the previous frame.
+      IndexedImage quantized;
+      cv::Rect changedBlocks;
+      if (!WaitTurn(quantizeTurn_, job.index)) return;
+      const bool ok = Quantize(blocks, quantized, changedBlocks);
+      AdvanceTurn(quantizeTurn_);
+      if (!ok) return;
+
+      FrameResult result;
+      if (!ProcessFrame(quantized, changedBlocks, result)) return;
+
+      if (!WaitTurn(writeTurn_, job.index)) return;
+      const bool written = Write(result);
+      AdvanceTurn(writeTurn_);
+      if (!written) return;
+    }
+  }
+
+  bool WaitTurn(const int& turn, int index) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [&] { return turn == index || failed_; });
+    return !failed_;
+  }
+
+  void AdvanceTurn(int& turn) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++turn;
+    changed_.notify_all();
+  }
+
+  // Ordered stage: palette application and the changed block rectangle (empty: no change).
+  bool Quantize(const cv::Mat& blocks, IndexedImage& quantized, cv::Rect& changedBlocks) {
+    std::shared_ptr<const Palette> palette = shared_;
+    if (!palette) {
+      std::vector<cv::Vec3f> centers;
+      palette = PixelArtProcessor::ExtractPalette(blocks, p_, centersLab_.empty() ? nullptr : &centersLab_, &centers);
+      if (!centers.empty()) centersLab_ = std::move(centers);
+    }
+    if (!palette) {
+      Fail("Palette extraction failed");
+      return false;
+    }
+    quantized.indices = PixelArtProcessor::ApplyPaletteIndices(blocks, *palette, p_);
+    quantized.colors = palette->Colors();
+    if (quantized.empty()) {
+      Fail("Palette application failed");
+      return false;
+    }
+
+    // Compared by color: the output depends on block colors only (not on which palette index
+    // holds them), so this also holds for WarmStart palettes that change every frame.
+    cv::Mat colors = quantized.ToBGR();
+    changedBlocks = previousColors_.empty() ? cv::Rect(0, 0, blocksW_, blocksH_)
+                                            : PixelArtProcessor::DiffRect(previousColors_, colors);
+    previousColors_ = colors;
+    return true;
+  }
+
+  // Parallel stage: expansion + post-processing of the changed blocks (plus halo), then the
+  // per-frame part of the encoding.
+  bool ProcessFrame(const IndexedImage& quantized, const cv::Rect& changedBlocks, FrameResult& result) {
+    if (changedBlocks.area() == 0) {
+      result.unchanged = true;
+      return true;
+    }
+    if (native_) {
+      // One output pixel per block: no halo, the changed blocks are the changed output.
+      result.rect = changedBlocks;
+      result.indexed.indices = quantized.indices(changedBlocks).clone();
+      result.indexed.colors = quantized.colors;
+    } else if (!PixelArtProcessor::ExpandAndPostProcessRegion(quantized, changedBlocks, outputFrame_, p_, true,
+                                                              result.rect, result.indexed, result.bgr)) {
+      Fail("Block expansion failed");
+      return false;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.blocksReprocessed += static_cast<int64_t>((result.rect.width + blockPx_ - 1) / blockPx_) *
+                                  ((result.rect.height + blockPx_ - 1) / blockPx_);
+    }
+
+    if (kind_ == OutputKind::Gif) {
+      IndexedImage frame = result.indexed;
+      if (frame.empty() && !IndexedImage::FromBGR(result.bgr, frame)) {
+        Fail("GIF output needs at most 256 colors per frame (edge enhancement adds more); "
+             "write video or frames instead");
+        return false;
+      }
+      // gifColors_ is the global table (fixed before the workers start); anything else is local.
+      const bool local = frame.colors != gifColors_;
+      const int delayCs = std::max(2, (delayMs_ + 5) / 10);
+      if (!IndexedCodec::AppendGIFFrame(frame, result.rect.tl(), delayCs, local, result.gifFrame)) {
+        Fail("GIF frame encoding failed");
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Ordered stage: composite / write one frame.
+  bool Write(FrameResult& result) {
+    const int index = stats_.frames;
+    ++stats_.frames;
+    stats_.blocks += static_cast<int64_t>(blocksW_) * blocksH_;
+    if (result.unchanged) ++stats_.unchangedFrames;
+    if (IsCancelled(options_.cancel)) {
+      Fail("Cancelled");
+      return false;
+    }
+
+    if (kind_ == OutputKind::Gif) {
+      if (index == 0) {
+        // Without a shared palette every frame has a local table; the global one is a stub.
+        static const std::vector<cv::Vec3b> kStub = {cv::Vec3b(0, 0, 0), cv::Vec3b(255, 255, 255)};
+        std::vector<uint8_t> header;
+        gif_.open(outputPath_, std::ios::binary | std::ios::trunc);
+        if (!gif_ || !IndexedCodec::BeginGIF(outputFrame_, gifColors_.empty() ? kStub : gifColors_,
+                                             options_.loopCount, header)) {
+          Fail("Cannot create " + outputPath_);
+          return false;
+        }
+        WriteBytes(header);
+      }
+      // Each frame is held back until the next one: unchanged frames extend its delay.
+      if (result.unchanged) {
+        pendingDelayMs_ += delayMs_;
+        IndexedCodec::SetGIFFrameDelay(pendingGifFrame_, std::max(2, (pendingDelayMs_ + 5) / 10));
+        return true;
+      }
+      WriteBytes(pendingGifFrame_);
+      pendingGifFrame_ = std::move(result.gifFrame);
+      pendingDelayMs_ = delayMs_;
+      return static_cast<bool>(gif_);
+    }
+
+    // Whole-frame outputs keep the current output frame and paint the changed part in.
+    if (!result.unchanged) {
+      if (canvas_.empty()) canvas_ = cv::Mat(outputFrame_, CV_8UC3, cv::Scalar::all(0));
+      const cv::Mat part = result.indexed.empty() ? result.bgr : result.indexed.ToBGR();
+      part.copyTo(canvas_(result.rect));
+    }
+    std::string err;
+    switch (kind_) {
+      case OutputKind::Video:
+        if (!video_.isOpened()) {
+          const std::string ext = LowerExtension(outputPath_);
+          const int fourcc = ext == ".avi" ? cv::VideoWriter::fourcc('M', 'J', 'P', 'G')
+                                           : cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+          video_.open(outputPath_, fourcc, 1000.0 / delayMs_, outputFrame_, true);
+          if (!video_.isOpened()) {
+            Fail("Cannot open video writer for " + outputPath_);
+            return false;
+          }
+        }
+        video_.write(canvas_);
+        return true;
+      case OutputKind::Sheet: {
+        if (sheet_.empty()) {
+          const int columns = std::max(1, options_.sheetColumns);
+          const int cells = options_.sheetFrames > 0 ? options_.sheetFrames
+                                                     : columns * std::max(1, options_.sheetRows);
+          const int rows = (cells + columns - 1) / columns;
+          sheet_ = cv::Mat(outputFrame_.height * rows, outputFrame_.width * columns, CV_8UC3, cv::Scalar::all(0));
+        }
+        const int columns = std::max(1, options_.sheetColumns);
+        const cv::Rect cell((index % columns) * outputFrame_.width, (index / columns) * outputFrame_.height,
+                            outputFrame_.width, outputFrame_.height);
+        if ((cell & cv::Rect(0, 0, sheet_.cols, sheet_.rows)) == cell) canvas_.copyTo(sheet_(cell));
+        return true;
+      }
+      case OutputKind::Frames: {
+        const fs::path out(outputPath_);
+        char number[16];
+        std::snprintf(number, sizeof(number), "_%04d", index);
+        const std::string framePath =
+            (out.parent_path() / (out.stem().string() + number + out.extension().string())).string();
+        if (result.unchanged && !lastFramePath_.empty()) {
+          std::error_code ec;
+          fs::copy_file(lastFramePath_, framePath, fs::copy_options::overwrite_existing, ec);
+          if (!ec) {
+            lastFramePath_ = framePath;
+            return true;
+          }
+        }
+        if (!SaveImage(framePath, canvas_, err)) {
+          Fail(framePath + ": " + err);
+          return false;
+        }
+        lastFramePath_ = framePath;
+        return true;
+      }
+      case OutputKind::Gif:
+        break;
+    }
+    return true;
+  }
+
+  bool Finish() {
+    std::string err;
+    switch (kind_) {
+      case OutputKind::Gif: {
+        if (!gif_.is_open()) {
+          error_ = "No frames decoded";
+          return false;
+        }
+        std::vector<uint8_t> trailer;
+        IndexedCodec::EndGIF(trailer);
+        WriteBytes(pendingGifFrame_);
+        WriteBytes(trailer);
+        gif_.close();
+        return static_cast<bool>(gif_);
+      }
+      case OutputKind::Video:
+        video_.release();
+        return stats_.frames > 0;
+      case OutputKind::Sheet:
+        if (sheet_.empty() || !SaveImage(outputPath_, sheet_, err)) {
+          error_ = sheet_.empty() ? "No frames decoded" : err;
+          return false;
+        }
+        return true;
+      case OutputKind::Frames:
+        return stats_.frames > 0;
+    }
+    return false;
+  }
+
+  void WriteBytes(const std::vector<uint8_t>& bytes) {
+    gif_.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+  }
+
+  // Indexed when the format and the colors allow it, like the GUI's save.
+  static bool SaveImage(const std::string& path, const cv::Mat& bgr, std::string& err) {
+    IndexedImage indexed;
+    if (ImageLoader::WritesIndexed(path) && IndexedImage::FromBGR(bgr, indexed)) {
+      return ImageLoader::SaveIndexed(path, indexed, err);
+    }
+    return ImageLoader::Save(path, bgr, err);
+  }
+
+  const PixelArtProcessor::Params p_;
+  const SequenceProcessor::Options options_;
+  const std::string outputPath_;
+  const OutputKind kind_;
+  const cv::Size inputFrame_;
+  cv::Size outputFrame_;
+  int blocksW_ = 0;
+  int blocksH_ = 0;
+  bool native_ = false;
+  int blockPx_ = 1; // output pixels per block
+  int delayMs_ = 100;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<Job> queue_;
+  bool readerDone_ = false;
+  bool failed_ = false;
+  std::string error_;
+  int quantizeTurn_ = 0;
+  int writeTurn_ = 0;
+
+  // Quantize stage state (frame order).
+  std::shared_ptr<const Palette> shared_;
+  std::vector<cv::Vec3f> centersLab_;
+  cv::Mat previousColors_;
+
+  std::vector<cv::Vec3b> gifColors_; // GIF global table: the shared palette's output colors
+
+  // Write stage state (frame order).
+  SequenceProcessor::Stats stats_;
+  std::ofstream gif_;
+  std::vector<uint8_t> pendingGifFrame_;
+  int pendingDelayMs_ = 0;
+  cv::VideoWriter video_;
+  cv::Mat canvas_;
+  cv::Mat sheet_;
+  std::string lastFramePath_;
+};
+} // namespace
+
+bool SequenceProcessor::Run(const std::string& inputPath, const std::string& outputPath,
+                            const PixelArtProcessor::Params& params, const Options& options, Stats* outStats,
+                            std::string& outError) {
+  outError.clear();
+  const PixelArtProcessor::Params p = PixelArtProcessor::Normalize(params);
+
+  const std::string ext = LowerExtension(outputPath);
+  const OutputKind kind = ext == ".gif" ? OutputKind::Gif
+                          : IsVideoExtension(ext) ? OutputKind::Video
+                          : options.sheetColumns > 0 ? OutputKind::Sheet
+                                                     : OutputKind::Frames;
+
+  FrameSource source;
+  if (!source.Open(inputPath, options, outError)) return false;
+  cv::Mat first;
+  if (!source.ReadAt(0, first) || first.empty()) {
+    outError = "No frames in " + inputPath;
+    return false;
+  }
+  const cv::Size frameSize = first.size();
+
+  // The shared palette: K-means over the block images of evenly spaced frames (one histogram),
+  // or the fixed preset. WarmStart re-clusters per frame instead.
+  std::shared_ptr<const Palette> shared;
+  const bool warmStart = options.paletteMode == PaletteMode::WarmStart &&
+                         p.palettePreset == PixelArtProcessor::PalettePreset::Custom;
+  if (!warmStart) {
+    cv::Mat samples;
+    if (p.palettePreset == PixelArtProcessor::PalettePreset::Custom) {
+      int count = source.FrameCount();
+      if (options.maxFrames > 0 && count > 0) count = std::min(count, options.maxFrames);
+      const int n = std::max(1, count > 0 ? std::min(options.paletteSamples, count) : options.paletteSamples);
+      std::vector<cv::Mat> blocks;
+      cv::Mat frame;
+      for (int i = 0; i < n; ++i) {
+        // Unknown length (or no seeking): the first n frames.
+        const int index = count > 0 ? static_cast<int>(static_cast<int64_t>(i) * count / n) : i;
+        if (!source.ReadAt(index, frame) || frame.size() != frameSize) break;
+        blocks.push_back(PixelArtProcessor::BuildBlockColorImage(frame, p));
+        if (IsCancelled(options.cancel)) {
+          outError = "Cancelled";
+          return false;
+        }
+      }
+      if (blocks.empty()) blocks.push_back(PixelArtProcessor::BuildBlockColorImage(first, p));
+      cv::vconcat(blocks, samples);
+    }
+    shared = PixelArtProcessor::ExtractPalette(samples, p);
+    if (!shared) {
+      outError = "Palette extraction failed";
+      return false;
+    }
+  }
+  first.release();
+  if (!source.Rewind()) {
+    outError = "Cannot reopen " + inputPath;
+    return false;
+  }
+
+  Pipeline pipeline(p, options, outputPath, kind, frameSize, source.Fps());
+  pipeline.SetSharedPalette(shared);
+  Stats stats;
+  if (!pipeline.Run(source, stats, outError)) return false;
+  if (outStats) *outStats = stats;
+  return true;
+}
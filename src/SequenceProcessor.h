@@ -0,0 +1,62 @@
+#pragma once
+
+#include "PixelArtProcessor.h"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// SequenceProcessor: PixelArtProcessor over a frame sequence (video, animated GIF or sprite
+// sheet) with a temporally stable palette.
+// Why this exists:
+// - Pixelising an animation frame by frame runs K-means on every frame: wasted work, and the
+//   palette (so every color) flickers from frame to frame.
+// - Here the palette is extracted once from evenly spaced sample frames and applied to all of
+//   them, or (WarmStart) re-clustered per frame starting from the previous frame's centers,
+//   which follows slow color drift without jumping.
+// - Frames flow through a pipelined decode -> process -> encode chain: a reader thread and
+//   `jobs` workers that reduce, expand and encode frames in parallel, with only the palette
+//   step and the final write taken in frame order.
+// - Animations are mostly static: after palette application, only blocks whose color changed
+//   (plus the post-processing halo) are expanded and encoded again. GIF output stores them as
+//   sub-rectangle frames; a frame with no change just extends the previous frame's delay.
+//
+// Input: anything cv::VideoCapture opens (videos, animated GIF; cv::imreadmulti is the GIF
+// fallback), or a sprite sheet image split into Options::sheetColumns x sheetRows cells.
+// Output by extension: ".gif" animated GIF; ".avi" / ".mp4" / ".mkv" / ".mov" video
+// (cv::VideoWriter); any other image format a sprite sheet with the input's layout (sheet
+// input) or one file per frame ("name_0000.png", ...).
+class SequenceProcessor {
+public:
+  enum class PaletteMode {
+    Shared,   // one palette from Options::paletteSamples frames, used for every frame
+    WarmStart // K-means per frame, seeded with the previous frame's centers (Custom only)
+  };
+
+  struct Options {
+    PaletteMode paletteMode = PaletteMode::Shared;
+    int paletteSamples = 16; // frames sampled (evenly spaced) for the shared palette
+    int sheetColumns = 0;    // > 0: the input is a sprite sheet of sheetColumns x sheetRows cells
+    int sheetRows = 0;
+    int sheetFrames = 0;     // cells used, row-major; 0 = all
+    int maxFrames = 0;       // 0 = all
+    int frameDelayMs = 0;    // output frame time; 0 = the source's (video fps), else 100 ms
+    int loopCount = 0;       // GIF loop count; 0 = forever
+    int jobs = 0;            // worker threads; 0 = hardware concurrency
+    const std::atomic<bool>* cancel = nullptr;
+  };
+
+  struct Stats {
+    cv::Size frameSize;            // input frame size
+    int frames = 0;
+    int unchangedFrames = 0;       // identical to the previous frame after palette application
+    int64_t blocks = 0;            // blocks over all frames
+    int64_t blocksReprocessed = 0; // blocks expanded / post-processed / encoded
+  };
+
+  static bool Run(const std::string& inputPath, const std::string& outputPath,
+                  const PixelArtProcessor::Params& params, const Options& options, Stats* outStats,
+                  std::string& outError);
+};
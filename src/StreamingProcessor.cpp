@@ -0,0 +1,129 @@
+#include "StreamingProcessor.h"
+
+#include "BlockKernels.h"
+#include "StripIO.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace {
+inline bool IsCancelled(const std::atomic<bool>* cancel) {
+  return cancel && cancel->load(std::memory_order_relaxed);
+}
+} // namespace
+
+bool StreamingProcessor::Run(const std::string& inputPath, const std::string& outputPath,
+                             const PixelArtProcessor::Params& params, const Options& options, Stats* outStats,
+                             std::string& outError) {
+  outError.clear();
+  const PixelArtProcessor::Params p = PixelArtProcessor::Normalize(params);
+  const int bs = p.blockSize;
+
+  StripReader reader;
+  if (!reader.Open(inputPath, outError)) return false;
+  const cv::Size inSize = reader.Size();
+  const int w = inSize.width;
+  const int h = inSize.height;
+  const int bw = (w + bs - 1) / bs;
+  const int bh = (h + bs - 1) / bs;
+
+  Stats stats;
+  stats.inputSize = inSize;
+  stats.streamedInput = reader.Streaming();
+
+  // Strip height in block rows, from the byte budget.
+  const size_t blockRowBytes = static_cast<size_t>(w) * 3 * static_cast<size_t>(bs);
+  const int stripBlocks = static_cast<int>(std::max<size_t>(1, options.stripBytes / std::max<size_t>(1, blockRowBytes)));
+
+  // Pass 1: block image, strip by strip. The pre-blur reads ksize / 2 rows beyond each strip.
+  const int ksize = p.preBlur ? PixelArtProcessor::PreBlurKernelSize(bs) : 1;
+  const int halo = ksize / 2;
+  cv::Mat small(bh, bw, CV_8UC3);
+  cv::Mat strip;
+  for (int b0 = 0; b0 < bh; b0 += stripBlocks) {
+    const int b1 = std::min(bh, b0 + stripBlocks);
+    const int y0 = std::max(0, b0 * bs - halo);
+    const int y1 = std::min(h, b1 * bs + halo);
+    if (!reader.ReadRows(y0, y1 - y0, strip, outError)) return false;
+    const cv::Mat part = p.preBlur
+        ? BlockKernels::BlurredBlockMeanRowsBGR(strip, y0, h, bs, ksize, b0, b1)
+        : BlockKernels::BlockMeanBGR(strip, bs);
+    if (part.rows != b1 - b0 || part.cols != bw) {
+      outError = "Block reduction failed";
+      return false;
+    }
+    part.copyTo(small.rowRange(b0, b1));
+    ++stats.strips;
+    if (IsCancelled(options.cancel)) {
+      outError = "Cancelled";
+      return false;
+    }
+  }
+  strip.release();
+  reader = StripReader{}; // closes the input before pass 2
+
+  // Palette extraction + application on the complete block image, as in Process.
+  const std::shared_ptr<const Palette> palette = PixelArtProcessor::ExtractPalette(small, p);
+  if (!palette) {
+    outError = "Palette extraction failed";
+    return false;
+  }
+  const cv::Mat quantized = PixelArtProcessor::ApplyPalette(small, *palette, p);
+  small.release();
+  if (quantized.empty()) {
+    outError = "Palette application failed";
+    return false;
+  }
+
+  const bool native = PixelArtProcessor::OutputIsNative(p);
+  stats.outputSize = native ? quantized.size() : inSize;
+  StripWriter writer;
+  if (!writer.Open(outputPath, stats.outputSize, outError)) return false;
+  stats.streamedOutput = writer.Streaming();
+  if (native) {
+    if (!writer.WriteRows(quantized, outError) || !writer.Close(outError)) return false;
+    if (outStats) *outStats = stats;
+    return true;
+  }
+
+  // Pass 2: output strips. With post-processing, each strip's block grid band extends by
+  // `haloBlocks` block rows on both sides: a block contributes min(bs, 2R + 1) grid rows, and
+  // the band's artificial top / bottom border only reaches R grid rows inwards.
+  const int radius = PixelArtProcessor::PostProcessRadius(p);
+  const int gridRowsPerBlock = std::min(bs, 2 * radius + 1);
+  const int haloBlocks = radius > 0 ? (radius + gridRowsPerBlock - 1) / gridRowsPerBlock : 0;
+  for (int b0 = 0; b0 < bh; b0 += stripBlocks) {
+    const int b1 = std::min(bh, b0 + stripBlocks);
+    const int rows = std::min(h, b1 * bs) - b0 * bs;
+    cv::Mat out;
+    if (radius == 0) {
+      out = BlockKernels::ExpandBlocksBGR(quantized.rowRange(b0, b1), cv::Size(w, rows), bs);
+    } else {
+      const int band0 = std::max(0, b0 - haloBlocks);
+      const int band1 = std::min(bh, b1 + haloBlocks);
+      const cv::Size bandSize(w, std::min(h, band1 * bs) - band0 * bs);
+      BlockKernels::BlockGrid grid =
+          BlockKernels::BuildBlockGrid(quantized.rowRange(band0, band1), bandSize, bs, radius);
+      if (p.edgeEnhance) PixelArtProcessor::ApplyEdgeEnhancementInPlace(grid.image, 0.7f);
+      if (p.outline) PixelArtProcessor::ApplyPixelArtOutline(grid.image, p.outlineThickness);
+      const cv::Mat band = BlockKernels::ExpandBlockGrid(grid);
+      const int skip = (b0 - band0) * bs;
+      if (band.rows < skip + rows) {
+        outError = "Post-processing failed";
+        return false;
+      }
+      out = band.rowRange(skip, skip + rows);
+    }
+    if (out.empty() || !writer.WriteRows(out, outError)) {
+      if (outError.empty()) outError = "Block expansion failed";
+      return false;
+    }
+    if (IsCancelled(options.cancel)) {
+      outError = "Cancelled";
+      return false;
+    }
+  }
+  if (!writer.Close(outError)) return false;
+  if (outStats) *outStats = stats;
+  return true;
+}
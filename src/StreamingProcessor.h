@@ -0,0 +1,47 @@
+#pragma once
+
+#include "PixelArtProcessor.h"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+// StreamingProcessor: PixelArtProcessor::Process from file to file with bounded memory.
+// Why this exists:
+// - Map and poster scans can exceed 1 GB decoded; Process needs the whole input in memory
+//   (plus the output at full size).
+// - The only whole-image state the pipeline really needs is the block image, which is
+//   blockSize² times smaller than the input. So the work is split into two passes over
+//   strips of block rows:
+//   1) read input strips (plus the pre-blur halo rows) through a StripReader and reduce them
+//      to block rows of the block image; then extract the palette (K-means) from the complete
+//      block image and apply it, exactly as Process does;
+//   2) expand output strips from the quantized block image (running edge enhancement /
+//      outlines on a block grid band with enough halo block rows) and hand them to a
+//      StripWriter, which encodes them as they arrive.
+// - Peak memory is the block image plus a few strips, independent of the input size, when
+//   both files are binary PPM / PGM (see StripIO); other formats fall back to a whole-image
+//   decode / encode by OpenCV, with the processing itself still done in strips.
+//
+// Output is identical to PixelArtProcessor::Process for the same input and params.
+class StreamingProcessor {
+public:
+  struct Options {
+    size_t stripBytes = size_t{64} << 20; // target size of one decoded input strip
+    const std::atomic<bool>* cancel = nullptr;
+  };
+
+  struct Stats {
+    cv::Size inputSize;
+    cv::Size outputSize;
+    bool streamedInput = false;  // false: the input format was decoded whole
+    bool streamedOutput = false; // false: the output format was encoded whole
+    int strips = 0;              // input strips read in pass 1
+  };
+
+  static bool Run(const std::string& inputPath, const std::string& outputPath,
+                  const PixelArtProcessor::Params& params, const Options& options, Stats* outStats,
+                  std::string& outError);
+};
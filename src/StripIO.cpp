@@ -0,0 +1,191 @@
+#include "StripIO.h"
+
+#include "ImageLoader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+
+#include <opencv2/imgproc.hpp>
+
+namespace {
+std::string LowerExtension(const std::string& path) {
+  std::string ext = std::filesystem::path(path).extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return ext;
+}
+
+// Next header token of a PNM file; '#' comments run to the end of the line.
+bool ReadPnmToken(std::istream& in, std::string& out) {
+  out.clear();
+  int c = in.get();
+  for (;;) {
+    while (c != EOF && std::isspace(c)) c = in.get();
+    if (c != '#') break;
+    while (c != EOF && c != '\n' && c != '\r') c = in.get();
+  }
+  // Header tokens are short; the cap stops the scan early on non-PNM files.
+  while (c != EOF && !std::isspace(c) && c != '#' && out.size() < 16) {
+    out.push_back(static_cast<char>(c));
+    c = in.get();
+  }
+  if (c == '#') in.unget();
+  // The single whitespace character ending the last token (maxval) is consumed here, so the
+  // stream then points at the first data byte.
+  return !out.empty();
+}
+
+bool ParsePositive(const std::string& s, int& out) {
+  if (s.empty() || s.size() > 9) return false;
+  out = 0;
+  for (char c : s) {
+    if (c < '0' || c > '9') return false;
+    out = out * 10 + (c - '0');
+  }
+  return out > 0;
+}
+} // namespace
+
+bool StripReader::Open(const std::string& path, std::string& outError) {
+  outError.clear();
+  file_.close();
+  image_.release();
+  raw_.release();
+  streaming_ = false;
+  size_ = cv::Size();
+
+  file_.open(path, std::ios::binary);
+  if (!file_) {
+    outError = "Cannot open " + path;
+    return false;
+  }
+  std::string magic, width, height, maxval;
+  if (ReadPnmToken(file_, magic) && (magic == "P6" || magic == "P5") && ReadPnmToken(file_, width) &&
+      ReadPnmToken(file_, height) && ReadPnmToken(file_, maxval)) {
+    int w = 0, h = 0, maxv = 0;
+    if (!ParsePositive(width, w) || !ParsePositive(height, h) || !ParsePositive(maxval, maxv)) {
+      outError = "Malformed PNM header: " + path;
+      return false;
+    }
+    if (maxv == 255) {
+      channels_ = magic == "P6" ? 3 : 1;
+      dataOffset_ = file_.tellg();
+      file_.seekg(0, std::ios::end);
+      const std::streamoff expected =
+          dataOffset_ + static_cast<std::streamoff>(w) * h * channels_;
+      if (file_.tellg() < expected) {
+        outError = "Truncated PNM file: " + path;
+        return false;
+      }
+      size_ = cv::Size(w, h);
+      streaming_ = true;
+      return true;
+    }
+    // 16-bit PNM: let OpenCV convert it.
+  }
+  file_.close();
+
+  if (!ImageLoader::LoadBGR(path, image_, outError)) return false;
+  size_ = image_.size();
+  return true;
+}
+
+bool StripReader::ReadRows(int firstRow, int count, cv::Mat& out, std::string& outError) {
+  outError.clear();
+  if (firstRow < 0 || count <= 0 || firstRow + count > size_.height) {
+    outError = "Row range outside the image";
+    return false;
+  }
+  if (!streaming_) {
+    out = image_.rowRange(firstRow, firstRow + count);
+    return true;
+  }
+
+  const std::streamoff rowBytes = static_cast<std::streamoff>(size_.width) * channels_;
+  raw_.create(count, size_.width, channels_ == 3 ? CV_8UC3 : CV_8UC1);
+  file_.clear();
+  file_.seekg(dataOffset_ + firstRow * rowBytes);
+  if (!file_.read(reinterpret_cast<char*>(raw_.data), count * rowBytes)) {
+    outError = "Read error in PNM data";
+    return false;
+  }
+  // PNM stores RGB (or gray); the pipeline works on BGR.
+  cv::cvtColor(raw_, out, channels_ == 3 ? cv::COLOR_RGB2BGR : cv::COLOR_GRAY2BGR);
+  return true;
+}
+
+bool StripWriter::Open(const std::string& path, const cv::Size& size, std::string& outError) {
+  outError.clear();
+  file_.close();
+  image_.release();
+  path_ = path;
+  size_ = size;
+  rowsWritten_ = 0;
+  if (size.width <= 0 || size.height <= 0) {
+    outError = "Nothing to save (image is empty).";
+    return false;
+  }
+
+  const std::string ext = LowerExtension(path);
+  streaming_ = ext == ".ppm" || ext == ".pnm";
+  if (!streaming_) {
+    image_.create(size, CV_8UC3);
+    return true;
+  }
+  file_.open(path, std::ios::binary | std::ios::trunc);
+  if (!file_) {
+    outError = "Cannot create " + path;
+    return false;
+  }
+  file_ << "P6\n" << size.width << ' ' << size.height << "\n255\n";
+  line_.resize(static_cast<size_t>(size.width) * 3);
+  return static_cast<bool>(file_);
+}
+
+bool StripWriter::WriteRows(const cv::Mat& rowsBgr, std::string& outError) {
+  outError.clear();
+  if (rowsBgr.type() != CV_8UC3 || rowsBgr.cols != size_.width || rowsWritten_ + rowsBgr.rows > size_.height) {
+    outError = "Row strip does not fit the output image";
+    return false;
+  }
+  if (!streaming_) {
+    rowsBgr.copyTo(image_.rowRange(rowsWritten_, rowsWritten_ + rowsBgr.rows));
+    rowsWritten_ += rowsBgr.rows;
+    return true;
+  }
+  for (int y = 0; y < rowsBgr.rows; ++y) {
+    const uchar* src = rowsBgr.ptr<uchar>(y);
+    for (size_t i = 0; i < line_.size(); i += 3) {
+      line_[i] = src[i + 2];
+      line_[i + 1] = src[i + 1];
+      line_[i + 2] = src[i];
+    }
+    file_.write(reinterpret_cast<const char*>(line_.data()), static_cast<std::streamsize>(line_.size()));
+  }
+  if (!file_) {
+    outError = "Write error: " + path_;
+    return false;
+  }
+  rowsWritten_ += rowsBgr.rows;
+  return true;
+}
+
+bool StripWriter::Close(std::string& outError) {
+  outError.clear();
+  if (rowsWritten_ != size_.height) {
+    outError = "Incomplete output image: " + path_;
+    return false;
+  }
+  if (!streaming_) {
+    const bool ok = ImageLoader::Save(path_, image_, outError);
+    image_.release();
+    return ok;
+  }
+  file_.close();
+  if (!file_) {
+    outError = "Write error: " + path_;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// StripIO: row-range image reading and sequential row writing for images too large to hold
+// decoded in memory (see StreamingProcessor).
+// Why this exists:
+// - cv::imread / cv::imwrite only work on whole images; a 40000×30000 scan is 3.6 GB as BGR.
+// - Binary PPM / PGM (P6 / P5, 8-bit) store plain rows after a short header, so any row range
+//   can be read with one seek, and rows can be written as they are produced.
+// - Every other format goes through OpenCV as before (whole image decoded up front, or
+//   buffered until Close); Streaming() tells which path a file takes.
+//   Large scans can be converted to PPM once with any image tool to process them in strips.
+
+// Reads row ranges of an image as 8-bit BGR.
+class StripReader {
+public:
+  bool Open(const std::string& path, std::string& outError);
+
+  cv::Size Size() const { return size_; }
+  // True if rows are decoded on demand; false if OpenCV decoded the whole image in Open.
+  bool Streaming() const { return streaming_; }
+
+  // Rows [firstRow, firstRow + count) as CV_8UC3 (count × width). Ranges may overlap and come
+  // in any order. `out` may reference internal memory: treat it as read-only, valid until the
+  // next call.
+  bool ReadRows(int firstRow, int count, cv::Mat& out, std::string& outError);
+
+private:
+  std::ifstream file_;
+  std::streamoff dataOffset_ = 0;
+  int channels_ = 3; // PNM only: 3 (P6, RGB) or 1 (P5, gray)
+  bool streaming_ = false;
+  cv::Size size_;
+  cv::Mat image_;    // non-streaming: the whole decoded image
+  cv::Mat raw_;      // streaming: file bytes of the last range
+};
+
+// Writes an image of a known size sequentially, top to bottom, as 8-bit BGR rows.
+class StripWriter {
+public:
+  bool Open(const std::string& path, const cv::Size& size, std::string& outError);
+
+  // True if rows go to the file as they are written (.ppm / .pnm); otherwise they are
+  // collected and encoded by OpenCV in Close.
+  bool Streaming() const { return streaming_; }
+
+  // Appends rows (CV_8UC3, `size.width` wide) below the ones written so far.
+  bool WriteRows(const cv::Mat& rowsBgr, std::string& outError);
+  // Fails if fewer than `size.height` rows were written.
+  bool Close(std::string& outError);
+
+private:
+  std::string path_;
+  std::ofstream file_;
+  bool streaming_ = false;
+  cv::Size size_;
+  int rowsWritten_ = 0;
+  cv::Mat image_;           // non-streaming: the output collected so far
+  std::vector<uchar> line_; // streaming: one RGB output row
+};
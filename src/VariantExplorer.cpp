@@ -0,0 +1,180 @@
+#include "VariantExplorer.h"
+
+#include "IndexedImage.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+namespace {
+// Scales `image` so its longest side is `side`: nearest when enlarging (block images keep
+// crisp blocks), area averaging when shrinking.
+cv::Mat Thumbnail(const cv::Mat& image, int side) {
+  const double scale = static_cast<double>(side) / std::max(image.cols, image.rows);
+  const cv::Size size(std::max(1, static_cast<int>(std::lround(image.cols * scale))),
+                      std::max(1, static_cast<int>(std::lround(image.rows * scale))));
+  cv::Mat out;
+  cv::resize(image, out, size, 0.0, 0.0, scale > 1.0 ? cv::INTER_NEAREST : cv::INTER_AREA);
+  return out;
+}
+} // namespace
+
+VariantExplorer::~VariantExplorer() {
+  Stop();
+}
+
+void VariantExplorer::Start(int threads) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!threads_.empty()) return;
+  stop_ = false;
+  if (threads <= 0) threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  for (int i = 0; i < threads; ++i) threads_.emplace_back(&VariantExplorer::ThreadMain, this);
+}
+
+void VariantExplorer::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+    if (current_) current_->cancel.store(true);
+  }
+  cv_.notify_all();
+  for (std::thread& t : threads_) t.join();
+  threads_.clear();
+}
+
+void VariantExplorer::Explore(const cv::Mat& inputBgr, const std::vector<PixelArtProcessor::Params>& variants,
+                              int thumbSide) {
+  auto exploration = std::make_shared<Exploration>();
+  exploration->input = inputBgr;
+  exploration->variants = variants;
+  exploration->thumbSide = std::max(16, thumbSide);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Running variants of the old exploration stop at their next stage boundary.
+    if (current_) current_->cancel.store(true);
+    current_ = std::move(exploration);
+    finished_.clear();
+  }
+  cv_.notify_all();
+}
+
+void VariantExplorer::Cancel() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (current_) current_->cancel.store(true);
+  current_.reset();
+  finished_.clear();
+}
+
+bool VariantExplorer::TakeFinished(std::vector<Tile>& out) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (finished_.empty()) return false;
+  for (Tile& tile : finished_) out.push_back(std::move(tile));
+  finished_.clear();
+  return true;
+}
+
+int VariantExplorer::Remaining() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!current_) return 0;
+  return static_cast<int>(current_->variants.size()) - current_->finished.load();
+}
+
+void VariantExplorer::ThreadMain() {
+  for (;;) {
+    std::shared_ptr<Exploration> exploration;
+    int index = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      // Claiming under the lock keeps `next` from running past the end while threads wait.
+      cv_.wait(lock, [this] {
+        return stop_ || (current_ && current_->next.load() < static_cast<int>(current_->variants.size()));
+      });
+      if (stop_) return;
+      exploration = current_;
+      index = exploration->next.fetch_add(1);
+    }
+
+    Tile tile = Render(*exploration, index);
+    exploration->finished.fetch_add(1);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Only publish tiles of the exploration still shown.
+    if (exploration == current_ && !exploration->cancel.load()) finished_.push_back(std::move(tile));
+  }
+}
+
+VariantExplorer::Tile VariantExplorer::Render(Exploration& exploration, int index) {
+  using PalettePreset = PixelArtProcessor::PalettePreset;
+  const auto t0 = std::chrono::steady_clock::now();
+  Tile tile;
+  tile.index = index;
+  tile.params = exploration.variants[index];
+  const cv::Mat& input = exploration.input;
+  const std::atomic<bool>& cancel = exploration.cancel;
+  if (input.empty() || input.type() != CV_8UC3 || cancel.load()) return tile;
+  const PixelArtProcessor::Params p = PixelArtProcessor::Normalize(tile.params);
+
+  // Steps 1 + 2, shared by every variant with this block size and blur setting.
+  std::shared_ptr<SharedBlocks> blocks;
+  {
+    std::lock_guard<std::mutex> lock(exploration.mutex);
+    std::shared_ptr<SharedBlocks>& entry = exploration.blocks[{p.blockSize, p.preBlur}];
+    if (!entry) entry = std::make_shared<SharedBlocks>();
+    blocks = entry;
+  }
+  {
+    std::lock_guard<std::mutex> lock(blocks->mutex);
+    if (!blocks->done) {
+      blocks->blocks = PixelArtProcessor::BuildBlockColorImage(input, p);
+      blocks->done = true;
+    }
+  }
+  if (blocks->blocks.empty() || cancel.load()) return tile;
+
+  // Step 3a, shared by every variant with this block image and palette params.
+  const bool custom = p.palettePreset == PalettePreset::Custom;
+  const PaletteKey paletteKey(custom ? p.blockSize : 0, custom && p.preBlur, static_cast<int>(p.palettePreset),
+                              custom ? p.paletteSize : 0, custom ? p.kmeansSeed : 0u, p.userPaletteId);
+  std::shared_ptr<SharedPalette> palette;
+  {
+    std::lock_guard<std::mutex> lock(exploration.mutex);
+    std::shared_ptr<SharedPalette>& entry = exploration.palettes[paletteKey];
+    if (!entry) entry = std::make_shared<SharedPalette>();
+    palette = entry;
+  }
+  {
+    std::lock_guard<std::mutex> lock(palette->mutex);
+    if (!palette->done) {
+      palette->palette = PixelArtProcessor::ExtractPalette(blocks->blocks, p);
+      palette->done = true;
+    }
+  }
+  if (!palette->palette || cancel.load()) return tile;
+
+  // Step 3b and the thumbnail, per variant.
+  const cv::Mat indices = PixelArtProcessor::ApplyPaletteIndices(blocks->blocks, *palette->palette, p);
+  if (indices.empty() || cancel.load()) return tile;
+  const std::vector<cv::Vec3b>& colors = palette->palette->Colors();
+  if (PixelArtProcessor::PostProcessRadius(p) == 0) {
+    // Plain expansion only repeats every block: scaling the block image is the same picture.
+    tile.image = Thumbnail(IndexedImage::ToBGR(indices, colors), exploration.thumbSide);
+  } else {
+    const int maxSide = std::max(indices.cols, indices.rows);
+    const int scale = std::min(std::max(2, p.blockSize),
+                               std::max(2, (2 * exploration.thumbSide + maxSide - 1) / maxSide));
+    PixelArtProcessor::Params thumbParams = p;
+    thumbParams.blockSize = scale;
+    thumbParams.nativeOutput = false;
+    IndexedImage outIndexed;
+    cv::Mat outBgr;
+    if (PixelArtProcessor::ExpandAndPostProcess(IndexedImage{indices, colors},
+                                                cv::Size(indices.cols * scale, indices.rows * scale), thumbParams,
+                                                /*keepIndexed=*/false, outIndexed, outBgr)) {
+      tile.image = Thumbnail(outBgr, exploration.thumbSide);
+    }
+  }
+  tile.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return tile;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "PixelArtProcessor.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// VariantExplorer: renders thumbnails of many Params variants of one image at once.
+// Why this exists:
+// - "Random Config" explores styles one serial full-resolution run at a time; comparing a
+//   dozen looks meant a dozen round trips through the controls.
+// - Explore hands a list of variants (random configs, or a block size × palette sweep) to a
+//   pool of threads that render them concurrently and hand out each thumbnail as it finishes,
+//   so the grid fills in progressively.
+// - Variants share their work: the decoded input is referenced once, the blur + block-mean
+//   image is computed once per (blockSize, preBlur) and every palette once per
+//   (block image, palette params): a 5 block size × 8 palette sweep runs 5 block passes instead
+//   of 40, and variants that only differ after the palette (dither, outline, ...) share one
+//   K-means extraction. Only palette application and the thumbnail are per variant.
+//
+// Thumbnails match the full-resolution result for plain and native output (the block image,
+// scaled to the thumbnail). Variants with edge enhancement or outlines are post-processed at
+// the smallest block size (at least 2 px, at most their own) that still covers the thumbnail;
+// outline widths are pixels, so they look thicker relative to a block than in the result.
+//
+// Threading contract: Start / Stop / Explore / Cancel / TakeFinished from one (UI) thread.
+// Same input rules as ProcessingWorker: inputs are shared, not copied, and must not be
+// modified in place after Explore.
+class VariantExplorer {
+public:
+  struct Tile {
+    int index = 0;                    // position in the variants list given to Explore
+    PixelArtProcessor::Params params; // the variant (as given to Explore)
+    cv::Mat image;                    // BGR thumbnail, longest side thumbSide; empty on failure
+    double seconds = 0.0;             // wall time of the variant (waits on shared stages included)
+  };
+
+  VariantExplorer() = default;
+  ~VariantExplorer();
+
+  VariantExplorer(const VariantExplorer&) = delete;
+  VariantExplorer& operator=(const VariantExplorer&) = delete;
+
+  // Starts `threads` render threads (0 => hardware concurrency).
+  void Start(int threads = 0);
+  // Cancels outstanding work and joins the threads. Safe to call more than once.
+  void Stop();
+
+  // Replaces the current exploration (cancelling its unfinished variants; their tiles are
+  // dropped) with `variants` of `inputBgr`, rendered at `thumbSide` px on the longest side.
+  void Explore(const cv::Mat& inputBgr, const std::vector<PixelArtProcessor::Params>& variants,
+               int thumbSide = 256);
+  // Drops the current exploration.
+  void Cancel();
+
+  // Appends the tiles finished since the last call (current exploration only). Non-blocking.
+  bool TakeFinished(std::vector<Tile>& out);
+
+  // Variants of the current exploration not finished yet.
+  int Remaining() const;
+
+private:
+  // One shared intermediate, computed by the first variant that needs it while the others
+  // wait on `mutex`.
+  struct SharedBlocks {
+    std::mutex mutex;
+    bool done = false;
+    cv::Mat blocks;
+  };
+  struct SharedPalette {
+    std::mutex mutex;
+    bool done = false;
+    std::shared_ptr<const Palette> palette;
+  };
+  // (blockSize, preBlur, palettePreset, paletteSize, kmeansSeed, userPaletteId); fields the
+  // palette does not depend on are zeroed (fixed palettes ignore the block image entirely).
+  using PaletteKey = std::tuple<int, bool, int, int, uint32_t, int>;
+
+  struct Exploration {
+    cv::Mat input;
+    std::vector<PixelArtProcessor::Params> variants;
+    int thumbSide = 256;
+    std::atomic<int> next{0};     // next variant to hand to a thread
+    std::atomic<int> finished{0}; // variants rendered (or failed)
+    std::atomic<bool> cancel{false};
+    std::mutex mutex; // guards the maps, not the entries
+    std::map<std::pair<int, bool>, std::shared_ptr<SharedBlocks>> blocks;
+    std::map<PaletteKey, std::shared_ptr<SharedPalette>> palettes;
+  };
+
+  void ThreadMain();
+  static Tile Render(Exploration& exploration, int index);
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::thread> threads_;
+  bool stop_ = false;
+  std::shared_ptr<Exploration> current_;
+  std::vector<Tile> finished_; // tiles of current_ not taken yet
+};
@@ -0,0 +1,362 @@
+// fpw_batch: headless batch front-end for PixelArtProcessor.
+//
+// Usage:
+//   fpw_batch -o <out_dir> [options] <input>...
+// Inputs may be image files or directories; see PrintUsage() for the full option list.
+
+#include "BatchRunner.h"
+#include "CpuDispatch.h"
+#include "ImageLoader.h"
+#include "PaletteRegistry.h"
+#include "ParamsFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+namespace {
+void PrintUsage(const char* exe) {
+  std::printf(
+      "Usage: %s -o <out_dir> [options] <input file or directory>...\n"
+      "\n"
+      "Inputs:\n"
+      "  -o, --out DIR            output directory (created if missing)\n"
+      "  -l, --list FILE          read additional input paths from FILE (one per line)\n"
+      "  -r, --recursive          scan input directories recursively\n"
+      "  -j, --jobs N             worker threads (default: all cores)\n"
+      "      --ext EXT            output format extension (default: png; png and gif are\n"
+      "                           written palette-indexed)\n"
+      "      --rgb                write 24-bit PNG instead of indexed PNG\n"
+      "      --encode-jobs N      encoder threads overlapping with processing (default: half\n"
+      "                           the workers; 0 = each worker encodes its own output)\n"
+      "      --png-level N        PNG compression level 0-9 (0 = store; default: encoder's)\n"
+      "      --png-strategy S     default|filtered|huffman|rle|fixed (rle is fast on pixel art)\n"
+      "      --jpeg-quality Q     JPEG quality 0-100 (default: 95)\n"
+      "      --suffix S           appended to output file names (default: none)\n"
+      "      --stream             process in strips with bounded memory (for huge scans;\n"
+      "                           fully streamed for .ppm/.pgm input and --ext ppm)\n"
+      "      --trace FILE         write per-stage timings and peak memory of every image as a\n"
+      "                           Chrome trace (chrome://tracing, Perfetto); not with --stream /\n"
+      "                           --sequence\n"
+      "      --verify             write nothing; check the optimised kernels against the\n"
+      "                           reference implementation on every input (-o not needed;\n"
+      "                           exit status 1 if any check fails)\n"
+      "      --cache DIR          result cache: inputs already processed with the same params and\n"
+      "                           output format are copied from DIR instead (not with --stream /\n"
+      "                           --sequence); new results are added\n"
+      "      --cache-max-mb N     trim the cache to N MB after the run (least recently used first)\n"
+      "      --backend B          optimized|reference (default: optimized, or $FPW_BACKEND)\n"
+      "      --isa NAME           CPU kernels: scalar|sse2|neon|sse4.1|avx2|avx512 (default: the\n"
+      "                           best this CPU supports, or $FPW_ISA)\n"
+      "\n"
+      "Frame sequences:\n"
+      "      --sequence           inputs are videos / animated GIFs / sprite sheets; --ext gif\n"
+      "                           writes an animated GIF, avi|mp4|mkv|mov a video, any other\n"
+      "                           format a sheet (sheet input) or numbered frames\n"
+      "      --sheet CxR[:N]      inputs are sprite sheets of C x R cells, first N used\n"
+      "                           (implies --sequence)\n"
+      "      --palette-mode M     shared|warm (default: shared; warm re-clusters every frame\n"
+      "                           from the previous frame's colors, custom preset only)\n"
+      "      --palette-samples N  frames sampled for the shared palette (default: 16)\n"
+      "      --frame-delay MS     output frame time (default: the source's, else 100)\n"
+      "      --max-frames N       stop after N frames (default: all)\n"
+      "\n"
+      "Pixel art params:\n"
+      "      --params FILE        load params from FILE (options after it override its values)\n"
+      "      --save-params FILE   write the final params to FILE (reusable with --params / the GUI)\n"
+      "      --block N            block size (default: 8)\n"
+      "      --palette-size N     K-means palette size for the custom preset (default: 16)\n"
+      "      --preset NAME        custom|nes|gameboy|gbpocket|pico8|cga|ega|c64 (default: custom)\n"
+      "      --palette-file FILE  use a .hex or .gpl palette (overrides --preset)\n"
+      "      --palette-from IMAGE extract the palette from IMAGE once (custom preset, block,\n"
+      "                           palette size and seed apply) and use it for every input\n"
+      "      --seed N             K-means seed for the custom preset (default: 1)\n"
+      "      --no-preblur         disable the pre-blur step\n"
+      "      --edge               enable edge enhancement\n"
+      "      --dither             enable dithering (algorithm: --dither-method)\n"
+      "      --dither-method M    fs (Floyd-Steinberg) | bayer2|bayer4|bayer8 (ordered) | bluenoise\n"
+      "                           (default: fs; implies --dither)\n"
+      "      --serpentine         serpentine scan for the fs method (implies --dither)\n"
+      "      --outline N          enable outlines with thickness N (1-5; clamped)\n"
+      "      --native             write one pixel per block instead of upscaling\n"
+      "                           (ignored with --edge / --outline)\n",
+      exe);
+}
+
+bool ParseInt(const char* s, int& out) {
+  if (!s || !*s) return false;
+  char* end = nullptr;
+  const long v = std::strtol(s, &end, 10);
+  if (*end != '\0') return false;
+  out = static_cast<int>(v);
+  return true;
+}
+
+// "CxR" or "CxR:N".
+bool ParseSheet(const std::string& s, SequenceProcessor::Options& out) {
+  int columns = 0, rows = 0, frames = 0;
+  char sep = 0;
+  const int n = std::sscanf(s.c_str(), "%dx%d%c%d", &columns, &rows, &sep, &frames);
+  if (n != 2 && !(n == 4 && sep == ':')) return false;
+  if (columns <= 0 || rows <= 0 || frames < 0) return false;
+  out.sheetColumns = columns;
+  out.sheetRows = rows;
+  out.sheetFrames = frames;
+  return true;
+}
+
+bool ParsePngStrategy(const std::string& name, ImageLoader::PngStrategy& out) {
+  using S = ImageLoader::PngStrategy;
+  struct Entry { const char* name; S strategy; };
+  static const Entry kStrategies[] = {
+    {"default", S::Default}, {"filtered", S::Filtered}, {"huffman", S::HuffmanOnly},
+    {"rle", S::RLE}, {"fixed", S::Fixed},
+  };
+  for (const Entry& e : kStrategies) {
+    if (name == e.name) {
+      out = e.strategy;
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+  BatchRunner::Options opts;
+  std::vector<std::string> inputArgs;
+  std::vector<std::string> listFiles;
+  std::string paletteFile;
+  std::string paletteFrom;
+  std::string saveParamsPath;
+  bool recursive = false;
+  bool verify = false;
+
+  // Defaults mirror the GUI (App::App).
+  opts.params.blockSize = 8;
+  opts.params.paletteSize = 16;
+  opts.params.preBlur = true;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string a = argv[i];
+    auto value = [&](const char* flag) -> const char* {
+      if (i + 1 >= argc) {
+        std::fprintf(stderr, "Missing value for %s\n", flag);
+        std::exit(2);
+      }
+      return argv[++i];
+    };
+    auto intValue = [&](const char* flag) {
+      int v = 0;
+      if (!ParseInt(value(flag), v)) {
+        std::fprintf(stderr, "Invalid integer for %s\n", flag);
+        std::exit(2);
+      }
+      return v;
+    };
+
+    if (a == "-h" || a == "--help") {
+      PrintUsage(argv[0]);
+      return 0;
+    } else if (a == "-o" || a == "--out") {
+      opts.outputDir = value("--out");
+    } else if (a == "-l" || a == "--list") {
+      listFiles.push_back(value("--list"));
+    } else if (a == "-r" || a == "--recursive") {
+      recursive = true;
+    } else if (a == "-j" || a == "--jobs") {
+      opts.jobs = intValue("--jobs");
+    } else if (a == "--ext") {
+      std::string ext = value("--ext");
+      opts.outputExt = (!ext.empty() && ext[0] == '.') ? ext : "." + ext;
+    } else if (a == "--suffix") {
+      opts.suffix = value("--suffix");
+    } else if (a == "--stream") {
+      opts.streaming = true;
+    } else if (a == "--cache") {
+      opts.cacheDir = value("--cache");
+    } else if (a == "--cache-max-mb") {
+      opts.cacheMaxBytes = static_cast<uint64_t>(std::max(0, intValue("--cache-max-mb"))) * 1024u * 1024u;
+    } else if (a == "--trace") {
+      opts.tracePath = value("--trace");
+    } else if (a == "--verify") {
+      verify = true;
+    } else if (a == "--backend") {
+      const std::string name = value("--backend");
+      PixelArtProcessor::Backend backend = PixelArtProcessor::Backend::Optimized;
+      if (!PixelArtProcessor::ParseBackend(name, backend)) {
+        std::fprintf(stderr, "Unknown backend: %s\n", name.c_str());
+        return 2;
+      }
+      PixelArtProcessor::SetBackend(backend);
+    } else if (a == "--isa") {
+      const std::string name = value("--isa");
+      CpuDispatch::Isa isa = CpuDispatch::Isa::Scalar;
+      if (!CpuDispatch::ParseIsa(name, isa)) {
+        std::fprintf(stderr, "Unknown instruction set: %s\n", name.c_str());
+        return 2;
+      }
+      if (!CpuDispatch::Select(isa)) {
+        std::fprintf(stderr, "Instruction set %s is not supported here; using %s\n", name.c_str(),
+                     CpuDispatch::IsaName(CpuDispatch::Active()));
+      }
+    } else if (a == "--sequence") {
+      opts.sequence = true;
+    } else if (a == "--sheet") {
+      const std::string sheet = value("--sheet");
+      if (!ParseSheet(sheet, opts.sequenceOptions)) {
+        std::fprintf(stderr, "Invalid sheet layout (expected CxR or CxR:N): %s\n", sheet.c_str());
+        return 2;
+      }
+      opts.sequence = true;
+    } else if (a == "--palette-mode") {
+      const std::string mode = value("--palette-mode");
+      if (mode == "shared") {
+        opts.sequenceOptions.paletteMode = SequenceProcessor::PaletteMode::Shared;
+      } else if (mode == "warm") {
+        opts.sequenceOptions.paletteMode = SequenceProcessor::PaletteMode::WarmStart;
+      } else {
+        std::fprintf(stderr, "Unknown palette mode: %s\n", mode.c_str());
+        return 2;
+      }
+    } else if (a == "--palette-samples") {
+      opts.sequenceOptions.paletteSamples = std::max(1, intValue("--palette-samples"));
+    } else if (a == "--frame-delay") {
+      opts.sequenceOptions.frameDelayMs = std::max(0, intValue("--frame-delay"));
+    } else if (a == "--max-frames") {
+      opts.sequenceOptions.maxFrames = std::max(0, intValue("--max-frames"));
+    } else if (a == "--rgb") {
+      opts.trueColor = true;
+    } else if (a == "--encode-jobs") {
+      const int n = intValue("--encode-jobs");
+      opts.encodeJobs = n > 0 ? n : -1;
+    } else if (a == "--png-level") {
+      opts.save.pngCompression = std::max(0, std::min(intValue("--png-level"), 9));
+    } else if (a == "--png-strategy") {
+      const std::string name = value("--png-strategy");
+      if (!ParsePngStrategy(name, opts.save.pngStrategy)) {
+        std::fprintf(stderr, "Unknown PNG strategy: %s\n", name.c_str());
+        return 2;
+      }
+    } else if (a == "--jpeg-quality") {
+      opts.save.jpegQuality = std::max(0, std::min(intValue("--jpeg-quality"), 100));
+    } else if (a == "--params") {
+      std::string err;
+      if (!ParamsFile::Load(value("--params"), opts.params, err)) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+      }
+    } else if (a == "--save-params") {
+      saveParamsPath = value("--save-params");
+    } else if (a == "--block") {
+      opts.params.blockSize = intValue("--block");
+    } else if (a == "--palette-size") {
+      opts.params.paletteSize = intValue("--palette-size");
+    } else if (a == "--preset") {
+      const std::string name = value("--preset");
+      if (!ParamsFile::ParsePreset(name, opts.params.palettePreset)) {
+        std::fprintf(stderr, "Unknown preset: %s\n", name.c_str());
+        return 2;
+      }
+    } else if (a == "--seed") {
+      opts.params.kmeansSeed = static_cast<uint32_t>(intValue("--seed"));
+    } else if (a == "--palette-file") {
+      paletteFile = value("--palette-file");
+    } else if (a == "--palette-from") {
+      paletteFrom = value("--palette-from");
+    } else if (a == "--no-preblur") {
+      opts.params.preBlur = false;
+    } else if (a == "--edge") {
+      opts.params.edgeEnhance = true;
+    } else if (a == "--dither") {
+      opts.params.dither = true;
+    } else if (a == "--dither-method") {
+      const std::string name = value("--dither-method");
+      if (!ParamsFile::ParseDitherMethod(name, opts.params.ditherMethod)) {
+        std::fprintf(stderr, "Unknown dither method: %s\n", name.c_str());
+        return 2;
+      }
+      opts.params.dither = true;
+    } else if (a == "--serpentine") {
+      opts.params.dither = true;
+      opts.params.ditherSerpentine = true;
+    } else if (a == "--outline") {
+      opts.params.outline = true;
+      opts.params.outlineThickness = intValue("--outline");
+    } else if (a == "--native") {
+      opts.params.nativeOutput = true;
+    } else if (!a.empty() && a[0] == '-') {
+      std::fprintf(stderr, "Unknown option: %s\n", a.c_str());
+      PrintUsage(argv[0]);
+      return 2;
+    } else {
+      inputArgs.push_back(a);
+    }
+  }
+
+  if ((opts.outputDir.empty() && !verify) || (inputArgs.empty() && listFiles.empty())) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+
+  std::string err;
+  if (!paletteFile.empty()) {
+    int id = -1;
+    if (!PaletteRegistry::LoadFile(paletteFile, id, err)) {
+      std::fprintf(stderr, "%s\n", err.c_str());
+      return 1;
+    }
+    opts.params.palettePreset = PixelArtProcessor::PalettePreset::User;
+    opts.params.userPaletteId = id;
+  } else if (!paletteFrom.empty()) {
+    // Extract once from the reference image; every input then only pays for palette application.
+    cv::Mat reference;
+    if (!ImageLoader::LoadBGR(paletteFrom, reference, err)) {
+      std::fprintf(stderr, "%s\n", err.c_str());
+      return 1;
+    }
+    const PixelArtProcessor::Params p = PixelArtProcessor::Normalize(opts.params);
+    const std::shared_ptr<const Palette> palette =
+        PixelArtProcessor::ExtractPalette(PixelArtProcessor::BuildBlockColorImage(reference, p), p);
+    if (!palette) {
+      std::fprintf(stderr, "Could not extract a palette from %s\n", paletteFrom.c_str());
+      return 1;
+    }
+    const std::string name = "from " + std::filesystem::path(paletteFrom).stem().string();
+    opts.params.palettePreset = PixelArtProcessor::PalettePreset::User;
+    opts.params.userPaletteId = PaletteRegistry::Register(name, palette->Colors(), palette->PreferredMetric());
+  }
+  if (!saveParamsPath.empty()) {
+    if (!ParamsFile::Save(saveParamsPath, opts.params, err)) {
+      std::fprintf(stderr, "%s\n", err.c_str());
+      return 1;
+    }
+  }
+  for (const std::string& list : listFiles) {
+    if (!BatchRunner::ReadFileList(list, opts.inputs, err)) {
+      std::fprintf(stderr, "%s\n", err.c_str());
+      return 1;
+    }
+  }
+  for (const std::string& in : inputArgs) {
+    if (!BatchRunner::CollectInputs(in, recursive, opts.inputs, err, opts.sequence)) {
+      std::fprintf(stderr, "%s\n", err.c_str());
+      return 1;
+    }
+  }
+  if (opts.inputs.empty()) {
+    std::fprintf(stderr, "No input images found.\n");
+    return 1;
+  }
+
+  if (verify) return BatchRunner::Verify(opts, stdout) == 0 ? 0 : 1;
+
+  // Peak memory per image needs the counting allocator, installed before any worker starts.
+  if (!opts.tracePath.empty()) ProcessStats::EnableAllocationTracking();
+  const BatchRunner::Report report = BatchRunner::Run(opts);
+  BatchRunner::PrintReport(report, stdout);
+  return report.failed == 0 ? 0 : 1;
+}
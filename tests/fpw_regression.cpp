@@ -0,0 +1,115 @@
+// fpw_regression: ctest driver for RegressionCheck (what `fpw_batch --verify` runs on a folder).
+//
+// Runs every check on a small generated corpus, so it needs no image files:
+//   - images: synthetic (gradients, shapes and noise; deterministic), flat color, pure noise,
+//     at sizes that leave partial blocks at the right / bottom edge and one smaller than a block
+//   - block sizes: 1 / 3 / 7 / 8 / 13, pre-blur off and on, K-means and fixed-palette pipelines
+//   - every CpuKernels variant this CPU supports (see CpuDispatch)
+// Exit status 0 when every non-report-only check is exact (or within its tolerance), 1 otherwise;
+// failing checks are printed with image, params and variant.
+
+#include "CpuDispatch.h"
+#include "PixelArtProcessor.h"
+#include "RegressionCheck.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+using Params = PixelArtProcessor::Params;
+
+cv::Mat MakeSynthetic(const cv::Size& size, uint64_t seed) {
+  cv::Mat img(size, CV_8UC3);
+  for (int y = 0; y < size.height; ++y) {
+    cv::Vec3b* row = img.ptr<cv::Vec3b>(y);
+    for (int x = 0; x < size.width; ++x) {
+      row[x] = cv::Vec3b(static_cast<uchar>(255 * x / size.width), static_cast<uchar>(255 * y / size.height),
+                         static_cast<uchar>(255 * (x + y) / (size.width + size.height)));
+    }
+  }
+  cv::RNG rng(seed);
+  const int minSide = std::min(size.width, size.height);
+  for (int i = 0; i < 24; ++i) {
+    const cv::Point c(rng.uniform(0, size.width), rng.uniform(0, size.height));
+    const cv::Scalar color(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+    const int r = rng.uniform(minSide / 40 + 1, minSide / 6 + 2);
+    if (i % 2) {
+      cv::circle(img, c, r, color, cv::FILLED, cv::LINE_AA);
+    } else {
+      cv::rectangle(img, cv::Rect(c.x - r, c.y - r / 2, 2 * r, r), color, cv::FILLED);
+    }
+  }
+  cv::Mat noise(size, CV_16SC3);
+  rng.fill(noise, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(6));
+  cv::Mat noisy;
+  cv::add(img, noise, noisy, cv::noArray(), CV_8UC3); // saturating
+  return noisy;
+}
+
+cv::Mat MakeNoise(const cv::Size& size, uint64_t seed) {
+  cv::Mat img(size, CV_8UC3);
+  cv::RNG(seed).fill(img, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+  return img;
+}
+
+struct Image { std::string name; cv::Mat bgr; };
+
+std::vector<Image> Corpus() {
+  return {
+    {"synthetic 160x120", MakeSynthetic(cv::Size(160, 120), 1)},
+    {"synthetic 181x97", MakeSynthetic(cv::Size(181, 97), 2)}, // partial blocks for most sizes
+    {"noise 67x45", MakeNoise(cv::Size(67, 45), 3)},
+    {"flat 40x30", cv::Mat(cv::Size(40, 30), CV_8UC3, cv::Scalar(49, 128, 255))},
+    {"synthetic 11x5", MakeSynthetic(cv::Size(11, 5), 4)}, // smaller than a 13 px block
+  };
+}
+
+std::vector<Params> ParamSets() {
+  std::vector<Params> sets;
+  for (const int block : {1, 3, 7, 8, 13}) {
+    for (const bool blur : {false, true}) {
+      Params p;
+      p.blockSize = block;
+      p.preBlur = blur;
+      p.paletteSize = 8;
+      // The whole-pipeline check is exact only with a fixed palette and no pre-blur; it
+      // alternates so both kinds of pipeline run.
+      p.palettePreset = blur ? PixelArtProcessor::PalettePreset::Custom : PixelArtProcessor::PalettePreset::Pico8;
+      p.dither = block % 2 == 1;
+      p.outline = block >= 7;
+      sets.push_back(p);
+    }
+  }
+  return sets;
+}
+} // namespace
+
+int main() {
+  const std::vector<Image> corpus = Corpus();
+  const std::vector<Params> sets = ParamSets();
+  int checks = 0;
+  int failures = 0;
+  for (int v = 0; v < CpuDispatch::kIsaCount; ++v) {
+    const auto isa = static_cast<CpuDispatch::Isa>(v);
+    if (!CpuDispatch::Select(isa)) continue;
+    for (const Image& image : corpus) {
+      for (const Params& p : sets) {
+        for (const RegressionCheck::Result& r : RegressionCheck::Run(image.bgr, p)) {
+          ++checks;
+          if (r.Passed()) continue;
+          ++failures;
+          std::printf("FAIL  %-7s %-18s block %-2d blur %d  %-26s %s\n", CpuDispatch::IsaName(isa),
+                      image.name.c_str(), p.blockSize, p.preBlur ? 1 : 0, r.check.c_str(),
+                      r.sameSize ? ("max delta " + std::to_string(r.maxDelta)).c_str() : "size / type mismatch");
+        }
+      }
+    }
+    std::printf("%s: done\n", CpuDispatch::IsaName(isa));
+  }
+  std::printf("%d check(s), %d failed\n", checks, failures);
+  return failures == 0 ? 0 : 1;
+}